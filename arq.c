@@ -0,0 +1,289 @@
+/**
+ * Embeddable ARQ library: parts shared by every policy
+ *
+ * CMPT 434 - A2
+ * Steven Rau
+ * scr108
+ * 11115094
+ */
+
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#include "arq.h"
+#include "stats.h"
+#include "log.h"
+#include "trace.h"
+
+/*-----------------------------------------------------------------------------
+ * Helper functions
+ * --------------------------------------------------------------------------*/
+
+long arq_now_usec(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec * 1000000L + now.tv_nsec / 1000L;
+}
+
+long arq_sender_now(const struct arq_sender *s)
+{
+    return s->ops.now_usec != NULL ? s->ops.now_usec(s->ops.ctx) : arq_now_usec();
+}
+
+/*-----------------------------------------------------------------------------
+ * Sender
+ * --------------------------------------------------------------------------*/
+
+void arq_sender_init(struct arq_sender *s, struct msg_pool *pool, struct arq_slot *window,
+                     uint32_t window_size, long timeout_usec, const struct arq_sender_ops *ops)
+{
+    memset(s, 0, sizeof(*s));
+
+    s->pool = pool;
+    s->window = window;
+    s->window_size = window_size;
+    s->timeout_usec = timeout_usec;
+    s->last_ack = UINT32_MAX;
+    s->srtt_usec = -1;
+    s->ops = *ops;
+}
+
+void arq_sender_resume(struct arq_sender *s, uint32_t next)
+{
+    /* With nothing acked yet, next - 1 is UINT32_MAX like a new sender's */
+    s->last_ack = next - 1;
+    s->ack_frontier = next;
+    s->next_seq = next;
+}
+
+struct message *arq_sender_next_msg(struct arq_sender *s)
+{
+    struct arq_slot *slot;
+
+    if (arq_sender_window_full(s))
+    {
+        return NULL;
+    }
+
+    /* The slot keeps its message if next_msg is called again before it was sent */
+    slot = arq_sender_slot(s, s->num_queued);
+    if (slot->msg == NULL && (slot->msg = msg_pool_get(s->pool)) == NULL)
+    {
+        LOG_ERR("ARQ sender: message pool is smaller than the window\n");
+
+        return NULL;
+    }
+
+    slot->acked = false;
+    msg_init(slot->msg, s->next_seq);
+    slot->msg->stream = s->stream;
+
+    return slot->msg;
+}
+
+/**
+ * Sends a message as several smaller ones, split between its records, each one fitting in the
+ * datagrams now allowed. Every piece carries the timestamp the whole message would have
+ */
+static bool transmit_pieces(struct arq_sender *s, const struct message *msg, uint32_t sec, uint32_t usec)
+{
+    struct message whole;
+    struct message piece;
+    size_t offset = 0;
+    const char *line;
+    size_t line_len;
+
+    /* A compressed message is split by its records, so expand a copy of it first */
+    memcpy(&whole, msg, msg_wire_len(msg));
+    if (!msg_decompress(&whole))
+    {
+        return false;
+    }
+
+    msg_init(&piece, msg_seq(&whole));
+    piece.stream = whole.stream;
+
+    while (msg_next_record(&whole, &offset, &line, &line_len))
+    {
+        if (!msg_add_record(&piece, line, line_len))
+        {
+            msg_seal(&piece, sec, usec);
+            if (!s->ops.send(s->ops.ctx, &piece, msg_wire_len(&piece)))
+            {
+                return false;
+            }
+            STATS_INC(STAT_MSGS_SENT);
+
+            msg_init(&piece, msg_last_seq(&piece) + 1);
+            piece.stream = whole.stream;
+            msg_add_record(&piece, line, line_len);
+        }
+    }
+
+    msg_seal(&piece, sec, usec);
+    if (!s->ops.send(s->ops.ctx, &piece, msg_wire_len(&piece)))
+    {
+        return false;
+    }
+    STATS_INC(STAT_MSGS_SENT);
+
+    return true;
+}
+
+bool arq_transmit(struct arq_sender *s, struct arq_slot *slot)
+{
+    struct message *msg = slot->msg;
+    long now = arq_sender_now(s);
+
+    slot->sent_usec = now;
+
+    /* Built before the largest datagram allowed shrank (the path MTU dropped), so it would no
+     * longer get through whole */
+    if (msg_wire_len(msg) > MSG_HEADER_SIZE + msg_payload_limit && msg_count(msg) > 1)
+    {
+        __atomic_fetch_or(&slot->tag, ARQ_TAG_PIECES, __ATOMIC_RELAXED);
+
+        LOG_DBG("\nSending seq #%u in pieces (%u bytes is too big now)\n", msg_seq(msg),
+                (unsigned)msg_wire_len(msg));
+
+        return transmit_pieces(s, msg, (uint32_t)(now / 1000000L), (uint32_t)(now % 1000000L));
+    }
+
+    /* Stamp every transmission (including retransmissions) so the echoed ack gives an RTT sample,
+     * and checksum the message as it goes out on the wire so the receiver can detect damage */
+    msg_seal(msg, (uint32_t)(now / 1000000L), (uint32_t)(now % 1000000L));
+
+    /* Only the part of the message in use goes on the wire */
+    if (!s->ops.send(s->ops.ctx, msg, msg_wire_len(msg)))
+    {
+        return false;
+    }
+
+    STATS_INC(STAT_MSGS_SENT);
+
+    return true;
+}
+
+void arq_rtt_sample(struct arq_sender *s, const struct ack *reply)
+{
+    long now = arq_sender_now(s);
+    long srtt = s->srtt_usec;
+    long rttvar = s->rttvar_usec;
+    long sample;
+    long err;
+
+    sample = (long)((uint32_t)(now / 1000000L) - ntohl(reply->ts_sec)) * 1000000L
+             + ((long)(now % 1000000L) - (long)ntohl(reply->ts_usec));
+
+    /* Ignore obviously bogus samples (e.g. an ack with no timestamp) */
+    if (sample < 0)
+    {
+        return;
+    }
+
+    /* RFC 6298 style smoothing */
+    if (srtt < 0)
+    {
+        srtt = sample;
+        rttvar = sample / 2;
+    }
+    else
+    {
+        err = sample - srtt;
+
+        srtt += err / 8;
+        rttvar += ((err < 0 ? -err : err) - rttvar) / 4;
+    }
+
+    /* Only the thread handling acks takes samples, but with an ack thread the sending thread may
+     * read the estimate (arq_sender_rto_usec()) at the same time */
+    __atomic_store_n(&s->rttvar_usec, rttvar, __ATOMIC_RELAXED);
+    __atomic_store_n(&s->srtt_usec, srtt, __ATOMIC_RELEASE);
+
+    LOG_DBG("RTT sample: %.3f ms  (smoothed: %.3f ms, suggested timeout: %.3f ms)\n",
+            sample / 1000.0, srtt / 1000.0, (srtt + 4 * rttvar) / 1000.0);
+}
+
+/*-----------------------------------------------------------------------------
+ * Receiver
+ * --------------------------------------------------------------------------*/
+
+void arq_receiver_init(struct arq_receiver *r, struct msg_pool *pool, struct message **buffer,
+                       uint32_t buffer_size, const struct arq_receiver_ops *ops)
+{
+    memset(r, 0, sizeof(*r));
+
+    r->pool = pool;
+    r->last_succ_seq = UINT32_MAX;
+    r->buffer = buffer;
+    r->buffer_size = buffer_size;
+    r->buffer_room = buffer_size;
+    r->ops = *ops;
+}
+
+void arq_receiver_resume(struct arq_receiver *r, uint32_t next)
+{
+    r->last_succ_seq = next - 1;
+
+    while (r->num_buffed > 0)
+    {
+        msg_pool_put(r->pool, r->buffer[--r->num_buffed]);
+    }
+}
+
+void arq_receiver_set_window(struct arq_receiver *r, uint32_t window)
+{
+    r->buffer_size = window > 0 && window - 1 < r->buffer_room ? window - 1 : r->buffer_room;
+}
+
+bool arq_send_ack(struct arq_receiver *r, uint32_t cum_ack, uint8_t flags, const struct message *msg)
+{
+    struct ack reply;
+
+    memset(&reply, 0, sizeof(reply));
+    reply.version = ACK_VERSION;
+    reply.flags = flags;
+    reply.stream = msg->stream;
+    reply.cum_ack = htonl(cum_ack);
+    reply.sel_ack = htonl((flags & ACK_FLAG_SELECTIVE) ? msg_last_seq(msg) : 0);
+    reply.ts_sec = msg->ts_sec;
+    reply.ts_usec = msg->ts_usec;
+
+    if (!r->ops.send_ack(r->ops.ctx, &reply))
+    {
+        TRACE(TRACE_DISCARD, r->stream, TRACE_DROP_ACK, cum_ack, ntohl(reply.sel_ack), r->num_buffed, 0,
+              ntohl(reply.ts_sec) * 1000000u + ntohl(reply.ts_usec));
+
+        return false;
+    }
+
+    STATS_INC(STAT_ACKS_SENT);
+    TRACE(TRACE_ACK_SENT, r->stream, flags, cum_ack, ntohl(reply.sel_ack), r->num_buffed, sizeof(reply),
+          ntohl(reply.ts_sec) * 1000000u + ntohl(reply.ts_usec));
+
+    return true;
+}
+
+void arq_deliver(struct arq_receiver *r, const struct message *msg)
+{
+    const char *line;
+    size_t line_len;
+    size_t offset = 0;
+    uint32_t seq = msg_seq(msg);
+
+    if (r->ops.deliver == NULL)
+    {
+        return;
+    }
+
+    while (msg_next_record(msg, &offset, &line, &line_len))
+    {
+        r->ops.deliver(r->ops.ctx, seq, line, line_len);
+
+        seq++;
+    }
+}
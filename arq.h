@@ -0,0 +1,317 @@
+/**
+ * Embeddable ARQ (automatic repeat request) library
+ *
+ * The sliding window sender and the receiver from the assignment, pulled
+ * out of the command line programs so they can be linked into other code.
+ * The library never allocates: the caller supplies a message pool (pool.h)
+ * along with the window and buffer storage, and all I/O goes through
+ * callbacks, so it can be driven by any socket (or anything else that moves
+ * datagrams). Messages move between the pool and the window/buffer by
+ * pointer, so nothing bigger than a pointer is shifted as acks come in.
+ *
+ * The receive policy is picked at compile time. Every policy specific
+ * function exists twice, once per policy, generated from arq_engine.h:
+ *
+ *     arq_gbn_*   Go-Back-N (Q1): out of order messages are dropped, and the
+ *                 sender re-sends the next unacked message
+ *     arq_sr_*    Selective Repeat (Q2): out of order messages are buffered and
+ *                 acked one by one, and the sender keeps a timer per message and
+ *                 re-sends only the messages that time out
+ *
+ * so the per-packet path never branches on the mode.
+ *
+ * Typical sender use:
+ *
+ *     msg = arq_sender_next_msg(&s);     // NULL while the window is full
+ *     msg_add_record(msg, line, len);    // any number of records that fit
+ *     arq_gbn_sender_send(&s);           // queue in the window and transmit
+ *     ...
+ *     arq_gbn_sender_on_ack(&s, buf, n); // for every datagram from the receiver
+ *     arq_gbn_sender_retransmit(&s);     // once arq_gbn_sender_retransmit_due(&s)
+ *     arq_gbn_sender_wait_usec(&s);      // how long to wait for the next ack
+ *
+ * The acks can also be read on a thread of their own, leaving the sending
+ * thread free to keep the link busy. The ack thread calls
+ * arq_gbn_sender_note_ack() for every datagram from the receiver, which only
+ * moves the sender's ack frontier and marks selectively acked slots, both
+ * through atomics. The sending thread calls arq_gbn_sender_reclaim() to take
+ * the acked messages out of the window, and keeps calling everything else
+ * (next_msg, send, retransmit, wait_usec) as before. There are no locks:
+ * the window itself, the pool and the timers only ever belong to the sending
+ * thread. sender_on_ack() is the two together, for a single thread.
+ *
+ * Typical receiver use:
+ *
+ *     arq_sr_receive(&r, msg, n);        // for every datagram from the sender
+ *
+ * A sender and receiver pair carries one stream of messages. Several streams
+ * can share a socket by giving each pair its own stream number and handing
+ * each datagram to the pair arq_msg_stream()/arq_ack_stream() name. Every
+ * stream has its own sequence numbers, window and reorder buffer, so a loss
+ * on one stream only holds up delivery on that stream.
+ *
+ * CMPT 434 - A2
+ * Steven Rau
+ * scr108
+ * 11115094
+ */
+
+#ifndef ARQ_H
+#define ARQ_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "shared.h"
+#include "message.h"
+#include "pool.h"
+
+/*-----------------------------------------------------------------------------
+ * Sender
+ * --------------------------------------------------------------------------*/
+
+struct arq_sender_ops
+{
+    /* Sends one datagram to the receiver. Returns false if it couldn't be sent */
+    bool (*send)(void *ctx, const void *buf, size_t len);
+
+    /* Current time in microseconds (NULL uses the monotonic clock). Lets the sender run in
+     * virtual time, e.g. in the simulator */
+    long (*now_usec)(void *ctx);
+
+    void *ctx;
+};
+
+/* One message in the sender's window */
+struct arq_slot
+{
+    struct message *msg;
+    long sent_usec;           /* When msg was last (re)transmitted (monotonic) */
+    bool acked;               /* Selectively acked, but not yet cumulatively (Selective Repeat) */
+    uint64_t tag;             /* Shared with the ack thread: (msg's last seq + 1) << 1 while queued,
+                               * with bit 0 set once it is selectively acked (0 while free), and
+                               * ARQ_TAG_PIECES once it is sent in pieces */
+};
+
+/* Set in a slot's tag once its message is too big for the datagrams now allowed (see
+ * msg_set_max_datagram()) and goes out split between its records instead. A selective ack then
+ * only covers a piece, so none can match the tag */
+#define ARQ_TAG_PIECES  (1ULL << 63)
+/* Acks in a row that don't move the window on before the oldest unacked message is re-sent
+ * without waiting for its timer (as in TCP: fewer could just be reordering) */
+#define ARQ_DUP_ACK_THRESHOLD  3
+
+struct arq_sender
+{
+    struct arq_slot *window;  /* Ring of the queued messages, oldest at head (caller supplied) */
+    uint32_t window_size;
+    uint32_t head;
+    uint32_t num_queued;      /* Messages in the window (yet to receive ack for) */
+    struct msg_pool *pool;    /* Where the window's messages come from */
+    uint32_t last_ack;        /* Last sequence number acked, UINT32_MAX before the first ack */
+    uint32_t ack_frontier;    /* Shared with the sending thread: last_ack + 1, the first sequence
+                               * number not cumulatively acked */
+    uint32_t next_seq;        /* Sequence number the next record will get */
+    long timeout_usec;        /* How long to wait for a message's ack before re-sending it */
+    long srtt_usec;           /* Shared with the sending thread: smoothed RTT from the echoed ack timestamps,
+                               * -1 before the first sample */
+    long rttvar_usec;         /* Shared with the sending thread */
+    uint32_t dup_acks;        /* Acks in a row that didn't move the window on */
+    bool fast_retransmit;     /* Enough duplicate acks came in to re-send the oldest unacked message */
+    uint8_t stream;           /* Stream this sender's messages go out on (0 unless set after init) */
+    struct arq_sender_ops ops;
+};
+
+/**
+ * Sets up a sender
+ *
+ * @param[in] s            The sender
+ * @param[in] pool         Pool of at least window_size messages
+ * @param[in] window       Storage for window_size slots, all zeroed
+ * @param[in] window_size  Number of messages window can hold
+ * @param[in] timeout_usec How long to wait for an ack before re-sending
+ * @param[in] ops          How to send datagrams
+ */
+void arq_sender_init(struct arq_sender *s, struct msg_pool *pool, struct arq_slot *window,
+                     uint32_t window_size, long timeout_usec, const struct arq_sender_ops *ops);
+
+/**
+ * Picks a fresh sender up where an earlier run left off (e.g. from a journal), before anything
+ * is sent: next is the first sequence number the receiver hadn't acked
+ */
+void arq_sender_resume(struct arq_sender *s, uint32_t next);
+
+/**
+ * Gets the next free window slot, set up with the next sequence number, for the
+ * caller to fill with records (and optionally compress) before sending it
+ *
+ * Returns NULL if the window is full
+ */
+struct message *arq_sender_next_msg(struct arq_sender *s);
+
+/* The i-th oldest slot in the window */
+static inline struct arq_slot *arq_sender_slot(const struct arq_sender *s, uint32_t i)
+{
+    return &s->window[(s->head + i) % s->window_size];
+}
+
+/* The i-th oldest message in the window */
+static inline struct message *arq_sender_msg(const struct arq_sender *s, uint32_t i)
+{
+    return arq_sender_slot(s, i)->msg;
+}
+
+static inline bool arq_sender_window_full(const struct arq_sender *s)
+{
+    return s->num_queued >= s->window_size;
+}
+
+/* True once everything sent has been acked */
+static inline bool arq_sender_idle(const struct arq_sender *s)
+{
+    return s->num_queued == 0;
+}
+
+/* First sequence number the receiver hasn't cumulatively acked. Safe from any thread */
+static inline uint32_t arq_sender_ack_frontier(const struct arq_sender *s)
+{
+    return __atomic_load_n(&s->ack_frontier, __ATOMIC_ACQUIRE);
+}
+
+/* RTO suggested by the RTT estimate (microseconds), or -1 without any samples. Safe to call while
+ * an ack thread is taking samples */
+static inline long arq_sender_rto_usec(const struct arq_sender *s)
+{
+    long srtt = __atomic_load_n(&s->srtt_usec, __ATOMIC_ACQUIRE);
+
+    return srtt < 0 ? -1 : srtt + 4 * __atomic_load_n(&s->rttvar_usec, __ATOMIC_RELAXED);
+}
+
+/*-----------------------------------------------------------------------------
+ * Receiver
+ * --------------------------------------------------------------------------*/
+
+struct arq_receiver_ops
+{
+    /* Decides whether a message counts as correctly received (NULL accepts everything).
+     * in_order is false for messages that arrive ahead of the next expected one */
+    bool (*accept)(void *ctx, const struct message *msg, bool in_order);
+
+    /* Hands one line to the application. Lines are always delivered in sequence order */
+    void (*deliver)(void *ctx, uint32_t seq, const char *line, size_t len);
+
+    /* Sends an ack (already in wire format) back to the sender. Returns false if it wasn't sent */
+    bool (*send_ack)(void *ctx, const struct ack *ack);
+
+    void *ctx;
+};
+
+struct arq_receiver
+{
+    uint32_t last_succ_seq;   /* Last in-order sequence number received, UINT32_MAX before the first */
+    struct message **buffer;  /* Out of order messages in sequence order (Selective Repeat only) */
+    uint32_t buffer_size;     /* Most messages held, at most buffer_room */
+    uint32_t buffer_room;     /* Pointers buffer has room for */
+    uint32_t num_buffed;
+    struct msg_pool *pool;    /* Where buffered messages are copied to */
+    uint8_t stream;           /* Stream this receiver handles (0 unless set after init) */
+    struct arq_receiver_ops ops;
+};
+
+/**
+ * Sets up a receiver
+ *
+ * @param[in] r            The receiver
+ * @param[in] pool         Pool of at least buffer_size messages (NULL for Go-Back-N)
+ * @param[in] buffer       Storage for buffer_size message pointers (NULL for Go-Back-N)
+ * @param[in] buffer_size  Number of messages buffer can hold
+ * @param[in] ops          Delivery and ack callbacks
+ */
+void arq_receiver_init(struct arq_receiver *r, struct msg_pool *pool, struct message **buffer,
+                       uint32_t buffer_size, const struct arq_receiver_ops *ops);
+
+/**
+ * Picks a receiver up where the session is to carry on (e.g. where an earlier run left off): next
+ * is the first sequence number still to be delivered. Anything buffered out of order is let go
+ */
+void arq_receiver_resume(struct arq_receiver *r, uint32_t next);
+
+/**
+ * Fits a receiver to the window agreed with the sender: no more than a window less one messages
+ * can arrive ahead of a gap, so no more are buffered (never more than it was set up with). Messages
+ * already buffered are kept
+ */
+void arq_receiver_set_window(struct arq_receiver *r, uint32_t window);
+
+/*-----------------------------------------------------------------------------
+ * Streams
+ * --------------------------------------------------------------------------*/
+
+/* Stream a datagram from the sender is on, or -1 if it is too short to be a message. It is
+ * only a hint until the receiver has checked the message's CRC */
+static inline int arq_msg_stream(const void *buf, int len)
+{
+    return len < MSG_HEADER_SIZE ? -1 : ((const struct message *)buf)->stream;
+}
+
+/* Stream a datagram from the receiver acks, or -1 if it isn't an ack */
+static inline int arq_ack_stream(const void *buf, int len)
+{
+    if (len < (int)sizeof(struct ack) || ((const struct ack *)buf)->version != ACK_VERSION)
+    {
+        return -1;
+    }
+
+    return ((const struct ack *)buf)->stream;
+}
+
+/*-----------------------------------------------------------------------------
+ * Policy specific functions (see arq_engine.h)
+ * --------------------------------------------------------------------------*/
+
+#define ARQ_DECLARE_POLICY(prefix)                                                      \
+    /* Queues the message from arq_sender_next_msg() in the window and transmits it */  \
+    bool prefix##_sender_send(struct arq_sender *s);                                    \
+    /* Handles a datagram from the receiver. Returns true if it was a valid ack */      \
+    bool prefix##_sender_on_ack(struct arq_sender *s, const void *buf, int len);        \
+    /* on_ack for the ack thread: records the ack for sender_reclaim() to act on */     \
+    bool prefix##_sender_note_ack(struct arq_sender *s, const void *buf, int len);      \
+    /* Sending thread: takes what note_ack() saw acked out of the window */             \
+    void prefix##_sender_reclaim(struct arq_sender *s);                                 \
+    /* Re-sends what timed out, or the oldest unacked message after duplicate acks */   \
+    void prefix##_sender_retransmit(struct arq_sender *s);                              \
+    /* How long (microseconds) until the first message's timer runs out */             \
+    long prefix##_sender_wait_usec(struct arq_sender *s);                               \
+    /* True if a timer ran out, or duplicate acks call for re-sending */                \
+    bool prefix##_sender_retransmit_due(struct arq_sender *s);                          \
+    /* Handles a datagram from the sender */                                            \
+    void prefix##_receive(struct arq_receiver *r, struct message *msg, int len);
+
+ARQ_DECLARE_POLICY(arq_gbn)
+ARQ_DECLARE_POLICY(arq_sr)
+
+/*-----------------------------------------------------------------------------
+ * Shared internals used by the policy engines
+ * --------------------------------------------------------------------------*/
+
+/* Current time from the monotonic clock in microseconds */
+long arq_now_usec(void);
+
+/* Current time by the sender's clock in microseconds */
+long arq_sender_now(const struct arq_sender *s);
+
+/* Stamps, seals and sends one message from the window, restarting its timer */
+bool arq_transmit(struct arq_sender *s, struct arq_slot *slot);
+
+/* Takes an RTT sample from the timestamp echoed in an ack */
+void arq_rtt_sample(struct arq_sender *s, const struct ack *reply);
+
+/* Builds and sends an ack for the given sequence number, echoing msg's timestamp.
+ * With ACK_FLAG_SELECTIVE the ack also names msg itself as received */
+bool arq_send_ack(struct arq_receiver *r, uint32_t cum_ack, uint8_t flags, const struct message *msg);
+
+/* Delivers every record of a message to the application */
+void arq_deliver(struct arq_receiver *r, const struct message *msg);
+
+#endif /* ARQ_H */
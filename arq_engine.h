@@ -0,0 +1,654 @@
+/**
+ * ARQ policy engine "template"
+ *
+ * Not a normal header: it is included once per policy by arq_gbn.c and
+ * arq_sr.c, which define before including it:
+ *
+ *     ARQ_FN(name)    Names a policy function (e.g. arq_gbn_##name)
+ *     ARQ_SELECTIVE   1 for Selective Repeat (out of order messages are buffered
+ *                     and acked individually, every message has its own timer),
+ *                     0 for Go-Back-N (out of order messages are dropped)
+ *
+ * so each policy gets its own copy of the per-packet code with the policy
+ * decisions resolved by the preprocessor.
+ *
+ * CMPT 434 - A2
+ * Steven Rau
+ * scr108
+ * 11115094
+ */
+
+#if !defined(ARQ_FN) || !defined(ARQ_SELECTIVE)
+#error "Define ARQ_FN and ARQ_SELECTIVE before including arq_engine.h"
+#endif
+
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "arq.h"
+#include "stats.h"
+#include "log.h"
+#include "trace.h"
+
+/*-----------------------------------------------------------------------------
+ * Sender
+ * --------------------------------------------------------------------------*/
+
+/**
+ * Logs a summary of the sliding window
+ */
+static void ARQ_FN(log_window)(struct arq_sender *s)
+{
+    stats_set(STAT_WINDOW_OCCUPANCY, s->num_queued);
+
+    if (s->num_queued > 0)
+    {
+        LOG_DBG("Window: %u queued (seq %u - %u)\n\n", s->num_queued, msg_seq(arq_sender_msg(s, 0)),
+                msg_last_seq(arq_sender_msg(s, s->num_queued-1)));
+    }
+    else
+    {
+        LOG_DBG("Window: empty\n\n");
+    }
+}
+
+/**
+ * Traces a message that just went out, along with the timestamp it carries
+ */
+static void ARQ_FN(trace_sent)(struct arq_sender *s, uint8_t event, uint8_t flags, const struct arq_slot *slot)
+{
+    TRACE(event, s->stream, flags, msg_seq(slot->msg), msg_last_seq(slot->msg), s->num_queued,
+          msg_wire_len(slot->msg), (uint32_t)slot->sent_usec);
+}
+
+bool ARQ_FN(sender_send)(struct arq_sender *s)
+{
+    struct arq_slot *slot;
+    bool sent;
+
+    if (arq_sender_window_full(s))
+    {
+        return false;
+    }
+
+    slot = arq_sender_slot(s, s->num_queued);
+
+    /* Every record gets a sequence number of its own */
+    s->next_seq += msg_count(slot->msg);
+    s->num_queued++;
+
+    /* Lets the ack thread find the slot by sequence number */
+    __atomic_store_n(&slot->tag, ((uint64_t)msg_last_seq(slot->msg) + 1) << 1, __ATOMIC_RELAXED);
+
+    sent = arq_transmit(s, slot);
+
+    ARQ_FN(trace_sent)(s, TRACE_SEND, 0, slot);
+
+    return sent;
+}
+
+/**
+ * Records the ack received: moves the ack frontier, and under Selective Repeat marks the message
+ * the receiver buffered. Only touches what the sender shares through atomics, so it can run on an
+ * ack thread while another thread sends
+ *
+ * Acks land on message boundaries (a message is received as a whole), unless it was sent in
+ * pieces. Either way a message leaves the window (in sender_reclaim()) once the ack covers its
+ * last record
+ */
+bool ARQ_FN(sender_note_ack)(struct arq_sender *s, const void *buf, int len)
+{
+    struct ack reply;
+    uint32_t seq_recvd;
+#if ARQ_SELECTIVE
+    uint64_t tag;
+    uint64_t expected;
+    uint32_t i;
+#endif
+
+    /* Drop anything that isn't a full ack of a version we understand */
+    if (len < (int)sizeof(reply) || ((const struct ack *)buf)->version != ACK_VERSION)
+    {
+        LOG_WRN("Malformed ack received (%i bytes)\n", len);
+
+        return false;
+    }
+
+    memcpy(&reply, buf, sizeof(reply));
+    seq_recvd = ntohl(reply.cum_ack);
+
+    /* Sequence numbers are per stream, so another stream's ack means nothing here */
+    if (reply.stream != s->stream)
+    {
+        LOG_WRN("Ack for stream %u received by stream %u\n", reply.stream, s->stream);
+
+        return false;
+    }
+
+    STATS_INC(STAT_ACKS_RECEIVED);
+    LOG_DBG("Ack received: %u\n", seq_recvd);
+    TRACE(TRACE_ACK, reply.stream, reply.flags, seq_recvd, ntohl(reply.sel_ack), 0, len,
+          ntohl(reply.ts_sec) * 1000000u + ntohl(reply.ts_usec));
+
+    arq_rtt_sample(s, &reply);
+
+    /* Update the last ack (an ack sent before anything arrived in order doesn't cover anything),
+     * and publish it to the sending thread */
+    if (seq_recvd != UINT32_MAX && (seq_recvd > s->last_ack || s->last_ack == UINT32_MAX))
+    {
+        s->last_ack = seq_recvd;
+
+        __atomic_store_n(&s->ack_frontier, seq_recvd + 1, __ATOMIC_RELEASE);
+    }
+
+#if ARQ_SELECTIVE
+    /* Mark the message the receiver buffered so it isn't re-sent. Where the window starts belongs
+     * to the sending thread, so look through every slot: the compare-and-swap only marks a slot
+     * still holding that message */
+    if (reply.flags & ACK_FLAG_SELECTIVE)
+    {
+        tag = ((uint64_t)ntohl(reply.sel_ack) + 1) << 1;
+
+        for (i = 0; i < s->window_size; i++)
+        {
+            expected = tag;
+
+            if (__atomic_compare_exchange_n(&s->window[i].tag, &expected, tag | 1, false,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            {
+                break;
+            }
+        }
+    }
+#endif
+
+    return true;
+}
+
+void ARQ_FN(sender_reclaim)(struct arq_sender *s)
+{
+    uint32_t frontier = arq_sender_ack_frontier(s);
+    struct arq_slot *oldest;
+    uint32_t freed = 0;
+#if ARQ_SELECTIVE
+    struct arq_slot *slot;
+    uint32_t i;
+#endif
+
+    /* Remove all messages from the window below the frontier since they must have already been
+     * received successfully, and give them back to the pool */
+    while (s->num_queued > 0)
+    {
+        oldest = arq_sender_slot(s, 0);
+
+        if (msg_last_seq(oldest->msg) >= frontier)
+        {
+            break;
+        }
+
+        __atomic_store_n(&oldest->tag, 0, __ATOMIC_RELAXED);
+        msg_pool_put(s->pool, oldest->msg);
+
+        oldest->msg = NULL;
+        s->head = (s->head + 1) % s->window_size;
+        s->num_queued--;
+        freed++;
+    }
+
+    if (freed > 0)
+    {
+        TRACE(TRACE_RECLAIM, s->stream, 0, frontier, 0, s->num_queued, 0, freed);
+    }
+
+#if ARQ_SELECTIVE
+    /* Pick up the selective acks, for the timers */
+    for (i = 0; i < s->num_queued; i++)
+    {
+        slot = arq_sender_slot(s, i);
+
+        if (!slot->acked && (__atomic_load_n(&slot->tag, __ATOMIC_RELAXED) & 1))
+        {
+            slot->acked = true;
+        }
+    }
+#endif
+
+    ARQ_FN(log_window)(s);
+}
+
+/**
+ * Updates the sliding window state according to the ack received
+ */
+bool ARQ_FN(sender_on_ack)(struct arq_sender *s, const void *buf, int len)
+{
+    uint32_t frontier = arq_sender_ack_frontier(s);
+
+    if (!ARQ_FN(sender_note_ack)(s, buf, len))
+    {
+        return false;
+    }
+
+    /* Acks that don't move the frontier while messages are out mean messages sent after the
+     * oldest one got there without it. A few in a row count as it being lost */
+    if (arq_sender_ack_frontier(s) != frontier)
+    {
+        s->dup_acks = 0;
+    }
+    else if (!arq_sender_idle(s) && ++s->dup_acks == ARQ_DUP_ACK_THRESHOLD)
+    {
+        s->fast_retransmit = true;
+    }
+
+    ARQ_FN(sender_reclaim)(s);
+
+    return true;
+}
+
+#if ARQ_SELECTIVE
+
+void ARQ_FN(sender_retransmit)(struct arq_sender *s)
+{
+    uint32_t i;
+    struct arq_slot *slot;
+    long now = arq_sender_now(s);
+    bool fast = s->fast_retransmit;
+    bool timer;
+
+    s->fast_retransmit = false;
+
+    /* Every message has its own timer: re-send just the unacked messages whose timer ran out.
+     * After duplicate acks, the oldest unacked message goes too */
+    for (i = 0; i < s->num_queued; i++)
+    {
+        slot = arq_sender_slot(s, i);
+
+        if (slot->acked)
+        {
+            continue;
+        }
+
+        timer = now - slot->sent_usec >= s->timeout_usec;
+
+        if (timer || fast)
+        {
+            STATS_INC(STAT_RETRANSMISSIONS);
+
+            arq_transmit(s, slot);
+
+            ARQ_FN(trace_sent)(s, TRACE_RETRANSMIT, timer ? TRACE_FLAG_TIMER : 0, slot);
+        }
+
+        fast = false;
+    }
+}
+
+long ARQ_FN(sender_wait_usec)(struct arq_sender *s)
+{
+    uint32_t i;
+    struct arq_slot *slot;
+    long now = arq_sender_now(s);
+    long wait = s->timeout_usec;
+    long left;
+
+    /* Wait until the first timer runs out */
+    for (i = 0; i < s->num_queued; i++)
+    {
+        slot = arq_sender_slot(s, i);
+
+        if (!slot->acked)
+        {
+            left = slot->sent_usec + s->timeout_usec - now;
+
+            if (left < wait)
+            {
+                wait = left < 0 ? 0 : left;
+            }
+        }
+    }
+
+    return wait;
+}
+
+#else
+
+/**
+ * Finds the message in the window holding the sequence # one greater than the last successfully
+ * acked sequence number. That is usually its first record, but a message sent in pieces can be
+ * acked part way through
+ *
+ * Returns NULL if it isn't in the window
+ */
+static struct arq_slot *ARQ_FN(frontier_slot)(struct arq_sender *s)
+{
+    uint32_t i;
+    struct arq_slot *slot;
+    uint32_t frontier = arq_sender_ack_frontier(s);
+
+    for (i = 0; i < s->num_queued; i++)
+    {
+        slot = arq_sender_slot(s, i);
+
+        if (msg_seq(slot->msg) <= frontier && frontier <= msg_last_seq(slot->msg))
+        {
+            return slot;
+        }
+    }
+
+    return NULL;
+}
+
+void ARQ_FN(sender_retransmit)(struct arq_sender *s)
+{
+    struct arq_slot *slot = ARQ_FN(frontier_slot)(s);
+    uint8_t flags;
+
+    s->fast_retransmit = false;
+
+    /* Send the next unacked message again */
+    if (slot != NULL)
+    {
+        STATS_INC(STAT_RETRANSMISSIONS);
+
+        /* Without its timer having run out, duplicate acks sent the sender back to it */
+        flags = arq_sender_now(s) - slot->sent_usec >= s->timeout_usec ? TRACE_FLAG_TIMER : 0;
+
+        arq_transmit(s, slot);
+
+        ARQ_FN(trace_sent)(s, TRACE_RETRANSMIT, flags, slot);
+    }
+}
+
+long ARQ_FN(sender_wait_usec)(struct arq_sender *s)
+{
+    struct arq_slot *slot = ARQ_FN(frontier_slot)(s);
+    long left;
+
+    /* The only message ever re-sent is the next unacked one, so its timer is the one that counts */
+    if (slot == NULL)
+    {
+        return s->timeout_usec;
+    }
+
+    left = slot->sent_usec + s->timeout_usec - arq_sender_now(s);
+
+    return left < 0 ? 0 : left;
+}
+
+#endif /* ARQ_SELECTIVE */
+
+bool ARQ_FN(sender_retransmit_due)(struct arq_sender *s)
+{
+    return !arq_sender_idle(s) && (s->fast_retransmit || ARQ_FN(sender_wait_usec)(s) == 0);
+}
+
+/*-----------------------------------------------------------------------------
+ * Receiver
+ * --------------------------------------------------------------------------*/
+
+#if ARQ_SELECTIVE
+
+/**
+ * Adds an out of order message to the buffer, keeping the buffer in sequence order (the
+ * sender re-sends messages individually, so they can fill gaps in any order). A message sent
+ * whole and the pieces it was later split into can overlap, so buffered messages it covers are
+ * replaced by it, and partial overlaps are left for clear_buffer_check() to trim
+ *
+ * Returns true if the receiver now holds all of the message (whether just buffered or buffered
+ * earlier), false if there was no room for it
+ */
+static bool ARQ_FN(buffer_msg)(struct arq_receiver *r, struct message *msg)
+{
+    struct message *copy;
+    uint32_t pos;
+    uint32_t end;
+    uint32_t i;
+
+    /* Find where the message goes. Most arrive in increasing order, so search from the end */
+    pos = r->num_buffed;
+    while (pos > 0 && msg_seq(r->buffer[pos-1]) >= msg_seq(msg))
+    {
+        pos--;
+    }
+
+    /* Nothing to do if a buffered message already holds every record of it */
+    if ((pos > 0 && msg_last_seq(r->buffer[pos-1]) >= msg_last_seq(msg)) ||
+        (pos < r->num_buffed && msg_seq(r->buffer[pos]) == msg_seq(msg) &&
+         msg_last_seq(r->buffer[pos]) >= msg_last_seq(msg)))
+    {
+        STATS_INC(STAT_DUPLICATES);
+        TRACE(TRACE_DISCARD, r->stream, TRACE_DROP_DUPLICATE, msg_seq(msg), msg_last_seq(msg), r->num_buffed, 0, 0);
+
+        return true;
+    }
+
+    /* Buffered messages from pos to end are covered by this one */
+    end = pos;
+    while (end < r->num_buffed && msg_last_seq(r->buffer[end]) <= msg_last_seq(msg))
+    {
+        end++;
+    }
+
+    if (r->num_buffed - (end - pos) >= r->buffer_size)
+    {
+        /* Should never happen if size is chosen wisely */
+        LOG_WRN("\tNo space left in buffer. Message discarded\n");
+        TRACE(TRACE_DISCARD, r->stream, TRACE_DROP_NO_ROOM, msg_seq(msg), msg_last_seq(msg), r->num_buffed, 0, 0);
+
+        return false;
+    }
+
+    /* The ones it covers are let go */
+    for (i = pos; i < end; i++)
+    {
+        STATS_INC(STAT_DUPLICATES);
+        TRACE(TRACE_DISCARD, r->stream, TRACE_DROP_DUPLICATE, msg_seq(r->buffer[i]), msg_last_seq(r->buffer[i]),
+              r->num_buffed, 0, 0);
+
+        msg_pool_put(r->pool, r->buffer[i]);
+    }
+
+    memmove(&r->buffer[pos], &r->buffer[end], (r->num_buffed - end) * sizeof(struct message *));
+    r->num_buffed -= end - pos;
+
+    if ((copy = msg_pool_get(r->pool)) == NULL)
+    {
+        LOG_WRN("\tNo space left in buffer. Message discarded\n");
+        TRACE(TRACE_DISCARD, r->stream, TRACE_DROP_NO_ROOM, msg_seq(msg), msg_last_seq(msg), r->num_buffed, 0, 0);
+
+        return false;
+    }
+
+    /* Only the part of the message in use needs copying */
+    memcpy(copy, msg, msg_wire_len(msg));
+
+    memmove(&r->buffer[pos+1], &r->buffer[pos], (r->num_buffed - pos) * sizeof(struct message *));
+    r->buffer[pos] = copy;
+    r->num_buffed++;
+
+    stats_set(STAT_BUFFER_OCCUPANCY, r->num_buffed);
+    TRACE(TRACE_BUFFER, r->stream, 0, msg_seq(msg), msg_last_seq(msg), r->num_buffed, msg_wire_len(msg), 0);
+
+    LOG_DBG("\tMessage buffered\n");
+    LOG_DBG("\tBuffer: %u buffered (seq %u - %u)\n\n", r->num_buffed, msg_seq(r->buffer[0]),
+            msg_last_seq(r->buffer[r->num_buffed-1]));
+
+    return true;
+}
+
+/**
+ * Delivers whatever can now be cleared from the buffer given the new in-order sequence number
+ *
+ * @param[in,out] new_seq  The new in-order sequence number received. Updated to be the largest
+ *                         sequence number of messages that were able to be cleared from the buffer
+ */
+static void ARQ_FN(clear_buffer_check)(struct arq_receiver *r, uint32_t *new_seq)
+{
+    uint32_t i = 0;
+    uint32_t first = *new_seq + 1;
+
+    if (r->num_buffed == 0)
+    {
+        return;
+    }
+
+    /* Go through the buffer and advance the sequence number past every consecutive message. A
+     * message can overlap ones delivered before it (see buffer_msg()): its records already
+     * delivered are dropped, and it is let go altogether if that is all of them */
+    while (i < r->num_buffed && msg_seq(r->buffer[i]) <= *new_seq + 1)
+    {
+        if (msg_last_seq(r->buffer[i]) <= *new_seq)
+        {
+            STATS_INC(STAT_DUPLICATES);
+            TRACE(TRACE_DISCARD, r->stream, TRACE_DROP_DUPLICATE, msg_seq(r->buffer[i]), msg_last_seq(r->buffer[i]),
+                  r->num_buffed, 0, 0);
+        }
+        else
+        {
+            if (msg_seq(r->buffer[i]) <= *new_seq)
+            {
+                msg_trim_front(r->buffer[i], *new_seq + 1);
+            }
+
+            *new_seq = msg_last_seq(r->buffer[i]);
+
+            msg_log_records("\tCleared from buffer:  ", r->buffer[i]);
+            arq_deliver(r, r->buffer[i]);
+        }
+
+        msg_pool_put(r->pool, r->buffer[i]);
+
+        i++;
+    }
+
+    /* If messages were cleared, shift remaining items to the front of the buffer */
+    if (i > 0)
+    {
+        memmove(&r->buffer[0], &r->buffer[i], (r->num_buffed - i) * sizeof(struct message *));
+        r->num_buffed -= i;
+
+        TRACE(TRACE_DRAIN, r->stream, 0, first, *new_seq, r->num_buffed, 0, i);
+    }
+
+    stats_set(STAT_BUFFER_OCCUPANCY, r->num_buffed);
+
+    LOG_DBG("\tNew most recent sequence number after buffer clear: %u\n", *new_seq);
+}
+
+#endif /* ARQ_SELECTIVE */
+
+void ARQ_FN(receive)(struct arq_receiver *r, struct message *msg, int len)
+{
+    uint32_t reply_seq;
+
+    STATS_INC(STAT_MSGS_RECEIVED);
+
+    /* A damaged message is treated exactly like a lost one: no ack, nothing buffered.
+     * Compressed messages are expanded here, before anything else looks at the text */
+    if (!msg_intact(msg, len) || !msg_decompress(msg))
+    {
+        STATS_INC(STAT_CORRUPT);
+        TRACE(TRACE_DISCARD, r->stream, TRACE_DROP_DAMAGED, msg_seq(msg), msg_seq(msg), r->num_buffed, len, 0);
+
+        LOG_DBG("\nDropped damaged message (%i bytes, checksum mismatch)\n", len);
+
+        return;
+    }
+
+    /* FEC parity reaches here only when the receiver isn't decoding it */
+    if (msg->flags & MSG_FLAG_PARITY)
+    {
+        LOG_DBG("\nIgnored FEC parity (seq %u)\n", msg_seq(msg));
+
+        return;
+    }
+
+    if (msg->stream != r->stream)
+    {
+        LOG_WRN("Message for stream %u received by stream %u\n", msg->stream, r->stream);
+
+        return;
+    }
+
+    msg_log_records("\nMsg recvd:  ", msg);
+
+    /* A message sent whole can arrive after some of its records came in pieces (or the other way
+     * round). Only the records not yet delivered are new */
+    if (r->last_succ_seq != UINT32_MAX && msg_seq(msg) <= r->last_succ_seq && r->last_succ_seq < msg_last_seq(msg))
+    {
+        msg_trim_front(msg, r->last_succ_seq + 1);
+    }
+
+    /* If the message is the next in-order message, reply with the sequence number received */
+    if (r->last_succ_seq == (msg_seq(msg) - 1))
+    {
+        if (r->ops.accept != NULL && !r->ops.accept(r->ops.ctx, msg, true))
+        {
+            TRACE(TRACE_DISCARD, r->stream, TRACE_DROP_REJECTED, msg_seq(msg), msg_last_seq(msg), r->num_buffed,
+                  len, 0);
+
+            return;
+        }
+
+        reply_seq = msg_last_seq(msg);
+
+        arq_deliver(r, msg);
+        TRACE(TRACE_RECEIVE, r->stream, 0, msg_seq(msg), reply_seq, r->num_buffed, len, 0);
+
+#if ARQ_SELECTIVE
+        /* Do any potential clearing of the buffer now that we have an in-order message */
+        ARQ_FN(clear_buffer_check)(r, &reply_seq);
+#endif
+
+        /* Send the sequence number successfully received as a reply back to the sender */
+        arq_send_ack(r, reply_seq, 0, msg);
+
+        /* Update the last successful sequence number received */
+        r->last_succ_seq = reply_seq;
+    }
+    /* Else if everything in the message was already received in order, send the acknowledgement
+     * again. Only this, not a selective ack, as none of it is held */
+    else if (r->last_succ_seq != UINT32_MAX && msg_last_seq(msg) <= r->last_succ_seq)
+    {
+        LOG_DBG("\tThis is a retransmission of a correctly received in-order message\n");
+
+        STATS_INC(STAT_DUPLICATES);
+        TRACE(TRACE_DISCARD, r->stream, TRACE_DROP_DUPLICATE, msg_seq(msg), msg_last_seq(msg), r->num_buffed, len, 0);
+
+        arq_send_ack(r, r->last_succ_seq, ACK_FLAG_RETRANS, msg);
+    }
+    /* Else the received message is neither the next in-order message nor a retransmission of the most
+     * recent in-order message */
+    else
+    {
+        STATS_INC(STAT_OUT_OF_ORDER);
+
+#if ARQ_SELECTIVE
+        /* Buffer it if received correctly */
+        if (r->ops.accept != NULL && !r->ops.accept(r->ops.ctx, msg, false))
+        {
+            TRACE(TRACE_DISCARD, r->stream, TRACE_DROP_REJECTED, msg_seq(msg), msg_last_seq(msg), r->num_buffed,
+                  len, 0);
+
+            return;
+        }
+
+        /* Ack the buffered message itself so the sender stops re-sending it, along with the most
+         * recently successful sequence number (UINT32_MAX if there isn't one yet). If it couldn't
+         * be buffered, only the latter, so the sender sends it again later */
+        if (ARQ_FN(buffer_msg)(r, msg))
+        {
+            arq_send_ack(r, r->last_succ_seq, ACK_FLAG_OUT_OF_ORDER | ACK_FLAG_SELECTIVE, msg);
+        }
+        else if (r->last_succ_seq != UINT32_MAX)
+        {
+            arq_send_ack(r, r->last_succ_seq, ACK_FLAG_OUT_OF_ORDER, msg);
+        }
+#else
+        LOG_DBG("\tThis is an out of order message. Nothing is to be done\n");
+        TRACE(TRACE_DISCARD, r->stream,
+              msg_seq(msg) <= r->last_succ_seq && r->last_succ_seq != UINT32_MAX ? TRACE_DROP_DUPLICATE
+                                                                                 : TRACE_DROP_OUT_OF_ORDER,
+              msg_seq(msg), msg_last_seq(msg), 0, len, 0);
+#endif
+    }
+}
@@ -0,0 +1,15 @@
+/**
+ * ARQ engine for the Go-Back-N (Q1) policy
+ *
+ * Out of order messages are dropped and only in-order messages are acked.
+ *
+ * CMPT 434 - A2
+ * Steven Rau
+ * scr108
+ * 11115094
+ */
+
+#define ARQ_FN(name)   arq_gbn_##name
+#define ARQ_SELECTIVE  0
+
+#include "arq_engine.h"
@@ -0,0 +1,15 @@
+/**
+ * ARQ engine for the Selective Repeat (Q2) policy
+ *
+ * Out of order messages are buffered until the gap in front of them is filled.
+ *
+ * CMPT 434 - A2
+ * Steven Rau
+ * scr108
+ * 11115094
+ */
+
+#define ARQ_FN(name)   arq_sr_##name
+#define ARQ_SELECTIVE  1
+
+#include "arq_engine.h"
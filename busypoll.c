@@ -0,0 +1,156 @@
+/**
+ * Low-latency mode: CPU pinning and busy-polled receives
+ *
+ * CMPT 434 - A2
+ * Steven Rau
+ * scr108
+ * 11115094
+ */
+
+/* For sched_setaffinity() and the CPU_* macros */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/select.h>
+
+#include "busypoll.h"
+#include "stats.h"
+
+/*-----------------------------------------------------------------------------
+ * Helper functions
+ * --------------------------------------------------------------------------*/
+
+static long mono_usec(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec * 1000000L + now.tv_nsec / 1000;
+}
+
+/*-----------------------------------------------------------------------------
+ * Low-latency mode
+ * --------------------------------------------------------------------------*/
+
+bool busypoll_pin_cpu(int cpu)
+{
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+
+    /* pid 0 is the calling thread */
+    if (sched_setaffinity(0, sizeof(set), &set) == -1)
+    {
+        fprintf(stderr, "Couldn't pin to CPU %d: %s\n", cpu, strerror(errno));
+
+        return false;
+    }
+
+    return true;
+}
+
+void busypoll_enable(int fd, int usec)
+{
+#ifdef SO_BUSY_POLL
+    if (setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof(usec)) == -1)
+    {
+        fprintf(stderr, "Warning: couldn't set SO_BUSY_POLL (%s), spinning in user space only\n",
+                strerror(errno));
+    }
+#else
+    (void)fd;
+    (void)usec;
+#endif
+}
+
+ssize_t busypoll_recv(int fd, void *buf, size_t len, struct sockaddr *addr, socklen_t *addr_len,
+                      struct sock_rx_info *info, uint32_t *last_drops, long spin_usec, long timeout_usec)
+{
+    long start = mono_usec();
+    long now = start;
+    long left;
+    socklen_t addr_size = addr_len != NULL ? *addr_len : 0;
+    ssize_t num_bytes;
+    struct timeval tv;
+    fd_set read_set;
+
+    /* Spin, checking the clock as we go, until something arrives or the budget runs out */
+    while (1)
+    {
+        if (addr_len != NULL)
+        {
+            *addr_len = addr_size;
+        }
+
+        if ((num_bytes = sock_recvfrom(fd, buf, len, MSG_DONTWAIT, addr, addr_len, info, last_drops)) >= 0)
+        {
+            STATS_INC(STAT_SPIN_HITS);
+
+            return num_bytes;
+        }
+
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+        {
+            return -1;
+        }
+
+        now = mono_usec();
+        if (now - start >= spin_usec || (timeout_usec >= 0 && now - start >= timeout_usec))
+        {
+            break;
+        }
+
+        /* Returns straight away on a core of its own. On a shared one it lets whatever is going
+         * to send the datagram run, rather than spinning out the whole budget against it */
+        sched_yield();
+    }
+
+    STATS_INC(STAT_SPIN_SLEEPS);
+
+    /* Then sleep for what is left of the timeout. select() also wakes up for errors (e.g. transmit
+     * timestamps), so a wakeup with nothing to read goes back to sleep */
+    while (1)
+    {
+        left = timeout_usec < 0 ? -1 : timeout_usec - (now - start);
+        if (timeout_usec >= 0 && left <= 0)
+        {
+            errno = EAGAIN;
+
+            return -1;
+        }
+
+        FD_ZERO(&read_set);
+        FD_SET(fd, &read_set);
+        tv.tv_sec = left / 1000000L;
+        tv.tv_usec = left % 1000000L;
+
+        /* Including EINTR, so a signal gets the caller back to check why it was sent */
+        if (select(fd + 1, &read_set, NULL, NULL, left < 0 ? NULL : &tv) == -1)
+        {
+            return -1;
+        }
+
+        if (addr_len != NULL)
+        {
+            *addr_len = addr_size;
+        }
+
+        if ((num_bytes = sock_recvfrom(fd, buf, len, MSG_DONTWAIT, addr, addr_len, info, last_drops)) >= 0)
+        {
+            return num_bytes;
+        }
+
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+        {
+            return -1;
+        }
+
+        now = mono_usec();
+    }
+}
@@ -0,0 +1,70 @@
+/**
+ * Low-latency mode: CPU pinning and busy-polled receives
+ *
+ * Blocking in select() or recvfrom() means every ack or message costs a
+ * sleep and a wakeup, which adds tens of microseconds to a round trip on
+ * loopback. In low-latency mode a program pins itself to one core, asks
+ * the kernel to busy poll the socket's device queue (SO_BUSY_POLL), and
+ * spins on non-blocking receives instead of sleeping.
+ *
+ * Spinning is bounded: once a receive has spun for its budget without
+ * anything arriving it falls back to blocking for the rest of its
+ * timeout, so an idle program doesn't hold its core at 100% forever.
+ * spin_hits and spin_sleeps count how often each happened.
+ *
+ * CMPT 434 - A2
+ * Steven Rau
+ * scr108
+ * 11115094
+ */
+
+#ifndef BUSYPOLL_H
+#define BUSYPOLL_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include "sock.h"
+
+/* Default spin budget (microseconds) before a receive goes back to blocking */
+#define BUSYPOLL_DEFAULT_SPIN_USEC  200
+
+/* Default time the kernel busy polls the device queue on each receive (microseconds) */
+#define BUSYPOLL_DEFAULT_KERNEL_USEC  50
+
+/**
+ * Pins the calling thread to one CPU. Threads it starts afterwards inherit that, so call it
+ * after starting the logger and stats threads
+ *
+ * Returns false (with a message printed) if it couldn't
+ */
+bool busypoll_pin_cpu(int cpu);
+
+/**
+ * Asks the kernel to busy poll the socket's device queue for up to usec on each receive
+ *
+ * Raising it above net.core.busy_read needs CAP_NET_ADMIN. Without that a warning is printed,
+ * and the program still spins on its own receives
+ */
+void busypoll_enable(int fd, int usec);
+
+/**
+ * sock_recvfrom() that spins on non-blocking receives for up to spin_usec before blocking
+ *
+ * @param[in]     fd            The socket
+ * @param[out]    buf           Buffer for the datagram
+ * @param[in]     len           Size of buf
+ * @param[out]    addr          Sender's address (may be NULL)
+ * @param[in,out] addr_len      Size of addr (may be NULL)
+ * @param[out]    info          Timestamp and GRO segment size of the datagram (may be NULL)
+ * @param[in,out] last_drops    The socket's drop count as of the last call
+ * @param[in]     spin_usec     Spin budget
+ * @param[in]     timeout_usec  How long to wait altogether, spinning included (-1 for ever)
+ *
+ * Returns the number of bytes received, or -1 with errno set (EAGAIN if the timeout ran out)
+ */
+ssize_t busypoll_recv(int fd, void *buf, size_t len, struct sockaddr *addr, socklen_t *addr_len,
+                      struct sock_rx_info *info, uint32_t *last_drops, long spin_usec, long timeout_usec);
+
+#endif /* BUSYPOLL_H */
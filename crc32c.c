@@ -0,0 +1,182 @@
+/**
+ * CRC32C (Castagnoli) checksum used to detect damaged datagrams
+ *
+ * CMPT 434 - A2
+ * Steven Rau
+ * scr108
+ * 11115094
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#define CRC32C_HAVE_SSE42_PATH
+#endif
+
+#include "crc32c.h"
+
+/*-----------------------------------------------------------------------------
+ * File-scope constants & globals
+ * --------------------------------------------------------------------------*/
+
+/* Reflected CRC32C polynomial */
+#define CRC32C_POLY  0x82F63B78
+
+/* Slicing-by-8 lookup tables for the software version */
+static uint32_t crc_table[8][256];
+
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+
+/* Chosen implementation, set up once on first use */
+static uint32_t (*crc32c_impl)(uint32_t crc, const unsigned char *p, size_t len);
+
+/*-----------------------------------------------------------------------------
+ * Helper functions
+ * --------------------------------------------------------------------------*/
+
+/**
+ * Table driven CRC32C, 8 bytes at a time
+ */
+static uint32_t crc32c_sw(uint32_t crc, const unsigned char *p, size_t len)
+{
+    uint64_t word;
+
+    /* Byte at a time until the pointer is 8 byte aligned */
+    while (len > 0 && ((uintptr_t)p & 7) != 0)
+    {
+        crc = crc_table[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+        len--;
+    }
+
+    while (len >= 8)
+    {
+        memcpy(&word, p, sizeof(word));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        word = __builtin_bswap64(word);
+#endif
+        word ^= crc;
+
+        crc = crc_table[7][word & 0xFF] ^
+              crc_table[6][(word >> 8) & 0xFF] ^
+              crc_table[5][(word >> 16) & 0xFF] ^
+              crc_table[4][(word >> 24) & 0xFF] ^
+              crc_table[3][(word >> 32) & 0xFF] ^
+              crc_table[2][(word >> 40) & 0xFF] ^
+              crc_table[1][(word >> 48) & 0xFF] ^
+              crc_table[0][word >> 56];
+
+        p += 8;
+        len -= 8;
+    }
+
+    while (len > 0)
+    {
+        crc = crc_table[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+        len--;
+    }
+
+    return crc;
+}
+
+#ifdef CRC32C_HAVE_SSE42_PATH
+/**
+ * CRC32C using the SSE4.2 crc32 instruction
+ */
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_hw(uint32_t crc, const unsigned char *p, size_t len)
+{
+#if defined(__x86_64__)
+    uint64_t crc64;
+    uint64_t word;
+#endif
+
+    while (len > 0 && ((uintptr_t)p & 7) != 0)
+    {
+        crc = _mm_crc32_u8(crc, *p++);
+        len--;
+    }
+
+#if defined(__x86_64__)
+    crc64 = crc;
+    while (len >= 8)
+    {
+        memcpy(&word, p, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+
+        p += 8;
+        len -= 8;
+    }
+    crc = (uint32_t)crc64;
+#endif
+
+    while (len >= 4)
+    {
+        uint32_t word32;
+
+        memcpy(&word32, p, sizeof(word32));
+        crc = _mm_crc32_u32(crc, word32);
+
+        p += 4;
+        len -= 4;
+    }
+
+    while (len > 0)
+    {
+        crc = _mm_crc32_u8(crc, *p++);
+        len--;
+    }
+
+    return crc;
+}
+#endif
+
+/**
+ * Builds the lookup tables and picks the fastest implementation the CPU supports
+ */
+static void crc32c_init(void)
+{
+    uint32_t crc;
+    int i;
+    int j;
+
+    for (i = 0; i < 256; i++)
+    {
+        crc = i;
+        for (j = 0; j < 8; j++)
+        {
+            crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+        }
+        crc_table[0][i] = crc;
+    }
+
+    for (i = 0; i < 256; i++)
+    {
+        for (j = 1; j < 8; j++)
+        {
+            crc_table[j][i] = crc_table[0][crc_table[j-1][i] & 0xFF] ^ (crc_table[j-1][i] >> 8);
+        }
+    }
+
+    crc32c_impl = crc32c_sw;
+
+#ifdef CRC32C_HAVE_SSE42_PATH
+    if (__builtin_cpu_supports("sse4.2"))
+    {
+        crc32c_impl = crc32c_hw;
+    }
+#endif
+}
+
+/*-----------------------------------------------------------------------------
+ *
+ * --------------------------------------------------------------------------*/
+
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len)
+{
+    pthread_once(&init_once, crc32c_init);
+
+    return ~crc32c_impl(~crc, buf, len);
+}
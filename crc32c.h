@@ -0,0 +1,30 @@
+/**
+ * CRC32C (Castagnoli) checksum used to detect damaged datagrams
+ *
+ * Uses the SSE4.2 crc32 instruction when the CPU has it, and a
+ * slicing-by-8 table driven version otherwise.
+ *
+ * CMPT 434 - A2
+ * Steven Rau
+ * scr108
+ * 11115094
+ */
+
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Computes or continues a CRC32C
+ *
+ * @param[in] crc  0 to start a new checksum, or the result of a previous call to continue it
+ * @param[in] buf  Data to checksum
+ * @param[in] len  Number of bytes in buf
+ *
+ * Returns the updated checksum
+ */
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len);
+
+#endif /* CRC32C_H */
@@ -0,0 +1,749 @@
+/**
+ * Forward error correction over groups of messages
+ *
+ * CMPT 434 - A2
+ * Steven Rau
+ * scr108
+ * 11115094
+ */
+
+#include <string.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <tmmintrin.h>
+#define FEC_HAVE_SSSE3  1
+#endif
+
+#include "fec.h"
+#include "message.h"
+#include "pool.h"
+#include "stats.h"
+#include "log.h"
+
+/*-----------------------------------------------------------------------------
+ * File-scope constants & globals
+ * --------------------------------------------------------------------------*/
+
+/* GF(256) reduction polynomial (x^8 + x^4 + x^3 + x^2 + 1), with 2 as the generator */
+#define GF_POLY  0x11d
+
+/* Parity row j of Reed-Solomon uses the Cauchy point FEC_MAX_K + j, message i the point i, so the
+ * two sets never overlap */
+#define GF_ROW_POINT(j)  (FEC_MAX_K + (j))
+
+static uint8_t gf_exp[512];
+static uint8_t gf_log[256];
+
+static pthread_once_t gf_once = PTHREAD_ONCE_INIT;
+
+static void gf_mul_add_scalar(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len);
+
+/* Picked once the CPU's features are known */
+static void (*gf_mul_add_impl)(uint8_t *, const uint8_t *, uint8_t, size_t) = gf_mul_add_scalar;
+
+/*-----------------------------------------------------------------------------
+ * GF(256) arithmetic
+ * --------------------------------------------------------------------------*/
+
+/**
+ * Nibble tables for multiplying by c: c * b == lo[b & 0xf] ^ hi[b >> 4]
+ */
+static void gf_nibble_tables(uint8_t c, uint8_t lo[16], uint8_t hi[16])
+{
+    int i;
+
+    for (i = 0; i < 16; i++)
+    {
+        lo[i] = gf_mul(c, (uint8_t)i);
+        hi[i] = gf_mul(c, (uint8_t)(i << 4));
+    }
+}
+
+static void gf_mul_add_scalar(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len)
+{
+    uint8_t lo[16];
+    uint8_t hi[16];
+    size_t i;
+
+    gf_nibble_tables(c, lo, hi);
+
+    for (i = 0; i < len; i++)
+    {
+        dst[i] ^= lo[src[i] & 0xf] ^ hi[src[i] >> 4];
+    }
+}
+
+#ifdef FEC_HAVE_SSSE3
+/**
+ * 16 bytes at a time: each nibble table fits in a register, and pshufb looks up all 16 nibbles
+ * at once
+ */
+__attribute__((target("ssse3")))
+static void gf_mul_add_ssse3(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len)
+{
+    uint8_t lo[16];
+    uint8_t hi[16];
+    __m128i lo_table;
+    __m128i hi_table;
+    __m128i mask = _mm_set1_epi8(0x0f);
+    __m128i in;
+    __m128i prod;
+    size_t i = 0;
+
+    gf_nibble_tables(c, lo, hi);
+    lo_table = _mm_loadu_si128((const __m128i *)lo);
+    hi_table = _mm_loadu_si128((const __m128i *)hi);
+
+    for (; i + 16 <= len; i += 16)
+    {
+        in = _mm_loadu_si128((const __m128i *)&src[i]);
+        prod = _mm_xor_si128(_mm_shuffle_epi8(lo_table, _mm_and_si128(in, mask)),
+                             _mm_shuffle_epi8(hi_table, _mm_and_si128(_mm_srli_epi64(in, 4), mask)));
+        _mm_storeu_si128((__m128i *)&dst[i],
+                         _mm_xor_si128(_mm_loadu_si128((const __m128i *)&dst[i]), prod));
+    }
+
+    for (; i < len; i++)
+    {
+        dst[i] ^= lo[src[i] & 0xf] ^ hi[src[i] >> 4];
+    }
+}
+#endif
+
+static void gf_init(void)
+{
+    int i;
+    int x = 1;
+
+    for (i = 0; i < 255; i++)
+    {
+        gf_exp[i] = (uint8_t)x;
+        gf_log[x] = (uint8_t)i;
+
+        x <<= 1;
+        if (x & 0x100)
+        {
+            x ^= GF_POLY;
+        }
+    }
+
+    /* Doubled so a product's log never has to be reduced mod 255 */
+    for (i = 255; i < 512; i++)
+    {
+        gf_exp[i] = gf_exp[i - 255];
+    }
+
+#ifdef FEC_HAVE_SSSE3
+    if (__builtin_cpu_supports("ssse3"))
+    {
+        gf_mul_add_impl = gf_mul_add_ssse3;
+    }
+#endif
+}
+
+uint8_t gf_mul(uint8_t a, uint8_t b)
+{
+    pthread_once(&gf_once, gf_init);
+
+    if (a == 0 || b == 0)
+    {
+        return 0;
+    }
+
+    return gf_exp[gf_log[a] + gf_log[b]];
+}
+
+static uint8_t gf_inv(uint8_t a)
+{
+    return gf_exp[255 - gf_log[a]];
+}
+
+void gf_mul_add(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len)
+{
+    size_t i;
+
+    pthread_once(&gf_once, gf_init);
+
+    if (c == 0)
+    {
+        return;
+    }
+
+    if (c == 1)
+    {
+        for (i = 0; i < len; i++)
+        {
+            dst[i] ^= src[i];
+        }
+
+        return;
+    }
+
+    gf_mul_add_impl(dst, src, c, len);
+}
+
+/*-----------------------------------------------------------------------------
+ * Helper functions
+ * --------------------------------------------------------------------------*/
+
+/**
+ * Coefficient of message i in parity datagram j
+ */
+static uint8_t fec_coef(uint8_t mode, int j, int i)
+{
+    return mode == FEC_XOR ? 1 : gf_inv((uint8_t)(GF_ROW_POINT(j) ^ i));
+}
+
+/**
+ * dst ^= c * (the message as it is coded: its wire bytes with the checksum and timestamp zeroed)
+ */
+static void fec_symbol_mul_add(uint8_t *dst, const struct message *msg, uint8_t c)
+{
+    struct message header;
+
+    memcpy(&header, msg, MSG_HEADER_SIZE);
+    header.crc = 0;
+    header.ts_sec = 0;
+    header.ts_usec = 0;
+
+    gf_mul_add(dst, (const uint8_t *)&header, c, MSG_HEADER_SIZE);
+    gf_mul_add(dst + MSG_HEADER_SIZE, (const uint8_t *)msg->text, c, msg_text_len(msg));
+}
+
+/**
+ * Inverts an m x m matrix over GF(256) in place (Gauss-Jordan)
+ *
+ * Returns false if it is singular (never for a Cauchy matrix)
+ */
+static bool gf_invert(uint8_t a[FEC_MAX_R][FEC_MAX_R], uint8_t inv[FEC_MAX_R][FEC_MAX_R], int m)
+{
+    int row;
+    int col;
+    int i;
+    uint8_t tmp;
+    uint8_t scale;
+
+    memset(inv, 0, sizeof(uint8_t) * FEC_MAX_R * FEC_MAX_R);
+    for (i = 0; i < m; i++)
+    {
+        inv[i][i] = 1;
+    }
+
+    for (col = 0; col < m; col++)
+    {
+        for (row = col; row < m && a[row][col] == 0; row++)
+        {
+        }
+
+        if (row == m)
+        {
+            return false;
+        }
+
+        for (i = 0; i < m; i++)
+        {
+            tmp = a[col][i]; a[col][i] = a[row][i]; a[row][i] = tmp;
+            tmp = inv[col][i]; inv[col][i] = inv[row][i]; inv[row][i] = tmp;
+        }
+
+        scale = gf_inv(a[col][col]);
+        for (i = 0; i < m; i++)
+        {
+            a[col][i] = gf_mul(a[col][i], scale);
+            inv[col][i] = gf_mul(inv[col][i], scale);
+        }
+
+        for (row = 0; row < m; row++)
+        {
+            if (row != col && (scale = a[row][col]) != 0)
+            {
+                for (i = 0; i < m; i++)
+                {
+                    a[row][i] ^= gf_mul(a[col][i], scale);
+                    inv[row][i] ^= gf_mul(inv[col][i], scale);
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Copies a parity header into (or out of) network byte order
+ */
+static void fec_header_to_wire(struct fec_header *wire, const struct fec_header *hdr)
+{
+    int i;
+
+    *wire = *hdr;
+    wire->first_seq = htonl(hdr->first_seq);
+    wire->block_len = htons(hdr->block_len);
+
+    for (i = 0; i < FEC_MAX_K; i++)
+    {
+        wire->counts[i] = htons(hdr->counts[i]);
+    }
+}
+
+static void fec_header_from_wire(struct fec_header *hdr, const struct fec_header *wire)
+{
+    int i;
+
+    *hdr = *wire;
+    hdr->first_seq = ntohl(wire->first_seq);
+    hdr->block_len = ntohs(wire->block_len);
+
+    for (i = 0; i < FEC_MAX_K; i++)
+    {
+        hdr->counts[i] = ntohs(wire->counts[i]);
+    }
+}
+
+/**
+ * Sequence number of message i of a group
+ */
+static uint32_t fec_group_seq(const struct fec_header *hdr, int i)
+{
+    uint32_t seq = hdr->first_seq;
+    int j;
+
+    for (j = 0; j < i; j++)
+    {
+        seq += hdr->counts[j];
+    }
+
+    return seq;
+}
+
+/**
+ * The kept message with the given sequence number, or NULL
+ */
+static const struct message *fec_history_get(const struct fec_decoder *d, uint32_t seq)
+{
+    const struct message *msg = &d->history[seq % FEC_HISTORY];
+
+    return msg_count(msg) != 0 && msg_seq(msg) == seq ? msg : NULL;
+}
+
+/**
+ * Chooses the size of the next group from the loss the receiver reported
+ */
+static void fec_size_group(struct fec_encoder *e)
+{
+    double loss = __atomic_load_n(&e->loss, __ATOMIC_RELAXED) / 255.0;
+    int k = e->max_k;
+    int r = 1;
+
+    if (e->mode == FEC_XOR)
+    {
+        /* One parity datagram rebuilds one loss, so shrink the group as loss grows */
+        if (loss > 0 && (int)(1.0 / (loss * FEC_LOSS_MARGIN)) < k)
+        {
+            k = (int)(1.0 / (loss * FEC_LOSS_MARGIN));
+        }
+
+        k = k < 2 ? 2 : k;
+    }
+    else
+    {
+        r = (int)(k * loss * FEC_LOSS_MARGIN + 0.999);
+        r = r < 1 ? 1 : r > e->max_r ? e->max_r : r;
+    }
+
+    e->k = k;
+    e->r = r;
+}
+
+/*-----------------------------------------------------------------------------
+ * Sender
+ * --------------------------------------------------------------------------*/
+
+void fec_encoder_init(struct fec_encoder *e, enum fec_mode mode, int k, int max_r)
+{
+    pthread_once(&gf_once, gf_init);
+
+    memset(e, 0, sizeof(*e));
+
+    e->mode = mode;
+    e->max_k = k < 1 ? 1 : k > FEC_MAX_K ? FEC_MAX_K : k;
+    e->max_r = mode == FEC_XOR ? 1 : max_r < 1 ? 1 : max_r > FEC_MAX_R ? FEC_MAX_R : max_r;
+}
+
+bool fec_encoder_add(struct fec_encoder *e, const struct message *msg)
+{
+    size_t len = msg_wire_len(msg);
+    int j;
+
+    /* Retransmissions were coded the first time round */
+    if ((msg->flags & MSG_FLAG_PARITY) || msg_seq(msg) < e->next_seq)
+    {
+        return false;
+    }
+    e->next_seq = msg_last_seq(msg) + 1;
+
+    /* The group's sequence numbers have to run on without a gap, so a message that can't be
+     * protected ends the group before it. The parity has to fit in the largest datagram allowed
+     * as well (FEC_MAX_SYMBOL, unless a smaller one was agreed with the receiver) */
+    if (len > FEC_MAX_SYMBOL || sizeof(struct fec_header) + len > msg_payload_limit)
+    {
+        return fec_encoder_close(e);
+    }
+
+    if (e->hdr.k == 0)
+    {
+        fec_size_group(e);
+
+        e->hdr.first_seq = msg_seq(msg);
+        e->hdr.block_len = 0;
+        e->hdr.mode = e->mode;
+        e->stream = msg->stream;
+
+        for (j = 0; j < e->r; j++)
+        {
+            memset(e->parity[j].text + sizeof(struct fec_header), 0, FEC_MAX_SYMBOL);
+        }
+    }
+
+    for (j = 0; j < e->r; j++)
+    {
+        fec_symbol_mul_add((uint8_t *)e->parity[j].text + sizeof(struct fec_header), msg,
+                           fec_coef(e->mode, j, e->hdr.k));
+    }
+
+    e->hdr.counts[e->hdr.k] = msg_count(msg);
+    e->hdr.k++;
+    if (len > e->hdr.block_len)
+    {
+        e->hdr.block_len = len;
+    }
+
+    if (e->hdr.k >= e->k)
+    {
+        return fec_encoder_close(e);
+    }
+
+    return false;
+}
+
+bool fec_encoder_close(struct fec_encoder *e)
+{
+    struct message *parity;
+    struct fec_header wire;
+    int j;
+
+    if (e->hdr.k == 0)
+    {
+        return false;
+    }
+
+    e->hdr.r = e->r;
+
+    for (j = 0; j < e->r; j++)
+    {
+        parity = &e->parity[j];
+
+        msg_init(parity, e->hdr.first_seq);
+        parity->flags = MSG_FLAG_PARITY;
+        parity->stream = e->stream;
+        parity->count = htons(e->hdr.k);
+        parity->len = htons(sizeof(struct fec_header) + e->hdr.block_len);
+
+        e->hdr.index = j;
+        fec_header_to_wire(&wire, &e->hdr);
+        memcpy(parity->text, &wire, sizeof(wire));
+    }
+
+    e->num_parity = e->r;
+    e->hdr.k = 0;
+
+    return true;
+}
+
+/*-----------------------------------------------------------------------------
+ * Receiver
+ * --------------------------------------------------------------------------*/
+
+void fec_decoder_init(struct fec_decoder *d)
+{
+    pthread_once(&gf_once, gf_init);
+
+    memset(d, 0, sizeof(*d));
+
+    d->history = mem_alloc(FEC_HISTORY, sizeof(struct message));
+    d->groups = mem_alloc(FEC_PENDING, sizeof(struct fec_group));
+}
+
+void fec_decoder_destroy(struct fec_decoder *d)
+{
+    mem_free(d->history);
+    mem_free(d->groups);
+}
+
+/**
+ * Rebuilds a group's missing messages if enough parity has arrived, and forgets the group
+ * once nothing in it is missing
+ */
+static void fec_try_group(struct fec_decoder *d, struct fec_group *g)
+{
+    uint8_t syndrome[FEC_MAX_R][FEC_MAX_SYMBOL];
+    uint8_t a[FEC_MAX_R][FEC_MAX_R];
+    uint8_t inv[FEC_MAX_R][FEC_MAX_R];
+    int missing[FEC_MAX_R];
+    int rows[FEC_MAX_R];
+    const struct message *present;
+    struct message *rebuilt;
+    int num_missing = 0;
+    int num_rows = 0;
+    int i;
+    int j;
+    int b;
+    uint32_t seq;
+
+    for (i = 0; i < g->hdr.k; i++)
+    {
+        if (fec_history_get(d, fec_group_seq(&g->hdr, i)) == NULL)
+        {
+            /* More missing than there could ever be parity for */
+            if (num_missing == FEC_MAX_R)
+            {
+                return;
+            }
+
+            missing[num_missing++] = i;
+        }
+    }
+
+    if (num_missing == 0)
+    {
+        g->used = false;
+
+        return;
+    }
+
+    for (j = 0; j < g->hdr.r && num_rows < num_missing; j++)
+    {
+        if (g->have[j])
+        {
+            rows[num_rows++] = j;
+        }
+    }
+
+    if (num_rows < num_missing)
+    {
+        return;
+    }
+
+    /* Take the messages that did arrive back out of the parity, leaving a small system in just
+     * the missing ones */
+    for (j = 0; j < num_rows; j++)
+    {
+        memcpy(syndrome[j], g->parity[rows[j]], g->hdr.block_len);
+
+        for (i = 0; i < g->hdr.k; i++)
+        {
+            if ((present = fec_history_get(d, fec_group_seq(&g->hdr, i))) != NULL)
+            {
+                fec_symbol_mul_add(syndrome[j], present, fec_coef(g->hdr.mode, rows[j], i));
+            }
+        }
+
+        for (b = 0; b < num_missing; b++)
+        {
+            a[j][b] = fec_coef(g->hdr.mode, rows[j], missing[b]);
+        }
+    }
+
+    g->used = false;
+
+    if (!gf_invert(a, inv, num_missing))
+    {
+        return;
+    }
+
+    for (b = 0; b < num_missing; b++)
+    {
+        seq = fec_group_seq(&g->hdr, missing[b]);
+        rebuilt = &d->history[seq % FEC_HISTORY];
+
+        memset(rebuilt, 0, sizeof(*rebuilt));
+        for (j = 0; j < num_rows; j++)
+        {
+            gf_mul_add((uint8_t *)rebuilt, syndrome[j], inv[b][j], g->hdr.block_len);
+        }
+
+        /* Anything that doesn't add up means the group was mixed up with another */
+        if (msg_seq(rebuilt) != seq || msg_count(rebuilt) != g->hdr.counts[missing[b]] ||
+            msg_wire_len(rebuilt) > g->hdr.block_len)
+        {
+            LOG_WRN("FEC: rebuilt message for seq %u doesn't match its group\n", seq);
+
+            rebuilt->count = 0;
+
+            continue;
+        }
+
+        /* Acks for it echo the parity's timestamp */
+        msg_seal(rebuilt, ntohl(g->ts_sec), ntohl(g->ts_usec));
+
+        if (d->num_recovered < (int)(sizeof(d->recovered) / sizeof(d->recovered[0])))
+        {
+            d->recovered[d->num_recovered++] = seq;
+        }
+    }
+}
+
+/**
+ * Retries every group waiting on more of its messages
+ */
+static void fec_try_groups(struct fec_decoder *d)
+{
+    int i;
+
+    for (i = 0; i < FEC_PENDING; i++)
+    {
+        if (d->groups[i].used)
+        {
+            fec_try_group(d, &d->groups[i]);
+        }
+    }
+}
+
+void fec_decoder_add_msg(struct fec_decoder *d, const struct message *msg, int len)
+{
+    struct message copy;
+    struct message *kept;
+
+    if (len < MSG_HEADER_SIZE || len > (int)sizeof(copy) || (msg->flags & MSG_FLAG_PARITY))
+    {
+        return;
+    }
+
+    /* msg_intact() zeroes the checksum, so check a copy */
+    memcpy(&copy, msg, len);
+    if (!msg_intact(&copy, len))
+    {
+        return;
+    }
+
+    kept = &d->history[msg_seq(msg) % FEC_HISTORY];
+    memcpy(kept, msg, msg_wire_len(msg));
+
+    fec_try_groups(d);
+}
+
+void fec_decoder_add_parity(struct fec_decoder *d, const struct message *msg, int len)
+{
+    struct message copy;
+    struct fec_header hdr;
+    struct fec_header wire;
+    struct fec_group *g = NULL;
+    int num_missing = 0;
+    int i;
+
+    if (len < MSG_HEADER_SIZE || len > (int)sizeof(copy))
+    {
+        return;
+    }
+
+    memcpy(&copy, msg, len);
+    if (!msg_intact(&copy, len) || msg_text_len(&copy) < sizeof(hdr))
+    {
+        STATS_INC(STAT_CORRUPT);
+
+        return;
+    }
+
+    memcpy(&wire, copy.text, sizeof(wire));
+    fec_header_from_wire(&hdr, &wire);
+    if (hdr.k == 0 || hdr.k > FEC_MAX_K || hdr.r == 0 || hdr.r > FEC_MAX_R || hdr.index >= hdr.r ||
+        hdr.block_len > FEC_MAX_SYMBOL || msg_text_len(&copy) != sizeof(hdr) + hdr.block_len)
+    {
+        LOG_WRN("FEC: malformed parity received\n");
+
+        return;
+    }
+
+    /* Find the group, or make room for it by dropping the oldest */
+    for (i = 0; i < FEC_PENDING; i++)
+    {
+        if (d->groups[i].used && d->groups[i].hdr.first_seq == hdr.first_seq && d->groups[i].hdr.k == hdr.k)
+        {
+            g = &d->groups[i];
+
+            break;
+        }
+
+        if (g == NULL || !d->groups[i].used || (g->used && d->groups[i].age < g->age))
+        {
+            g = &d->groups[i];
+        }
+    }
+
+    if (!g->used || g->hdr.first_seq != hdr.first_seq || g->hdr.k != hdr.k)
+    {
+        /* Everything in it that arrived already was rebuilt from, or isn't needed */
+        for (i = 0; i < hdr.k; i++)
+        {
+            num_missing += fec_history_get(d, fec_group_seq(&hdr, i)) == NULL;
+        }
+
+        /* The first parity of each group measures how much of it was lost */
+        d->loss += ((double)num_missing / hdr.k - d->loss) / 8;
+
+        if (num_missing == 0)
+        {
+            return;
+        }
+
+        memset(g->have, 0, sizeof(g->have));
+        g->hdr = hdr;
+        g->age = d->age++;
+        g->used = true;
+    }
+
+    g->have[hdr.index] = true;
+    g->ts_sec = copy.ts_sec;
+    g->ts_usec = copy.ts_usec;
+    memcpy(g->parity[hdr.index], copy.text + sizeof(hdr), hdr.block_len);
+
+    fec_try_group(d, g);
+}
+
+bool fec_decoder_next_recovered(struct fec_decoder *d, struct message *msg)
+{
+    uint32_t seq;
+
+    while (d->num_recovered > 0)
+    {
+        seq = d->recovered[0];
+
+        d->num_recovered--;
+        memmove(&d->recovered[0], &d->recovered[1], d->num_recovered * sizeof(d->recovered[0]));
+
+        if (fec_decoder_lookup(d, seq, msg))
+        {
+            STATS_INC(STAT_FEC_RECOVERED);
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool fec_decoder_lookup(const struct fec_decoder *d, uint32_t seq, struct message *msg)
+{
+    const struct message *kept = fec_history_get(d, seq);
+
+    if (kept == NULL)
+    {
+        return false;
+    }
+
+    memcpy(msg, kept, msg_wire_len(kept));
+
+    return true;
+}
@@ -0,0 +1,211 @@
+/**
+ * Forward error correction over groups of messages
+ *
+ * The sender follows every group of k new messages on a stream with r
+ * parity datagrams, so the receiver can rebuild up to r of the group's
+ * messages that were lost without waiting a timeout for them to be sent
+ * again. Two codes are supported:
+ *
+ *     FEC_XOR  One parity datagram, the XOR of the group's messages. Rebuilds
+ *              a single loss per group
+ *     FEC_RS   Reed-Solomon (a systematic Cauchy code over GF(256)). Any r
+ *              losses in the group can be rebuilt
+ *
+ * Each message is coded as its wire bytes with the checksum and timestamp
+ * zeroed (those change with every retransmission), padded with zeros to the
+ * group's longest message. A rebuilt message is sealed again, with the
+ * parity's timestamp, before it is handed to the ARQ receiver like any
+ * other.
+ *
+ * The receiver reports the loss it sees in its acks, and the sender sizes
+ * each new group from it: more parity per group (Reed-Solomon) or smaller
+ * groups (XOR) as loss goes up.
+ *
+ * CMPT 434 - A2
+ * Steven Rau
+ * scr108
+ * 11115094
+ */
+
+#ifndef FEC_H
+#define FEC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "shared.h"
+
+/* Most messages in a group, and most parity datagrams following one */
+#define FEC_MAX_K  32
+#define FEC_MAX_R  8
+
+/* Recent messages the decoder keeps per stream to rebuild others from, and groups it waits on */
+#define FEC_HISTORY  128
+#define FEC_PENDING  4
+
+/* Groups carry this many times the parity the measured loss calls for */
+#define FEC_LOSS_MARGIN  2.0
+
+enum fec_mode
+{
+    FEC_XOR = 1,
+    FEC_RS = 2
+};
+
+/*
+ * Start of a parity datagram's text (its header is a struct message with
+ * MSG_FLAG_PARITY set and count set to k). block_len bytes of parity follow.
+ * Network byte order, like the message header
+ */
+struct fec_header
+{
+    uint32_t first_seq;          /* Sequence number of the group's first message */
+    uint16_t block_len;          /* Length of the group's longest message */
+    uint8_t mode;                /* enum fec_mode */
+    uint8_t k;                   /* Messages in the group */
+    uint8_t index;               /* Which of the group's parity datagrams this is */
+    uint8_t r;                   /* Parity datagrams in the group */
+    uint16_t counts[FEC_MAX_K];  /* Records in each message, giving the sequence number of each */
+};
+
+/* Longest message (on the wire) that can be protected. Longer ones are sent without parity */
+#define FEC_MAX_SYMBOL  (MAX_DATAGRAM_SIZE - MSG_HEADER_SIZE - sizeof(struct fec_header))
+
+/*-----------------------------------------------------------------------------
+ * Sender
+ * --------------------------------------------------------------------------*/
+
+struct fec_encoder
+{
+    enum fec_mode mode;
+    uint8_t max_k;              /* Group size asked for */
+    uint8_t max_r;              /* Most parity datagrams per group */
+    uint8_t k;                  /* Size and parity of the group being built */
+    uint8_t r;
+    uint8_t stream;
+    uint8_t loss;               /* Loss the receiver last reported, in 255ths */
+    uint8_t num_parity;         /* Parity datagrams ready in parity[] */
+    uint32_t next_seq;          /* Messages below this were already coded (they are retransmissions) */
+    struct fec_header hdr;      /* The group being built (hdr.k messages so far) */
+    struct message parity[FEC_MAX_R];
+};
+
+/**
+ * Sets up an encoder for one stream
+ *
+ * @param[out] e      The encoder
+ * @param[in]  mode   Which code to use
+ * @param[in]  k      Messages per group (at most FEC_MAX_K)
+ * @param[in]  max_r  Most parity datagrams per group (at most FEC_MAX_R; XOR always uses 1)
+ */
+void fec_encoder_init(struct fec_encoder *e, enum fec_mode mode, int k, int max_r);
+
+/**
+ * Codes a message that was just sent. Retransmissions, and messages too long to protect, are
+ * skipped
+ *
+ * Returns true if that finished a group: e->num_parity datagrams in e->parity are ready to be
+ * sealed and sent
+ */
+bool fec_encoder_add(struct fec_encoder *e, const struct message *msg);
+
+/**
+ * Finishes the group early, e.g. when the sender stops to wait for acks
+ *
+ * Returns true if the group had any messages, leaving its parity ready like fec_encoder_add()
+ */
+bool fec_encoder_close(struct fec_encoder *e);
+
+/**
+ * Takes the loss the receiver reported in an ack, to size the next group from
+ */
+static inline void fec_encoder_set_loss(struct fec_encoder *e, uint8_t loss)
+{
+    /* Set from the ack thread when the sender runs one */
+    __atomic_store_n(&e->loss, loss, __ATOMIC_RELAXED);
+}
+
+/*-----------------------------------------------------------------------------
+ * Receiver
+ * --------------------------------------------------------------------------*/
+
+/* A group the decoder has parity for, waiting until enough of it arrives to rebuild the rest */
+struct fec_group
+{
+    bool used;
+    struct fec_header hdr;
+    uint32_t ts_sec;            /* Timestamp of the latest parity (network byte order) */
+    uint32_t ts_usec;
+    uint32_t age;               /* When the group arrived, oldest is evicted first */
+    bool have[FEC_MAX_R];
+    uint8_t parity[FEC_MAX_R][FEC_MAX_SYMBOL];
+};
+
+struct fec_decoder
+{
+    struct message *history;    /* FEC_HISTORY recent messages as received, at seq % FEC_HISTORY */
+    struct fec_group *groups;   /* FEC_PENDING groups */
+    uint32_t age;
+    uint32_t recovered[FEC_MAX_R * FEC_PENDING];  /* Rebuilt messages not yet handed out */
+    int num_recovered;
+    double loss;                /* Running average of the fraction of each group lost */
+};
+
+/**
+ * Sets up a decoder for one stream (allocating its history up front)
+ */
+void fec_decoder_init(struct fec_decoder *d);
+
+void fec_decoder_destroy(struct fec_decoder *d);
+
+/**
+ * Keeps a received message to rebuild others from, if it is intact. Call it before handing the
+ * message to the ARQ receiver, which changes it
+ *
+ * @param[in] d    The decoder
+ * @param[in] msg  The message received
+ * @param[in] len  Number of bytes received
+ */
+void fec_decoder_add_msg(struct fec_decoder *d, const struct message *msg, int len);
+
+/**
+ * Takes in a parity datagram (dropping it if damaged), rebuilding whatever it can
+ */
+void fec_decoder_add_parity(struct fec_decoder *d, const struct message *msg, int len);
+
+/**
+ * Hands out the next message the decoder rebuilt, sealed and ready for the ARQ receiver
+ *
+ * Returns false once there are none left
+ */
+bool fec_decoder_next_recovered(struct fec_decoder *d, struct message *msg);
+
+/**
+ * Copies out a kept message by sequence number (e.g. for Go-Back-N to take again the
+ * messages it dropped while a rebuilt one was missing)
+ *
+ * Returns false if the decoder doesn't have it
+ */
+bool fec_decoder_lookup(const struct fec_decoder *d, uint32_t seq, struct message *msg);
+
+/**
+ * Loss the decoder has seen, in 255ths, for the sender to size its groups from
+ */
+static inline uint8_t fec_decoder_loss(const struct fec_decoder *d)
+{
+    return (uint8_t)(d->loss * 255.0 + 0.5);
+}
+
+/*-----------------------------------------------------------------------------
+ * GF(256) arithmetic
+ * --------------------------------------------------------------------------*/
+
+uint8_t gf_mul(uint8_t a, uint8_t b);
+
+/**
+ * dst ^= c * src over len bytes. Uses SSSE3 byte shuffles when the CPU has them
+ */
+void gf_mul_add(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len);
+
+#endif /* FEC_H */
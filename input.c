@@ -0,0 +1,167 @@
+/**
+ * Line reader for the sender's text input
+ *
+ * CMPT 434 - A2
+ * Steven Rau
+ * scr108
+ * 11115094
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "input.h"
+
+/*-----------------------------------------------------------------------------
+ * Helper functions
+ * --------------------------------------------------------------------------*/
+
+static long now_ms(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec * 1000L + now.tv_nsec / 1000000L;
+}
+
+/**
+ * Copies up to max_len bytes of a line out of the buffer
+ */
+static int take_line(struct line_input *in, size_t line_len, char *line, size_t max_len)
+{
+    size_t n = line_len < max_len ? line_len : max_len;
+
+    memcpy(line, &in->buf[in->start], n);
+
+    return (int)n;
+}
+
+/*-----------------------------------------------------------------------------
+ *
+ * --------------------------------------------------------------------------*/
+
+void input_init(struct line_input *in, int fd)
+{
+    in->fd = fd;
+    in->eof = false;
+    in->truncating = false;
+    in->start = 0;
+    in->end = 0;
+}
+
+int input_read_line(struct line_input *in, char *line, size_t max_len, int timeout_ms)
+{
+    long deadline = timeout_ms >= 0 ? now_ms() + timeout_ms : 0;
+    struct pollfd pfd;
+    char *nl;
+    size_t line_len;
+    ssize_t n;
+    int n_copied;
+    int wait_ms;
+    int rv;
+
+    while (1)
+    {
+        nl = memchr(&in->buf[in->start], '\n', in->end - in->start);
+
+        /* Skip whatever is left of a line that was already cut off */
+        if (in->truncating)
+        {
+            if (nl != NULL)
+            {
+                in->start = nl - in->buf + 1;
+                in->truncating = false;
+
+                continue;
+            }
+
+            in->start = in->end;
+        }
+        /* A full line is buffered */
+        else if (nl != NULL)
+        {
+            line_len = nl - &in->buf[in->start] + 1;
+            n_copied = take_line(in, line_len, line, max_len);
+            in->start += line_len;
+
+            return n_copied;
+        }
+        /* The line is already too long, so send what fits and drop the rest */
+        else if (in->end - in->start >= max_len)
+        {
+            n_copied = take_line(in, max_len, line, max_len);
+            in->start = in->end;
+            in->truncating = true;
+
+            return n_copied;
+        }
+        /* Last line with no newline at the end of the input */
+        else if (in->eof)
+        {
+            if (in->end > in->start)
+            {
+                n_copied = take_line(in, in->end - in->start, line, max_len);
+                in->start = in->end;
+
+                return n_copied;
+            }
+
+            return -1;
+        }
+
+        /* Make room and wait for more input */
+        if (in->start > 0)
+        {
+            memmove(in->buf, &in->buf[in->start], in->end - in->start);
+            in->end -= in->start;
+            in->start = 0;
+        }
+
+        if (timeout_ms >= 0)
+        {
+            wait_ms = (int)(deadline - now_ms());
+            if (wait_ms < 0)
+            {
+                wait_ms = 0;
+            }
+
+            pfd.fd = in->fd;
+            pfd.events = POLLIN;
+
+            /* A signal gets the caller back to check why it was sent (e.g. to stop) */
+            rv = poll(&pfd, 1, wait_ms);
+            if (rv < 0 && errno != EINTR)
+            {
+                perror("poll");
+            }
+            if (rv <= 0)
+            {
+                return 0;
+            }
+        }
+
+        n = read(in->fd, &in->buf[in->end], sizeof(in->buf) - in->end);
+        if (n < 0 && errno == EINTR)
+        {
+            return 0;
+        }
+        if (n <= 0)
+        {
+            if (n < 0)
+            {
+                perror("read");
+            }
+
+            in->eof = true;
+
+            continue;
+        }
+
+        in->end += n;
+    }
+}
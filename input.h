@@ -0,0 +1,51 @@
+/**
+ * Line reader for the sender's text input
+ *
+ * Reads straight from the file descriptor into a fixed buffer (rather than
+ * through stdio), so the sender can tell whether another line is already
+ * waiting and wait for one with a timeout.
+ *
+ * CMPT 434 - A2
+ * Steven Rau
+ * scr108
+ * 11115094
+ */
+
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Size of the read buffer. Must be larger than the longest line kept */
+#define INPUT_BUF_SIZE  8192
+
+struct line_input
+{
+    int fd;
+    bool eof;
+    bool truncating;    /* Discarding the rest of a line that was too long */
+    size_t start;       /* First unread byte in buf */
+    size_t end;         /* One past the last byte read into buf */
+    char buf[INPUT_BUF_SIZE];
+};
+
+void input_init(struct line_input *in, int fd);
+
+/**
+ * Reads the next line (including its newline)
+ *
+ * Lines longer than max_len are cut off at max_len characters and the rest
+ * of the line is skipped, the same as the max message length.
+ *
+ * @param[in]  in          The reader
+ * @param[out] line        Buffer to hold the line (not NUL terminated)
+ * @param[in]  max_len     Size of the line buffer
+ * @param[in]  timeout_ms  How long to wait for a line, or -1 to wait forever
+ *
+ * Returns the length of the line, 0 if no line arrived in time (or a signal interrupted the wait),
+ * or -1 at end of input
+ */
+int input_read_line(struct line_input *in, char *line, size_t max_len, int timeout_ms);
+
+#endif /* INPUT_H */
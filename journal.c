@@ -0,0 +1,137 @@
+/**
+ * On-disk journal of transfer progress, for resuming after a restart
+ *
+ * CMPT 434 - A2
+ * Steven Rau
+ * scr108
+ * 11115094
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "journal.h"
+#include "crc32c.h"
+
+/*-----------------------------------------------------------------------------
+ * File-scope constants & globals
+ * --------------------------------------------------------------------------*/
+
+#define JOURNAL_MAGIC    0x4a515241  /* "ARQJ" */
+#define JOURNAL_VERSION  1
+
+/*-----------------------------------------------------------------------------
+ * Helper functions
+ * --------------------------------------------------------------------------*/
+
+static uint32_t journal_crc(const struct journal_record *rec)
+{
+    return crc32c(0, rec, offsetof(struct journal_record, crc));
+}
+
+/**
+ * Reads copy i of the record, returning false if it is missing or damaged
+ */
+static bool journal_read_copy(int fd, int i, struct journal_record *rec)
+{
+    if (pread(fd, rec, sizeof(*rec), i * sizeof(*rec)) != sizeof(*rec))
+    {
+        return false;
+    }
+
+    return rec->magic == JOURNAL_MAGIC && rec->version == JOURNAL_VERSION && rec->crc == journal_crc(rec);
+}
+
+/*-----------------------------------------------------------------------------
+ * Journal
+ * --------------------------------------------------------------------------*/
+
+bool journal_open(struct journal *j, const char *path, uint8_t role, int num_streams)
+{
+    struct journal_record copies[2];
+    bool valid[2];
+    int newest;
+
+    memset(j, 0, sizeof(*j));
+    j->fd = -1;
+
+    if ((j->fd = open(path, O_RDWR | O_CREAT, 0644)) == -1)
+    {
+        perror("journal open");
+
+        return false;
+    }
+
+    valid[0] = journal_read_copy(j->fd, 0, &copies[0]);
+    valid[1] = journal_read_copy(j->fd, 1, &copies[1]);
+
+    /* A new journal starts every stream at 0 */
+    if (!valid[0] && !valid[1])
+    {
+        j->rec.magic = JOURNAL_MAGIC;
+        j->rec.version = JOURNAL_VERSION;
+        j->rec.role = role;
+        j->rec.num_streams = num_streams;
+
+        return true;
+    }
+
+    newest = !valid[0] || (valid[1] && copies[1].generation > copies[0].generation);
+    j->rec = copies[newest];
+
+    if (j->rec.role != role)
+    {
+        fprintf(stderr, "Journal %s was written by the %s\n", path,
+                j->rec.role == JOURNAL_SENDER ? "sender" : "receiver");
+    }
+    else if (j->rec.num_streams != num_streams)
+    {
+        fprintf(stderr, "Journal %s was written with %u streams, not %d\n", path,
+                j->rec.num_streams, num_streams);
+    }
+    else
+    {
+        return true;
+    }
+
+    close(j->fd);
+    j->fd = -1;
+
+    return false;
+}
+
+void journal_record(struct journal *j, int stream, uint32_t next, uint32_t sent)
+{
+    if (j->fd == -1)
+    {
+        return;
+    }
+
+    if (j->rec.next[stream] == next && j->rec.sent[stream] == sent)
+    {
+        return;
+    }
+    j->rec.next[stream] = next;
+    j->rec.sent[stream] = sent;
+
+    /* Alternate between the two copies, so the last one written is never the one overwritten */
+    j->rec.generation++;
+    j->rec.crc = journal_crc(&j->rec);
+
+    if (pwrite(j->fd, &j->rec, sizeof(j->rec), (j->rec.generation % 2) * sizeof(j->rec)) != sizeof(j->rec))
+    {
+        perror("journal write");
+    }
+}
+
+void journal_close(struct journal *j)
+{
+    if (j->fd != -1)
+    {
+        close(j->fd);
+        j->fd = -1;
+    }
+}
@@ -0,0 +1,88 @@
+/**
+ * On-disk journal of transfer progress, for resuming after a restart
+ *
+ * The journal holds, for every stream, the first sequence number that
+ * still has to go through: on the sender, the first one not yet acked; on
+ * the receiver, the first one not yet delivered. A restarted pair reads
+ * them back and carries on from there, the sender skipping the lines of
+ * its (replayed) input that were already acked.
+ *
+ * The receiver records its progress before every ack it sends, so the
+ * sender's journal can never be ahead of it. Messages that were sent but
+ * not acked (the unacked range, up to the sender's next sequence number)
+ * are sent again after a restart, and anything the receiver already had
+ * is acked as a duplicate.
+ *
+ * The file holds two copies of the record, written alternately, each with
+ * a generation number and a CRC32C. A write torn by a crash leaves the
+ * other copy intact, and the newest intact copy is the one read back.
+ * Writes aren't synced to disk, so the journal survives the program
+ * restarting but not the machine losing power.
+ *
+ * CMPT 434 - A2
+ * Steven Rau
+ * scr108
+ * 11115094
+ */
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "shared.h"
+
+/* Which end wrote a journal, so one end's journal is never taken for the other's */
+#define JOURNAL_SENDER    's'
+#define JOURNAL_RECEIVER  'r'
+
+/* One copy of the journal's contents as it is on disk (host byte order) */
+struct journal_record
+{
+    uint32_t magic;
+    uint8_t version;
+    uint8_t role;                  /* JOURNAL_SENDER or JOURNAL_RECEIVER */
+    uint8_t num_streams;
+    uint8_t reserved;
+    uint64_t generation;           /* Bumped on every write. The newer copy wins */
+    uint32_t next[MAX_STREAMS];    /* First sequence number on each stream still to go through */
+    uint32_t sent[MAX_STREAMS];    /* Sender only: the next sequence number it would have given out */
+    uint32_t crc;                  /* CRC32C of everything above */
+};
+
+struct journal
+{
+    int fd;                        /* -1 when no journal is kept */
+    struct journal_record rec;
+};
+
+/**
+ * Opens (or creates) a journal and reads back the progress recorded in it
+ *
+ * A journal written by the other end, or with a different number of streams, is refused, since
+ * resuming from it would skip or repeat lines
+ *
+ * @param[out] j            The journal. rec.next[] holds where each stream resumes (0 if new)
+ * @param[in]  path         File to keep it in
+ * @param[in]  role         JOURNAL_SENDER or JOURNAL_RECEIVER
+ * @param[in]  num_streams  Streams open
+ *
+ * Returns false (with a message printed) if the journal can't be used
+ */
+bool journal_open(struct journal *j, const char *path, uint8_t role, int num_streams);
+
+/**
+ * Records a stream's progress, writing the journal out if it moved (the sender calls it once per
+ * wait for an ack, so that is at most one write each)
+ *
+ * @param[in] j       The journal (does nothing if fd is -1)
+ * @param[in] stream  The stream
+ * @param[in] next    First sequence number still to go through
+ * @param[in] sent    Sender only: its next sequence number (ignored on the receiver)
+ */
+void journal_record(struct journal *j, int stream, uint32_t next, uint32_t sent);
+
+void journal_close(struct journal *j);
+
+#endif /* JOURNAL_H */
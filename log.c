@@ -0,0 +1,580 @@
+/**
+ * Asynchronous leveled logger
+ *
+ * CMPT 434 - A2
+ * Steven Rau
+ * scr108
+ * 11115094
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stddef.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "log.h"
+
+/*-----------------------------------------------------------------------------
+ * File-scope constants & globals
+ * --------------------------------------------------------------------------*/
+
+/* Number of records in each thread's ring (must be a power of 2) */
+#define LOG_RING_SIZE  512
+
+/* How long the log thread sleeps when every ring is empty */
+#define LOG_IDLE_NSEC  5000000L
+
+/* Marks a NULL %s argument */
+#define LOG_STR_NULL  UINT16_MAX
+
+/* One argument as captured by the producer. Integers are widened to 64 bits */
+union log_arg
+{
+    int64_t i;
+    uint64_t u;
+    double d;
+    const void *p;
+    uint16_t str_off;   /* Offset of a %s string in the record's inline string area */
+};
+
+/* Compact binary log record */
+struct log_record
+{
+    uint64_t ts_ns;
+    const char *fmt;
+    uint8_t level;
+    uint8_t nargs;
+    uint16_t str_used;
+    union log_arg args[LOG_MAX_ARGS];
+    char str[LOG_STR_BYTES];
+};
+
+/* Single producer (the owning thread) single consumer (the log thread) ring */
+struct log_ring
+{
+    uint64_t head;      /* Next slot the producer writes */
+    uint64_t tail;      /* Next slot the consumer reads */
+    uint64_t dropped;   /* Records dropped because the ring was full */
+    uint64_t dropped_reported;
+    struct log_record rec[LOG_RING_SIZE];
+    struct log_ring *next;
+};
+
+int log_level = LOG_INFO;
+
+static _Thread_local struct log_ring *local_ring = NULL;
+
+/* Every thread's ring. Rings are never freed so late records from exited threads still get out */
+static struct log_ring *all_rings = NULL;
+static pthread_mutex_t rings_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Held while draining so the exit path and the log thread never consume the same ring at once */
+static pthread_mutex_t drain_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Flush handshake between log_flush() and the log thread */
+static pthread_mutex_t flush_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t flush_wake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t flush_done_cond = PTHREAD_COND_INITIALIZER;
+static uint64_t flush_requested = 0;
+static uint64_t flush_done = 0;
+
+static bool log_started = false;
+
+/*-----------------------------------------------------------------------------
+ * Helper functions
+ * --------------------------------------------------------------------------*/
+
+/**
+ * Describes one conversion in a format string
+ */
+struct log_spec
+{
+    const char *start;  /* Points at the '%' */
+    size_t len;         /* Length of the whole spec including the conversion character */
+    char length[3];     /* Length modifier ("", "h", "hh", "l", "ll", "z", "j", "t" or "L") */
+    char conv;          /* Conversion character, or 0 at the end of the format */
+};
+
+/**
+ * Finds the next conversion in a format string
+ *
+ * @param[in]  fmt   Where to start looking
+ * @param[out] spec  The conversion found
+ *
+ * Returns a pointer just past the conversion, or NULL if there are no more
+ */
+static const char *log_next_spec(const char *fmt, struct log_spec *spec)
+{
+    const char *p;
+    int n = 0;
+
+    while ((p = strchr(fmt, '%')) != NULL && p[1] == '%')
+    {
+        fmt = p + 2;
+    }
+
+    if (p == NULL)
+    {
+        return NULL;
+    }
+
+    spec->start = p++;
+
+    /* Flags, width and precision */
+    while (*p != '\0' && strchr("-+ #0'.123456789", *p) != NULL)
+    {
+        p++;
+    }
+
+    /* Length modifier */
+    while (*p != '\0' && strchr("hlzjtL", *p) != NULL)
+    {
+        if (n < 2)
+        {
+            spec->length[n++] = *p;
+        }
+        p++;
+    }
+    spec->length[n] = '\0';
+
+    spec->conv = *p;
+    if (*p != '\0')
+    {
+        p++;
+    }
+    spec->len = p - spec->start;
+
+    return p;
+}
+
+static struct log_ring *log_register_thread(void)
+{
+    struct log_ring *r = calloc(1, sizeof(struct log_ring));
+
+    if (r == NULL)
+    {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&rings_lock);
+    r->next = all_rings;
+    all_rings = r;
+    pthread_mutex_unlock(&rings_lock);
+
+    local_ring = r;
+
+    return r;
+}
+
+/**
+ * Captures the arguments of a log call into a record, following the format string
+ */
+static void log_capture(struct log_record *rec, const char *fmt, va_list ap)
+{
+    struct log_spec spec;
+    const char *p = fmt;
+    const char *s;
+    size_t s_len;
+    union log_arg *arg;
+
+    rec->nargs = 0;
+    rec->str_used = 0;
+
+    while ((p = log_next_spec(p, &spec)) != NULL && rec->nargs < LOG_MAX_ARGS)
+    {
+        arg = &rec->args[rec->nargs];
+
+        switch (spec.conv)
+        {
+            case 'd':
+            case 'i':
+                if (strcmp(spec.length, "ll") == 0 || strcmp(spec.length, "j") == 0)
+                    arg->i = va_arg(ap, long long);
+                else if (spec.length[0] == 'l' || spec.length[0] == 'z' || spec.length[0] == 't')
+                    arg->i = va_arg(ap, long);
+                else if (strcmp(spec.length, "hh") == 0)
+                    arg->i = (signed char)va_arg(ap, int);
+                else if (spec.length[0] == 'h')
+                    arg->i = (short)va_arg(ap, int);
+                else
+                    arg->i = va_arg(ap, int);
+                break;
+            case 'u':
+            case 'x':
+            case 'X':
+            case 'o':
+            case 'c':
+                if (strcmp(spec.length, "ll") == 0 || strcmp(spec.length, "j") == 0)
+                    arg->u = va_arg(ap, unsigned long long);
+                else if (spec.length[0] == 'l' || spec.length[0] == 'z' || spec.length[0] == 't')
+                    arg->u = va_arg(ap, unsigned long);
+                else if (strcmp(spec.length, "hh") == 0)
+                    arg->u = (unsigned char)va_arg(ap, unsigned int);
+                else if (spec.length[0] == 'h')
+                    arg->u = (unsigned short)va_arg(ap, unsigned int);
+                else
+                    arg->u = va_arg(ap, unsigned int);
+                break;
+            case 'e':
+            case 'E':
+            case 'f':
+            case 'F':
+            case 'g':
+            case 'G':
+            case 'a':
+            case 'A':
+                if (spec.length[0] == 'L')
+                    arg->d = (double)va_arg(ap, long double);
+                else
+                    arg->d = va_arg(ap, double);
+                break;
+            case 'p':
+                arg->p = va_arg(ap, void *);
+                break;
+            case 's':
+                s = va_arg(ap, const char *);
+                if (s == NULL)
+                {
+                    arg->str_off = LOG_STR_NULL;
+                    break;
+                }
+                /* Copy as much of the string as still fits, always NUL terminated */
+                arg->str_off = rec->str_used;
+                s_len = strnlen(s, LOG_STR_BYTES);
+                if (s_len > LOG_STR_BYTES - 1 - rec->str_used)
+                {
+                    s_len = LOG_STR_BYTES - 1 - rec->str_used;
+                }
+                memcpy(&rec->str[rec->str_used], s, s_len);
+                rec->str[rec->str_used + s_len] = '\0';
+                rec->str_used += s_len + (rec->str_used + s_len < LOG_STR_BYTES - 1 ? 1 : 0);
+                break;
+            default:
+                /* Unsupported conversion, stop capturing so the arguments don't get misaligned */
+                return;
+        }
+
+        rec->nargs++;
+    }
+}
+
+/**
+ * Formats a record back into text, the way printf would have
+ */
+static void log_format(struct log_record *rec, char *out, size_t out_size)
+{
+    struct log_spec spec;
+    const char *p = rec->fmt;
+    const char *next;
+    char piece[64];
+    size_t used = 0;
+    size_t n;
+    int i = 0;
+    union log_arg *arg;
+
+    out[0] = '\0';
+
+    while (used < out_size - 1)
+    {
+        next = log_next_spec(p, &spec);
+
+        /* Copy the literal text up to the conversion (or the end), collapsing "%%" */
+        n = next != NULL ? (size_t)(spec.start - p) : strlen(p);
+        while (n > 0 && used < out_size - 1)
+        {
+            out[used++] = *p;
+            if (*p == '%' && n > 1)
+            {
+                p++;
+                n--;
+            }
+            p++;
+            n--;
+        }
+        out[used] = '\0';
+        if (next == NULL || used >= out_size - 1)
+        {
+            break;
+        }
+
+        /* Rebuild the conversion without its length modifier and add back the one that
+         * matches how the argument was captured */
+        n = spec.len - 1 - strlen(spec.length);
+        if (n >= sizeof(piece) - 4)
+        {
+            break;
+        }
+        memcpy(piece, spec.start, n);
+        piece[n] = '\0';
+
+        arg = &rec->args[i++];
+
+        if (i > rec->nargs)
+        {
+            used += snprintf(out + used, out_size - used, "?");
+        }
+        else if (strchr("di", spec.conv) != NULL)
+        {
+            strcat(piece, "ll");
+            piece[n + 2] = spec.conv;
+            piece[n + 3] = '\0';
+            used += snprintf(out + used, out_size - used, piece, (long long)arg->i);
+        }
+        else if (strchr("uxXo", spec.conv) != NULL)
+        {
+            strcat(piece, "ll");
+            piece[n + 2] = spec.conv;
+            piece[n + 3] = '\0';
+            used += snprintf(out + used, out_size - used, piece, (unsigned long long)arg->u);
+        }
+        else if (spec.conv == 'c')
+        {
+            piece[n] = 'c';
+            piece[n + 1] = '\0';
+            used += snprintf(out + used, out_size - used, piece, (int)arg->u);
+        }
+        else if (strchr("eEfFgGaA", spec.conv) != NULL)
+        {
+            piece[n] = spec.conv;
+            piece[n + 1] = '\0';
+            used += snprintf(out + used, out_size - used, piece, arg->d);
+        }
+        else if (spec.conv == 'p')
+        {
+            piece[n] = 'p';
+            piece[n + 1] = '\0';
+            used += snprintf(out + used, out_size - used, piece, arg->p);
+        }
+        else if (spec.conv == 's')
+        {
+            piece[n] = 's';
+            piece[n + 1] = '\0';
+            used += snprintf(out + used, out_size - used, piece,
+                             arg->str_off == LOG_STR_NULL ? "(null)" : &rec->str[arg->str_off]);
+        }
+
+        p = next;
+    }
+}
+
+/**
+ * Writes out every record currently queued in every ring
+ *
+ * Records from different threads are merged by timestamp so the output
+ * keeps the order things actually happened in
+ *
+ * Returns the number of records written
+ */
+static int log_drain(void)
+{
+    struct log_ring *rings;
+    struct log_ring *r;
+    struct log_ring *oldest;
+    struct log_record *rec;
+    uint64_t dropped;
+    char line[1024];
+    int count = 0;
+
+    pthread_mutex_lock(&drain_lock);
+
+    pthread_mutex_lock(&rings_lock);
+    rings = all_rings;
+    pthread_mutex_unlock(&rings_lock);
+
+    while (1)
+    {
+        /* Find the ring whose next record is the oldest */
+        oldest = NULL;
+        for (r = rings; r != NULL; r = r->next)
+        {
+            if (r->tail < __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) &&
+                (oldest == NULL || r->rec[r->tail & (LOG_RING_SIZE - 1)].ts_ns <
+                                   oldest->rec[oldest->tail & (LOG_RING_SIZE - 1)].ts_ns))
+            {
+                oldest = r;
+            }
+        }
+
+        if (oldest == NULL)
+        {
+            break;
+        }
+
+        rec = &oldest->rec[oldest->tail & (LOG_RING_SIZE - 1)];
+
+        log_format(rec, line, sizeof(line));
+        fputs(line, rec->level <= LOG_WARN ? stderr : stdout);
+
+        __atomic_store_n(&oldest->tail, oldest->tail + 1, __ATOMIC_RELEASE);
+        count++;
+    }
+
+    for (r = rings; r != NULL; r = r->next)
+    {
+        dropped = __atomic_load_n(&r->dropped, __ATOMIC_RELAXED);
+        if (dropped != r->dropped_reported)
+        {
+            fprintf(stderr, "[log: %llu records dropped]\n",
+                    (unsigned long long)(dropped - r->dropped_reported));
+            r->dropped_reported = dropped;
+        }
+    }
+
+    if (count > 0)
+    {
+        fflush(stdout);
+    }
+
+    pthread_mutex_unlock(&drain_lock);
+
+    return count;
+}
+
+/**
+ * Background thread that formats and writes out the records
+ */
+static void *log_thread(void *arg)
+{
+    struct timespec wake;
+    uint64_t requested;
+
+    while (1)
+    {
+        if (log_drain() > 0)
+        {
+            continue;
+        }
+
+        pthread_mutex_lock(&flush_lock);
+
+        requested = flush_requested;
+        if (requested != flush_done)
+        {
+            pthread_mutex_unlock(&flush_lock);
+
+            /* Everything logged before the flush request is in the rings by now */
+            log_drain();
+
+            pthread_mutex_lock(&flush_lock);
+            flush_done = requested;
+            pthread_cond_broadcast(&flush_done_cond);
+        }
+        else
+        {
+            clock_gettime(CLOCK_REALTIME, &wake);
+            wake.tv_nsec += LOG_IDLE_NSEC;
+            if (wake.tv_nsec >= 1000000000L)
+            {
+                wake.tv_sec++;
+                wake.tv_nsec -= 1000000000L;
+            }
+
+            pthread_cond_timedwait(&flush_wake, &flush_lock, &wake);
+        }
+
+        pthread_mutex_unlock(&flush_lock);
+    }
+
+    return NULL;
+}
+
+static void log_drain_at_exit(void)
+{
+    log_drain();
+    fflush(stdout);
+}
+
+/*-----------------------------------------------------------------------------
+ *
+ * --------------------------------------------------------------------------*/
+
+void log_write(int level, const char *fmt, ...)
+{
+    struct log_ring *r = local_ring;
+    struct log_record *rec;
+    struct timespec now;
+    uint64_t head;
+    va_list ap;
+
+    va_start(ap, fmt);
+
+    /* Before the log thread is running (or if a ring can't be allocated) just print directly */
+    if (!log_started || (r == NULL && (r = log_register_thread()) == NULL))
+    {
+        vfprintf(level <= LOG_WARN ? stderr : stdout, fmt, ap);
+        va_end(ap);
+
+        return;
+    }
+
+    head = r->head;
+
+    if (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) >= LOG_RING_SIZE)
+    {
+        __atomic_store_n(&r->dropped, r->dropped + 1, __ATOMIC_RELAXED);
+        va_end(ap);
+
+        return;
+    }
+
+    rec = &r->rec[head & (LOG_RING_SIZE - 1)];
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    rec->ts_ns = (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+    rec->fmt = fmt;
+    rec->level = level;
+    log_capture(rec, fmt, ap);
+
+    va_end(ap);
+
+    __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+}
+
+void log_flush(void)
+{
+    uint64_t mine;
+
+    if (!log_started)
+    {
+        fflush(stdout);
+
+        return;
+    }
+
+    pthread_mutex_lock(&flush_lock);
+
+    mine = ++flush_requested;
+    pthread_cond_signal(&flush_wake);
+
+    while (flush_done < mine)
+    {
+        pthread_cond_wait(&flush_done_cond, &flush_lock);
+    }
+
+    pthread_mutex_unlock(&flush_lock);
+}
+
+void log_start(int level)
+{
+    pthread_t tid;
+    int rv;
+
+    log_level = level;
+
+    if ((rv = pthread_create(&tid, NULL, log_thread, NULL)) != 0)
+    {
+        fprintf(stderr, "log: pthread_create: %s\n", strerror(rv));
+
+        return;
+    }
+
+    pthread_detach(tid);
+
+    log_started = true;
+
+    atexit(log_drain_at_exit);
+}
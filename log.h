@@ -0,0 +1,71 @@
+/**
+ * Asynchronous leveled logger
+ *
+ * Log calls on the data path don't format anything. The format string
+ * pointer and the raw arguments are copied into a compact binary record in
+ * a per-thread ring, and a background thread does the formatting and the
+ * I/O. Records are dropped (and counted) rather than blocking when a ring
+ * is full.
+ *
+ * Format strings must be string literals (only the pointer is stored) and
+ * support the usual integer, double, %c, %p and %s conversions. Strings
+ * are copied into the record and truncated to LOG_STR_BYTES in total.
+ *
+ * CMPT 434 - A2
+ * Steven Rau
+ * scr108
+ * 11115094
+ */
+
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdbool.h>
+
+/* Log levels. Anything logged per packet should use LOG_DEBUG */
+#define LOG_ERROR  0
+#define LOG_WARN   1
+#define LOG_INFO   2
+#define LOG_DEBUG  3
+
+/* Max number of arguments and inline string bytes carried in one record */
+#define LOG_MAX_ARGS   8
+#define LOG_STR_BYTES  96
+
+/* Current verbosity. Records above this level are skipped before any work is done */
+extern int log_level;
+
+void log_write(int level, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+/**
+ * Logs a record if the level is enabled. The level check is inlined so
+ * disabled data path logging costs a single compare
+ */
+#define LOG(level, ...) \
+    do { if ((level) <= log_level) log_write((level), __VA_ARGS__); } while (0)
+
+#define LOG_ERR(...)   LOG(LOG_ERROR, __VA_ARGS__)
+#define LOG_WRN(...)   LOG(LOG_WARN, __VA_ARGS__)
+#define LOG_INF(...)   LOG(LOG_INFO, __VA_ARGS__)
+#define LOG_DBG(...)   LOG(LOG_DEBUG, __VA_ARGS__)
+
+static inline bool log_enabled(int level)
+{
+    return level <= log_level;
+}
+
+/**
+ * Starts the background log thread
+ *
+ * @param[in] level  Verbosity (LOG_ERROR to LOG_DEBUG)
+ */
+void log_start(int level);
+
+/**
+ * Blocks until every record logged so far has been written out. Used before
+ * prompting the user so the prompt shows up after the context it refers to
+ */
+void log_flush(void);
+
+#endif /* LOG_H */
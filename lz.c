@@ -0,0 +1,259 @@
+/**
+ * Small, fast LZ77 codec used to compress message text
+ *
+ * CMPT 434 - A2
+ * Steven Rau
+ * scr108
+ * 11115094
+ */
+
+#include <string.h>
+
+#include "lz.h"
+
+/*-----------------------------------------------------------------------------
+ * Helper functions
+ * --------------------------------------------------------------------------*/
+
+static inline uint32_t read32(const uint8_t *p)
+{
+    uint32_t v;
+
+    memcpy(&v, p, sizeof(v));
+
+    return v;
+}
+
+static inline uint32_t lz_hash(uint32_t v)
+{
+    return (v * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+/**
+ * Writes a length that didn't fit in its token nibble as a run of 255s plus a remainder
+ *
+ * Returns the new output position, or -1 if it doesn't fit
+ */
+static int put_length(uint8_t *dst, int op, int dst_cap, int len)
+{
+    while (len >= 255)
+    {
+        if (op >= dst_cap)
+        {
+            return -1;
+        }
+        dst[op++] = 255;
+        len -= 255;
+    }
+
+    if (op >= dst_cap)
+    {
+        return -1;
+    }
+    dst[op++] = (uint8_t)len;
+
+    return op;
+}
+
+/**
+ * Writes one sequence: literals followed by an optional match (match_len 0 for the last one)
+ *
+ * Returns the new output position, or -1 if it doesn't fit
+ */
+static int put_sequence(uint8_t *dst, int op, int dst_cap, const uint8_t *lit, int lit_len,
+                        int offset, int match_len)
+{
+    int ml = match_len > 0 ? match_len - LZ_MIN_MATCH : 0;
+
+    if (op >= dst_cap)
+    {
+        return -1;
+    }
+
+    dst[op++] = (uint8_t)(((lit_len >= 15 ? 15 : lit_len) << 4) | (ml >= 15 ? 15 : ml));
+
+    if (lit_len >= 15 && (op = put_length(dst, op, dst_cap, lit_len - 15)) < 0)
+    {
+        return -1;
+    }
+
+    if (op + lit_len > dst_cap)
+    {
+        return -1;
+    }
+    memcpy(&dst[op], lit, lit_len);
+    op += lit_len;
+
+    if (match_len == 0)
+    {
+        return op;
+    }
+
+    if (op + 2 > dst_cap)
+    {
+        return -1;
+    }
+    dst[op++] = offset & 0xFF;
+    dst[op++] = offset >> 8;
+
+    if (ml >= 15 && (op = put_length(dst, op, dst_cap, ml - 15)) < 0)
+    {
+        return -1;
+    }
+
+    return op;
+}
+
+/**
+ * Reads a length continued past its token nibble
+ *
+ * Returns the new input position, or -1 if the input runs out
+ */
+static int get_length(const uint8_t *src, int ip, int src_len, int *len)
+{
+    uint8_t b;
+
+    do
+    {
+        if (ip >= src_len)
+        {
+            return -1;
+        }
+        b = src[ip++];
+        *len += b;
+    } while (b == 255 && *len < LZ_MAX_BLOCK);
+
+    return ip;
+}
+
+/*-----------------------------------------------------------------------------
+ *
+ * --------------------------------------------------------------------------*/
+
+int lz_compress(const uint8_t *src, int src_len, uint8_t *dst, int dst_cap, uint16_t *table)
+{
+    int ip = 0;
+    int anchor = 0;
+    int ref;
+    int len;
+    int op = 0;
+    uint32_t seq;
+    uint32_t h;
+
+    if (src_len > LZ_MAX_BLOCK)
+    {
+        return 0;
+    }
+
+    memset(table, 0, LZ_HASH_SIZE * sizeof(uint16_t));
+
+    while (ip + LZ_MIN_MATCH <= src_len)
+    {
+        seq = read32(&src[ip]);
+        h = lz_hash(seq);
+        ref = table[h];
+        table[h] = (uint16_t)ip;
+
+        if (ref >= ip || read32(&src[ref]) != seq)
+        {
+            /* Skip ahead faster the longer it's been since the last match */
+            ip += 1 + ((ip - anchor) >> 6);
+
+            continue;
+        }
+
+        /* Extend the match as far as it goes */
+        len = LZ_MIN_MATCH;
+        while (ip + len < src_len && src[ref + len] == src[ip + len])
+        {
+            len++;
+        }
+
+        op = put_sequence(dst, op, dst_cap, &src[anchor], ip - anchor, ip - ref, len);
+        if (op < 0)
+        {
+            return 0;
+        }
+
+        ip += len;
+        anchor = ip;
+
+        /* Remember a position near the end of the match to help find the next one */
+        if (ip - 2 >= 0 && ip + 2 <= src_len)
+        {
+            table[lz_hash(read32(&src[ip - 2]))] = (uint16_t)(ip - 2);
+        }
+    }
+
+    op = put_sequence(dst, op, dst_cap, &src[anchor], src_len - anchor, 0, 0);
+
+    return op < 0 ? 0 : op;
+}
+
+int lz_decompress(const uint8_t *src, int src_len, uint8_t *dst, int dst_cap)
+{
+    int ip = 0;
+    int op = 0;
+    int lit_len;
+    int match_len;
+    int offset;
+    uint8_t token;
+
+    while (ip < src_len)
+    {
+        token = src[ip++];
+
+        lit_len = token >> 4;
+        if (lit_len == 15 && (ip = get_length(src, ip, src_len, &lit_len)) < 0)
+        {
+            return -1;
+        }
+
+        if (ip + lit_len > src_len || op + lit_len > dst_cap)
+        {
+            return -1;
+        }
+        memcpy(&dst[op], &src[ip], lit_len);
+        ip += lit_len;
+        op += lit_len;
+
+        /* The last sequence has no match */
+        if (ip == src_len)
+        {
+            break;
+        }
+
+        if (ip + 2 > src_len)
+        {
+            return -1;
+        }
+        offset = src[ip] | (src[ip + 1] << 8);
+        ip += 2;
+
+        if (offset == 0 || offset > op)
+        {
+            return -1;
+        }
+
+        match_len = token & 15;
+        if (match_len == 15 && (ip = get_length(src, ip, src_len, &match_len)) < 0)
+        {
+            return -1;
+        }
+        match_len += LZ_MIN_MATCH;
+
+        if (op + match_len > dst_cap)
+        {
+            return -1;
+        }
+
+        /* Byte at a time, since the match may overlap the bytes it is producing */
+        while (match_len-- > 0)
+        {
+            dst[op] = dst[op - offset];
+            op++;
+        }
+    }
+
+    return op;
+}
@@ -0,0 +1,59 @@
+/**
+ * Small, fast LZ77 codec used to compress message text
+ *
+ * The block format follows LZ4: a sequence of (literals, match) pairs, each
+ * starting with a token byte whose high nibble is the literal count and
+ * low nibble the match length minus LZ_MIN_MATCH (15 in either nibble
+ * means more length bytes follow). Each match is a 2 byte little endian
+ * offset back into the output. The final sequence has literals only.
+ *
+ * Blocks are limited to 64 KB. Nothing is allocated: the compressor works
+ * in a hash table supplied by the caller.
+ *
+ * CMPT 434 - A2
+ * Steven Rau
+ * scr108
+ * 11115094
+ */
+
+#ifndef LZ_H
+#define LZ_H
+
+#include <stdint.h>
+
+/* Number of entries in the compressor's hash table (must be a power of 2) */
+#define LZ_HASH_BITS  12
+#define LZ_HASH_SIZE  (1 << LZ_HASH_BITS)
+
+/* Shortest match worth encoding */
+#define LZ_MIN_MATCH  4
+
+/* Largest block the codec handles (offsets and table entries are 16 bits) */
+#define LZ_MAX_BLOCK  65535
+
+/**
+ * Compresses a block
+ *
+ * @param[in]  src      Data to compress
+ * @param[in]  src_len  Number of bytes in src (at most LZ_MAX_BLOCK)
+ * @param[out] dst      Output buffer
+ * @param[in]  dst_cap  Size of the output buffer
+ * @param[in]  table    Scratch hash table of LZ_HASH_SIZE entries
+ *
+ * Returns the compressed size, or 0 if the result wouldn't fit in dst_cap
+ */
+int lz_compress(const uint8_t *src, int src_len, uint8_t *dst, int dst_cap, uint16_t *table);
+
+/**
+ * Decompresses a block. The input is checked, so it is safe on data from the network
+ *
+ * @param[in]  src      Compressed data
+ * @param[in]  src_len  Number of bytes in src
+ * @param[out] dst      Output buffer
+ * @param[in]  dst_cap  Size of the output buffer
+ *
+ * Returns the decompressed size, or -1 if the block is malformed or too big for dst
+ */
+int lz_decompress(const uint8_t *src, int src_len, uint8_t *dst, int dst_cap);
+
+#endif /* LZ_H */
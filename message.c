@@ -0,0 +1,251 @@
+/**
+ * Helpers for building, sealing and reading struct message
+ *
+ * CMPT 434 - A2
+ * Steven Rau
+ * scr108
+ * 11115094
+ */
+
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#include "message.h"
+#include "crc32c.h"
+#include "log.h"
+#include "stats.h"
+
+/* The header size is used on its own for wire lengths, so make sure it matches the struct */
+_Static_assert(offsetof(struct message, text) == MSG_HEADER_SIZE, "MSG_HEADER_SIZE out of date");
+
+size_t msg_payload_limit = DEFAULT_DATAGRAM_SIZE - MSG_HEADER_SIZE;
+
+void msg_set_max_datagram(size_t bytes)
+{
+    if (bytes < MSG_MIN_DATAGRAM)
+    {
+        bytes = MSG_MIN_DATAGRAM;
+    }
+
+    msg_payload_limit = bytes < MAX_DATAGRAM_SIZE ? bytes - MSG_HEADER_SIZE : MAX_PAYLOAD_LENGTH;
+}
+
+void msg_init(struct message *msg, uint32_t seq)
+{
+    memset(msg, 0, MSG_HEADER_SIZE);
+
+    msg->seq = htonl(seq);
+}
+
+bool msg_add_record(struct message *msg, const char *line, size_t line_len)
+{
+    uint16_t rec_len = htons((uint16_t)line_len);
+    uint16_t len = msg_text_len(msg);
+
+    if (!msg_has_room(msg, line_len))
+    {
+        return false;
+    }
+
+    memcpy(&msg->text[len], &rec_len, sizeof(rec_len));
+    memcpy(&msg->text[len + sizeof(rec_len)], line, line_len);
+
+    msg->len = htons(len + sizeof(rec_len) + line_len);
+    msg->count = htons(msg_count(msg) + 1);
+
+    return true;
+}
+
+bool msg_next_record(const struct message *msg, size_t *offset, const char **line, size_t *line_len)
+{
+    uint16_t rec_len;
+
+    if (*offset + sizeof(rec_len) > msg_text_len(msg))
+    {
+        return false;
+    }
+
+    memcpy(&rec_len, &msg->text[*offset], sizeof(rec_len));
+    rec_len = ntohs(rec_len);
+
+    if (*offset + sizeof(rec_len) + rec_len > msg_text_len(msg))
+    {
+        return false;
+    }
+
+    *line = &msg->text[*offset + sizeof(rec_len)];
+    *line_len = rec_len;
+    *offset += sizeof(rec_len) + rec_len;
+
+    return true;
+}
+
+void msg_trim_front(struct message *msg, uint32_t seq)
+{
+    size_t offset = 0;
+    const char *line;
+    size_t line_len;
+    uint32_t first = msg_seq(msg);
+    uint16_t len = msg_text_len(msg);
+
+    while (first < seq && msg_next_record(msg, &offset, &line, &line_len))
+    {
+        first++;
+    }
+
+    memmove(msg->text, &msg->text[offset], len - offset);
+
+    msg->len = htons(len - offset);
+    msg->count = htons(msg_count(msg) - (first - msg_seq(msg)));
+    msg->seq = htonl(first);
+}
+
+void compress_init(struct compress_stage *stage, double max_ns_per_byte)
+{
+    memset(stage, 0, sizeof(*stage));
+
+    stage->enabled = max_ns_per_byte > 0;
+    stage->max_ns_per_byte = max_ns_per_byte;
+    stage->ratio = 0.5;
+    stage->ns_per_byte = 0;
+}
+
+bool msg_compress(struct message *msg, struct compress_stage *stage)
+{
+    uint8_t out[MAX_PAYLOAD_LENGTH];
+    struct timespec start;
+    struct timespec end;
+    double elapsed_ns;
+    uint16_t len = msg_text_len(msg);
+    int out_len;
+    int max_out;
+
+    if (!stage->enabled || len == 0 || (msg->flags & MSG_FLAG_COMPRESSED))
+    {
+        return false;
+    }
+
+    /* While backed off, send everything as is */
+    if (stage->backoff > 0)
+    {
+        stage->backoff--;
+
+        return false;
+    }
+
+    /* Only keep the result if it saves enough to be worth decompressing */
+    max_out = (int)(len * (1.0 - COMPRESS_MIN_SAVINGS));
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    out_len = lz_compress((uint8_t *)msg->text, len, out, max_out, stage->table);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    elapsed_ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+
+    stage->ratio += ((out_len > 0 ? (double)out_len / len : 1.0) - stage->ratio) / 8;
+    stage->ns_per_byte += (elapsed_ns / len - stage->ns_per_byte) / 8;
+
+    /* Stop compressing for a while if it isn't paying off on average */
+    if (stage->ratio > 1.0 - COMPRESS_MIN_SAVINGS || stage->ns_per_byte > stage->max_ns_per_byte)
+    {
+        LOG_DBG("Compression not paying off (ratio %.2f, %.1f ns/byte), pausing for %u messages\n",
+                stage->ratio, stage->ns_per_byte, COMPRESS_BACKOFF_MSGS);
+
+        stage->backoff = COMPRESS_BACKOFF_MSGS;
+        stage->ratio = 0.5;
+        stage->ns_per_byte = 0;
+    }
+
+    if (out_len == 0)
+    {
+        return false;
+    }
+
+    stats_add(STAT_COMPRESS_IN_BYTES, len);
+    stats_add(STAT_COMPRESS_OUT_BYTES, out_len);
+
+    msg->raw_len = htons(len);
+    msg->len = htons(out_len);
+    msg->flags |= MSG_FLAG_COMPRESSED;
+    memcpy(msg->text, out, out_len);
+
+    return true;
+}
+
+bool msg_decompress(struct message *msg)
+{
+    uint8_t out[MAX_PAYLOAD_LENGTH];
+    int out_len;
+
+    if (!(msg->flags & MSG_FLAG_COMPRESSED))
+    {
+        return true;
+    }
+
+    out_len = lz_decompress((uint8_t *)msg->text, msg_text_len(msg), out, sizeof(out));
+    if (out_len < 0 || out_len != ntohs(msg->raw_len))
+    {
+        return false;
+    }
+
+    memcpy(msg->text, out, out_len);
+    msg->len = htons(out_len);
+    msg->raw_len = 0;
+    msg->flags &= ~MSG_FLAG_COMPRESSED;
+
+    return true;
+}
+
+void msg_seal(struct message *msg, uint32_t sec, uint32_t usec)
+{
+    msg->ts_sec = htonl(sec);
+    msg->ts_usec = htonl(usec);
+
+    msg->crc = 0;
+    msg->crc = htonl(crc32c(0, msg, msg_wire_len(msg)));
+}
+
+bool msg_intact(struct message *msg, int num_bytes)
+{
+    uint32_t recv_crc;
+
+    /* A message sent with GSO may be padded out to the batch's segment size */
+    if (num_bytes < MSG_HEADER_SIZE || num_bytes < msg_wire_len(msg) || msg_count(msg) == 0)
+    {
+        return false;
+    }
+
+    recv_crc = ntohl(msg->crc);
+    msg->crc = 0;
+
+    return crc32c(0, msg, msg_wire_len(msg)) == recv_crc;
+}
+
+void msg_log_records(const char *prefix, const struct message *msg)
+{
+    char text[MAX_TEXT_LENGTH + 1];
+    const char *line;
+    size_t line_len;
+    size_t offset = 0;
+    uint32_t seq = msg_seq(msg);
+
+    if (!log_enabled(LOG_DEBUG))
+    {
+        return;
+    }
+
+    while (msg_next_record(msg, &offset, &line, &line_len))
+    {
+        if (line_len > MAX_TEXT_LENGTH)
+        {
+            line_len = MAX_TEXT_LENGTH;
+        }
+        memcpy(text, line, line_len);
+        text[line_len] = '\0';
+
+        LOG_DBG("%sSeq #: %u   Text: %s", prefix, seq, text);
+
+        seq++;
+    }
+}
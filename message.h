@@ -0,0 +1,187 @@
+/**
+ * Helpers for building, sealing and reading struct message
+ *
+ * CMPT 434 - A2
+ * Steven Rau
+ * scr108
+ * 11115094
+ */
+
+#ifndef MESSAGE_H
+#define MESSAGE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <arpa/inet.h>
+
+#include "shared.h"
+#include "lz.h"
+#include "fec.h"
+
+/* Bytes each record takes up in a message on top of the line itself */
+#define MSG_RECORD_OVERHEAD  sizeof(uint16_t)
+
+/* Smallest datagram messages can be sized to: the header, and room for at least one byte of
+ * text after an FEC header (parity goes out as a message too) */
+#define MSG_MIN_DATAGRAM  (MSG_HEADER_SIZE + sizeof(struct fec_header) + 1)
+
+/* Most text a message built here may carry: enough for a DEFAULT_DATAGRAM_SIZE datagram, unless
+ * msg_set_max_datagram() changed it */
+extern size_t msg_payload_limit;
+
+/**
+ * Sizes every message built from here on to fit in bytes on the wire, e.g. the segment size agreed
+ * with the receiver or the path MTU found. Sizes outside MSG_MIN_DATAGRAM to MAX_DATAGRAM_SIZE are
+ * clamped to them. Messages received are still taken up to MAX_DATAGRAM_SIZE
+ */
+void msg_set_max_datagram(size_t bytes);
+
+/*
+ * A message's seq, count, len and raw_len are kept in network byte order, like the ack's fields,
+ * so it goes on the wire (and is checksummed) straight from memory. These read them
+ */
+static inline uint32_t msg_seq(const struct message *msg)
+{
+    return ntohl(msg->seq);
+}
+
+static inline uint16_t msg_count(const struct message *msg)
+{
+    return ntohs(msg->count);
+}
+
+static inline uint16_t msg_text_len(const struct message *msg)
+{
+    return ntohs(msg->len);
+}
+
+/**
+ * Gets the sequence number of the last record in a message
+ */
+static inline uint32_t msg_last_seq(const struct message *msg)
+{
+    return msg_seq(msg) + msg_count(msg) - 1;
+}
+
+/**
+ * Gets the number of bytes the message takes up on the wire
+ */
+static inline size_t msg_wire_len(const struct message *msg)
+{
+    return MSG_HEADER_SIZE + msg_text_len(msg);
+}
+
+/**
+ * Checks if a line of the given length still fits in the message
+ */
+static inline bool msg_has_room(const struct message *msg, size_t line_len)
+{
+    return msg_text_len(msg) + MSG_RECORD_OVERHEAD + line_len <= msg_payload_limit;
+}
+
+/* Compression has to save at least this fraction of the bytes to be worth it */
+#define COMPRESS_MIN_SAVINGS  0.10
+
+/* Default CPU budget for compression (nanoseconds spent per input byte) */
+#define COMPRESS_DEFAULT_NS_PER_BYTE  20.0
+
+/* Number of messages sent uncompressed after compression stops paying off, before trying again */
+#define COMPRESS_BACKOFF_MSGS  256
+
+/*
+ * Sender side compression stage
+ * 
+ * Keeps running averages of the compression ratio and cost, and turns
+ * itself off for a while when either one shows compression isn't paying off
+ */
+struct compress_stage
+{
+    bool enabled;           /* Compression was asked for */
+    double max_ns_per_byte; /* CPU budget */
+    double ratio;           /* Running average of compressed size / raw size */
+    double ns_per_byte;     /* Running average of compression cost */
+    uint32_t backoff;       /* Messages left to send uncompressed */
+    uint16_t table[LZ_HASH_SIZE];
+};
+
+/**
+ * Sets up a compression stage
+ * 
+ * @param[in] max_ns_per_byte  CPU budget, or 0 to turn compression off
+ */
+void compress_init(struct compress_stage *stage, double max_ns_per_byte);
+
+/**
+ * Compresses the text of a message in place, if the stage is on and it pays off
+ * 
+ * Returns true if the message was compressed
+ */
+bool msg_compress(struct message *msg, struct compress_stage *stage);
+
+/**
+ * Undoes msg_compress() on a received message. Messages that weren't compressed are left alone
+ * 
+ * Returns false if the compressed text is malformed
+ */
+bool msg_decompress(struct message *msg);
+
+/**
+ * Clears a message and gives it the sequence number of its first record
+ */
+void msg_init(struct message *msg, uint32_t seq);
+
+/**
+ * Appends a line as the next record of a message. Each record starts with its length (network
+ * byte order)
+ *
+ * Returns false (and leaves the message alone) if the line doesn't fit
+ */
+bool msg_add_record(struct message *msg, const char *line, size_t line_len);
+
+/**
+ * Iterates over the records of a message
+ *
+ * @param[in]     msg       The message
+ * @param[in,out] offset    Start at 0. Updated to point at the following record
+ * @param[out]    line      Start of the record's line (not NUL terminated)
+ * @param[out]    line_len  Length of the record's line
+ *
+ * Returns false once there are no more (well formed) records
+ */
+bool msg_next_record(const struct message *msg, size_t *offset, const char **line, size_t *line_len);
+
+/**
+ * Drops the records of a received (expanded) message that come before seq, so that it starts
+ * there. A message sent whole can overlap ones sent in pieces, and only its new records are kept
+ */
+void msg_trim_front(struct message *msg, uint32_t seq);
+
+/**
+ * Stamps the transmit time and checksum into a message just before it is sent
+ *
+ * @param[in] sec   Transmit timestamp, seconds
+ * @param[in] usec  Transmit timestamp, microseconds
+ */
+void msg_seal(struct message *msg, uint32_t sec, uint32_t usec);
+
+/**
+ * Checks that a received message is complete and undamaged
+ *
+ * @param[in] msg        The message received
+ * @param[in] num_bytes  Number of bytes actually received
+ *
+ * Returns true if the length adds up and the CRC32C matches the contents. Bytes past the
+ * message's own length (padding) are ignored
+ */
+bool msg_intact(struct message *msg, int num_bytes);
+
+/**
+ * Logs (at debug level) every record in a message along with its sequence number
+ *
+ * @param[in] prefix  Text logged in front of each record
+ * @param[in] msg     The message
+ */
+void msg_log_records(const char *prefix, const struct message *msg);
+
+#endif /* MESSAGE_H */
@@ -0,0 +1,449 @@
+/**
+ * Multipath striping: one transfer over several UDP flows
+ *
+ * CMPT 434 - A2
+ * Steven Rau
+ * scr108
+ * 11115094
+ */
+
+/* For sendmmsg() */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/select.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+
+#include "multipath.h"
+#include "sock.h"
+#include "pool.h"
+#include "log.h"
+
+/*-----------------------------------------------------------------------------
+ * File-scope constants & globals
+ * --------------------------------------------------------------------------*/
+
+/* How often a sleeping flow thread checks whether the transfer is over (milliseconds) */
+#define MULTIPATH_POLL_MS  100
+
+/*-----------------------------------------------------------------------------
+ * Helper functions
+ * --------------------------------------------------------------------------*/
+
+static long mono_usec(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec * 1000000L + now.tv_nsec / 1000;
+}
+
+/**
+ * Wakes up a thread sleeping on an eventfd
+ */
+static void wake(int fd)
+{
+    uint64_t one = 1;
+
+    if (write(fd, &one, sizeof(one)) == -1)
+    {
+        perror("eventfd write");
+    }
+}
+
+/**
+ * Clears any wakeups waiting on an eventfd (it is non-blocking)
+ */
+static void clear_wakeups(int fd)
+{
+    uint64_t count;
+
+    if (read(fd, &count, sizeof(count)) == -1 && errno != EAGAIN)
+    {
+        perror("eventfd read");
+    }
+}
+
+/**
+ * Flow thread: sends the next batch of datagrams queued for the flow
+ *
+ * Returns true if there were any
+ */
+static bool flow_send(struct mp_flow *f)
+{
+    struct mmsghdr msgs[MULTIPATH_BATCH];
+    struct iovec iov[MULTIPATH_BATCH];
+    struct mp_datagram *d;
+    uint32_t head = f->tx_head;
+    uint32_t num = __atomic_load_n(&f->tx_tail, __ATOMIC_ACQUIRE) - head;
+    uint32_t i;
+    int sent;
+
+    if (num == 0)
+    {
+        return false;
+    }
+
+    num = num < MULTIPATH_BATCH ? num : MULTIPATH_BATCH;
+
+    memset(msgs, 0, num * sizeof(struct mmsghdr));
+    for (i = 0; i < num; i++)
+    {
+        d = &f->tx[(head + i) % MULTIPATH_RING_SIZE];
+        iov[i].iov_base = d->data;
+        iov[i].iov_len = d->len;
+        msgs[i].msg_hdr.msg_name = &f->addr;
+        msgs[i].msg_hdr.msg_namelen = f->addr_len;
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    /* A datagram that can't be sent is dropped, like one lost on the way */
+    if ((sent = sendmmsg(f->sock, msgs, num, 0)) <= 0)
+    {
+        perror("sendmmsg");
+
+        sent = 1;
+    }
+
+    __atomic_store_n(&f->tx_head, head + sent, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+/**
+ * Flow thread: reads the acks waiting on the flow's socket into its ring, and wakes the protocol
+ * thread if it is asleep
+ *
+ * Returns true if there were any
+ */
+static bool flow_read_acks(struct mp_flow *f)
+{
+    struct multipath *mp = f->mp;
+    struct sock_rx_info rx;
+    struct mp_ack *a;
+    uint32_t tail = f->ack_tail;
+    ssize_t num_bytes;
+    bool got = false;
+
+    /* Once the ring is full, the rest wait in the socket */
+    while (tail - __atomic_load_n(&f->ack_head, __ATOMIC_ACQUIRE) < MULTIPATH_RING_SIZE)
+    {
+        a = &f->acks[tail % MULTIPATH_RING_SIZE];
+
+        if ((num_bytes = sock_recvfrom(f->sock, a->data, sizeof(a->data), MSG_DONTWAIT, NULL, NULL,
+                                       &rx, &f->kernel_drops)) == -1)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                perror("recvfrom");
+            }
+
+            break;
+        }
+
+        a->len = num_bytes;
+        a->rx_ts = rx.ts;
+
+        /* Publish the ack before looking for a sleeping protocol thread, which sets its flag
+         * before looking at the ring, so one of the two always sees the other */
+        __atomic_store_n(&f->ack_tail, ++tail, __ATOMIC_SEQ_CST);
+        got = true;
+    }
+
+    if (got && __atomic_load_n(&mp->waiting, __ATOMIC_SEQ_CST))
+    {
+        wake(mp->wake_fd);
+    }
+
+    return got;
+}
+
+/**
+ * Flow thread: sends whatever is queued and reads acks, sleeping while there is neither
+ */
+static void *flow_thread(void *arg)
+{
+    struct mp_flow *f = arg;
+    struct pollfd fds[2];
+    bool sent;
+    bool acked;
+
+    fds[0].fd = f->sock;
+    fds[0].events = POLLIN;
+    fds[1].fd = f->wake_fd;
+    fds[1].events = POLLIN;
+
+    while (!__atomic_load_n(&f->mp->stop, __ATOMIC_ACQUIRE))
+    {
+        sent = flow_send(f);
+        acked = flow_read_acks(f);
+
+        if (sent || acked)
+        {
+            continue;
+        }
+
+        __atomic_store_n(&f->waiting, true, __ATOMIC_SEQ_CST);
+
+        if (__atomic_load_n(&f->tx_tail, __ATOMIC_SEQ_CST) == f->tx_head &&
+            poll(fds, 2, MULTIPATH_POLL_MS) == -1 && errno != EINTR)
+        {
+            perror("poll");
+        }
+
+        __atomic_store_n(&f->waiting, false, __ATOMIC_SEQ_CST);
+
+        clear_wakeups(f->wake_fd);
+    }
+
+    return NULL;
+}
+
+/**
+ * Protocol thread: takes the next ack from the flows' rings, round-robin so no flow is starved
+ *
+ * Returns its length, or -1 if there are none
+ */
+static ssize_t take_ack(struct multipath *mp, void *buf, size_t len, struct timespec *rx_ts)
+{
+    struct mp_flow *f;
+    struct mp_ack *a;
+    uint32_t head;
+    int i;
+    int num_bytes;
+
+    for (i = 0; i < mp->num_flows; i++)
+    {
+        f = &mp->flows[(mp->next_rx + i) % mp->num_flows];
+        head = f->ack_head;
+
+        if (head == __atomic_load_n(&f->ack_tail, __ATOMIC_SEQ_CST))
+        {
+            continue;
+        }
+
+        a = &f->acks[head % MULTIPATH_RING_SIZE];
+        num_bytes = a->len < (int)len ? a->len : (int)len;
+        memcpy(buf, a->data, num_bytes);
+        *rx_ts = a->rx_ts;
+
+        __atomic_store_n(&f->ack_head, head + 1, __ATOMIC_RELEASE);
+        mp->next_rx = (mp->next_rx + i + 1) % mp->num_flows;
+
+        return num_bytes;
+    }
+
+    return -1;
+}
+
+/**
+ * Sets up one flow's socket, sending to addr (moved along by port_offset ports)
+ */
+static bool flow_open(struct mp_flow *f, const struct sockaddr *addr, socklen_t addr_len, int port_offset,
+                      int rcvbuf, int sndbuf)
+{
+    memcpy(&f->addr, addr, addr_len);
+    f->addr_len = addr_len;
+
+    if (addr->sa_family == AF_INET6)
+    {
+        ((struct sockaddr_in6 *)&f->addr)->sin6_port =
+            htons(ntohs(((struct sockaddr_in6 *)&f->addr)->sin6_port) + port_offset);
+    }
+    else
+    {
+        ((struct sockaddr_in *)&f->addr)->sin_port =
+            htons(ntohs(((struct sockaddr_in *)&f->addr)->sin_port) + port_offset);
+    }
+
+    /* The kernel gives every socket a source port of its own on its first send */
+    if ((f->sock = socket(addr->sa_family, SOCK_DGRAM, 0)) == -1)
+    {
+        perror("multipath: socket");
+
+        return false;
+    }
+
+    if ((f->wake_fd = eventfd(0, EFD_NONBLOCK)) == -1)
+    {
+        perror("multipath: eventfd");
+        close(f->sock);
+
+        return false;
+    }
+
+    sock_set_buffers(f->sock, rcvbuf, sndbuf);
+    sock_track_drops(f->sock);
+    sock_enable_timestamps(f->sock, false);
+
+    return true;
+}
+
+/*-----------------------------------------------------------------------------
+ * Multipath
+ * --------------------------------------------------------------------------*/
+
+bool multipath_open(struct multipath *mp, int num_flows, const struct sockaddr *addr, socklen_t addr_len,
+                    bool spread_ports, int rcvbuf, int sndbuf)
+{
+    struct mp_flow *f;
+    int i;
+
+    memset(mp, 0, sizeof(*mp));
+    mp->flows = mem_alloc(num_flows, sizeof(struct mp_flow));
+
+    if ((mp->wake_fd = eventfd(0, EFD_NONBLOCK)) == -1)
+    {
+        perror("multipath: eventfd");
+        mem_free(mp->flows);
+
+        return false;
+    }
+
+    for (i = 0; i < num_flows; i++)
+    {
+        f = &mp->flows[i];
+        memset(f, 0, sizeof(*f));
+        f->mp = mp;
+
+        if (!flow_open(f, addr, addr_len, spread_ports ? i : 0, rcvbuf, sndbuf))
+        {
+            break;
+        }
+
+        if ((errno = pthread_create(&f->tid, NULL, flow_thread, f)) != 0)
+        {
+            perror("multipath: pthread_create");
+            close(f->sock);
+            close(f->wake_fd);
+
+            break;
+        }
+
+        mp->num_flows++;
+    }
+
+    if (mp->num_flows < num_flows)
+    {
+        multipath_close(mp);
+
+        return false;
+    }
+
+    return true;
+}
+
+bool multipath_send(struct multipath *mp, const void *buf, size_t len)
+{
+    struct mp_flow *f;
+    struct mp_datagram *d;
+    uint32_t tail;
+    int i;
+
+    for (i = 0; i < mp->num_flows; i++)
+    {
+        f = &mp->flows[mp->next_tx];
+        mp->next_tx = (mp->next_tx + 1) % mp->num_flows;
+
+        tail = f->tx_tail;
+        if (tail - __atomic_load_n(&f->tx_head, __ATOMIC_ACQUIRE) >= MULTIPATH_RING_SIZE)
+        {
+            continue;
+        }
+
+        d = &f->tx[tail % MULTIPATH_RING_SIZE];
+        d->len = len < sizeof(d->data) ? len : sizeof(d->data);
+        memcpy(d->data, buf, d->len);
+
+        /* Publish the datagram before looking for a sleeping flow thread (see flow_read_acks()) */
+        __atomic_store_n(&f->tx_tail, tail + 1, __ATOMIC_SEQ_CST);
+
+        if (__atomic_load_n(&f->waiting, __ATOMIC_SEQ_CST))
+        {
+            wake(f->wake_fd);
+        }
+
+        return true;
+    }
+
+    LOG_WRN("Every flow is backed up, datagram dropped\n");
+
+    return false;
+}
+
+ssize_t multipath_recv(struct multipath *mp, void *buf, size_t len, struct timespec *rx_ts, long timeout_usec)
+{
+    long deadline = mono_usec() + timeout_usec;
+    long left;
+    ssize_t num_bytes;
+    struct timeval tv;
+    fd_set wake_set;
+
+    while ((num_bytes = take_ack(mp, buf, len, rx_ts)) < 0)
+    {
+        if ((left = deadline - mono_usec()) <= 0)
+        {
+            errno = EAGAIN;
+
+            return -1;
+        }
+
+        /* Say we're going to sleep, then look once more, so an ack read in between isn't missed */
+        __atomic_store_n(&mp->waiting, true, __ATOMIC_SEQ_CST);
+
+        if ((num_bytes = take_ack(mp, buf, len, rx_ts)) < 0)
+        {
+            FD_ZERO(&wake_set);
+            FD_SET(mp->wake_fd, &wake_set);
+            tv.tv_sec = left / 1000000L;
+            tv.tv_usec = left % 1000000L;
+
+            if (select(mp->wake_fd + 1, &wake_set, NULL, NULL, &tv) == -1 && errno != EINTR)
+            {
+                __atomic_store_n(&mp->waiting, false, __ATOMIC_SEQ_CST);
+
+                return -1;
+            }
+        }
+
+        __atomic_store_n(&mp->waiting, false, __ATOMIC_SEQ_CST);
+
+        clear_wakeups(mp->wake_fd);
+
+        if (num_bytes >= 0)
+        {
+            break;
+        }
+    }
+
+    return num_bytes;
+}
+
+void multipath_close(struct multipath *mp)
+{
+    int i;
+
+    __atomic_store_n(&mp->stop, true, __ATOMIC_RELEASE);
+
+    for (i = 0; i < mp->num_flows; i++)
+    {
+        wake(mp->flows[i].wake_fd);
+        pthread_join(mp->flows[i].tid, NULL);
+
+        close(mp->flows[i].sock);
+        close(mp->flows[i].wake_fd);
+    }
+
+    close(mp->wake_fd);
+    mem_free(mp->flows);
+
+    mp->num_flows = 0;
+}
@@ -0,0 +1,136 @@
+/**
+ * Multipath striping: one transfer over several UDP flows
+ *
+ * One socket tops out at what a single core can push through the kernel,
+ * and one flow always hashes to the same NIC queue. Striping spreads the
+ * sender's datagrams round-robin over several flows, each on a socket of
+ * its own (so from a source port of its own), and optionally to
+ * consecutive receiver ports as well. Every flow has a thread making its
+ * system calls: it sends what has been queued for it in batches with
+ * sendmmsg(), and reads the acks that come back on it.
+ *
+ * The thread running the protocol keeps the ARQ state to itself. It hands
+ * datagrams to the flows and takes their acks back through single
+ * producer, single consumer rings, so the two sides only share each ring's
+ * head and tail (atomics). Either side makes a system call to wake the
+ * other only when the other is asleep.
+ *
+ * The receiver merges the flows back into one sequence: a message lands in
+ * the same ARQ receiver whichever flow it came on, and its ack goes back on
+ * that flow.
+ *
+ * CMPT 434 - A2
+ * Steven Rau
+ * scr108
+ * 11115094
+ */
+
+#ifndef MULTIPATH_H
+#define MULTIPATH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include "shared.h"
+
+/* Datagrams (and acks) each flow can have queued */
+#define MULTIPATH_RING_SIZE  256
+
+/* Most datagrams a flow sends with one sendmmsg() */
+#define MULTIPATH_BATCH  32
+
+/* A datagram queued for a flow to send */
+struct mp_datagram
+{
+    uint32_t len;
+    char data[MAX_DATAGRAM_SIZE];
+};
+
+/* An ack a flow read, waiting to be taken */
+struct mp_ack
+{
+    int len;
+    struct timespec rx_ts;        /* When the kernel received it (zero if unknown) */
+    char data[sizeof(struct ack)];
+};
+
+struct multipath;
+
+/* One flow: a socket, the thread driving it, and its two rings */
+struct mp_flow
+{
+    struct multipath *mp;
+    pthread_t tid;
+    int sock;
+    struct sockaddr_storage addr; /* The receiver port this flow sends to */
+    socklen_t addr_len;
+    uint32_t kernel_drops;        /* The socket's kernel drop count as of the last ack read */
+    int wake_fd;                  /* eventfd that wakes the flow thread when datagrams are queued */
+    bool waiting;                 /* Shared: set while the flow thread is asleep */
+
+    struct mp_datagram tx[MULTIPATH_RING_SIZE];
+    uint32_t tx_head;             /* Shared: next datagram to send (advanced by the flow thread) */
+    uint32_t tx_tail;             /* Shared: next free entry (advanced by the protocol thread) */
+
+    struct mp_ack acks[MULTIPATH_RING_SIZE];
+    uint32_t ack_head;            /* Shared: next ack to take (advanced by the protocol thread) */
+    uint32_t ack_tail;            /* Shared: next free entry (advanced by the flow thread) */
+};
+
+struct multipath
+{
+    struct mp_flow *flows;
+    int num_flows;
+    int next_tx;                  /* Flow the next datagram goes on */
+    int next_rx;                  /* Flow looked at first for the next ack */
+    int wake_fd;                  /* eventfd that wakes the protocol thread when an ack comes in */
+    bool waiting;                 /* Shared: set while the protocol thread is asleep */
+    bool stop;                    /* Shared: set once the transfer is over */
+};
+
+/**
+ * Opens the flows and starts their threads
+ *
+ * @param[in] mp            The multipath link
+ * @param[in] num_flows     Number of flows (at most MAX_FLOWS)
+ * @param[in] addr          The receiver's address
+ * @param[in] addr_len      Size of addr
+ * @param[in] spread_ports  Whether flow i goes to the receiver's port + i, rather than all to its port
+ * @param[in] rcvbuf        Socket receive buffer size in bytes (0 for the default)
+ * @param[in] sndbuf        Socket send buffer size in bytes (0 for the default)
+ *
+ * Returns false (with a message printed) if they couldn't all be opened
+ */
+bool multipath_open(struct multipath *mp, int num_flows, const struct sockaddr *addr, socklen_t addr_len,
+                    bool spread_ports, int rcvbuf, int sndbuf);
+
+/**
+ * Queues a datagram on the next flow round-robin (or the one after, if that one is backed up)
+ *
+ * Returns false if every flow is backed up, in which case the datagram is dropped
+ */
+bool multipath_send(struct multipath *mp, const void *buf, size_t len);
+
+/**
+ * Takes the next ack any flow read, waiting up to timeout_usec for one
+ *
+ * @param[in]  mp            The multipath link
+ * @param[out] buf           Buffer for the ack
+ * @param[in]  len           Size of buf
+ * @param[out] rx_ts         When the kernel received it (zero if unknown)
+ * @param[in]  timeout_usec  Longest to wait
+ *
+ * Returns the number of bytes in the ack, or -1 with errno set (EAGAIN if the timeout ran out)
+ */
+ssize_t multipath_recv(struct multipath *mp, void *buf, size_t len, struct timespec *rx_ts, long timeout_usec);
+
+/**
+ * Stops the flow threads and closes their sockets
+ */
+void multipath_close(struct multipath *mp);
+
+#endif /* MULTIPATH_H */
@@ -0,0 +1,297 @@
+/**
+ * Path MTU discovery: finding the largest datagram that gets to the
+ * receiver without being fragmented
+ *
+ * CMPT 434 - A2
+ * Steven Rau
+ * scr108
+ * 11115094
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "pmtu.h"
+#include "message.h"
+#include "stats.h"
+#include "log.h"
+
+/*-----------------------------------------------------------------------------
+ * Helper functions
+ * --------------------------------------------------------------------------*/
+
+static long now_usec(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec * 1000000L + now.tv_nsec / 1000L;
+}
+
+/**
+ * Stops the kernel fragmenting anything sent on the socket: the don't fragment bit is set, and
+ * a datagram too big for the local interface fails with EMSGSIZE. The kernel's own path MTU
+ * estimate (from ICMP) is ignored, since the probes find it
+ */
+static bool disable_fragmentation(int sock, int family)
+{
+    int discover;
+    int on = 1;
+    int rv;
+
+    if (family == AF_INET6)
+    {
+        discover = IPV6_PMTUDISC_PROBE;
+        rv = setsockopt(sock, IPPROTO_IPV6, IPV6_MTU_DISCOVER, &discover, sizeof(discover));
+
+        if (rv == 0)
+        {
+            rv = setsockopt(sock, IPPROTO_IPV6, IPV6_DONTFRAG, &on, sizeof(on));
+        }
+    }
+    else
+    {
+        discover = IP_PMTUDISC_PROBE;
+        rv = setsockopt(sock, IPPROTO_IP, IP_MTU_DISCOVER, &discover, sizeof(discover));
+    }
+
+    if (rv == -1)
+    {
+        perror("setsockopt (path MTU discovery)");
+
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Picks the next size to probe in a search, or ends the search once the gap is small enough
+ */
+static void next_search_size(struct pmtu *p, long now)
+{
+    uint32_t next;
+
+    p->probe_size = 0;
+    p->probe_count = 0;
+
+    if (p->too_big - p->size <= PMTU_SEARCH_STEP)
+    {
+        p->state = PMTU_SEARCH_COMPLETE;
+        p->raise_usec = now + PMTU_RAISE_USEC;
+
+        LOG_INF("Path MTU search done: datagrams of %u bytes\n", p->size);
+
+        return;
+    }
+
+    /* Most paths carry what the receiver takes (e.g. a LAN, or loopback), so that is tried first */
+    if (p->too_big > p->max)
+    {
+        next = p->max;
+    }
+    else
+    {
+        next = (p->size + (p->too_big - p->size) / 2) & ~3u;
+    }
+
+    p->probe_size = next;
+}
+
+/**
+ * A probe got through: its size is taken for messages
+ */
+static bool probe_acked(struct pmtu *p, long now)
+{
+    bool changed = p->probe_size != p->size;
+
+    LOG_DBG("\nPath MTU probe of %u bytes acked\n", p->probe_size);
+
+    p->size = p->probe_size;
+
+    if (p->state != PMTU_SEARCHING)
+    {
+        p->state = PMTU_SEARCHING;
+        p->too_big = p->max + 1;
+    }
+
+    next_search_size(p, now);
+
+    return changed;
+}
+
+/**
+ * A probe went unanswered PMTU_MAX_PROBES times (or couldn't be sent): its size doesn't get through
+ */
+static void probe_lost(struct pmtu *p, long now)
+{
+    LOG_DBG("\nPath MTU probe of %u bytes lost\n", p->probe_size);
+
+    if (p->state == PMTU_BASE)
+    {
+        p->state = PMTU_ERROR;
+        p->probe_size = 0;
+        p->probe_count = 0;
+        p->raise_usec = now + PMTU_RAISE_USEC;
+
+        LOG_WRN("Path MTU probes aren't being answered, staying at %u bytes\n", p->size);
+
+        return;
+    }
+
+    p->too_big = p->probe_size;
+    next_search_size(p, now);
+}
+
+/*-----------------------------------------------------------------------------
+ * Path MTU discovery
+ * --------------------------------------------------------------------------*/
+
+bool pmtu_open(struct pmtu *p, int sock, int family, uint32_t max_datagram, long timeout_usec)
+{
+    memset(p, 0, sizeof(*p));
+    p->timeout_usec = timeout_usec;
+    p->rto_usec = timeout_usec;
+    p->sock = sock;
+    p->family = family;
+    p->max = max_datagram;
+    p->base = max_datagram < PMTU_BASE_DATAGRAM ? max_datagram : PMTU_BASE_DATAGRAM;
+    p->size = p->base;
+    p->too_big = p->max + 1;
+    p->state = PMTU_BASE;
+    p->probe_size = p->base;
+    p->progress_usec = now_usec();
+
+    return disable_fragmentation(sock, family);
+}
+
+bool pmtu_update(struct pmtu *p, long rto_usec, uint32_t acked, bool outstanding)
+{
+    long now = now_usec();
+    uint32_t got = __atomic_exchange_n(&p->probe_acked, 0, __ATOMIC_ACQUIRE);
+    bool changed = false;
+
+    /* Probes go with the RTT, not the (much longer) fixed timeout, so a lost one is noticed quickly */
+    p->rto_usec = rto_usec < 0 || rto_usec > p->timeout_usec ? p->timeout_usec : rto_usec;
+    p->rto_usec = p->rto_usec < PMTU_MIN_PROBE_USEC ? PMTU_MIN_PROBE_USEC : p->rto_usec;
+
+    if (acked != p->acked || !outstanding)
+    {
+        p->acked = acked;
+        p->progress_usec = now;
+    }
+
+    /* The size in use stopped getting through (a black hole): fall back to the base size, and
+     * search again from there */
+    if (p->size > p->base && now - p->progress_usec > PMTU_BLACK_HOLE_RTOS * p->timeout_usec)
+    {
+        LOG_WRN("Nothing acked for %d timeouts, dropping datagrams from %u to %u bytes\n",
+                PMTU_BLACK_HOLE_RTOS, p->size, p->base);
+
+        p->too_big = p->size;
+        p->size = p->base;
+        p->state = PMTU_BASE;
+        p->probe_size = p->base;
+        p->probe_count = 0;
+        p->progress_usec = now;
+
+        return true;
+    }
+
+    if (p->probe_size != 0 && got == p->probe_size)
+    {
+        changed = probe_acked(p, now);
+    }
+    else if (p->probe_size != 0 && p->probe_count >= PMTU_MAX_PROBES && now >= p->probe_due_usec)
+    {
+        probe_lost(p, now);
+    }
+
+    /* Time to look for a bigger size */
+    if ((p->state == PMTU_SEARCH_COMPLETE || p->state == PMTU_ERROR) && now >= p->raise_usec)
+    {
+        if (p->state == PMTU_ERROR)
+        {
+            p->state = PMTU_BASE;
+            p->probe_size = p->base;
+            p->probe_count = 0;
+        }
+        else
+        {
+            p->state = PMTU_SEARCHING;
+            p->too_big = p->max + 1;
+            next_search_size(p, now);
+        }
+    }
+
+    return changed;
+}
+
+size_t pmtu_next_probe(struct pmtu *p)
+{
+    long now = now_usec();
+
+    /* None wanted, one already waiting on its ack, or one about to be given up on */
+    if (p->probe_size == 0 || p->probe_count >= PMTU_MAX_PROBES ||
+        (p->probe_count > 0 && now < p->probe_due_usec))
+    {
+        return 0;
+    }
+
+    msg_init(&p->probe, 0);
+    p->probe.flags = MSG_FLAG_PROBE;
+    p->probe.count = htons(1);
+    p->probe.len = htons(p->probe_size - MSG_HEADER_SIZE);
+    memset(p->probe.text, 0, p->probe_size - MSG_HEADER_SIZE);
+
+    /* The ack echoes the timestamp like any other, so it gives an RTT sample too */
+    msg_seal(&p->probe, (uint32_t)(now / 1000000L), (uint32_t)(now % 1000000L));
+
+    p->probe_count++;
+    p->probe_due_usec = now + p->rto_usec;
+
+    STATS_INC(STAT_PMTU_PROBES);
+
+    return p->probe_size;
+}
+
+void pmtu_probe_failed(struct pmtu *p)
+{
+    probe_lost(p, now_usec());
+}
+
+void pmtu_on_ack(struct pmtu *p, const void *buf, int len)
+{
+    const struct ack *reply = buf;
+
+    if (len < (int)sizeof(*reply) || !(reply->flags & ACK_FLAG_PROBE))
+    {
+        return;
+    }
+
+    __atomic_store_n(&p->probe_acked, ntohl(reply->sel_ack), __ATOMIC_RELEASE);
+}
+
+bool pmtu_reply(struct ack *reply, struct message *probe, int len)
+{
+    if (!(probe->flags & MSG_FLAG_PROBE) || !msg_intact(probe, len))
+    {
+        return false;
+    }
+
+    memset(reply, 0, sizeof(*reply));
+    reply->version = ACK_VERSION;
+    reply->flags = ACK_FLAG_PROBE;
+    reply->stream = probe->stream;
+    reply->cum_ack = htonl(UINT32_MAX);
+    reply->sel_ack = htonl(msg_wire_len(probe));
+    reply->ts_sec = probe->ts_sec;
+    reply->ts_usec = probe->ts_usec;
+
+    return true;
+}
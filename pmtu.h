@@ -0,0 +1,152 @@
+/**
+ * Path MTU discovery: finding the largest datagram that gets to the
+ * receiver without being fragmented
+ *
+ * Messages used to be capped at a size picked at compile time. Too small
+ * and every datagram carries less than it could; too big and IP fragments
+ * it, so losing any fragment loses the whole message. The sender now
+ * searches for the biggest size the path carries, in the style of
+ * packetization layer path MTU discovery (RFC 8899): it sends probes
+ * (padding only, MSG_FLAG_PROBE) of the size it wants to try, the
+ * receiver acks every probe it gets (ACK_FLAG_PROBE), and a size is taken
+ * once its probe is acked. Nothing relies on ICMP "too big" messages,
+ * which firewalls often drop. The socket is set so the kernel never
+ * fragments (IP_PMTUDISC_PROBE, IPV6_DONTFRAG), and a probe too big for
+ * the local interface fails right away with EMSGSIZE.
+ *
+ * The search confirms the base size (which every path should carry)
+ * first, then tries the largest size the receiver takes, and halves the
+ * gap between the sizes known to work and known not to until it is down
+ * to PMTU_SEARCH_STEP. Messages are built up to the size confirmed so far
+ * while it runs. A size that stops getting through (the path changed) is
+ * noticed by the transfer stalling for PMTU_BLACK_HOLE_RTOS timeouts: the
+ * sender drops back to the base size and searches again. Every
+ * PMTU_RAISE_USEC it also searches again for a bigger size.
+ *
+ * Messages sent before a drop can be bigger than the path now carries.
+ * The ARQ engine re-sends those split between their records (see
+ * arq_transmit()), rather than leaving it to IP fragmentation.
+ *
+ * Probes are sent, and their timers checked, each time the sender goes
+ * around its loop, which during a transfer is every ack.
+ *
+ * CMPT 434 - A2
+ * Steven Rau
+ * scr108
+ * 11115094
+ */
+
+#ifndef PMTU_H
+#define PMTU_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "shared.h"
+
+/* Datagram every IPv4 and IPv6 path should carry (RFC 8899's BASE_PLPMTU), where the search starts */
+#define PMTU_BASE_DATAGRAM  1200
+
+/* Times a probe is sent before its size is taken not to get through */
+#define PMTU_MAX_PROBES  3
+
+/* The search stops once the sizes known to work and known not to are this close (bytes) */
+#define PMTU_SEARCH_STEP  16
+
+/* How long a search result stands before looking for a bigger size again (RFC 8899's
+ * PMTU_RAISE_TIMER, microseconds) */
+#define PMTU_RAISE_USEC  600000000L
+
+/* Timeouts in a row, with nothing acked in between, taken to mean the path no longer carries
+ * the size in use */
+#define PMTU_BLACK_HOLE_RTOS  3
+
+/* Least time a probe waits for its ack (microseconds), however short the RTT */
+#define PMTU_MIN_PROBE_USEC  10000L
+
+enum pmtu_state
+{
+    PMTU_BASE,             /* Confirming the base size */
+    PMTU_SEARCHING,        /* Probing bigger sizes */
+    PMTU_SEARCH_COMPLETE,  /* Using the largest size found, until the raise timer runs out */
+    PMTU_ERROR             /* Not even the base size was acked (e.g. the receiver doesn't answer probes) */
+};
+
+struct pmtu
+{
+    enum pmtu_state state;
+    int sock;
+    int family;
+    uint32_t size;          /* Largest datagram confirmed to get through, which messages are built up to */
+    uint32_t base;          /* The base size (less, if the receiver takes less) */
+    uint32_t max;           /* Largest size worth trying: what the receiver takes */
+    uint32_t too_big;       /* Smallest size found not to get through (max + 1 if none) */
+    uint32_t probe_size;    /* Size being probed (0 if none is) */
+    int probe_count;        /* Times it has been sent */
+    long probe_due_usec;    /* When it is sent again, or given up on */
+    long raise_usec;        /* When to search for a bigger size again */
+    long rto_usec;          /* How long a probe waits for its ack */
+    long timeout_usec;      /* The retransmission timeout, which a black hole is counted in */
+    uint32_t acked;         /* The transfer's acked count as of the last time it moved forward */
+    long progress_usec;     /* and when that was */
+    uint32_t probe_acked;   /* Shared with an ack thread: size of the last probe acked (0 once taken) */
+    struct message probe;   /* The probe, kept until the next one (io_uring sends it later) */
+};
+
+/**
+ * Starts path MTU discovery on a socket, turning off fragmentation
+ *
+ * @param[in] p             The discovery state
+ * @param[in] sock          Socket the transfer is sent on
+ * @param[in] family        Its address family (AF_INET or AF_INET6)
+ * @param[in] max_datagram  Largest size worth trying (the size agreed with the receiver)
+ * @param[in] timeout_usec  How long the sender waits for an ack before re-sending
+ *
+ * Returns false (with a message printed) if the socket options couldn't be set
+ */
+bool pmtu_open(struct pmtu *p, int sock, int family, uint32_t max_datagram, long timeout_usec);
+
+/**
+ * Moves the search along. Called by the sending thread every time around its loop
+ *
+ * @param[in] p              The discovery state
+ * @param[in] rto_usec       How long to wait for a probe's ack (the RTO from the RTT samples, or
+ *                           -1 if there are none yet)
+ * @param[in] acked          Count of what the transfer has had acked so far (grows whenever an ack
+ *                           moves it forward)
+ * @param[in] outstanding    Whether anything sent is waiting on an ack
+ *
+ * Returns true if the size messages are built up to changed
+ */
+bool pmtu_update(struct pmtu *p, long rto_usec, uint32_t acked, bool outstanding);
+
+/**
+ * Builds the next probe into p->probe, if one is due
+ *
+ * Returns its length, or 0 if there is nothing to send
+ */
+size_t pmtu_next_probe(struct pmtu *p);
+
+/**
+ * Gives up on the probe just built straight away, e.g. when sending it failed with EMSGSIZE
+ */
+void pmtu_probe_failed(struct pmtu *p);
+
+/**
+ * Takes the receiver's ack for a probe. Safe to call from a thread reading the acks
+ */
+void pmtu_on_ack(struct pmtu *p, const void *buf, int len);
+
+/**
+ * Receiver: builds the ack for a probe
+ *
+ * @param[out] reply  The ack
+ * @param[in]  probe  The probe received
+ * @param[in]  len    Number of bytes received
+ *
+ * Returns false if the probe is damaged (or cut short), in which case it isn't acked
+ */
+bool pmtu_reply(struct ack *reply, struct message *probe, int len);
+
+#endif /* PMTU_H */
@@ -0,0 +1,70 @@
+/**
+ * Preallocated message pool and counted heap allocation
+ *
+ * CMPT 434 - A2
+ * Steven Rau
+ * scr108
+ * 11115094
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "pool.h"
+#include "stats.h"
+
+void *mem_alloc(size_t count, size_t size)
+{
+    void *ptr = calloc(count, size);
+
+    if (ptr == NULL)
+    {
+        perror("calloc");
+
+        exit(1);
+    }
+
+    STATS_INC(STAT_HEAP_ALLOCS);
+    stats_add(STAT_HEAP_BYTES, count * size);
+
+    return ptr;
+}
+
+void mem_free(void *ptr)
+{
+    if (ptr == NULL)
+    {
+        return;
+    }
+
+    free(ptr);
+
+    STATS_INC(STAT_HEAP_FREES);
+}
+
+void msg_pool_init(struct msg_pool *pool, uint32_t capacity)
+{
+    uint32_t i;
+
+    pool->slots = mem_alloc(capacity, sizeof(struct message));
+    pool->free_list = mem_alloc(capacity, sizeof(struct message *));
+    pool->capacity = capacity;
+
+    /* Hand out the lowest slots first */
+    for (i = 0; i < capacity; i++)
+    {
+        pool->free_list[i] = &pool->slots[capacity - 1 - i];
+    }
+    pool->num_free = capacity;
+}
+
+void msg_pool_destroy(struct msg_pool *pool)
+{
+    mem_free(pool->slots);
+    mem_free(pool->free_list);
+
+    pool->slots = NULL;
+    pool->free_list = NULL;
+    pool->capacity = 0;
+    pool->num_free = 0;
+}
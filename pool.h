@@ -0,0 +1,85 @@
+/**
+ * Preallocated message pool and counted heap allocation
+ *
+ * Every buffer the protocol needs is sized from the window/buffer size and
+ * allocated once at startup through mem_alloc(), which counts allocations
+ * in the runtime stats. Messages then come and go through a fixed pool, so
+ * the per-message path never touches the heap and heap_allocs stays flat
+ * once a transfer is running.
+ *
+ * (The stats and logger allocate their per-thread blocks with plain calloc,
+ * once per thread, since counting those would recurse into the stats.)
+ *
+ * CMPT 434 - A2
+ * Steven Rau
+ * scr108
+ * 11115094
+ */
+
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "shared.h"
+
+/**
+ * Allocates zeroed memory and counts it. Exits if out of memory
+ *
+ * @param[in] count  Number of elements
+ * @param[in] size   Size of each element
+ */
+void *mem_alloc(size_t count, size_t size);
+
+/**
+ * Frees memory from mem_alloc() and counts it
+ */
+void mem_free(void *ptr);
+
+/* Fixed number of messages handed out and returned in any order */
+struct msg_pool
+{
+    struct message *slots;       /* Storage for every message */
+    struct message **free_list;  /* Stack of the slots not in use */
+    uint32_t capacity;
+    uint32_t num_free;
+};
+
+/**
+ * Allocates a pool's storage up front
+ *
+ * @param[in] pool      The pool
+ * @param[in] capacity  Number of messages the pool holds
+ */
+void msg_pool_init(struct msg_pool *pool, uint32_t capacity);
+
+/**
+ * Frees a pool's storage
+ */
+void msg_pool_destroy(struct msg_pool *pool);
+
+/**
+ * Takes a message from the pool
+ *
+ * Returns NULL if every message is in use
+ */
+static inline struct message *msg_pool_get(struct msg_pool *pool)
+{
+    if (pool->num_free == 0)
+    {
+        return NULL;
+    }
+
+    return pool->free_list[--pool->num_free];
+}
+
+/**
+ * Returns a message taken with msg_pool_get() to the pool
+ */
+static inline void msg_pool_put(struct msg_pool *pool, struct message *msg)
+{
+    pool->free_list[pool->num_free++] = msg;
+}
+
+#endif /* POOL_H */
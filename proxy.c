@@ -0,0 +1,738 @@
+/**
+ * UDP impairment proxy that sits between a sender and a receiver and
+ * makes the link between them behave like a slow, lossy WAN link.
+ *
+ * The sender is pointed at the proxy's port instead of the receiver's.
+ * Datagrams in both directions (messages one way, acks the other) go
+ * through the same impairments, each direction with its own queue and
+ * random stream:
+ *
+ *     - burst loss (Gilbert-Elliott: an average loss rate and a mean burst length)
+ *     - a rate cap, with a limited queue in front of it
+ *     - a delay drawn from a constant, uniform, normal or pareto distribution
+ *     - reordering (a datagram is held back so the ones after it overtake it)
+ *     - duplication
+ *     - an MTU: longer datagrams are dropped, as a router that may not
+ *       fragment them would, and the limit can change partway through
+ *
+ * Every random decision comes from a seeded generator, so the same seed
+ * and the same traffic give the same losses, delays and reorderings.
+ *
+ * CMPT 434 - A2
+ * Steven Rau
+ * scr108
+ * 11115094
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netdb.h>
+
+#include "shared.h"
+#include "stats.h"
+#include "log.h"
+#include "pool.h"
+#include "rng.h"
+#include "sock.h"
+
+
+/*-----------------------------------------------------------------------------
+ * File-scope constants & globals
+ * --------------------------------------------------------------------------*/
+
+/* Largest datagram relayed (anything longer is cut off) */
+#define PROXY_MAX_DATAGRAM  MAX_DATAGRAM_SIZE
+
+/* Default number of datagrams that can be waiting in each direction */
+#define PROXY_DEFAULT_QUEUE  1024
+
+/* Default extra hold for reordered datagrams (microseconds) */
+#define PROXY_DEFAULT_REORDER_USEC  10000
+
+enum delay_dist
+{
+    DELAY_CONSTANT,   /* Always delay */
+    DELAY_UNIFORM,    /* delay +/- jitter */
+    DELAY_NORMAL,     /* Mean delay, standard deviation jitter */
+    DELAY_PARETO      /* At least delay, with a heavy tail of mean jitter */
+};
+
+struct proxy_config
+{
+    long delay_usec;
+    long jitter_usec;
+    enum delay_dist dist;
+    double loss_prob;        /* Average fraction of datagrams lost */
+    double burst_len;        /* Mean number of datagrams lost in a row */
+    double reorder_prob;
+    long reorder_usec;       /* How long a reordered datagram is held back */
+    double dup_prob;
+    double rate_bps;         /* Link rate in bits per second, 0 for unlimited */
+    uint32_t queue_limit;    /* Datagrams that can be waiting in one direction */
+    uint64_t seed;
+    uint32_t mtu;            /* Longest datagram the link carries, 0 for no limit */
+    long mtu_change_usec;    /* When the path changes (since the proxy started), 0 for never */
+    uint32_t mtu_after;      /* and the limit from then on */
+    long start_usec;
+};
+
+/* One direction of the link */
+struct direction
+{
+    const char *name;
+    struct rng rng;
+    bool in_burst;           /* Gilbert-Elliott state: losing everything */
+    long link_free_usec;     /* When the rate capped link finishes its current datagram */
+    uint32_t queued;         /* Datagrams waiting in this direction */
+    int out_sock;            /* Socket datagrams leave on */
+    struct sockaddr_storage out_addr;
+    socklen_t out_addr_len;  /* 0 until the destination is known */
+};
+
+/* A datagram waiting to be delivered */
+struct pending
+{
+    long due_usec;
+    uint64_t order;          /* Breaks ties so equal due times stay first in, first out */
+    struct direction *dir;
+    size_t len;
+    char data[PROXY_MAX_DATAGRAM];
+};
+
+/* Min-heap (by due time) of the datagrams waiting in either direction, and the free slots */
+struct pending_queue
+{
+    struct pending **heap;
+    uint32_t num_pending;
+    struct pending **free_list;
+    uint32_t num_free;
+    uint64_t next_order;
+};
+
+/*-----------------------------------------------------------------------------
+ * Helper functions
+ * --------------------------------------------------------------------------*/
+
+static long now_usec(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec * 1000000L + now.tv_nsec / 1000L;
+}
+
+/**
+ * Draws a one-way delay for a datagram
+ */
+static long sample_delay(const struct proxy_config *cfg, struct rng *r)
+{
+    double u1;
+    double u2;
+    double delay;
+
+    switch (cfg->dist)
+    {
+        case DELAY_UNIFORM:
+            delay = cfg->delay_usec + (2 * rng_uniform(r) - 1) * cfg->jitter_usec;
+            break;
+        case DELAY_NORMAL:
+            /* Box-Muller */
+            u1 = 1.0 - rng_uniform(r);
+            u2 = rng_uniform(r);
+            delay = cfg->delay_usec + cfg->jitter_usec * sqrt(-2.0 * log(u1)) * cos(2 * M_PI * u2);
+            break;
+        case DELAY_PARETO:
+            /* Shape 3 (scale 2 * jitter), shifted so it starts at delay and averages jitter above it */
+            u1 = 1.0 - rng_uniform(r);
+            delay = cfg->delay_usec + 2.0 * cfg->jitter_usec * (pow(u1, -1.0 / 3.0) - 1.0);
+            break;
+        case DELAY_CONSTANT:
+        default:
+            delay = cfg->delay_usec;
+            break;
+    }
+
+    return delay < 0 ? 0 : (long)delay;
+}
+
+/**
+ * Decides whether the next datagram is lost, using the Gilbert-Elliott two state model
+ *
+ * In the good state nothing is lost; in the bad state everything is. The state changes
+ * are chosen so that the average loss is loss_prob and bursts last burst_len on average
+ */
+static bool burst_loss(const struct proxy_config *cfg, struct direction *dir)
+{
+    double leave_bad;
+    double enter_bad;
+
+    if (cfg->loss_prob <= 0)
+    {
+        return false;
+    }
+
+    leave_bad = 1.0 / (cfg->burst_len < 1 ? 1 : cfg->burst_len);
+    enter_bad = cfg->loss_prob * leave_bad / (1.0 - cfg->loss_prob);
+
+    if (dir->in_burst)
+    {
+        dir->in_burst = !rng_chance(&dir->rng, leave_bad);
+    }
+    else
+    {
+        dir->in_burst = rng_chance(&dir->rng, enter_bad);
+    }
+
+    return dir->in_burst;
+}
+
+static bool pending_before(const struct pending *a, const struct pending *b)
+{
+    return a->due_usec < b->due_usec || (a->due_usec == b->due_usec && a->order < b->order);
+}
+
+static void queue_push(struct pending_queue *q, struct pending *p)
+{
+    uint32_t i = q->num_pending++;
+    struct pending *tmp;
+
+    p->order = q->next_order++;
+    q->heap[i] = p;
+
+    /* Sift up */
+    while (i > 0 && pending_before(q->heap[i], q->heap[(i - 1) / 2]))
+    {
+        tmp = q->heap[i];
+        q->heap[i] = q->heap[(i - 1) / 2];
+        q->heap[(i - 1) / 2] = tmp;
+
+        i = (i - 1) / 2;
+    }
+}
+
+static struct pending *queue_pop(struct pending_queue *q)
+{
+    struct pending *top = q->heap[0];
+    struct pending *tmp;
+    uint32_t i = 0;
+    uint32_t child;
+
+    q->heap[0] = q->heap[--q->num_pending];
+
+    /* Sift down */
+    while ((child = 2 * i + 1) < q->num_pending)
+    {
+        if (child + 1 < q->num_pending && pending_before(q->heap[child + 1], q->heap[child]))
+        {
+            child++;
+        }
+
+        if (!pending_before(q->heap[child], q->heap[i]))
+        {
+            break;
+        }
+
+        tmp = q->heap[i];
+        q->heap[i] = q->heap[child];
+        q->heap[child] = tmp;
+
+        i = child;
+    }
+
+    return top;
+}
+
+/**
+ * Schedules one copy of a datagram for delivery
+ *
+ * @param[in] due_usec  When it should be delivered
+ */
+static void schedule(struct pending_queue *q, struct direction *dir, const char *buf, size_t len,
+                     long due_usec)
+{
+    struct pending *p;
+
+    if (q->num_free == 0)
+    {
+        STATS_INC(STAT_PROXY_QUEUE_DROPS);
+
+        return;
+    }
+
+    p = q->free_list[--q->num_free];
+    p->due_usec = due_usec;
+    p->dir = dir;
+    p->len = len;
+    memcpy(p->data, buf, len);
+
+    dir->queued++;
+    queue_push(q, p);
+}
+
+/**
+ * Runs a datagram that just arrived through the impairments and queues whatever survives
+ */
+static void impair(const struct proxy_config *cfg, struct pending_queue *q, struct direction *dir,
+                   const char *buf, size_t len, long now)
+{
+    long tx_start;
+    long tx_done;
+    long due;
+    uint32_t mtu = cfg->mtu_change_usec > 0 && now - cfg->start_usec >= cfg->mtu_change_usec ?
+                   cfg->mtu_after : cfg->mtu;
+
+    /* Too big for the link, and not allowed to be fragmented */
+    if (mtu > 0 && len > mtu)
+    {
+        STATS_INC(STAT_PROXY_TOO_BIG);
+
+        LOG_DBG("%s: %lu bytes is over the %u byte MTU, dropped\n", dir->name, (unsigned long)len, mtu);
+
+        return;
+    }
+
+    if (burst_loss(cfg, dir))
+    {
+        STATS_INC(STAT_PROXY_LOST);
+
+        LOG_DBG("%s: lost %lu bytes\n", dir->name, (unsigned long)len);
+
+        return;
+    }
+
+    /* Tail drop once the queue in front of the link is full */
+    if (dir->queued >= cfg->queue_limit)
+    {
+        STATS_INC(STAT_PROXY_QUEUE_DROPS);
+
+        LOG_DBG("%s: queue full, dropped %lu bytes\n", dir->name, (unsigned long)len);
+
+        return;
+    }
+
+    /* Serialize onto the rate capped link, then add the propagation delay */
+    tx_start = dir->link_free_usec > now ? dir->link_free_usec : now;
+    tx_done = tx_start;
+    if (cfg->rate_bps > 0)
+    {
+        tx_done += (long)(len * 8 * 1e6 / cfg->rate_bps);
+        dir->link_free_usec = tx_done;
+    }
+
+    due = tx_done + sample_delay(cfg, &dir->rng);
+
+    if (rng_chance(&dir->rng, cfg->reorder_prob))
+    {
+        STATS_INC(STAT_PROXY_REORDERED);
+
+        due += cfg->reorder_usec;
+    }
+
+    schedule(q, dir, buf, len, due);
+
+    if (rng_chance(&dir->rng, cfg->dup_prob))
+    {
+        STATS_INC(STAT_PROXY_DUPLICATED);
+
+        schedule(q, dir, buf, len, tx_done + sample_delay(cfg, &dir->rng));
+    }
+}
+
+/**
+ * Sends every datagram that is due
+ *
+ * Returns how long (ms) until the next one is due, or -1 if none are waiting
+ */
+static int deliver_due(struct pending_queue *q, long now)
+{
+    struct pending *p;
+    long wait;
+
+    while (q->num_pending > 0 && q->heap[0]->due_usec <= now)
+    {
+        p = queue_pop(q);
+        p->dir->queued--;
+
+        if (p->dir->out_addr_len > 0 &&
+            sendto(p->dir->out_sock, p->data, p->len, 0, (struct sockaddr *)&p->dir->out_addr,
+                   p->dir->out_addr_len) >= 0)
+        {
+            STATS_INC(STAT_PROXY_FORWARDED);
+        }
+
+        q->free_list[q->num_free++] = p;
+    }
+
+    if (q->num_pending == 0)
+    {
+        return -1;
+    }
+
+    /* Round up so poll() doesn't wake just before the datagram is due */
+    wait = (q->heap[0]->due_usec - now + 999) / 1000;
+
+    return wait > 1000 ? 1000 : (int)wait;
+}
+
+static bool parse_dist(const char *name, enum delay_dist *dist)
+{
+    if (strcmp(name, "constant") == 0)
+    {
+        *dist = DELAY_CONSTANT;
+    }
+    else if (strcmp(name, "uniform") == 0)
+    {
+        *dist = DELAY_UNIFORM;
+    }
+    else if (strcmp(name, "normal") == 0)
+    {
+        *dist = DELAY_NORMAL;
+    }
+    else if (strcmp(name, "pareto") == 0)
+    {
+        *dist = DELAY_PARETO;
+    }
+    else
+    {
+        return false;
+    }
+
+    return true;
+}
+
+/*-----------------------------------------------------------------------------
+ *
+ * --------------------------------------------------------------------------*/
+
+int main(int argc, char *argv[])
+{
+    struct proxy_config cfg;
+    struct pending_queue q;
+    struct pending *slots;
+    struct direction to_receiver;
+    struct direction to_sender;
+    struct addrinfo hints;
+    struct addrinfo *serv_info;
+    struct addrinfo *p;
+    struct pollfd fds[2];
+    int listen_sock;
+    int rv;
+    int i;
+    int wait_ms;
+    ssize_t num_bytes;
+    char buf[PROXY_MAX_DATAGRAM];
+    long now;
+    char *stats_file = NULL;  /* File to dump runtime stats to (stderr if not given) */
+    int stats_interval = 0;   /* Seconds between periodic stats dumps to the file */
+    char **args;              /* Positional arguments following the options */
+    int opt;
+    int verbosity = LOG_INFO; /* Each -v enables more logging (-v logs every datagram) */
+    int rcvbuf = 0;           /* Socket buffer sizes in bytes (0 leaves the system default) */
+    int sndbuf = 0;
+    uint32_t listen_drops = 0;  /* Kernel drop counts of each socket as of the last datagram read */
+    uint32_t out_drops = 0;
+    double change_sec = 0;    /* When the MTU changes */
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.dist = DELAY_CONSTANT;
+    cfg.burst_len = 1;
+    cfg.reorder_usec = PROXY_DEFAULT_REORDER_USEC;
+    cfg.queue_limit = PROXY_DEFAULT_QUEUE;
+    cfg.seed = 1;
+
+    /* Get the impairments, followed by the proxy's port and the receiver's host and port */
+    while ((opt = getopt(argc, argv, "d:j:D:l:b:r:g:u:R:q:S:m:M:s:i:B:W:v")) != -1)
+    {
+        switch (opt)
+        {
+            case 'd':
+                cfg.delay_usec = (long)(atof(optarg) * 1000);
+                break;
+            case 'j':
+                cfg.jitter_usec = (long)(atof(optarg) * 1000);
+                break;
+            case 'D':
+                if (!parse_dist(optarg, &cfg.dist))
+                {
+                    argc = 0;
+                }
+                break;
+            case 'l':
+                cfg.loss_prob = atof(optarg);
+                break;
+            case 'b':
+                cfg.burst_len = atof(optarg);
+                break;
+            case 'r':
+                cfg.reorder_prob = atof(optarg);
+                break;
+            case 'g':
+                cfg.reorder_usec = (long)(atof(optarg) * 1000);
+                break;
+            case 'u':
+                cfg.dup_prob = atof(optarg);
+                break;
+            case 'R':
+                cfg.rate_bps = atof(optarg) * 1000;
+                break;
+            case 'q':
+                cfg.queue_limit = atoi(optarg);
+                break;
+            case 'S':
+                cfg.seed = strtoull(optarg, NULL, 10);
+                break;
+            case 'm':
+                cfg.mtu = atoi(optarg);
+                break;
+            case 'M':
+                if (sscanf(optarg, "%lf:%u", &change_sec, &cfg.mtu_after) != 2 || change_sec <= 0)
+                {
+                    argc = 0;
+                }
+                cfg.mtu_change_usec = (long)(change_sec * 1000000);
+                break;
+            case 's':
+                stats_file = optarg;
+                break;
+            case 'i':
+                stats_interval = atoi(optarg);
+                break;
+            case 'B':
+                rcvbuf = atoi(optarg);
+                break;
+            case 'W':
+                sndbuf = atoi(optarg);
+                break;
+            case 'v':
+                verbosity++;
+                break;
+            default:
+                argc = 0;
+                break;
+        }
+    }
+    args = argv + optind;
+
+    if (argc - optind < 3)
+    {
+        fprintf(stderr, "Usage: %s [-v] [-d delay_ms] [-j jitter_ms] [-D constant|uniform|normal|pareto]\n"
+                        "\t[-l loss_prob] [-b mean_burst_len] [-r reorder_prob] [-g reorder_hold_ms]\n"
+                        "\t[-u dup_prob] [-R rate_kbps] [-q queue_limit] [-S seed]\n"
+                        "\t[-m max_datagram_bytes] [-M after_sec:max_datagram_bytes]\n"
+                        "\t[-s stats_file] [-i stats_interval_sec] [-B rcvbuf_bytes] [-W sndbuf_bytes]\n"
+                        "\t<listen_port> <receiver_ip> <receiver_port>\n", argv[0]);
+
+        exit(1);
+    }
+
+    if (atoi(args[0]) < MIN_PORT_NUM || atoi(args[0]) > MAX_PORT_NUM ||
+        atoi(args[2]) < MIN_PORT_NUM || atoi(args[2]) > MAX_PORT_NUM)
+    {
+        fprintf(stderr, "Usage: Port numbers must be between %d and %d\n",
+                         MIN_PORT_NUM, MAX_PORT_NUM);
+
+        exit(1);
+    }
+
+    if (cfg.loss_prob >= 1 || cfg.queue_limit < 1)
+    {
+        fprintf(stderr, "Usage: Loss probability must be below 1 and the queue limit at least 1\n");
+
+        exit(1);
+    }
+
+    cfg.start_usec = now_usec();
+
+    /* Bind the port the sender talks to */
+    memset(&hints, 0, sizeof hints);
+    hints.ai_family = AF_INET6;      /* Use IPv6 */
+    hints.ai_socktype = SOCK_DGRAM;  /* UDP datagram sockets */
+    hints.ai_flags = AI_PASSIVE;     /* Let getaddrinfo() chose an address for me */
+
+    if ((rv = getaddrinfo(NULL, args[0], &hints, &serv_info)) != 0)
+    {
+        fprintf(stderr, "getaddrinfo: %s\n", gai_strerror(rv));
+
+        exit(1);
+    }
+
+    for(p = serv_info; p != NULL; p = p->ai_next)
+    {
+        if ((listen_sock = socket(p->ai_family, p->ai_socktype, p->ai_protocol)) == -1)
+        {
+            perror("proxy: socket");
+
+            continue;
+        }
+
+        if (bind(listen_sock, p->ai_addr, p->ai_addrlen) == -1)
+        {
+            close(listen_sock);
+            perror("proxy: bind");
+
+            continue;
+        }
+
+        break;
+    }
+
+    if (p == NULL)
+    {
+        fprintf(stderr, "proxy: failed to bind socket\n");
+
+        return 2;
+    }
+
+    freeaddrinfo(serv_info);
+
+    /* Make the socket that talks to the receiver */
+    memset(&to_receiver, 0, sizeof(to_receiver));
+    memset(&hints, 0, sizeof hints);
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+
+    if ((rv = getaddrinfo(args[1], args[2], &hints, &serv_info)) != 0)
+    {
+        fprintf(stderr, "getaddrinfo: %s\n", gai_strerror(rv));
+
+        exit(1);
+    }
+
+    for(p = serv_info; p != NULL; p = p->ai_next)
+    {
+        if ((to_receiver.out_sock = socket(p->ai_family, p->ai_socktype, p->ai_protocol)) == -1)
+        {
+            perror("proxy: socket");
+
+            continue;
+        }
+
+        break;
+    }
+
+    if (p == NULL)
+    {
+        fprintf(stderr, "proxy: failed to create socket\n");
+
+        exit(1);
+    }
+
+    memcpy(&to_receiver.out_addr, p->ai_addr, p->ai_addrlen);
+    to_receiver.out_addr_len = p->ai_addrlen;
+
+    freeaddrinfo(serv_info);
+
+    /* Both sockets take the same buffer sizes, and count what the kernel drops */
+    sock_set_buffers(listen_sock, rcvbuf, sndbuf);
+    sock_track_drops(listen_sock);
+    sock_set_buffers(to_receiver.out_sock, rcvbuf, sndbuf);
+    sock_track_drops(to_receiver.out_sock);
+
+    /* Acks go back out the listening socket to whoever last sent a message */
+    memset(&to_sender, 0, sizeof(to_sender));
+    to_sender.out_sock = listen_sock;
+
+    /* Each direction gets its own random stream so one direction's traffic doesn't change
+     * the other's impairments */
+    to_receiver.name = "to receiver";
+    rng_seed(&to_receiver.rng, cfg.seed * 2);
+    to_sender.name = "to sender";
+    rng_seed(&to_sender.rng, cfg.seed * 2 + 1);
+
+    /* Allocate every queue slot up front: a full queue in each direction, plus duplicates */
+    memset(&q, 0, sizeof(q));
+    q.num_free = 4 * cfg.queue_limit;
+    slots = mem_alloc(q.num_free, sizeof(struct pending));
+    q.heap = mem_alloc(q.num_free, sizeof(struct pending *));
+    q.free_list = mem_alloc(q.num_free, sizeof(struct pending *));
+    for (i = 0; i < (int)q.num_free; i++)
+    {
+        q.free_list[i] = &slots[i];
+    }
+
+    /* Start exporting runtime counters (on SIGUSR1, periodically and at exit) */
+    stats_start("proxy", stats_file, stats_interval);
+
+    /* Start the background logger */
+    log_start(verbosity);
+
+    printf("UDP impairment proxy started: \n"
+           "\tListening on port %s, forwarding to %s port %s\n"
+           "\tDelay: %.1f ms  Jitter: %.1f ms  Loss: %.3f (mean burst %.1f)\n"
+           "\tReorder: %.3f  Duplicate: %.3f  Rate: %.0f kbit/s  Seed: %llu\n\n",
+           args[0], args[1], args[2], cfg.delay_usec / 1000.0, cfg.jitter_usec / 1000.0,
+           cfg.loss_prob, cfg.burst_len, cfg.reorder_prob, cfg.dup_prob, cfg.rate_bps / 1000,
+           (unsigned long long)cfg.seed);
+
+    fds[0].fd = listen_sock;
+    fds[0].events = POLLIN;
+    fds[1].fd = to_receiver.out_sock;
+    fds[1].events = POLLIN;
+
+    wait_ms = -1;
+
+    /* Main proxy loop: take in datagrams from either side, and send out the ones that are due,
+     * until SIGINT or SIGTERM */
+    while (!stats_stopping())
+    {
+        if (poll(fds, 2, wait_ms) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            perror("poll");
+
+            exit(1);
+        }
+
+        now = now_usec();
+
+        /* A message from the sender. Remember where it came from so acks can go back */
+        if (fds[0].revents & POLLIN)
+        {
+            to_sender.out_addr_len = sizeof(to_sender.out_addr);
+            num_bytes = sock_recvfrom(listen_sock, buf, sizeof(buf), 0, (struct sockaddr *)&to_sender.out_addr,
+                                      &to_sender.out_addr_len, NULL, &listen_drops);
+            if (num_bytes >= 0)
+            {
+                impair(&cfg, &q, &to_receiver, buf, num_bytes, now);
+            }
+        }
+
+        /* An ack from the receiver */
+        if (fds[1].revents & POLLIN)
+        {
+            num_bytes = sock_recvfrom(to_receiver.out_sock, buf, sizeof(buf), 0, NULL, NULL, NULL, &out_drops);
+            if (num_bytes >= 0)
+            {
+                impair(&cfg, &q, &to_sender, buf, num_bytes, now);
+            }
+        }
+
+        wait_ms = deliver_due(&q, now_usec());
+    }
+
+    /* Whatever is still held back is dropped */
+    mem_free(q.free_list);
+    mem_free(q.heap);
+    mem_free(slots);
+
+    close(to_receiver.out_sock);
+    close(listen_sock);
+
+    return 0;
+}
@@ -0,0 +1,1154 @@
+/**
+ * UDP receiver (server) that takes in messages and
+ * replies with an ack indicating the sequence number
+ * of the most recently received message.
+ *
+ * Contains a control interface to manually choose to
+ * "corrupt" a received message.
+ *
+ * The protocol itself lives in the ARQ library (arq.h). This file is built
+ * twice, the same as the sender: as q1receiver with the Go-Back-N engine,
+ * and as q2receiver (with ARQ_SELECTIVE_REPEAT defined) with the Selective
+ * Repeat engine, which also buffers out of order messages.
+ *
+ * CMPT 434 - A2
+ * Steven Rau
+ * scr108
+ * 11115094
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <sys/select.h>
+
+#include "shared.h"
+#include "stats.h"
+#include "log.h"
+#include "message.h"
+#include "input.h"
+#include "pool.h"
+#include "arq.h"
+#include "sock.h"
+#include "uring.h"
+#include "fec.h"
+#include "journal.h"
+#include "busypoll.h"
+#include "session.h"
+#include "pmtu.h"
+#include "shmem.h"
+#include "trace.h"
+
+
+/*-----------------------------------------------------------------------------
+ * File-scope constants & globals
+ * --------------------------------------------------------------------------*/
+
+/* Pick the ARQ engine this receiver is built with */
+#ifdef ARQ_SELECTIVE_REPEAT
+#define ARQ_POLICY(name)  arq_sr_##name
+#else
+#define ARQ_POLICY(name)  arq_gbn_##name
+#endif
+
+/* Most messages the receiver can buffer out of order (each takes up a whole struct message) */
+#define MAX_RECEIVER_BUFFER  4096
+
+/* How often a receiver waiting on shared memory checks the sender is still there (microseconds) */
+#define RECEIVER_SHM_POLL_USEC  100000L
+
+/* Everything the ARQ callbacks need to talk to the sender and the user */
+struct receiver_ctx
+{
+    int sock_fd;                /* Socket the message being handled came in on */
+    int socks[MAX_FLOWS];       /* Every port bound: just the one, unless merging multipath flows */
+    uint32_t socks_drops[MAX_FLOWS];  /* Each one's kernel drop count as of the last message read */
+    int num_socks;
+    int next_sock;              /* Socket looked at first for the next message */
+    struct sockaddr_storage their_addr;  /* Sender of the message being handled */
+    socklen_t addr_len;
+    float ack_loss_prob;
+    struct line_input answers;  /* Reader for the yes/no message corrupt input */
+    uint32_t kernel_drops;      /* The socket's kernel drop count as of the last message read */
+    struct sock_rx_info rx;     /* When the kernel received the message being handled, and GRO's segment size */
+    int num_streams;            /* Streams open (each has its own arq_receiver) */
+    int stream;                 /* Stream of the message being handled */
+    struct fec_decoder *fec;    /* One decoder per stream, rebuilding lost messages from parity (NULL if off) */
+    struct journal journal;     /* Lines delivered on each stream, for resuming after a restart */
+    struct session_params session;  /* What this receiver offers in the session handshake */
+    struct session_params agreed;   /* and what was last agreed with the sender */
+    bool session_open;          /* Whether a hello has been answered yet */
+    uint32_t hello_ts_sec;      /* Timestamp of the hello answered last, telling one sent again */
+    uint32_t hello_ts_usec;     /* from a new session */
+    uint32_t port;              /* Port bound (the first, with multipath) */
+    struct shmem shm;           /* A sender on this host's shared memory, while it uses it (region is NULL otherwise) */
+};
+
+/*-----------------------------------------------------------------------------
+ * Helper functions
+ * --------------------------------------------------------------------------*/
+
+/**
+ * Get sockaddr, IPv4 or IPv6:
+ */
+void *get_in_addr(struct sockaddr *sa)
+{
+    /* IPv4 case */
+    if (sa->sa_family == AF_INET)
+    {
+        return &(((struct sockaddr_in*)sa)->sin_addr);
+    }
+
+    /* IPv6 case */
+    return &(((struct sockaddr_in6*)sa)->sin6_addr);
+}
+
+/**
+ * Opens a UDP socket bound to port on this host (IPv6)
+ *
+ * Returns the socket, or -1 if no address could be bound
+ */
+int bind_port(uint32_t port)
+{
+    struct addrinfo hints;
+    struct addrinfo *serv_info;
+    struct addrinfo *p;
+    char port_str[16];
+    int sock_fd = -1;
+    int rv;
+
+    memset(&hints, 0, sizeof hints);
+    hints.ai_family = AF_INET6;      /* Use IPv6 */
+    hints.ai_socktype = SOCK_DGRAM;  /* UDP datagram sockets */
+    hints.ai_flags = AI_PASSIVE;     /* Let getaddrinfo() chose an address for me */
+
+    snprintf(port_str, sizeof(port_str), "%u", port);
+    if ((rv = getaddrinfo(NULL, port_str, &hints, &serv_info)) != 0)
+    {
+        fprintf(stderr, "getaddrinfo: %s\n", gai_strerror(rv));
+
+        exit(1);
+    }
+
+    /* Loop through the list of addrinfos and bind to the first one we can */
+    for(p = serv_info; p != NULL; p = p->ai_next)
+    {
+        if ((sock_fd = socket(p->ai_family, p->ai_socktype,
+                              p->ai_protocol)) == -1)
+        {
+            perror("UDP server: socket");
+
+            continue;
+        }
+
+        if (bind(sock_fd, p->ai_addr, p->ai_addrlen) == -1)
+        {
+            close(sock_fd);
+            perror("UDP server: bind");
+
+            sock_fd = -1;
+
+            continue;
+        }
+
+        break;
+    }
+
+    freeaddrinfo(serv_info);
+
+    return sock_fd;
+}
+
+/**
+ * Turns UDP GRO on for every port bound. Returns false if the kernel doesn't support it
+ */
+bool enable_gro(struct receiver_ctx *rc)
+{
+    int i;
+
+    for (i = 0; i < rc->num_socks; i++)
+    {
+        if (!sock_enable_gro(rc->socks[i]))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Waits for a message on any of the ports (multipath), taking the ports in turn so no flow is
+ * starved. The message's ack goes back out the port it came in on
+ *
+ * @param[in] rc   The receiver_ctx
+ * @param[in] buf  Buffer for the datagram
+ * @param[in] len  Size of buf
+ *
+ * Returns the number of bytes received, or -1 on error
+ */
+int recv_any_port(struct receiver_ctx *rc, char *buf, int len)
+{
+    fd_set read_set;
+    int max_fd = -1;
+    int num_bytes;
+    int idx;
+    int i;
+
+    while (1)
+    {
+        FD_ZERO(&read_set);
+        for (i = 0; i < rc->num_socks; i++)
+        {
+            FD_SET(rc->socks[i], &read_set);
+            max_fd = rc->socks[i] > max_fd ? rc->socks[i] : max_fd;
+        }
+
+        if (select(max_fd + 1, &read_set, NULL, NULL, NULL) == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            return -1;
+        }
+
+        for (i = 0; i < rc->num_socks; i++)
+        {
+            idx = (rc->next_sock + i) % rc->num_socks;
+            if (!FD_ISSET(rc->socks[idx], &read_set))
+            {
+                continue;
+            }
+
+            rc->next_sock = (idx + 1) % rc->num_socks;
+            rc->sock_fd = rc->socks[idx];
+
+            if ((num_bytes = sock_recvfrom(rc->sock_fd, buf, len, MSG_DONTWAIT, (struct sockaddr *)&rc->their_addr,
+                                           &rc->addr_len, &rc->rx, &rc->socks_drops[idx])) != -1 ||
+                (errno != EAGAIN && errno != EWOULDBLOCK))
+            {
+                return num_bytes;
+            }
+        }
+    }
+}
+
+/**
+ * Lets go of the sender's shared memory, going back to the socket
+ */
+void close_shared(struct receiver_ctx *rc)
+{
+    shmem_close(&rc->shm);
+
+    LOG_DBG("\n");
+    log_flush();
+    printf("Shared memory session closed, back to UDP\n");
+}
+
+/**
+ * Waits for a message through shared memory. Once the sender is done with it (or has died), the
+ * receiver goes back to its socket
+ *
+ * @param[in] rc   The receiver_ctx
+ * @param[in] buf  Buffer for the datagram
+ * @param[in] len  Size of buf
+ *
+ * Returns the number of bytes received, or -1 with errno set to EPIPE once the sender is gone (or
+ * EINTR once the receiver is asked to stop)
+ */
+int recv_shared(struct receiver_ctx *rc, char *buf, int len)
+{
+    int num_bytes;
+
+    while ((num_bytes = shmem_recv(&rc->shm, buf, len, RECEIVER_SHM_POLL_USEC)) == -1)
+    {
+        if (stats_stopping())
+        {
+            errno = EINTR;
+
+            return -1;
+        }
+
+        if (errno == EPIPE || shmem_peer_gone(&rc->shm))
+        {
+            close_shared(rc);
+
+            errno = EPIPE;
+
+            return -1;
+        }
+
+        /* A hello sent again (because its answer was lost) still comes on the socket. Anything
+         * else there means the sender went ahead without shared memory */
+        rc->addr_len = sizeof rc->their_addr;
+        if ((num_bytes = sock_recvfrom(rc->sock_fd, buf, len, MSG_DONTWAIT, (struct sockaddr *)&rc->their_addr,
+                                       &rc->addr_len, &rc->rx, &rc->kernel_drops)) >= 0)
+        {
+            if (num_bytes < MSG_HEADER_SIZE || !(((struct message *)buf)->flags & MSG_FLAG_HELLO))
+            {
+                close_shared(rc);
+            }
+
+            return num_bytes;
+        }
+    }
+
+    /* Nothing is timestamped on the way through the rings */
+    memset(&rc->rx, 0, sizeof(rc->rx));
+
+    return num_bytes;
+}
+
+/**
+ * Gets a bool determining if an ack should be viewed as corrupt or lost (ie. don't
+ * send the ack)
+ *
+ * @param[in] prob  Probability that the ack should be considered corrupt (between 0 and 1)
+ *
+ * Returns true or false based on a given probability
+ */
+bool ackLost(float prob)
+{
+    /* Generate s random float between 0 and 1 */
+    float rand_num = (float)rand() / (float)RAND_MAX;
+
+    if (rand_num < prob)
+    {
+        STATS_INC(STAT_ACKS_LOST);
+
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * Asks the user whether a message should be considered correctly received (ARQ accept callback)
+ *
+ * @param[in] ctx       The receiver_ctx
+ * @param[in] msg       The message received
+ * @param[in] in_order  Whether msg is the next in-order message (always, under Go-Back-N)
+ */
+bool ask_msg_received(void *ctx, const struct message *msg, bool in_order)
+{
+    struct receiver_ctx *rc = ctx;
+    char msgRecvd[16];  /* Buffer to read in the yes/no message corrupt input */
+
+    /* Get user inpt to decide whether the data received was "corrupt" (i.e., no ack) */
+    log_flush();
+    if (rc->num_streams > 1)
+    {
+        printf("\tStream %u:", msg->stream);
+    }
+    printf("\tSeq #%u - %u is %s\n"
+           "\tShould the message be correctly received? (y/n) \n\t", msg_seq(msg), msg_last_seq(msg),
+           in_order ? "the next in-order message" : "an out of order message.");
+
+    if (input_read_line(&rc->answers, msgRecvd, sizeof(msgRecvd), -1) <= 0)
+    {
+        return false;
+    }
+
+    /* If the first letter Y or y (yes), the message was received */
+    return msgRecvd[0] == 'y' || msgRecvd[0] == 'Y';
+}
+
+/**
+ * Notes a line handed over in order by the ARQ library (ARQ deliver callback). The text
+ * itself was already logged when the message arrived
+ */
+void deliver_line(void *ctx, uint32_t seq, const char *line, size_t len)
+{
+    struct receiver_ctx *rc = ctx;
+
+    (void)line;
+
+    LOG_DBG("\tDelivered stream %d seq #%u (%lu bytes)\n", rc->stream, seq, (unsigned long)len);
+}
+
+/**
+ * Sends an ack back to the sender, unless it is chosen to be lost (ARQ send_ack callback)
+ *
+ * @param[in] ctx  The receiver_ctx
+ * @param[in] ack  The ack, already in network byte order
+ */
+bool send_ack(void *ctx, const struct ack *ack)
+{
+    struct receiver_ctx *rc = ctx;
+    struct ack reply = *ack;
+    struct timespec now;
+    int64_t hold_ns;
+
+    /* Everything an ack covers is in the journal before the ack goes out, so a restarted sender
+     * never resumes past what this end delivered */
+    journal_record(&rc->journal, reply.stream, ntohl(reply.cum_ack) + 1, 0);
+
+    /* If the ack should be considered lost/corrupt, don't send a reply */
+    if (ackLost(rc->ack_loss_prob))
+    {
+        LOG_DBG("\tAck was corrupted\n");
+
+        return false;
+    }
+
+    /* Tell the sender how long the message was held here, so it can tell network time from
+     * processing time */
+    if (rc->rx.ts.tv_sec != 0)
+    {
+        sock_now(&now);
+
+        if ((hold_ns = sock_ts_diff_ns(&now, &rc->rx.ts)) >= 0)
+        {
+            stats_record(HIST_RECEIVER_HOLD_NS, hold_ns);
+            reply.hold_nsec = htonl(hold_ns >= UINT32_MAX ? UINT32_MAX : (uint32_t)hold_ns);
+        }
+    }
+
+    /* Lets the sender size its FEC groups for the loss on this stream */
+    if (rc->fec != NULL)
+    {
+        reply.loss = fec_decoder_loss(&rc->fec[reply.stream]);
+    }
+
+    if (rc->shm.region != NULL)
+    {
+        if (!shmem_send(&rc->shm, &reply, sizeof(reply)))
+        {
+            return false;
+        }
+    }
+    else if (sendto(rc->sock_fd, (const char *)&reply, sizeof(reply), 0,
+                    (struct sockaddr *)&rc->their_addr, rc->addr_len) < 0)
+    {
+        perror("sendto");
+
+        return false;
+    }
+
+    LOG_DBG("\tAck sent\n");
+
+    return true;
+}
+
+/**
+ * Maps the shared memory a sender on this host offered, keeping the mapping already open if the
+ * hello was sent again
+ *
+ * Returns false if it can't be used (see shmem_attach())
+ */
+bool attach_shared(struct receiver_ctx *rc, uint32_t key)
+{
+    if (rc->shm.region != NULL && rc->shm.key == key)
+    {
+        return true;
+    }
+
+    shmem_close(&rc->shm);
+
+    return shmem_attach(&rc->shm, key, rc->port);
+}
+
+/**
+ * Answers the sender's session hello with the best settings both ends support. Every hello is
+ * answered (the sender sends it again if the answer is lost), but the settings are only printed
+ * when they change. The receivers are fitted to what was agreed, and a hello this end can't work
+ * with is refused instead
+ *
+ * @param[in] receivers  One receiver per stream
+ * @param[in] rc         The receiver_ctx
+ * @param[in] msg        The hello
+ * @param[in] len        Number of bytes received
+ */
+void answer_hello(struct arq_receiver *receivers, struct receiver_ctx *rc, struct message *msg, int len)
+{
+    struct session_params theirs;
+    struct session_params mine;
+    struct session_params agreed;
+    char reply[sizeof(struct ack) + sizeof(struct session_params)];
+    enum session_reject reason;
+    bool resent;
+    int reply_len;
+    int stream;
+
+    if (!session_read_hello(msg, len, &theirs))
+    {
+        LOG_DBG("\nDamaged session hello dropped\n");
+
+        return;
+    }
+
+    /* A sender this end can't work with (e.g. on another protocol version) is told so, and gives up */
+    if ((reason = session_check(&theirs)) != SESSION_ACCEPTED)
+    {
+        LOG_WRN("Session refused: %s (the sender speaks version %u)\n", session_reject_name(reason),
+                theirs.version);
+
+        reply_len = session_reject(reply, msg, reason);
+        if (sendto(rc->sock_fd, reply, reply_len, 0, (struct sockaddr *)&rc->their_addr, rc->addr_len) == -1)
+        {
+            perror("sendto");
+        }
+
+        return;
+    }
+
+    /* Every stream resumes from where this end has got to, unless the sender is further behind. A
+     * hello sent again (the same timestamp) gets the same answer, whatever arrived since */
+    mine = rc->session;
+    resent = rc->session_open && msg->ts_sec == rc->hello_ts_sec && msg->ts_usec == rc->hello_ts_usec;
+    for (stream = 0; stream < mine.num_streams; stream++)
+    {
+        mine.resume[stream] = resent ? rc->agreed.resume[stream] : receivers[stream].last_succ_seq + 1;
+    }
+
+    session_negotiate(&theirs, &mine, &agreed);
+
+    /* The messages that follow come through the sender's shared memory if this end can map it.
+     * A sender that didn't offer it is taken at its word, and any earlier mapping let go */
+    if ((agreed.features & SESSION_FEATURE_SHM) && !attach_shared(rc, theirs.shm_key))
+    {
+        agreed.features &= ~SESSION_FEATURE_SHM;
+        agreed.shm_key = 0;
+    }
+
+    if (!(agreed.features & SESSION_FEATURE_SHM))
+    {
+        shmem_close(&rc->shm);
+    }
+
+    /* Take up the agreed settings before any data comes: messages on streams past the agreed
+     * ones are dropped, and each stream buffers no more than the sender's window can put ahead
+     * of a gap */
+    rc->num_streams = agreed.num_streams;
+    for (stream = 0; stream < agreed.num_streams; stream++)
+    {
+        arq_receiver_set_window(&receivers[stream], agreed.window);
+
+        /* Going back means taking lines again that were already delivered, so anything kept
+         * for the ones after them is let go */
+        if (!resent && agreed.resume[stream] != mine.resume[stream])
+        {
+            arq_receiver_resume(&receivers[stream], agreed.resume[stream]);
+            journal_record(&rc->journal, stream, agreed.resume[stream], 0);
+
+            if (rc->fec != NULL)
+            {
+                fec_decoder_destroy(&rc->fec[stream]);
+                fec_decoder_init(&rc->fec[stream]);
+            }
+        }
+    }
+
+    rc->hello_ts_sec = msg->ts_sec;
+    rc->hello_ts_usec = msg->ts_usec;
+
+    reply_len = session_reply(reply, msg, &agreed);
+
+    if (sendto(rc->sock_fd, reply, reply_len, 0, (struct sockaddr *)&rc->their_addr, rc->addr_len) == -1)
+    {
+        perror("sendto");
+    }
+
+    if (!rc->session_open || memcmp(&agreed, &rc->agreed, sizeof(agreed)) != 0)
+    {
+        /* Finish the line the debug output left open */
+        LOG_DBG("\n");
+        log_flush();
+        session_print(&mine, &agreed);
+
+        rc->agreed = agreed;
+        rc->session_open = true;
+    }
+}
+
+/**
+ * Acks a path MTU probe, telling the sender its size got through
+ *
+ * @param[in] rc   The receiver_ctx
+ * @param[in] msg  The probe
+ * @param[in] len  Number of bytes received
+ */
+void answer_probe(struct receiver_ctx *rc, struct message *msg, int len)
+{
+    struct ack reply;
+
+    if (!pmtu_reply(&reply, msg, len))
+    {
+        LOG_DBG("\nDamaged path MTU probe dropped\n");
+
+        return;
+    }
+
+    LOG_DBG("\nPath MTU probe of %d bytes acked\n", len);
+
+    if (sendto(rc->sock_fd, &reply, sizeof(reply), 0, (struct sockaddr *)&rc->their_addr, rc->addr_len) == -1)
+    {
+        perror("sendto");
+    }
+}
+
+/**
+ * Hands a message to the receiver for the stream it is on, rebuilding any lost ones it can with FEC
+ *
+ * @param[in] receivers  One receiver per stream
+ * @param[in] rc         The receiver_ctx
+ * @param[in] msg        The message received
+ * @param[in] len        Number of bytes received
+ */
+void receive_on_stream(struct arq_receiver *receivers, struct receiver_ctx *rc, struct message *msg, int len)
+{
+    int stream = arq_msg_stream(msg, len);
+    struct arq_receiver *r;
+#ifndef ARQ_SELECTIVE_REPEAT
+    bool recovered = false;
+    uint32_t next;
+#endif
+
+    /* A hello opens the session, and isn't a message of any stream */
+    if (len >= MSG_HEADER_SIZE && (msg->flags & MSG_FLAG_HELLO))
+    {
+        answer_hello(receivers, rc, msg, len);
+
+        return;
+    }
+
+    /* So is a path MTU probe */
+    if (len >= MSG_HEADER_SIZE && (msg->flags & MSG_FLAG_PROBE))
+    {
+        answer_probe(rc, msg, len);
+
+        return;
+    }
+
+    /* Nothing is acked for a stream that isn't open, the same as a damaged message */
+    if (stream < 0 || stream >= rc->num_streams)
+    {
+        STATS_INC(STAT_MSGS_RECEIVED);
+        STATS_INC(STAT_CORRUPT);
+
+        LOG_DBG("\nDropped message for stream %d (%d open)\n", stream, rc->num_streams);
+
+        return;
+    }
+
+    rc->stream = stream;
+    r = &receivers[stream];
+
+    if (rc->fec == NULL)
+    {
+        ARQ_POLICY(receive)(r, msg, len);
+
+        return;
+    }
+
+    /* Parity only goes to the decoder. A message is kept for it before the ARQ receiver changes it */
+    if (msg->flags & MSG_FLAG_PARITY)
+    {
+        fec_decoder_add_parity(&rc->fec[stream], msg, len);
+    }
+    else
+    {
+        fec_decoder_add_msg(&rc->fec[stream], msg, len);
+        ARQ_POLICY(receive)(r, msg, len);
+    }
+
+    /* Rebuilt messages are received like any other */
+    while (fec_decoder_next_recovered(&rc->fec[stream], msg))
+    {
+        ARQ_POLICY(receive)(r, msg, msg_wire_len(msg));
+#ifndef ARQ_SELECTIVE_REPEAT
+        recovered = true;
+#endif
+    }
+
+#ifndef ARQ_SELECTIVE_REPEAT
+    /* Go-Back-N dropped whatever arrived after a lost message. Now that it is rebuilt, take those
+     * again from the decoder instead of waiting for the sender to go back for them */
+    while (recovered && fec_decoder_lookup(&rc->fec[stream], (next = r->last_succ_seq + 1), msg))
+    {
+        ARQ_POLICY(receive)(r, msg, msg_wire_len(msg));
+
+        if (r->last_succ_seq + 1 == next)
+        {
+            break;
+        }
+    }
+#endif
+}
+
+
+/*-----------------------------------------------------------------------------
+ *
+ * --------------------------------------------------------------------------*/
+
+int main(int argc, char *argv[])
+{
+    uint32_t port_num;
+    int num_bytes;
+    char s[INET6_ADDRSTRLEN];
+    struct message *msg;
+#ifdef ARQ_SELECTIVE_REPEAT
+    struct msg_pool pool;     /* Space for every message that can be buffered */
+    struct message **buffer;  /* Out of order messages waiting for the gap before them to fill (per stream) */
+    int buff_size;
+#endif
+    struct receiver_ctx rc;
+    struct arq_receiver receivers[MAX_STREAMS];  /* One receiver (sequence numbers and reordering) per stream */
+    int num_streams = 1;
+    int stream;
+    struct arq_receiver_ops receiver_ops;
+    char *stats_file = NULL;  /* File to dump runtime stats to (stderr if not given) */
+    int stats_interval = 0;   /* Seconds between periodic stats dumps to the file */
+    char **args;              /* Positional arguments following the options */
+    int opt;
+    int verbosity = LOG_INFO; /* Each -v enables more logging (-v logs every packet) */
+    int rcvbuf = 0;           /* Socket buffer sizes in bytes (0 leaves the system default) */
+    int sndbuf = 0;
+    bool use_uring = false;   /* Receive through io_uring instead of recvfrom() */
+    struct uring_receiver ur;
+    bool use_gro = false;     /* Let the kernel coalesce messages that arrive together (UDP GRO) */
+    bool use_fec = false;     /* Rebuild lost messages from the sender's FEC parity */
+    char *journal_file = NULL;  /* Where to keep progress for resuming (none if not given) */
+    char *trace_file = NULL;  /* Where to record every message and ack (none if not given) */
+    int num_ports = 1;        /* Multipath: consecutive ports the sender's flows come in on */
+    int mss = MAX_DATAGRAM_SIZE;  /* Largest datagram taken, offered in the session handshake */
+    bool use_shm = true;      /* Take a sender on this host up on its shared memory */
+    int i;
+    int pin_cpu = -1;         /* Low-latency mode: core to pin to (-1 = off) */
+    long spin_usec = BUSYPOLL_DEFAULT_SPIN_USEC;  /* and how long to spin for each message */
+    char *rx_buf;             /* What each receive lands in: the message itself, or a GRO buffer */
+    int rx_buf_len;
+    int seg_size;             /* Size of each message in a coalesced receive */
+    int seg_len;
+    int offset;
+    struct timespec now;
+
+    /* Get any options, followed by the positional arguments */
+    while ((opt = getopt(argc, argv, "s:i:B:W:ugS:FJ:t:C:b:M:m:Nv")) != -1)
+    {
+        switch (opt)
+        {
+            case 's':
+                stats_file = optarg;
+                break;
+            case 'i':
+                stats_interval = atoi(optarg);
+                break;
+            case 'B':
+                rcvbuf = atoi(optarg);
+                break;
+            case 'W':
+                sndbuf = atoi(optarg);
+                break;
+            case 'u':
+                use_uring = true;
+                break;
+            case 'g':
+                use_gro = true;
+                break;
+            case 'S':
+                num_streams = atoi(optarg);
+                break;
+            case 'F':
+                use_fec = true;
+                break;
+            case 'J':
+                journal_file = optarg;
+                break;
+            case 't':
+                trace_file = optarg;
+                break;
+            case 'C':
+                pin_cpu = atoi(optarg);
+                break;
+            case 'b':
+                spin_usec = atol(optarg);
+                break;
+            case 'M':
+                num_ports = atoi(optarg);
+                break;
+            case 'm':
+                mss = atoi(optarg);
+                break;
+            case 'N':
+                use_shm = false;
+                break;
+            case 'v':
+                verbosity++;
+                break;
+            default:
+                argc = 0;
+                break;
+        }
+    }
+    args = argv + optind;
+
+#ifdef ARQ_SELECTIVE_REPEAT
+    if (argc - optind < 3)
+    {
+        fprintf(stderr, "Usage: %s [-v] [-s stats_file] [-i stats_interval_sec] [-B rcvbuf_bytes] [-W sndbuf_bytes] [-u] [-g] [-S num_streams] [-F] [-J journal_file] [-t trace_file] [-C cpu] [-b spin_usec] [-M num_ports] [-m max_datagram_bytes] [-N] <port_number> <ack_loss_prob> <buffer_size>\n", argv[0]);
+
+        exit(1);
+    }
+
+    /* Grab the buffer size from the commmand line */
+    buff_size = atoi(args[2]);
+    if (buff_size < 1 || buff_size > MAX_RECEIVER_BUFFER)
+    {
+        fprintf(stderr, "Usage: Buffer size must be between 1 and %d\n", MAX_RECEIVER_BUFFER);
+
+        exit(1);
+    }
+#else
+    if (argc - optind < 2)
+    {
+        fprintf(stderr, "Usage: %s [-v] [-s stats_file] [-i stats_interval_sec] [-B rcvbuf_bytes] [-W sndbuf_bytes] [-u] [-g] [-S num_streams] [-F] [-J journal_file] [-t trace_file] [-C cpu] [-b spin_usec] [-M num_ports] [-m max_datagram_bytes] [-N] <port_number> <ack_loss_prob>\n", argv[0]);
+
+        exit(1);
+    }
+#endif
+
+    if (num_streams < 1 || num_streams > MAX_STREAMS)
+    {
+        fprintf(stderr, "Usage: Number of streams must be between 1 and %d\n", MAX_STREAMS);
+
+        exit(1);
+    }
+
+    if (mss < (int)SESSION_MIN_MSS || mss > MAX_DATAGRAM_SIZE)
+    {
+        fprintf(stderr, "Usage: Largest datagram must be between %d and %d bytes\n", (int)SESSION_MIN_MSS,
+                         MAX_DATAGRAM_SIZE);
+
+        exit(1);
+    }
+
+    if (num_ports < 1 || num_ports > MAX_FLOWS)
+    {
+        fprintf(stderr, "Usage: Number of ports must be between 1 and %d\n", MAX_FLOWS);
+
+        exit(1);
+    }
+
+    memset(&rc, 0, sizeof(rc));
+    rc.num_streams = num_streams;
+    rc.journal.fd = -1;
+
+    if (journal_file != NULL && !journal_open(&rc.journal, journal_file, JOURNAL_RECEIVER, num_streams))
+    {
+        exit(1);
+    }
+
+    /* Grab the ack loss probability from the command line */
+    rc.ack_loss_prob = atof(args[1]);
+
+    /* What the session handshake offers */
+    rc.session.version = ACK_VERSION;
+    rc.session.num_streams = num_streams;
+    rc.session.features = SESSION_FEATURE_COMPRESS | (use_fec ? SESSION_FEATURE_FEC : 0);
+#ifdef ARQ_SELECTIVE_REPEAT
+    /* Out of order messages are buffered, so the sender's window is cut down to what fits */
+    rc.session.features |= SESSION_FEATURE_SACK;
+    rc.session.buffer = buff_size;
+#endif
+    rc.session.mss = mss;
+    rc.session.features |= use_shm ? SESSION_FEATURE_SHM : 0;
+
+    /* Grab the port number */
+    port_num = atoi(args[0]);
+    if (port_num < MIN_PORT_NUM || port_num + num_ports - 1 > MAX_PORT_NUM)
+    {
+        fprintf(stderr, "Usage: Port number must be between %d and %d\n",
+                         MIN_PORT_NUM, MAX_PORT_NUM);
+
+        exit(1);
+    }
+
+    /* Bind the port, and with multipath the ports after it. Every flow's messages end up on the
+     * same stream, and acks go back out the port the message came in on */
+    for (i = 0; i < num_ports; i++)
+    {
+        if ((rc.socks[i] = bind_port(port_num + i)) == -1)
+        {
+            fprintf(stderr, "UDP server: failed to bind socket\n");
+
+            return 2;
+        }
+    }
+    rc.num_socks = num_ports;
+    rc.port = port_num;
+    rc.sock_fd = rc.socks[0];
+
+    if (num_ports > 1)
+    {
+        printf("Merging flows from ports %u - %u\n", port_num, port_num + num_ports - 1);
+    }
+
+    /* Size the socket buffers for bursts and have the kernel report any it still drops */
+    for (i = 0; i < rc.num_socks; i++)
+    {
+        sock_set_buffers(rc.socks[i], rcvbuf, sndbuf);
+        sock_track_drops(rc.socks[i]);
+        sock_enable_timestamps(rc.socks[i], false);
+    }
+
+    /* io_uring and low-latency mode wait on a single socket */
+    if (rc.num_socks > 1 && (use_uring || pin_cpu >= 0))
+    {
+        fprintf(stderr, "io_uring receive and low-latency mode are not used with multipath\n");
+
+        use_uring = false;
+        pin_cpu = -1;
+    }
+
+    /* Older kernels (or ones with io_uring turned off) get the classic path */
+    if (use_uring && !uring_receiver_init(&ur, rc.sock_fd, sizeof(struct message)))
+    {
+        fprintf(stderr, "io_uring receive unavailable (%s), using recvfrom()\n", strerror(errno));
+
+        use_uring = false;
+    }
+    else if (use_uring)
+    {
+        printf("Using io_uring multishot receive\n");
+    }
+
+    /* Allocate space for the message to be received */
+    msg = mem_alloc(1, sizeof(struct message));
+    rx_buf = (char *)msg;
+    rx_buf_len = sizeof(struct message);
+
+    /* GRO only applies to recvfrom(); the io_uring buffers hold one message each */
+    if (use_gro && use_uring)
+    {
+        fprintf(stderr, "GRO is not used with io_uring receive\n");
+    }
+    else if (use_gro && !enable_gro(&rc))
+    {
+        fprintf(stderr, "UDP GRO unavailable, receiving one message at a time\n");
+    }
+    else if (use_gro)
+    {
+        rx_buf = mem_alloc(1, SOCK_GRO_BUFFER_SIZE);
+        rx_buf_len = SOCK_GRO_BUFFER_SIZE;
+
+        printf("Using UDP GRO\n");
+    }
+
+    input_init(&rc.answers, STDIN_FILENO);
+
+    /* Hook the ARQ engine up to the socket and the user prompts. Only Selective Repeat buffers
+     * anything */
+    receiver_ops.accept = ask_msg_received;
+    receiver_ops.deliver = deliver_line;
+    receiver_ops.send_ack = send_ack;
+    receiver_ops.ctx = &rc;
+#ifdef ARQ_SELECTIVE_REPEAT
+    /* Allocate the buffer space (all of it up front, so nothing is allocated per message). Every
+     * stream gets a buffer of that size */
+    msg_pool_init(&pool, buff_size * num_streams);
+    buffer = mem_alloc(buff_size * num_streams, sizeof(struct message *));
+#endif
+    for (stream = 0; stream < num_streams; stream++)
+    {
+#ifdef ARQ_SELECTIVE_REPEAT
+        arq_receiver_init(&receivers[stream], &pool, buffer + stream * buff_size, buff_size, &receiver_ops);
+#else
+        arq_receiver_init(&receivers[stream], NULL, NULL, 0, &receiver_ops);
+#endif
+        receivers[stream].stream = stream;
+
+        /* Carry on after the last line delivered before a restart */
+        if (rc.journal.fd != -1 && rc.journal.rec.next[stream] > 0)
+        {
+            arq_receiver_resume(&receivers[stream], rc.journal.rec.next[stream]);
+
+            printf("Resuming stream %d at seq #%u\n", stream, rc.journal.rec.next[stream]);
+        }
+    }
+
+    /* The code and group sizes come with the parity, so there is nothing to pick here */
+    if (use_fec)
+    {
+        rc.fec = mem_alloc(num_streams, sizeof(struct fec_decoder));
+        for (stream = 0; stream < num_streams; stream++)
+        {
+            fec_decoder_init(&rc.fec[stream]);
+        }
+
+        printf("Rebuilding lost messages from FEC parity\n");
+    }
+
+    /* Start exporting runtime counters (on SIGUSR1, periodically and at exit) */
+    stats_start("receiver", stats_file, stats_interval);
+
+    /* Start the background logger */
+    log_start(verbosity);
+
+    /* Record every message and ack for traceview to go over afterwards */
+    if (trace_file != NULL && !trace_open(trace_file, TRACE_RECEIVER))
+    {
+        exit(1);
+    }
+
+    /* Low-latency mode pins the receiver (after the logger and stats threads started, so they
+     * don't share its core) and spins for messages. io_uring already waits in the kernel */
+    if (pin_cpu >= 0 && use_uring)
+    {
+        fprintf(stderr, "Low-latency mode is not used with io_uring receive\n");
+
+        pin_cpu = -1;
+    }
+    else if (pin_cpu >= 0 && !busypoll_pin_cpu(pin_cpu))
+    {
+        pin_cpu = -1;
+    }
+    else if (pin_cpu >= 0)
+    {
+        busypoll_enable(rc.sock_fd, BUSYPOLL_DEFAULT_KERNEL_USEC);
+
+        printf("Low-latency mode: pinned to CPU %d, spinning up to %ld us for each message\n",
+               pin_cpu, spin_usec);
+    }
+
+    printf("UDP Server: waiting to recvfrom...\n");
+
+    /* Main receiver loop that takes in messages from the sender and handles them according to
+     * their sequence number. Under Selective Repeat, out of order messages can be buffered until
+     * the next in-order message is received. Runs until Ctrl-C / SIGTERM */
+    while (!stats_stopping())
+    {
+        /* Clear out the message space */
+        memset(msg, 0, sizeof(struct message));
+
+        /* Receive the message */
+        rc.addr_len = sizeof rc.their_addr;
+        if (rc.shm.region != NULL)
+        {
+            num_bytes = recv_shared(&rc, rx_buf, rx_buf_len);
+        }
+        else if (use_uring)
+        {
+            num_bytes = uring_receiver_recv(&ur, msg, sizeof(struct message),
+                (struct sockaddr *)&rc.their_addr, &rc.addr_len, &rc.rx, &rc.kernel_drops);
+        }
+        else if (pin_cpu >= 0)
+        {
+            num_bytes = busypoll_recv(rc.sock_fd, rx_buf, rx_buf_len,
+                (struct sockaddr *)&rc.their_addr, &rc.addr_len, &rc.rx, &rc.kernel_drops, spin_usec, -1);
+        }
+        else if (rc.num_socks > 1)
+        {
+            num_bytes = recv_any_port(&rc, rx_buf, rx_buf_len);
+        }
+        else
+        {
+            num_bytes = sock_recvfrom(rc.sock_fd, rx_buf, rx_buf_len, 0,
+                (struct sockaddr *)&rc.their_addr, &rc.addr_len, &rc.rx, &rc.kernel_drops);
+        }
+
+        /* The shared memory session ended, so the next message comes on the socket */
+        if (num_bytes == -1 && errno == EPIPE)
+        {
+            continue;
+        }
+
+        if (num_bytes == -1)
+        {
+            /* Woken up to stop: the loop condition ends it */
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            perror("recvfrom");
+
+            exit(1);
+        }
+
+        /* How long the datagram sat in the socket before being read */
+        if (rc.rx.ts.tv_sec != 0)
+        {
+            sock_now(&now);
+            stats_record(HIST_RX_WAKEUP_NS, sock_ts_diff_ns(&now, &rc.rx.ts));
+        }
+
+        /* Only pay for the address conversion when packets are actually being logged */
+        if (log_enabled(LOG_DEBUG))
+        {
+            LOG_DBG("\nUDP Server: got packet from %s", inet_ntop(rc.their_addr.ss_family,
+                                                    get_in_addr((struct sockaddr *)&rc.their_addr),
+                                                    s, sizeof s));
+        }
+
+        /* A coalesced receive holds several messages back to back, each segment_size bytes but
+         * the last. Each is handled on its own, as if it had been received by itself */
+        seg_size = rc.rx.segment_size > 0 ? rc.rx.segment_size : num_bytes;
+        offset = 0;
+        do
+        {
+            seg_len = num_bytes - offset < seg_size ? num_bytes - offset : seg_size;
+            if (rx_buf != (char *)msg)
+            {
+                seg_len = seg_len < (int)sizeof(struct message) ? seg_len : (int)sizeof(struct message);
+                memset(msg, 0, sizeof(struct message));
+                memcpy(msg, rx_buf + offset, seg_len);
+            }
+
+            receive_on_stream(receivers, &rc, msg, seg_len);
+
+            offset += seg_size;
+        } while (offset < num_bytes);
+    }
+
+#ifdef ARQ_SELECTIVE_REPEAT
+    mem_free(buffer);
+
+    msg_pool_destroy(&pool);
+#endif
+
+    if (rx_buf != (char *)msg)
+    {
+        mem_free(rx_buf);
+    }
+
+    mem_free(msg);
+
+    if (rc.fec != NULL)
+    {
+        for (stream = 0; stream < num_streams; stream++)
+        {
+            fec_decoder_destroy(&rc.fec[stream]);
+        }
+
+        mem_free(rc.fec);
+    }
+
+    if (use_uring)
+    {
+        uring_receiver_destroy(&ur);
+    }
+
+    shmem_close(&rc.shm);
+
+    journal_close(&rc.journal);
+
+    trace_close();
+
+    for (i = 0; i < rc.num_socks; i++)
+    {
+        close(rc.socks[i]);
+    }
+
+    return 0;
+}
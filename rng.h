@@ -0,0 +1,51 @@
+/**
+ * Small seeded random number generator (splitmix64)
+ *
+ * Used wherever runs have to be reproducible from a seed (the impairment
+ * proxy and the simulator), instead of rand().
+ *
+ * CMPT 434 - A2
+ * Steven Rau
+ * scr108
+ * 11115094
+ */
+
+#ifndef RNG_H
+#define RNG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct rng
+{
+    uint64_t state;
+};
+
+static inline void rng_seed(struct rng *r, uint64_t seed)
+{
+    r->state = seed;
+}
+
+static inline uint64_t rng_next(struct rng *r)
+{
+    uint64_t z = (r->state += 0x9E3779B97F4A7C15ULL);
+
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+
+    return z ^ (z >> 31);
+}
+
+/* Uniform double in [0, 1) */
+static inline double rng_uniform(struct rng *r)
+{
+    return (rng_next(r) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* True with the given probability */
+static inline bool rng_chance(struct rng *r, double prob)
+{
+    return prob > 0 && rng_uniform(r) < prob;
+}
+
+#endif /* RNG_H */
@@ -0,0 +1,426 @@
+/**
+ * Loopback round-trip benchmark for the low-latency (busy-poll) mode
+ *
+ * Bounces a message-sized datagram off an echo thread over ::1, which
+ * replies with an ack-sized one, and times every round trip. Each mode
+ * waits the way the real programs do:
+ *
+ *     blocking  The client waits in select() like the senders, the echo
+ *               thread in a blocking recvfrom() like the receivers
+ *     busypoll  Both pin to a core, set SO_BUSY_POLL and spin on
+ *               non-blocking receives (busypoll_recv()), like -C does
+ *     shm       No socket: the datagrams go through the shared-memory
+ *               rings (shmem.h) a sender and receiver on one host use
+ *
+ * One CSV row is printed per mode, with the round-trip percentiles and
+ * how many of the busy-polled receives found their datagram while spinning.
+ *
+ * Spinning only pays off when the two ends are on different cores. On a
+ * single core the spinners yield to each other, so busy polling comes out
+ * about the same as blocking.
+ *
+ * CMPT 434 - A2
+ * Steven Rau
+ * scr108
+ * 11115094
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "shared.h"
+#include "stats.h"
+#include "pool.h"
+#include "sock.h"
+#include "busypoll.h"
+#include "shmem.h"
+
+
+/*-----------------------------------------------------------------------------
+ * File-scope constants & globals
+ * --------------------------------------------------------------------------*/
+
+/* Round trips run before timing starts, to warm up caches and the scheduler */
+#define BENCH_WARMUP  1000
+
+/* How long either end waits for a datagram before giving up (microseconds) */
+#define BENCH_TIMEOUT_USEC  1000000L
+
+struct bench_config
+{
+    bool busy;           /* Busy-poll mode, rather than blocking */
+    bool shm;            /* Shared-memory mode, rather than either */
+    int client_cpu;
+    int echo_cpu;
+    long spin_usec;
+    int samples;
+    int msg_len;         /* Bytes sent each way: a message there, an ack back */
+};
+
+/* One end of the ping-pong */
+struct bench_end
+{
+    const struct bench_config *cfg;
+    int sock;
+    struct sockaddr_in6 peer;
+    struct shmem shm;    /* Shared-memory mode: the client's end is the sender's, the echo's the receiver's */
+    int64_t *rtt_ns;     /* Client only: one sample per round trip */
+    bool ok;
+};
+
+/*-----------------------------------------------------------------------------
+ * Helper functions
+ * --------------------------------------------------------------------------*/
+
+static int64_t now_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (int64_t)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+static const char *mode_name(const struct bench_config *cfg)
+{
+    return cfg->shm ? "shm" : cfg->busy ? "busypoll" : "blocking";
+}
+
+static int cmp_int64(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a;
+    int64_t y = *(const int64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * Opens a UDP socket on an ephemeral loopback port, returning its address in addr
+ */
+static int open_loopback(struct sockaddr_in6 *addr)
+{
+    socklen_t len = sizeof(*addr);
+    int fd;
+
+    if ((fd = socket(AF_INET6, SOCK_DGRAM, 0)) == -1)
+    {
+        perror("socket");
+
+        exit(1);
+    }
+
+    memset(addr, 0, sizeof(*addr));
+    addr->sin6_family = AF_INET6;
+    addr->sin6_addr = in6addr_loopback;
+
+    if (bind(fd, (struct sockaddr *)addr, sizeof(*addr)) == -1 ||
+        getsockname(fd, (struct sockaddr *)addr, &len) == -1)
+    {
+        perror("bind");
+
+        exit(1);
+    }
+
+    sock_track_drops(fd);
+
+    return fd;
+}
+
+/**
+ * Waits for one datagram the way the mode says to
+ *
+ * @param[in] e        The end receiving
+ * @param[in] blocked  How a blocking wait is done: in select() first (the sender), or straight
+ *                     in recvfrom() (the receiver)
+ */
+static ssize_t bench_recv(struct bench_end *e, char *buf, size_t len, bool blocked)
+{
+    struct timeval tv;
+    fd_set read_set;
+    uint32_t drops = 0;
+
+    if (e->cfg->shm)
+    {
+        return shmem_recv(&e->shm, buf, len, BENCH_TIMEOUT_USEC);
+    }
+
+    if (e->cfg->busy)
+    {
+        return busypoll_recv(e->sock, buf, len, NULL, NULL, NULL, &drops, e->cfg->spin_usec,
+                             BENCH_TIMEOUT_USEC);
+    }
+
+    if (blocked)
+    {
+        FD_ZERO(&read_set);
+        FD_SET(e->sock, &read_set);
+        tv.tv_sec = BENCH_TIMEOUT_USEC / 1000000L;
+        tv.tv_usec = BENCH_TIMEOUT_USEC % 1000000L;
+
+        if (select(e->sock + 1, &read_set, NULL, NULL, &tv) <= 0)
+        {
+            errno = EAGAIN;
+
+            return -1;
+        }
+    }
+
+    return sock_recvfrom(e->sock, buf, len, 0, NULL, NULL, NULL, &drops);
+}
+
+/**
+ * Sends one datagram to the other end
+ *
+ * Returns false (with errno set) if it couldn't
+ */
+static bool bench_send(struct bench_end *e, const char *buf, size_t len)
+{
+    if (e->cfg->shm)
+    {
+        errno = ENOBUFS;
+
+        return shmem_send(&e->shm, buf, len);
+    }
+
+    return sendto(e->sock, buf, len, 0, (struct sockaddr *)&e->peer, sizeof(e->peer)) != -1;
+}
+
+/**
+ * Echo thread: replies to every datagram with an ack-sized one, until an empty one arrives
+ */
+static void *echo_thread(void *arg)
+{
+    struct bench_end *e = arg;
+    char buf[MAX_DATAGRAM_SIZE];
+    ssize_t num_bytes;
+
+    if (e->cfg->busy && !busypoll_pin_cpu(e->cfg->echo_cpu))
+    {
+        return NULL;
+    }
+
+    while ((num_bytes = bench_recv(e, buf, sizeof(buf), false)) > 0)
+    {
+        if (!bench_send(e, buf, sizeof(struct ack)))
+        {
+            perror("echo sendto");
+
+            return NULL;
+        }
+    }
+
+    e->ok = num_bytes == 0;
+
+    return NULL;
+}
+
+/**
+ * Client thread: times cfg->samples round trips (after the warmup)
+ */
+static void *client_thread(void *arg)
+{
+    struct bench_end *e = arg;
+    char buf[MAX_DATAGRAM_SIZE];
+    int64_t start;
+    int i;
+
+    memset(buf, 'x', sizeof(buf));
+
+    if (e->cfg->busy && !busypoll_pin_cpu(e->cfg->client_cpu))
+    {
+        return NULL;
+    }
+
+    for (i = -BENCH_WARMUP; i < e->cfg->samples; i++)
+    {
+        start = now_ns();
+
+        if (!bench_send(e, buf, e->cfg->msg_len) || bench_recv(e, buf, sizeof(buf), true) <= 0)
+        {
+            perror("round trip");
+
+            break;
+        }
+
+        if (i >= 0)
+        {
+            e->rtt_ns[i] = now_ns() - start;
+        }
+    }
+
+    e->ok = i == e->cfg->samples;
+
+    /* An empty datagram stops the echo thread */
+    bench_send(e, buf, 0);
+
+    return NULL;
+}
+
+/**
+ * Runs one mode and prints its row
+ */
+static void run_mode(const struct bench_config *cfg)
+{
+    struct bench_end client;
+    struct bench_end echo;
+    pthread_t client_tid;
+    pthread_t echo_tid;
+    uint64_t before[STAT_NUM_COUNTERS];
+    uint64_t after[STAT_NUM_COUNTERS];
+    int64_t *rtt_ns = mem_alloc(cfg->samples, sizeof(int64_t));
+    int n = cfg->samples;
+
+    memset(&client, 0, sizeof(client));
+    memset(&echo, 0, sizeof(echo));
+    client.cfg = echo.cfg = cfg;
+    client.rtt_ns = rtt_ns;
+    client.sock = open_loopback(&echo.peer);
+    echo.sock = open_loopback(&client.peer);
+
+    if (cfg->busy)
+    {
+        busypoll_enable(client.sock, BUSYPOLL_DEFAULT_KERNEL_USEC);
+        busypoll_enable(echo.sock, BUSYPOLL_DEFAULT_KERNEL_USEC);
+    }
+
+    /* Both ends map the rings, as a sender and receiver in two processes would */
+    if (cfg->shm && (!shmem_create(&client.shm, ntohs(echo.peer.sin6_port)) ||
+                     !shmem_attach(&echo.shm, client.shm.key, ntohs(echo.peer.sin6_port))))
+    {
+        fprintf(stderr, "shm: couldn't map the rings\n");
+
+        exit(1);
+    }
+
+    if (cfg->shm)
+    {
+        shmem_unlink(&client.shm);
+    }
+
+    stats_aggregate(before);
+
+    pthread_create(&echo_tid, NULL, echo_thread, &echo);
+    pthread_create(&client_tid, NULL, client_thread, &client);
+    pthread_join(client_tid, NULL);
+    pthread_join(echo_tid, NULL);
+
+    stats_aggregate(after);
+
+    if (!client.ok || !echo.ok)
+    {
+        fprintf(stderr, "%s: the benchmark didn't finish\n", mode_name(cfg));
+    }
+    else
+    {
+        qsort(rtt_ns, n, sizeof(int64_t), cmp_int64);
+
+        printf("%s,%d,%.2f,%.2f,%.2f,%.2f,%llu,%llu\n", mode_name(cfg), n,
+               rtt_ns[n / 2] / 1000.0, rtt_ns[(int)(n * 0.99)] / 1000.0, rtt_ns[(int)(n * 0.999)] / 1000.0,
+               rtt_ns[n - 1] / 1000.0,
+               (unsigned long long)(after[STAT_SPIN_HITS] - before[STAT_SPIN_HITS]),
+               (unsigned long long)(after[STAT_SPIN_SLEEPS] - before[STAT_SPIN_SLEEPS]));
+    }
+
+    shmem_close(&echo.shm);
+    shmem_close(&client.shm);
+    close(client.sock);
+    close(echo.sock);
+    mem_free(rtt_ns);
+}
+
+
+/*-----------------------------------------------------------------------------
+ *
+ * --------------------------------------------------------------------------*/
+
+int main(int argc, char **argv)
+{
+    struct bench_config cfg;
+    long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    char *modes = "blocking,busypoll,shm";
+    int opt;
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.samples = 100000;
+    cfg.msg_len = 64;
+    cfg.spin_usec = BUSYPOLL_DEFAULT_SPIN_USEC;
+    cfg.client_cpu = 0;
+    cfg.echo_cpu = num_cpus > 1 ? 1 : 0;
+
+    while ((opt = getopt(argc, argv, "m:n:l:C:E:b:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'm':
+                modes = optarg;
+                break;
+            case 'n':
+                cfg.samples = atoi(optarg);
+                break;
+            case 'l':
+                cfg.msg_len = atoi(optarg);
+                break;
+            case 'C':
+                cfg.client_cpu = atoi(optarg);
+                break;
+            case 'E':
+                cfg.echo_cpu = atoi(optarg);
+                break;
+            case 'b':
+                cfg.spin_usec = atol(optarg);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-m blocking,busypoll,shm] [-n samples] [-l msg_bytes] "
+                                "[-C client_cpu] [-E echo_cpu] [-b spin_usec]\n", argv[0]);
+
+                exit(1);
+        }
+    }
+
+    if (cfg.samples < 1 || cfg.msg_len < (int)sizeof(struct ack) || cfg.msg_len > MAX_DATAGRAM_SIZE)
+    {
+        fprintf(stderr, "Usage: Need at least 1 sample, of %d to %d bytes\n", (int)sizeof(struct ack),
+                MAX_DATAGRAM_SIZE);
+
+        exit(1);
+    }
+
+    if (num_cpus < 2)
+    {
+        fprintf(stderr, "Warning: only one CPU online, so both ends share it and busy polling can't gain much\n");
+    }
+
+    printf("mode,samples,p50_us,p99_us,p999_us,max_us,spin_hits,spin_sleeps\n");
+
+    if (strstr(modes, "blocking") != NULL)
+    {
+        cfg.busy = false;
+        run_mode(&cfg);
+    }
+
+    if (strstr(modes, "busypoll") != NULL)
+    {
+        cfg.busy = true;
+        run_mode(&cfg);
+    }
+
+    /* Spins (and yields) on the rings the way the real programs do, without pinning */
+    if (strstr(modes, "shm") != NULL)
+    {
+        cfg.busy = false;
+        cfg.shm = true;
+        run_mode(&cfg);
+    }
+
+    return 0;
+}
@@ -0,0 +1,2073 @@
+/**
+ * UDP sender that takes in the receiver's IP address and Port number
+ * as command line arguments.
+ *
+ * Sent data is input as text on the command line
+ *
+ * The protocol itself lives in the ARQ library (arq.h). This file is built
+ * twice: as q1sender with the Go-Back-N engine, and as q2sender (with
+ * ARQ_SELECTIVE_REPEAT defined) with the Selective Repeat engine.
+ *
+ * CMPT 434 - A2
+ * Steven Rau
+ * scr108
+ * 11115094
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <arpa/inet.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <sys/eventfd.h>
+#include <netdb.h>
+#include <netinet/in.h>
+
+#include "sender.h"
+#include "shared.h"
+#include "stats.h"
+#include "log.h"
+#include "message.h"
+#include "input.h"
+#include "pool.h"
+#include "arq.h"
+#include "sock.h"
+#include "uring.h"
+#include "fec.h"
+#include "journal.h"
+#include "busypoll.h"
+#include "multipath.h"
+#include "session.h"
+#include "pmtu.h"
+#include "shmem.h"
+#include "trace.h"
+
+/*-----------------------------------------------------------------------------
+ * File-scope constants & globals
+ * --------------------------------------------------------------------------*/
+
+/* Pick the ARQ engine this sender is built with */
+#ifdef ARQ_SELECTIVE_REPEAT
+#define ARQ_POLICY(name)  arq_sr_##name
+#else
+#define ARQ_POLICY(name)  arq_gbn_##name
+#endif
+
+/* Number of recent transmissions remembered, to match acks and transmit timestamps to */
+#define SENDER_TX_LOG  1024
+
+/* Submission queue size of the io_uring backend, and what its completions are for */
+#define SENDER_URING_ENTRIES  256
+#define SENDER_UD_SEND        1
+#define SENDER_UD_RECV        2
+
+/* How often the ack thread checks whether the transfer is over (microseconds) */
+#define SENDER_ACK_POLL_USEC  100000L
+
+/* When one transmission went out. With an ack thread, the sending thread fills in records while
+ * the ack thread reads them, so every field is stored and loaded with __atomic builtins */
+struct tx_record
+{
+    uint32_t ts_sec;             /* The message's header timestamp, which its ack echoes back */
+    uint32_t ts_usec;
+    int64_t user_ns;             /* Just before sendto() (see sock_ts_ns()) */
+    int64_t kernel_ns;           /* The kernel's transmit timestamp (zero until it is read) */
+};
+
+/* Where datagrams for the receiver go */
+struct receiver_link
+{
+    int sock;
+    struct addrinfo *addr;
+    uint32_t kernel_drops;  /* The socket's kernel drop count as of the last ack read */
+    bool tx_timestamps;     /* Whether the kernel timestamps sent datagrams */
+    uint32_t num_sent;      /* Datagrams sent on the socket (the kernel numbers them the same way) */
+    struct tx_record tx_log[SENDER_TX_LOG];  /* Indexed by datagram number */
+
+    /* io_uring backend: the socket is a fixed file and the window's messages a fixed buffer.
+     * Sends are queued and go in with the next wait for an ack, in one system call */
+    bool use_uring;
+    struct uring ring;
+    const char *fixed_buf;  /* The registered buffer (the message pool's slots) */
+    size_t fixed_len;
+    bool recv_armed;        /* Whether a receive for the next ack is in flight */
+    char ack_buf[sizeof(struct ack)];
+    char ack_control[SOCK_CONTROL_LEN];
+    struct iovec ack_iov;
+    struct msghdr ack_hdr;
+
+    /* GSO: messages sent from the window are batched and handed to the kernel in one send,
+     * each padded out to the largest one's size */
+    bool use_gso;
+    const char *pool_buf;   /* The message pool's slots (batched messages are padded within them) */
+    size_t pool_len;
+    struct iovec gso_iov[SOCK_GSO_MAX_SEGMENTS];
+    unsigned gso_count;
+    size_t gso_seg;         /* Size every batched message is sent as */
+
+    /* Low-latency mode: acks are spun for instead of waited on in select() (-1 when off) */
+    long spin_usec;
+
+    /* FEC: one encoder per stream, following each group of new messages with parity (NULL if off) */
+    struct fec_encoder *fec;
+
+    /* Multipath: datagrams are striped over several flows, each with a socket and thread of its
+     * own, instead of going out on sock (NULL if off) */
+    struct multipath *mp;
+
+    /* Whether an ack thread reads the acks (only noting them, for the sending thread to reclaim) */
+    bool acks_on_thread;
+
+    /* Path MTU discovery: messages are sized to the largest datagram found to get through (NULL if off) */
+    struct pmtu *pmtu;
+
+    /* Shared memory: with the receiver on this host, messages and acks go through rings in a
+     * mapping the two share instead of the socket (NULL if off) */
+    struct shmem *shm;
+};
+
+/* Ack thread: reads every ack as it arrives, while the main thread sends */
+struct ack_thread
+{
+    pthread_t tid;
+    struct arq_sender *senders;
+    int num_streams;
+    struct receiver_link *link;
+    int wake_fd;            /* eventfd the ack thread wakes the sending thread up with */
+    uint32_t num_acks;      /* Shared: valid acks noted so far */
+    bool sender_waiting;    /* Shared: set while the sending thread waits for acks */
+    bool stop;              /* Shared: set once the sending thread is done */
+};
+
+/*-----------------------------------------------------------------------------
+ * Helper Functions
+ * --------------------------------------------------------------------------*/
+
+static long now_ms(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec * 1000L + now.tv_nsec / 1000000L;
+}
+
+/**
+ * Queues a message to be sent through io_uring. It goes out with the next submission, along
+ * with any others queued from the window in the meantime
+ */
+bool queue_uring_send(struct receiver_link *link, const void *msg, size_t len)
+{
+    struct io_uring_sqe *sqe;
+
+    /* Make room by submitting what is queued if the window outgrew the submission queue */
+    if ((sqe = uring_get_sqe(&link->ring)) == NULL)
+    {
+        uring_submit(&link->ring, 0, 0);
+
+        if ((sqe = uring_get_sqe(&link->ring)) == NULL)
+        {
+            fprintf(stderr, "io_uring: submission queue full\n");
+
+            return false;
+        }
+    }
+
+    /* Messages in the window are in the registered buffer, so the kernel doesn't have to map them
+     * for every send. The socket is connected, so a write sends the datagram */
+    if ((const char *)msg >= link->fixed_buf && (const char *)msg + len <= link->fixed_buf + link->fixed_len)
+    {
+        sqe->opcode = IORING_OP_WRITE_FIXED;
+        sqe->buf_index = 0;
+    }
+    else
+    {
+        sqe->opcode = IORING_OP_SEND;
+    }
+    sqe->fd = 0;
+    sqe->flags = IOSQE_FIXED_FILE;
+    sqe->addr = (uint64_t)(uintptr_t)msg;
+    sqe->len = len;
+    sqe->user_data = SENDER_UD_SEND;
+
+    __atomic_add_fetch(&link->num_sent, 1, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+/**
+ * Sends every batched message, all with one send if the kernel supports GSO
+ *
+ * Returns false if any of them couldn't be sent
+ */
+bool flush_gso(struct receiver_link *link)
+{
+    unsigned i;
+    unsigned count = link->gso_count;
+    bool sent = true;
+
+    if (count == 0)
+    {
+        return true;
+    }
+    link->gso_count = 0;
+
+    /* The kernel cuts the buffer into datagrams of the segment size, so every message but the
+     * last is padded out to it */
+    for (i = 0; i + 1 < count; i++)
+    {
+        link->gso_iov[i].iov_len = link->gso_seg;
+    }
+    link->gso_seg = 0;
+
+    if (count > 1 && link->use_gso)
+    {
+        if (sock_send_segments(link->sock, link->gso_iov, count, link->gso_iov[0].iov_len,
+                               link->addr->ai_addr, link->addr->ai_addrlen))
+        {
+            return true;
+        }
+
+        fprintf(stderr, "UDP GSO send failed (%s), sending one message at a time\n", strerror(errno));
+        link->use_gso = false;
+    }
+
+    /* Receivers ignore the padding, so the messages can go out as they are */
+    for (i = 0; i < count; i++)
+    {
+        if (sendto(link->sock, link->gso_iov[i].iov_base, link->gso_iov[i].iov_len, 0,
+                   link->addr->ai_addr, link->addr->ai_addrlen) == -1)
+        {
+            perror("sendto");
+
+            sent = false;
+        }
+    }
+
+    return sent;
+}
+
+/**
+ * Adds a message to the GSO batch, sending the batch first if the message would make it too big
+ * for one send
+ */
+bool queue_gso_send(struct receiver_link *link, const void *msg, size_t len)
+{
+    size_t seg = len > link->gso_seg ? len : link->gso_seg;
+
+    if (link->gso_count == SOCK_GSO_MAX_SEGMENTS || (link->gso_count + 1) * seg > SOCK_GSO_MAX_BYTES)
+    {
+        if (!flush_gso(link))
+        {
+            return false;
+        }
+
+        seg = len;
+    }
+
+    link->gso_iov[link->gso_count].iov_base = (void *)msg;
+    link->gso_iov[link->gso_count].iov_len = len;
+    link->gso_count++;
+    link->gso_seg = seg;
+
+    __atomic_add_fetch(&link->num_sent, 1, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+/**
+ * Sends one datagram on whichever path the link uses, logging the transmission
+ *
+ * @param[in] link  The link to send on
+ * @param[in] msg   Buffer containing the message to send
+ * @param[in] len   Number of bytes to send
+ */
+bool send_datagram(struct receiver_link *link, const void *msg, size_t len)
+{
+    struct tx_record *rec = &link->tx_log[link->num_sent % SENDER_TX_LOG];
+    const struct message *header = msg;
+    struct timespec now;
+
+    sock_now(&now);
+    __atomic_store_n(&rec->ts_sec, header->ts_sec, __ATOMIC_RELAXED);
+    __atomic_store_n(&rec->ts_usec, header->ts_usec, __ATOMIC_RELAXED);
+    __atomic_store_n(&rec->kernel_ns, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&rec->user_ns, sock_ts_ns(&now), __ATOMIC_RELAXED);
+
+    if (link->use_uring)
+    {
+        return queue_uring_send(link, msg, len);
+    }
+
+    if (link->mp != NULL)
+    {
+        if (!multipath_send(link->mp, msg, len))
+        {
+            return false;
+        }
+
+        __atomic_add_fetch(&link->num_sent, 1, __ATOMIC_RELEASE);
+
+        return true;
+    }
+
+    if (link->shm != NULL)
+    {
+        if (!shmem_send(link->shm, msg, len))
+        {
+            return false;
+        }
+
+        __atomic_add_fetch(&link->num_sent, 1, __ATOMIC_RELEASE);
+
+        return true;
+    }
+
+    /* Padding a message out to the segment size stays inside its slot in the pool */
+    if (link->use_gso && (const char *)msg >= link->pool_buf &&
+        (const char *)msg + sizeof(struct message) <= link->pool_buf + link->pool_len)
+    {
+        return queue_gso_send(link, msg, len);
+    }
+
+    if (sendto(link->sock, msg, len, 0, link->addr->ai_addr, link->addr->ai_addrlen) == -1)
+    {
+        /* A path MTU probe too big for the local interface is expected to fail */
+        if (errno != EMSGSIZE || !(header->flags & MSG_FLAG_PROBE))
+        {
+            perror("sendto");
+        }
+
+        return false;
+    }
+
+    __atomic_add_fetch(&link->num_sent, 1, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+/**
+ * Seals and sends the parity an FEC group was just closed with
+ *
+ * @param[in] link  The link to send on
+ * @param[in] e     The stream's encoder, with its parity ready
+ */
+void send_parity(struct receiver_link *link, struct fec_encoder *e)
+{
+    struct message *parity;
+    long now;
+    int i;
+
+    /* The group's own messages go out first: the receiver counts what it lost when the parity
+     * arrives. Parity isn't in the window, so it never goes through the batch or the fixed buffer */
+    if (link->use_uring)
+    {
+        uring_submit(&link->ring, 0, 0);
+    }
+    else
+    {
+        flush_gso(link);
+    }
+
+    for (i = 0; i < e->num_parity; i++)
+    {
+        parity = &e->parity[i];
+
+        now = arq_now_usec();
+        msg_seal(parity, (uint32_t)(now / 1000000L), (uint32_t)(now % 1000000L));
+
+        if (link->use_uring)
+        {
+            if (sendto(link->sock, parity, msg_wire_len(parity), 0, link->addr->ai_addr,
+                       link->addr->ai_addrlen) == -1)
+            {
+                perror("sendto");
+            }
+
+            __atomic_add_fetch(&link->num_sent, 1, __ATOMIC_RELEASE);
+        }
+        else
+        {
+            send_datagram(link, parity, msg_wire_len(parity));
+        }
+
+        STATS_INC(STAT_FEC_PARITY_SENT);
+    }
+
+    e->num_parity = 0;
+}
+
+/**
+ * Closes a stream's FEC group early, once waiting for more messages would only hold up the ones
+ * in it: there is no more input for now, or the window is full with nothing older than the group
+ * left for an ack to free room
+ *
+ * @param[in] link     The link to send the parity on
+ * @param[in] s        The stream's sender
+ * @param[in] stalled  Whether the input has run dry
+ */
+void close_fec_group(struct receiver_link *link, const struct arq_sender *s, bool stalled)
+{
+    struct fec_encoder *e = &link->fec[s->stream];
+
+    if (e->hdr.k == 0)
+    {
+        return;
+    }
+
+    if (stalled || (arq_sender_window_full(s) && msg_seq(arq_sender_msg(s, 0)) >= e->hdr.first_seq))
+    {
+        if (fec_encoder_close(e))
+        {
+            send_parity(link, e);
+        }
+    }
+}
+
+/**
+ * Takes in a msg buffer and sends it to the reciever (the ARQ library's send callback)
+ *
+ * New messages are also coded into their stream's FEC group, and a full group is followed by
+ * its parity
+ *
+ * @param[in] ctx  The receiver_link to send on
+ * @param[in] msg  Buffer containing the message to send
+ * @param[in] len  Number of bytes to send
+ */
+bool transfer_msg_to_receiver(void *ctx, const void *msg, size_t len)
+{
+    struct receiver_link *link = ctx;
+    const struct message *header = msg;
+
+    if (!send_datagram(link, msg, len))
+    {
+        return false;
+    }
+
+    if (link->fec != NULL && fec_encoder_add(&link->fec[header->stream], header))
+    {
+        send_parity(link, &link->fec[header->stream]);
+    }
+
+    return true;
+}
+
+/**
+ * Reads every transmit timestamp waiting on the socket into the transmission log
+ */
+void read_tx_timestamps(struct receiver_link *link)
+{
+    struct tx_record *rec;
+    struct timespec ts;
+    uint32_t id;
+    int64_t stack_ns;
+
+    while (sock_read_tx_timestamp(link->sock, &id, &ts))
+    {
+        /* Too old to still be in the log */
+        if (link->num_sent - id > SENDER_TX_LOG)
+        {
+            continue;
+        }
+
+        rec = &link->tx_log[id % SENDER_TX_LOG];
+        __atomic_store_n(&rec->kernel_ns, sock_ts_ns(&ts), __ATOMIC_RELAXED);
+
+        if ((stack_ns = sock_ts_ns(&ts) - __atomic_load_n(&rec->user_ns, __ATOMIC_RELAXED)) >= 0)
+        {
+            stats_record(HIST_TX_STACK_NS, stack_ns);
+        }
+    }
+}
+
+/**
+ * Takes RTT samples from an ack, measured between the kernel's timestamps where there are any:
+ * the whole round trip, and the round trip less the time the receiver held the message
+ *
+ * @param[in] link   The link the ack came in on
+ * @param[in] buf    The ack
+ * @param[in] len    Length of the ack
+ * @param[in] rx_ts  When the kernel received the ack (zero if unknown)
+ */
+void measure_rtt(struct receiver_link *link, const void *buf, int len, const struct timespec *rx_ts)
+{
+    struct ack reply;
+    struct timespec now;
+    const struct timespec *received = rx_ts;
+    struct tx_record *rec = NULL;
+    int64_t sent_ns;
+    uint32_t hold_ns;
+    int64_t rtt_ns;
+    uint32_t i;
+    /* With an ack thread, the sending thread logs transmissions as this reads them */
+    uint32_t num_sent = __atomic_load_n(&link->num_sent, __ATOMIC_ACQUIRE);
+
+    if (len < (int)sizeof(reply) || ((const struct ack *)buf)->version != ACK_VERSION)
+    {
+        return;
+    }
+    memcpy(&reply, buf, sizeof(reply));
+
+    sock_now(&now);
+    if (rx_ts->tv_sec != 0)
+    {
+        stats_record(HIST_RX_WAKEUP_NS, sock_ts_diff_ns(&now, rx_ts));
+    }
+    else
+    {
+        received = &now;
+    }
+
+    /* Find the transmission the ack echoes, newest first */
+    for (i = 1; i <= num_sent && i <= SENDER_TX_LOG; i++)
+    {
+        rec = &link->tx_log[(num_sent - i) % SENDER_TX_LOG];
+
+        if (__atomic_load_n(&rec->ts_sec, __ATOMIC_RELAXED) == reply.ts_sec &&
+            __atomic_load_n(&rec->ts_usec, __ATOMIC_RELAXED) == reply.ts_usec)
+        {
+            break;
+        }
+
+        rec = NULL;
+    }
+
+    if (rec == NULL)
+    {
+        return;
+    }
+
+    if ((sent_ns = __atomic_load_n(&rec->kernel_ns, __ATOMIC_RELAXED)) == 0)
+    {
+        sent_ns = __atomic_load_n(&rec->user_ns, __ATOMIC_RELAXED);
+    }
+
+    /* The record read may have been handed to a newer transmission meanwhile (the log wrapped
+     * around), in which case the sample could mix the two */
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&link->num_sent, __ATOMIC_RELAXED) - (num_sent - i) >= SENDER_TX_LOG)
+    {
+        return;
+    }
+
+    if ((rtt_ns = sock_ts_ns(received) - sent_ns) < 0)
+    {
+        return;
+    }
+
+    stats_record(HIST_RTT_NS, rtt_ns);
+
+    hold_ns = ntohl(reply.hold_nsec);
+    if (hold_ns != 0 && hold_ns != UINT32_MAX && hold_ns <= rtt_ns)
+    {
+        stats_record(HIST_RTT_NETWORK_NS, rtt_ns - hold_ns);
+    }
+}
+
+/**
+ * Picks the stream a line goes on from an "@<stream> " tag at its start, and strips the tag off.
+ * Untagged lines, and tags naming a stream that isn't open, go on stream 0 as they are
+ *
+ * @param[in,out] line         The line read in
+ * @param[in,out] line_len     Its length
+ * @param[in]     num_streams  Number of streams open
+ *
+ * Returns the stream
+ */
+int take_stream_tag(char *line, int *line_len, int num_streams)
+{
+    int stream = 0;
+    int i = 1;
+
+    if (*line_len < 2 || line[0] != '@')
+    {
+        return 0;
+    }
+
+    while (i < *line_len && line[i] >= '0' && line[i] <= '9' && stream < MAX_STREAMS)
+    {
+        stream = stream * 10 + (line[i] - '0');
+        i++;
+    }
+
+    /* Needs at least one digit, a space, and something left over to send */
+    if (i == 1 || i + 1 >= *line_len || line[i] != ' ' || stream >= num_streams)
+    {
+        return 0;
+    }
+
+    *line_len -= i + 1;
+    memmove(line, line + i + 1, *line_len);
+
+    return stream;
+}
+
+/**
+ * Reads the next line and takes its stream tag off, skipping the lines a resumed transfer
+ * already had acked
+ *
+ * @param[in]     in           The input
+ * @param[out]    line         Buffer for the line (MAX_TEXT_LENGTH bytes)
+ * @param[in]     timeout_ms   How long to wait for a line, or -1 to wait forever
+ * @param[in]     num_streams  Number of streams open
+ * @param[in,out] skip         Lines still to skip on each stream
+ * @param[out]    stream       Stream the line goes on
+ *
+ * Returns the length of the line, 0 if no line arrived in time, or -1 at end of input
+ */
+int read_line(struct line_input *in, char *line, int timeout_ms, int num_streams, uint32_t *skip,
+              int *stream)
+{
+    int line_len;
+
+    while ((line_len = input_read_line(in, line, MAX_TEXT_LENGTH, timeout_ms)) > 0)
+    {
+        *stream = take_stream_tag(line, &line_len, num_streams);
+
+        if (skip[*stream] == 0)
+        {
+            break;
+        }
+
+        skip[*stream]--;
+    }
+
+    return line_len;
+}
+
+/**
+ * Hands an ack to the sender of the stream it is for
+ *
+ * @param[in] senders      One sender per stream
+ * @param[in] num_streams  Number of streams open
+ * @param[in] link         The link it arrived on (whose FEC encoders take the loss it reports)
+ * @param[in] buf          The datagram from the receiver
+ * @param[in] len          Its length
+ *
+ * Returns true if it was a valid ack
+ */
+bool handle_ack(struct arq_sender *senders, int num_streams, struct receiver_link *link,
+                const void *buf, int len)
+{
+    int stream = arq_ack_stream(buf, len);
+
+    if (stream < 0 || stream >= num_streams)
+    {
+        LOG_WRN("Malformed ack received (%i bytes)\n", len);
+
+        return false;
+    }
+
+    /* A late answer to the session hello (when the hello was sent more than once) isn't an ack */
+    if (((const struct ack *)buf)->flags & ACK_FLAG_HELLO)
+    {
+        return false;
+    }
+
+    /* Nor is the answer to a path MTU probe */
+    if (((const struct ack *)buf)->flags & ACK_FLAG_PROBE)
+    {
+        if (link->pmtu != NULL)
+        {
+            pmtu_on_ack(link->pmtu, buf, len);
+        }
+
+        return false;
+    }
+
+    if (link->fec != NULL)
+    {
+        fec_encoder_set_loss(&link->fec[stream], ((const struct ack *)buf)->loss);
+    }
+
+    /* An ack thread only notes the ack. The sending thread takes the messages out of the window */
+    if (link->acks_on_thread)
+    {
+        return ARQ_POLICY(sender_note_ack)(&senders[stream], buf, len);
+    }
+
+    return ARQ_POLICY(sender_on_ack)(&senders[stream], buf, len);
+}
+
+/**
+ * Moves path MTU discovery along: resizes the messages built from here on if the size changed,
+ * and sends a probe if one is due
+ *
+ * @param[in] link         The link, with discovery on
+ * @param[in] senders      One sender per stream
+ * @param[in] num_streams  Number of streams open
+ */
+void run_pmtu(struct receiver_link *link, struct arq_sender *senders, int num_streams)
+{
+    uint32_t acked = 0;
+    bool outstanding = false;
+    size_t len;
+    int stream;
+
+    for (stream = 0; stream < num_streams; stream++)
+    {
+        acked += arq_sender_ack_frontier(&senders[stream]);
+        outstanding |= !arq_sender_idle(&senders[stream]);
+    }
+
+    if (pmtu_update(link->pmtu, arq_sender_rto_usec(&senders[0]), acked, outstanding))
+    {
+        msg_set_max_datagram(link->pmtu->size);
+
+        LOG_INF("Sending datagrams of up to %u bytes\n", link->pmtu->size);
+    }
+
+    if ((len = pmtu_next_probe(link->pmtu)) > 0 && !send_datagram(link, &link->pmtu->probe, len) &&
+        errno == EMSGSIZE)
+    {
+        pmtu_probe_failed(link->pmtu);
+    }
+}
+
+/**
+ * Notes a wait for an ack that ran out, tracing it on every stream with messages outstanding
+ */
+void note_timeout(const struct arq_sender *senders, int num_streams)
+{
+    int stream;
+
+    LOG_INF("Timed out waiting for reply.\n");
+
+    STATS_INC(STAT_TIMEOUTS);
+
+    for (stream = 0; stream < num_streams; stream++)
+    {
+        if (!arq_sender_idle(&senders[stream]))
+        {
+            TRACE(TRACE_TIMEOUT, stream, 0, arq_sender_ack_frontier(&senders[stream]), 0,
+                  senders[stream].num_queued, 0, 0);
+        }
+    }
+}
+
+/**
+ * Gets an ack (reply) from the receiver and hands it to the ARQ engine
+ *
+ * The ack should be the sequence number of most recent successfully recieved packet
+ *
+ * @param[in] senders      The ARQ sender state, one per stream
+ * @param[in] num_streams  Number of streams open
+ * @param[in] link         Socket the receiver replies on
+ * @param[in] timeout      Amount of time to wait for response before timing out and moving on
+ *
+ * Returns true if a valid ack was received
+ */
+bool get_reply_from_receiver(struct arq_sender *senders, int num_streams, struct receiver_link *link,
+                             struct timeval *timeout)
+{
+    int num_bytes;
+    int rv;
+    char reply[sizeof(struct ack)];
+    struct sock_rx_info rx;
+    fd_set socket_read_set;
+
+    /* Send the messages batched up for GSO before waiting on their acks */
+    flush_gso(link);
+
+    /* Use select to see if the receiver's socket is ready for reading (has sent a reply) */
+    while (1)
+    {
+        /* Create a socket file descriptor set containing the receiver's fd for the select call */
+        FD_ZERO(&socket_read_set);
+        FD_SET(link->sock, &socket_read_set);
+
+        if ((rv = select(link->sock + 1, &socket_read_set, NULL, NULL, timeout)) <= 0)
+        {
+            break;
+        }
+
+        /* Transmit timestamps wake select() up too */
+        if (link->tx_timestamps)
+        {
+            read_tx_timestamps(link);
+        }
+
+        /* Read in the UDP server's reply. If it was only timestamps, go back to waiting for the
+         * rest of the timeout (select() leaves the time remaining in it) */
+        if ((num_bytes = sock_recvfrom(link->sock, reply, sizeof(reply), MSG_DONTWAIT, NULL, NULL,
+                                       &rx, &link->kernel_drops)) == -1)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                continue;
+            }
+
+            perror("recvfrom");
+
+            return false;
+        }
+
+        measure_rtt(link, reply, num_bytes, &rx.ts);
+
+        return handle_ack(senders, num_streams, link, reply, num_bytes);
+    }
+
+    /* If select doesn't return that a socket is ready, either timeout or error occured */
+    if (rv == 0)
+    {
+        note_timeout(senders, num_streams);
+    }
+    /* Interrupted because the program is stopping, which the main loop checks next */
+    else if (errno != EINTR)
+    {
+        perror("select");
+    }
+
+    return false;
+}
+
+/**
+ * Low-latency version of get_reply_from_receiver(): spins on the socket for the ack, for up to
+ * the spin budget, instead of sleeping in select(). The deadline of the earliest timer (the
+ * timeout) is checked as it spins
+ */
+bool get_reply_from_receiver_spin(struct arq_sender *senders, int num_streams, struct receiver_link *link,
+                                  struct timeval *timeout)
+{
+    int num_bytes;
+    char reply[sizeof(struct ack)];
+    struct sock_rx_info rx;
+
+    flush_gso(link);
+
+    if ((num_bytes = busypoll_recv(link->sock, reply, sizeof(reply), NULL, NULL, &rx, &link->kernel_drops,
+                                   link->spin_usec, timeout->tv_sec * 1000000L + timeout->tv_usec)) == -1)
+    {
+        /* Interrupted because the program is stopping, which the main loop checks next */
+        if (errno == EINTR)
+        {
+            return false;
+        }
+
+        if (errno != EAGAIN)
+        {
+            perror("recvfrom");
+
+            return false;
+        }
+
+        note_timeout(senders, num_streams);
+
+        return false;
+    }
+
+    /* Nothing wakes up for transmit timestamps here, so pick them up along with the ack */
+    if (link->tx_timestamps)
+    {
+        read_tx_timestamps(link);
+    }
+
+    measure_rtt(link, reply, num_bytes, &rx.ts);
+
+    return handle_ack(senders, num_streams, link, reply, num_bytes);
+}
+
+/**
+ * Multipath version of get_reply_from_receiver(): takes the next ack any of the flows read
+ */
+bool get_reply_from_receiver_multipath(struct arq_sender *senders, int num_streams,
+                                       struct receiver_link *link, struct timeval *timeout)
+{
+    int num_bytes;
+    char reply[sizeof(struct ack)];
+    struct timespec rx_ts;
+
+    if ((num_bytes = multipath_recv(link->mp, reply, sizeof(reply), &rx_ts,
+                                    timeout->tv_sec * 1000000L + timeout->tv_usec)) == -1)
+    {
+        if (errno != EAGAIN)
+        {
+            perror("select");
+
+            return false;
+        }
+
+        note_timeout(senders, num_streams);
+
+        return false;
+    }
+
+    measure_rtt(link, reply, num_bytes, &rx_ts);
+
+    return handle_ack(senders, num_streams, link, reply, num_bytes);
+}
+
+/**
+ * Shared memory version of get_reply_from_receiver(): takes the next ack from the receiver's ring
+ */
+bool get_reply_from_receiver_shared(struct arq_sender *senders, int num_streams,
+                                    struct receiver_link *link, struct timeval *timeout)
+{
+    int num_bytes;
+    char reply[sizeof(struct ack)];
+    struct timespec rx_ts;
+
+    if ((num_bytes = shmem_recv(link->shm, reply, sizeof(reply), timeout->tv_sec * 1000000L + timeout->tv_usec)) == -1)
+    {
+        note_timeout(senders, num_streams);
+
+        return false;
+    }
+
+    /* Nothing is timestamped on the way through the rings */
+    memset(&rx_ts, 0, sizeof(rx_ts));
+    measure_rtt(link, reply, num_bytes, &rx_ts);
+
+    return handle_ack(senders, num_streams, link, reply, num_bytes);
+}
+
+/**
+ * io_uring version of get_reply_from_receiver(): submits the queued sends and a receive for the
+ * ack, and waits until the ack arrives or the timeout runs out
+ */
+bool get_reply_from_receiver_uring(struct arq_sender *senders, int num_streams,
+                                   struct receiver_link *link, struct timeval *timeout)
+{
+    struct io_uring_sqe *sqe;
+    struct io_uring_cqe *cqe;
+    struct sock_rx_info rx;
+    long deadline = arq_now_usec() + timeout->tv_sec * 1000000L + timeout->tv_usec;
+    long remaining;
+    int num_bytes = -1;
+    int rv;
+
+    if (!link->recv_armed && (sqe = uring_get_sqe(&link->ring)) != NULL)
+    {
+        link->ack_hdr.msg_controllen = sizeof(link->ack_control);
+
+        sqe->opcode = IORING_OP_RECVMSG;
+        sqe->fd = 0;
+        sqe->flags = IOSQE_FIXED_FILE;
+        sqe->addr = (uint64_t)(uintptr_t)&link->ack_hdr;
+        sqe->len = 1;
+        sqe->user_data = SENDER_UD_RECV;
+
+        link->recv_armed = true;
+    }
+
+    do
+    {
+        remaining = deadline - arq_now_usec();
+
+        if ((rv = uring_submit(&link->ring, 1, remaining > 0 ? remaining : 0)) < 0 &&
+            rv != -ETIME && rv != -EINTR)
+        {
+            fprintf(stderr, "io_uring_enter: %s\n", strerror(-rv));
+
+            return false;
+        }
+
+        /* Interrupted because the program is stopping, which the main loop checks next */
+        if (rv == -EINTR && stats_stopping())
+        {
+            return false;
+        }
+
+        while ((cqe = uring_peek_cqe(&link->ring)) != NULL)
+        {
+            if (cqe->user_data == SENDER_UD_RECV)
+            {
+                link->recv_armed = false;
+                num_bytes = cqe->res;
+            }
+            else if (cqe->res < 0)
+            {
+                fprintf(stderr, "io_uring send: %s\n", strerror(-cqe->res));
+            }
+
+            uring_cqe_seen(&link->ring);
+        }
+
+        if (num_bytes >= 0)
+        {
+            sock_read_cmsgs(&link->ack_hdr, &rx, &link->kernel_drops);
+            measure_rtt(link, link->ack_buf, num_bytes, &rx.ts);
+
+            return handle_ack(senders, num_streams, link, link->ack_buf, num_bytes);
+        }
+    } while (arq_now_usec() < deadline);
+
+    note_timeout(senders, num_streams);
+
+    return false;
+}
+
+/**
+ * Ack thread: waits on the socket and notes every ack as soon as it arrives, so acks are handled
+ * promptly however busy the sending thread is. The sending thread is woken up if it is waiting
+ *
+ * @param[in] arg  The struct ack_thread
+ */
+void *ack_thread_main(void *arg)
+{
+    struct ack_thread *t = arg;
+    struct receiver_link *link = t->link;
+    char reply[sizeof(struct ack)];
+    struct sock_rx_info rx;
+    struct timeval timeout;
+    fd_set socket_read_set;
+    int num_bytes;
+    uint64_t one = 1;
+
+    while (!__atomic_load_n(&t->stop, __ATOMIC_ACQUIRE))
+    {
+        /* Time out now and then to see whether the transfer is over */
+        FD_ZERO(&socket_read_set);
+        FD_SET(link->sock, &socket_read_set);
+        timeout.tv_sec = SENDER_ACK_POLL_USEC / 1000000L;
+        timeout.tv_usec = SENDER_ACK_POLL_USEC % 1000000L;
+
+        if (select(link->sock + 1, &socket_read_set, NULL, NULL, &timeout) <= 0)
+        {
+            continue;
+        }
+
+        if ((num_bytes = sock_recvfrom(link->sock, reply, sizeof(reply), MSG_DONTWAIT, NULL, NULL,
+                                       &rx, &link->kernel_drops)) == -1)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                perror("recvfrom");
+            }
+
+            continue;
+        }
+
+        measure_rtt(link, reply, num_bytes, &rx.ts);
+
+        if (!handle_ack(t->senders, t->num_streams, link, reply, num_bytes))
+        {
+            continue;
+        }
+
+        /* Count the ack before looking for a waiting sender, which sets its flag before looking at
+         * the count, so one of the two always sees the other */
+        __atomic_add_fetch(&t->num_acks, 1, __ATOMIC_SEQ_CST);
+
+        if (__atomic_load_n(&t->sender_waiting, __ATOMIC_SEQ_CST) &&
+            write(t->wake_fd, &one, sizeof(one)) == -1)
+        {
+            perror("eventfd write");
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * The sending thread's wait when an ack thread is running: sleeps until an ack it hasn't seen
+ * yet is noted or the timeout runs out
+ *
+ * @param[in]     t          The ack thread
+ * @param[in,out] acks_seen  Acks noted as of the last wait
+ * @param[in]     timeout    Longest to wait
+ */
+void wait_for_acks(struct ack_thread *t, uint32_t *acks_seen, struct timeval *timeout)
+{
+    fd_set wake_set;
+    uint64_t count;
+    int rv = 1;
+
+    /* Send the messages batched up for GSO before waiting on their acks */
+    flush_gso(t->link);
+
+    __atomic_store_n(&t->sender_waiting, true, __ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&t->num_acks, __ATOMIC_SEQ_CST) == *acks_seen)
+    {
+        FD_ZERO(&wake_set);
+        FD_SET(t->wake_fd, &wake_set);
+
+        if ((rv = select(t->wake_fd + 1, &wake_set, NULL, NULL, timeout)) == 0)
+        {
+            note_timeout(t->senders, t->num_streams);
+        }
+        else if (rv == -1)
+        {
+            perror("select");
+        }
+    }
+
+    __atomic_store_n(&t->sender_waiting, false, __ATOMIC_SEQ_CST);
+
+    /* Clear any wakeup (the eventfd is non-blocking), then take everything noted up to now */
+    if (read(t->wake_fd, &count, sizeof(count)) == -1 && errno != EAGAIN)
+    {
+        perror("eventfd read");
+    }
+
+    *acks_seen = __atomic_load_n(&t->num_acks, __ATOMIC_SEQ_CST);
+}
+
+/**
+ * Starts the ack thread. From then on only it reads the socket
+ *
+ * Returns false (with errno set) if it couldn't be started
+ */
+bool start_ack_thread(struct ack_thread *t, struct arq_sender *senders, int num_streams,
+                      struct receiver_link *link)
+{
+    memset(t, 0, sizeof(*t));
+    t->senders = senders;
+    t->num_streams = num_streams;
+    t->link = link;
+
+    if ((t->wake_fd = eventfd(0, EFD_NONBLOCK)) == -1)
+    {
+        return false;
+    }
+
+    link->acks_on_thread = true;
+
+    if ((errno = pthread_create(&t->tid, NULL, ack_thread_main, t)) != 0)
+    {
+        link->acks_on_thread = false;
+        close(t->wake_fd);
+
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Stops the ack thread once the transfer is done
+ */
+void stop_ack_thread(struct ack_thread *t)
+{
+    __atomic_store_n(&t->stop, true, __ATOMIC_RELEASE);
+
+    pthread_join(t->tid, NULL);
+    close(t->wake_fd);
+
+    t->link->acks_on_thread = false;
+}
+
+/**
+ * Switches the link over to io_uring, if the kernel supports it
+ *
+ * @param[in,out] link  The link, already open
+ * @param[in]     pool  The window's message pool, registered as a fixed buffer
+ *
+ * Returns false (leaving the link on the classic path) if it isn't available
+ */
+bool open_uring(struct receiver_link *link, struct msg_pool *pool)
+{
+    struct iovec fixed;
+
+    if (!uring_init(&link->ring, SENDER_URING_ENTRIES))
+    {
+        return false;
+    }
+
+    fixed.iov_base = pool->slots;
+    fixed.iov_len = pool->capacity * sizeof(struct message);
+
+    /* Writes need a connected socket */
+    if (connect(link->sock, link->addr->ai_addr, link->addr->ai_addrlen) == -1 ||
+        !uring_register_files(&link->ring, &link->sock, 1) ||
+        !uring_register_buffers(&link->ring, &fixed, 1))
+    {
+        uring_destroy(&link->ring);
+
+        return false;
+    }
+
+    link->fixed_buf = fixed.iov_base;
+    link->fixed_len = fixed.iov_len;
+
+    link->ack_iov.iov_base = link->ack_buf;
+    link->ack_iov.iov_len = sizeof(link->ack_buf);
+    memset(&link->ack_hdr, 0, sizeof(link->ack_hdr));
+    link->ack_hdr.msg_iov = &link->ack_iov;
+    link->ack_hdr.msg_iovlen = 1;
+    link->ack_hdr.msg_control = link->ack_control;
+
+    /* Transmit timestamps are only read on the classic path. Left on, they would pile up on
+     * the error queue */
+    link->tx_timestamps = sock_enable_timestamps(link->sock, false);
+    link->recv_armed = false;
+    link->use_uring = true;
+
+    return true;
+}
+
+/**
+ * Opens the session: sends the hello and waits for the receiver to answer with the settings both
+ * ends support. Without an answer after a few tries, the sender goes ahead with its own
+ *
+ * @param[in]  link          The link to the receiver, before anything else is sent on it
+ * @param[in]  mine          This sender's parameters
+ * @param[out] agreed        The settings to use
+ * @param[in]  timeout_usec  How long to wait for each answer
+ */
+void open_session(struct receiver_link *link, const struct session_params *mine,
+                  struct session_params *agreed, long timeout_usec)
+{
+    struct message hello;
+    char reply[sizeof(struct ack) + sizeof(struct session_params)];
+    size_t len = session_hello(&hello, mine);
+    struct timeval timeout;
+    fd_set socket_read_set;
+    enum session_reject reason;
+    int num_bytes;
+    int tries;
+
+    for (tries = 0; tries < SESSION_HELLO_TRIES; tries++)
+    {
+        /* Logged like any other transmission, so the kernel's transmit timestamps stay in step */
+        if (!send_datagram(link, &hello, len))
+        {
+            break;
+        }
+
+        timeout.tv_sec = timeout_usec / 1000000L;
+        timeout.tv_usec = timeout_usec % 1000000L;
+
+        while (1)
+        {
+            FD_ZERO(&socket_read_set);
+            FD_SET(link->sock, &socket_read_set);
+
+            if (select(link->sock + 1, &socket_read_set, NULL, NULL, &timeout) <= 0)
+            {
+                break;
+            }
+
+            if (link->tx_timestamps)
+            {
+                read_tx_timestamps(link);
+            }
+
+            if ((num_bytes = sock_recvfrom(link->sock, reply, sizeof(reply), MSG_DONTWAIT, NULL, NULL,
+                                           NULL, &link->kernel_drops)) == -1)
+            {
+                continue;
+            }
+
+            if ((reason = session_read_rejection(reply, num_bytes)) != SESSION_ACCEPTED)
+            {
+                fprintf(stderr, "The receiver refused the session: %s\n", session_reject_name(reason));
+
+                exit(1);
+            }
+
+            /* Anything else (e.g. an ack left over from an earlier run) is ignored */
+            if (!session_read_reply(reply, num_bytes, agreed))
+            {
+                continue;
+            }
+
+            if (((struct ack *)reply)->version != ACK_VERSION)
+            {
+                fprintf(stderr, "The receiver speaks protocol version %u, not %u\n",
+                        ((struct ack *)reply)->version, ACK_VERSION);
+
+                exit(1);
+            }
+
+            /* Messages can't be sized to fit a segment this small, or bigger than this end sends */
+            if (agreed->mss < MSG_MIN_DATAGRAM || agreed->mss > mine->mss)
+            {
+                fprintf(stderr, "The receiver agreed to datagrams of %u bytes, which this sender can't use\n",
+                        agreed->mss);
+
+                exit(1);
+            }
+
+            return;
+        }
+    }
+
+    fprintf(stderr, "No answer to the session hello, going ahead with the command line settings\n");
+
+    /* Except shared memory, which the receiver has to have mapped */
+    *agreed = *mine;
+    agreed->features &= ~SESSION_FEATURE_SHM;
+    agreed->shm_key = 0;
+}
+
+/**
+ * Resolves the receiver's address and opens the socket used for the whole transfer
+ *
+ * @param[in]  receiver_ip    Host name of server (UDP)
+ * @param[in]  receiver_port  Server's port number (UDP)
+ * @param[in]  rcvbuf         Socket receive buffer size in bytes (0 for the default)
+ * @param[in]  sndbuf         Socket send buffer size in bytes (0 for the default)
+ * @param[out] link           The socket and the address it sends to
+ * @param[out] serv_info      Address list to free once done with link
+ */
+void open_receiver_link(char *receiver_ip, char *receiver_port, int rcvbuf, int sndbuf,
+                        struct receiver_link *link, struct addrinfo **serv_info)
+{
+    struct addrinfo hints;
+    struct addrinfo *p;
+    int rv;
+
+    memset(&hints, 0, sizeof hints);
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+
+    /* Get the receiver's address information */
+    if ((rv = getaddrinfo(receiver_ip, receiver_port, &hints, serv_info)) != 0)
+    {
+        fprintf(stderr, "getaddrinfo: %s\n", gai_strerror(rv));
+
+        exit(1);
+    }
+
+    /* Loop through the results and make the first available socket */
+    for(p = *serv_info; p != NULL; p = p->ai_next)
+    {
+        if ((link->sock = socket(p->ai_family, p->ai_socktype,
+                              p->ai_protocol)) == -1)
+        {
+            perror("talker: socket");
+
+            continue;
+        }
+
+        break;
+    }
+
+    if (p == NULL)
+    {
+        fprintf(stderr, "talker: failed to create socket\n");
+
+        exit(1);
+    }
+
+    link->addr = p;
+    link->kernel_drops = 0;
+    link->num_sent = 0;
+    link->use_uring = false;
+    link->use_gso = false;
+    link->gso_count = 0;
+    link->gso_seg = 0;
+    link->fec = NULL;
+    link->spin_usec = -1;
+    link->acks_on_thread = false;
+    link->mp = NULL;
+    link->pmtu = NULL;
+    link->shm = NULL;
+
+    sock_set_buffers(link->sock, rcvbuf, sndbuf);
+    sock_track_drops(link->sock);
+    link->tx_timestamps = sock_enable_timestamps(link->sock, true);
+}
+
+
+/*-----------------------------------------------------------------------------
+ *
+ * --------------------------------------------------------------------------*/
+
+int main(int argc, char **argv)
+{
+    int max_window_size;
+    int timeout_sec;
+    char *receiver_ip;
+    char *receiver_port;
+    struct receiver_link link;
+    struct addrinfo *serv_info;
+    struct arq_sender senders[MAX_STREAMS];  /* One sender (window and sequence numbers) per stream */
+    struct arq_sender_ops sender_ops;
+    int num_streams = 1;
+    int stream;
+    struct msg_pool pool;             /* Every message the windows can hold, allocated up front */
+    struct arq_slot *window;          /* The sliding windows, back to back (messages from the pool) */
+    struct message *msg;
+    struct line_input input;          /* Reader for the lines of text from stdin */
+    char line[MAX_TEXT_LENGTH];       /* Line of text read in */
+    int line_len = 0;                 /* Length of a line read in but not sent yet (0 if none) */
+    int line_stream = 0;              /* Stream that line goes on */
+    int sent_stream;                  /* Stream a new message is being sent on (-1 if none) */
+    bool any_room;                    /* Whether some stream's window has room for another message */
+    bool all_idle;                    /* Whether every stream's messages have all been acked */
+    bool input_done = false;          /* Set once stdin has been read to the end */
+    int coalesce_ms = 0;              /* How long to wait for more lines to pack into a message (0 = off) */
+    long flush_at;                    /* Time (ms) a message being packed must be sent by */
+    long now;
+    struct compress_stage compress;   /* Optional compression of each message's text */
+    bool use_compression = false;
+    struct timeval timeout;
+    long wait_usec;
+    char *stats_file = NULL;  /* File to dump runtime stats to (stderr if not given) */
+    int stats_interval = 0;   /* Seconds between periodic stats dumps to the file */
+    char **args;              /* Positional arguments following the options */
+    int opt;
+    int verbosity = LOG_INFO; /* Each -v enables more logging (-v logs every packet) */
+    int rcvbuf = 0;           /* Socket buffer sizes in bytes (0 leaves the system default) */
+    int sndbuf = 0;
+    bool use_uring = false;   /* Send and receive through io_uring instead of sendto()/select() */
+    bool use_gso = false;     /* Batch the window's messages into one send with UDP GSO */
+    int fec_mode = 0;         /* Forward error correction code (an enum fec_mode, 0 = off) */
+    int fec_k = 8;            /* Messages per FEC group */
+    int fec_max_r = 4;        /* Most parity datagrams per group (Reed-Solomon) */
+    char *journal_file = NULL;   /* Where to keep progress for resuming (none if not given) */
+    struct journal journal;
+    char *trace_file = NULL;     /* Where to record the transfer's events (none if not given) */
+    uint32_t skip[MAX_STREAMS];  /* Input lines on each stream that were acked before a restart */
+    int pin_cpu = -1;         /* Low-latency mode: core to pin to (-1 = off) */
+    long spin_usec = BUSYPOLL_DEFAULT_SPIN_USEC;  /* and how long to spin for each ack */
+    bool use_ack_thread = false;  /* Read the acks on a thread of their own */
+    struct ack_thread acks;
+    uint32_t acks_seen = 0;       /* Acks the ack thread had noted as of the last wait */
+    int mss = 0;                  /* Largest datagram to send (0: the default for the mode) */
+    bool use_pmtu = false;        /* Find the largest datagram the path carries, and send those */
+    struct pmtu pmtu;
+    struct session_params mine;   /* What this sender asks for in the session handshake */
+    struct session_params agreed; /* and what the receiver agreed to */
+    int num_flows = 1;            /* Multipath: UDP flows the transfer is striped over (1 = off) */
+    bool spread_ports = false;    /* and whether they go to consecutive receiver ports */
+    bool use_shm = true;          /* Go through shared memory when the receiver is on this host */
+    bool offer_shm;
+    struct shmem shm;
+    uint16_t port;
+
+    /* Get any options, followed by the receiver host and port as well as window size and timeout */
+    while ((opt = getopt(argc, argv, "c:zs:i:B:W:ugS:F:K:P:J:t:C:b:TM:rm:pNv")) != -1)
+    {
+        switch (opt)
+        {
+            case 'c':
+                coalesce_ms = atoi(optarg);
+                break;
+            case 'z':
+                use_compression = true;
+                break;
+            case 's':
+                stats_file = optarg;
+                break;
+            case 'i':
+                stats_interval = atoi(optarg);
+                break;
+            case 'B':
+                rcvbuf = atoi(optarg);
+                break;
+            case 'W':
+                sndbuf = atoi(optarg);
+                break;
+            case 'u':
+                use_uring = true;
+                break;
+            case 'g':
+                use_gso = true;
+                break;
+            case 'S':
+                num_streams = atoi(optarg);
+                break;
+            case 'F':
+                fec_mode = strcmp(optarg, "xor") == 0 ? FEC_XOR : strcmp(optarg, "rs") == 0 ? FEC_RS : -1;
+                break;
+            case 'K':
+                fec_k = atoi(optarg);
+                break;
+            case 'P':
+                fec_max_r = atoi(optarg);
+                break;
+            case 'J':
+                journal_file = optarg;
+                break;
+            case 't':
+                trace_file = optarg;
+                break;
+            case 'C':
+                pin_cpu = atoi(optarg);
+                break;
+            case 'b':
+                spin_usec = atol(optarg);
+                break;
+            case 'T':
+                use_ack_thread = true;
+                break;
+            case 'M':
+                num_flows = atoi(optarg);
+                break;
+            case 'r':
+                spread_ports = true;
+                break;
+            case 'm':
+                mss = atoi(optarg);
+                break;
+            case 'p':
+                use_pmtu = true;
+                break;
+            case 'N':
+                use_shm = false;
+                break;
+            case 'v':
+                verbosity++;
+                break;
+            default:
+                argc = 0;
+                break;
+        }
+    }
+    args = argv + optind;
+
+    /* Get the receiver host and port as well as window size and timeout from the command line */
+    if (argc - optind < 4 || fec_mode < 0)
+    {
+        fprintf(stderr, "Usage: %s [-v] [-c coalesce_delay_ms] [-z] [-s stats_file] [-i stats_interval_sec] "
+                        "[-B rcvbuf_bytes] [-W sndbuf_bytes] [-u] [-g] [-S num_streams] "
+                        "[-F xor|rs] [-K fec_group_size] [-P fec_max_parity] [-J journal_file] [-t trace_file] [-C cpu] [-b spin_usec] [-T] [-M num_flows] [-r] [-m max_datagram_bytes] [-p] [-N] <receiver_ip> <receiver_port> <max_window_size> <timeout_sec>\n", argv[0]);
+
+        exit(1);
+    }
+    receiver_ip = args[0];
+    receiver_port = args[1];
+    max_window_size = atoi(args[2]);
+    timeout_sec = atoi(args[3]);
+
+    /* Check to make sure input variables are allowed */
+    if (atoi(receiver_port) < MIN_PORT_NUM || atoi(receiver_port) > MAX_PORT_NUM)
+    {
+        fprintf(stderr, "Usage: Port numbers must be between %d and %d\n",
+                         MIN_PORT_NUM, MAX_PORT_NUM);
+
+        exit(1);
+    }
+
+    if (max_window_size < 1)
+    {
+        fprintf(stderr, "Usage: Max window size must be at least 1\n");
+
+        exit(1);
+    }
+
+    if (num_streams < 1 || num_streams > MAX_STREAMS)
+    {
+        fprintf(stderr, "Usage: Number of streams must be between 1 and %d\n", MAX_STREAMS);
+
+        exit(1);
+    }
+
+    /* Without path MTU discovery, datagrams stay small enough for any Ethernet path. With it, -m
+     * caps how far the search goes */
+    if (mss == 0)
+    {
+        mss = use_pmtu ? MAX_DATAGRAM_SIZE : DEFAULT_DATAGRAM_SIZE;
+    }
+
+    if (mss < (int)SESSION_MIN_MSS || mss > MAX_DATAGRAM_SIZE)
+    {
+        fprintf(stderr, "Usage: Datagrams must be allowed between %d and %d bytes\n", (int)SESSION_MIN_MSS,
+                         MAX_DATAGRAM_SIZE);
+
+        exit(1);
+    }
+
+    if (num_flows < 1 || num_flows > MAX_FLOWS)
+    {
+        fprintf(stderr, "Usage: Number of flows must be between 1 and %d\n", MAX_FLOWS);
+
+        exit(1);
+    }
+
+    if (fec_mode != 0 && (fec_k < 1 || fec_k > FEC_MAX_K || fec_max_r < 1 || fec_max_r > FEC_MAX_R))
+    {
+        fprintf(stderr, "Usage: FEC group size must be between 1 and %d, and parity between 1 and %d\n",
+                         FEC_MAX_K, FEC_MAX_R);
+
+        exit(1);
+    }
+
+    printf("UDP sender started: \n"
+           "\tReceiver IP/Hostname: %s, Receiver Port: %s\n"
+           "\tMax message window size: %i  Timeout (sec): %i\n"
+	   "\tReady for input...\n\n", receiver_ip, receiver_port, max_window_size, timeout_sec);
+
+    /* Start exporting runtime counters (on SIGUSR1, periodically and at exit) */
+    stats_start("sender", stats_file, stats_interval);
+
+    /* Start the background logger */
+    log_start(verbosity);
+
+    /* Record every send, ack and timeout for traceview to go over afterwards */
+    if (trace_file != NULL && !trace_open(trace_file, TRACE_SENDER))
+    {
+        exit(1);
+    }
+
+    /* One socket is used for the whole transfer */
+    open_receiver_link(receiver_ip, receiver_port, rcvbuf, sndbuf, &link, &serv_info);
+
+    /* Where the last run got to is offered in the session hello, and the receiver may send it
+     * further back */
+    journal.fd = -1;
+    if (journal_file != NULL && !journal_open(&journal, journal_file, JOURNAL_SENDER, num_streams))
+    {
+        exit(1);
+    }
+
+    /* Agree on the settings with the receiver before anything else is sent */
+    memset(&mine, 0, sizeof(mine));
+    mine.version = ACK_VERSION;
+    mine.num_streams = num_streams;
+    mine.features = (use_compression ? SESSION_FEATURE_COMPRESS : 0) |
+                    (fec_mode != 0 ? SESSION_FEATURE_FEC : 0);
+#ifdef ARQ_SELECTIVE_REPEAT
+    mine.features |= SESSION_FEATURE_SACK;
+#endif
+    mine.window = max_window_size;
+    mine.mss = mss;
+    for (stream = 0; stream < num_streams && journal.fd != -1; stream++)
+    {
+        mine.resume[stream] = journal.rec.next[stream];
+    }
+
+    /* A receiver on this host is offered shared memory instead of the socket, unless something
+     * only the socket has was asked for */
+    port = ntohs(link.addr->ai_family == AF_INET6 ? ((struct sockaddr_in6 *)link.addr->ai_addr)->sin6_port
+                                                  : ((struct sockaddr_in *)link.addr->ai_addr)->sin_port);
+    offer_shm = use_shm && !use_uring && !use_gso && pin_cpu < 0 && !use_ack_thread && num_flows == 1 &&
+                !use_pmtu && shmem_is_local(link.addr->ai_addr, link.addr->ai_addrlen) &&
+                shmem_create(&shm, port);
+    if (offer_shm)
+    {
+        mine.features |= SESSION_FEATURE_SHM;
+        mine.shm_key = shm.key;
+    }
+
+    open_session(&link, &mine, &agreed, timeout_sec * 1000000L);
+    session_print(&mine, &agreed);
+
+    /* The receiver maps the shared memory before agreeing to it, so its name can go either way */
+    if (offer_shm && (agreed.features & SESSION_FEATURE_SHM))
+    {
+        shmem_unlink(&shm);
+        link.shm = &shm;
+        link.tx_timestamps = sock_enable_timestamps(link.sock, false);
+
+        printf("\tSending through shared memory (the receiver is on this host)\n");
+    }
+    else if (offer_shm)
+    {
+        shmem_close(&shm);
+    }
+
+    max_window_size = agreed.window;
+    num_streams = agreed.num_streams;
+    use_compression = use_compression && (agreed.features & SESSION_FEATURE_COMPRESS);
+    fec_mode = (agreed.features & SESSION_FEATURE_FEC) ? fec_mode : 0;
+    msg_set_max_datagram(agreed.mss);
+
+    /* Allocate space for every stream's sliding window and hand it to the ARQ engine. This is all
+     * the memory the sender needs; nothing is allocated per message after this. The streams share
+     * one pool, so it can be registered with io_uring as a single buffer */
+    msg_pool_init(&pool, max_window_size * num_streams);
+    window = mem_alloc(max_window_size * num_streams, sizeof(struct arq_slot));
+
+    /* Older kernels (or ones with io_uring turned off) get the classic path */
+    if (use_uring && !open_uring(&link, &pool))
+    {
+        fprintf(stderr, "io_uring unavailable (%s), using sendto()/select()\n", strerror(errno));
+    }
+    else if (use_uring)
+    {
+        printf("\tUsing io_uring for sends and acks\n");
+    }
+
+    /* io_uring already puts the whole window in one system call, so GSO is only for the
+     * classic path. Transmit timestamps are numbered per send, not per message, so they are
+     * turned off */
+    if (use_gso && link.use_uring)
+    {
+        fprintf(stderr, "GSO is not used with io_uring\n");
+    }
+    else if (use_gso)
+    {
+        link.pool_buf = (const char *)pool.slots;
+        link.pool_len = pool.capacity * sizeof(struct message);
+        link.tx_timestamps = sock_enable_timestamps(link.sock, false);
+        link.use_gso = true;
+
+        printf("\tBatching sends with UDP GSO\n");
+    }
+
+    /* Low-latency mode pins the sender (after the logger and stats threads started, so they
+     * don't share its core) and spins for acks. io_uring already waits in the kernel */
+    if (pin_cpu >= 0 && link.use_uring)
+    {
+        fprintf(stderr, "Low-latency mode is not used with io_uring\n");
+    }
+    else if (pin_cpu >= 0 && busypoll_pin_cpu(pin_cpu))
+    {
+        busypoll_enable(link.sock, BUSYPOLL_DEFAULT_KERNEL_USEC);
+        link.spin_usec = spin_usec;
+
+        printf("\tLow-latency mode: pinned to CPU %d, spinning up to %ld us for each ack\n",
+               pin_cpu, spin_usec);
+    }
+
+    sender_ops.send = transfer_msg_to_receiver;
+    sender_ops.now_usec = NULL;
+    sender_ops.ctx = &link;
+    for (stream = 0; stream < num_streams; stream++)
+    {
+        arq_sender_init(&senders[stream], &pool, window + stream * max_window_size, max_window_size,
+                        timeout_sec * 1000000L, &sender_ops);
+        senders[stream].stream = stream;
+    }
+
+    /* Every stream codes its own messages, since each has its own sequence numbers */
+    if (fec_mode != 0)
+    {
+        link.fec = mem_alloc(num_streams, sizeof(struct fec_encoder));
+        for (stream = 0; stream < num_streams; stream++)
+        {
+            fec_encoder_init(&link.fec[stream], fec_mode, fec_k, fec_max_r);
+        }
+
+        printf("\tForward error correction: %s over groups of up to %d messages\n",
+               fec_mode == FEC_XOR ? "XOR parity" : "Reed-Solomon", fec_k);
+    }
+
+    /* Carry on from where the session agreed the last run got to. The input is read from the start
+     * again, and the lines that were acked are skipped */
+    memset(skip, 0, sizeof(skip));
+    for (stream = 0; stream < num_streams; stream++)
+    {
+        skip[stream] = agreed.resume[stream];
+        arq_sender_resume(&senders[stream], agreed.resume[stream]);
+
+        if (journal.fd != -1 && (agreed.resume[stream] > 0 || journal.rec.sent[stream] > 0))
+        {
+            printf("\tResuming stream %d at seq #%u (%u sent but not acked before the restart)\n",
+                   stream, agreed.resume[stream], journal.rec.sent[stream] - journal.rec.next[stream]);
+        }
+    }
+
+    if (num_streams > 1)
+    {
+        printf("\tCarrying %d streams (start a line with \"@<stream> \" to pick one)\n", num_streams);
+    }
+
+    /* Multipath stripes everything over the flows' sockets instead of the link's own. The flows
+     * have threads of their own making the system calls, so io_uring, GSO and low-latency mode
+     * don't apply */
+    if (num_flows > 1 && (link.use_uring || link.use_gso || link.spin_usec >= 0))
+    {
+        fprintf(stderr, "Multipath is not used with io_uring, GSO or low-latency mode\n");
+    }
+    else if (num_flows > 1)
+    {
+        link.mp = mem_alloc(1, sizeof(struct multipath));
+        if (!multipath_open(link.mp, num_flows, link.addr->ai_addr, link.addr->ai_addrlen, spread_ports,
+                            rcvbuf, sndbuf))
+        {
+            exit(1);
+        }
+
+        link.tx_timestamps = sock_enable_timestamps(link.sock, false);
+
+        printf("\tStriping over %d flows%s\n", num_flows, spread_ports ? ", one receiver port each" : "");
+    }
+
+    /* Messages start out at the base size, and grow as bigger probes get through. The flows'
+     * sockets aren't the link's, so multipath keeps the agreed size. io_uring sends later from
+     * the buffer it is given, which a message re-sent in pieces (after the size drops) doesn't keep */
+    if (use_pmtu && (link.mp != NULL || link.use_uring))
+    {
+        fprintf(stderr, "Path MTU discovery is not used with io_uring or multipath\n");
+    }
+    else if (use_pmtu)
+    {
+        if (!pmtu_open(&pmtu, link.sock, link.addr->ai_family, agreed.mss, timeout_sec * 1000000L))
+        {
+            exit(1);
+        }
+
+        link.pmtu = &pmtu;
+        msg_set_max_datagram(pmtu.size);
+
+        printf("\tPath MTU discovery: starting at %u bytes, probing up to %u\n", pmtu.size, pmtu.max);
+    }
+
+    /* The ack thread takes over reading the socket. io_uring, low-latency mode and multipath have
+     * their own ways of waiting for acks. Path MTU discovery's probe state is moved along by both
+     * the acks and the sending thread, so it stays on one thread. The transmission log is written by
+     * this thread and read by the ack thread, so the kernel's transmit timestamps (which the reader
+     * would write in) are off */
+    if (use_ack_thread && (link.use_uring || link.spin_usec >= 0 || link.mp != NULL || link.pmtu != NULL))
+    {
+        fprintf(stderr, "The ack thread is not used with io_uring, low-latency mode, multipath or path MTU discovery\n");
+    }
+    else if (use_ack_thread)
+    {
+        link.tx_timestamps = sock_enable_timestamps(link.sock, false);
+
+        if (!start_ack_thread(&acks, senders, num_streams, &link))
+        {
+            fprintf(stderr, "Couldn't start the ack thread (%s)\n", strerror(errno));
+
+            exit(1);
+        }
+
+        printf("\tReading acks on a thread of their own\n");
+    }
+
+    input_init(&input, STDIN_FILENO);
+
+    compress_init(&compress, use_compression ? COMPRESS_DEFAULT_NS_PER_BYTE : 0);
+
+    /* Main sender loop that receives user input from stdin and forwards the messages to the receiver
+     * via UDP. The user-specified window size and timeout length determine the functional details
+     * of the sliding window implementation. Every stream has a window of its own. Runs until all
+     * input is acked, or Ctrl-C / SIGTERM */
+    while (!stats_stopping())
+    {
+        any_room = false;
+        all_idle = true;
+        for (stream = 0; stream < num_streams; stream++)
+        {
+            /* Take what the ack thread saw acked out of the window */
+            if (link.acks_on_thread)
+            {
+                ARQ_POLICY(sender_reclaim)(&senders[stream]);
+            }
+
+            any_room |= !arq_sender_window_full(&senders[stream]);
+            all_idle &= arq_sender_idle(&senders[stream]);
+        }
+
+        /* Probe the path, and size the next messages to what was found */
+        if (link.pmtu != NULL)
+        {
+            run_pmtu(&link, senders, num_streams);
+        }
+
+        /* Read the command line text if a window has room for it, unless a line is left over
+         * from the last message (or is waiting on its stream's window) */
+        if (line_len == 0 && any_room && !input_done)
+        {
+            /* Only prompt when a person is typing, not for every line of piped input */
+            if (isatty(STDIN_FILENO))
+            {
+                printf("Enter a message: \n");
+            }
+
+            line_len = read_line(&input, line, link.fec != NULL ? 0 : -1, num_streams, skip, &line_stream);
+
+            /* With FEC, groups still filling up are closed before blocking on input, so their
+             * messages aren't left unprotected while nothing else is coming */
+            if (line_len == 0)
+            {
+                for (stream = 0; stream < num_streams; stream++)
+                {
+                    close_fec_group(&link, &senders[stream], true);
+                }
+
+                line_len = read_line(&input, line, -1, num_streams, skip, &line_stream);
+            }
+
+            if (line_len < 0)
+            {
+                input_done = true;
+                line_len = 0;
+
+                continue;
+            }
+
+            /* Interrupted by a signal: go back around and check whether it means stop */
+            if (line_len == 0)
+            {
+                continue;
+            }
+        }
+
+        /* Once all input has been sent and acked there is nothing left to do */
+        sent_stream = line_len > 0 && !arq_sender_window_full(&senders[line_stream]) ? line_stream : -1;
+        if (sent_stream < 0 && all_idle)
+        {
+            break;
+        }
+
+        /* If the line's window isn't full, send another new message on its stream */
+        if (sent_stream >= 0)
+        {
+            /* Build the message right in the next window slot, starting with the line as its first record */
+            msg = arq_sender_next_msg(&senders[line_stream]);
+            msg_add_record(msg, line, line_len);
+            line_len = 0;
+
+            /* When coalescing, keep packing lines into the message until it is full or the delay
+             * runs out. A line that doesn't fit (or is for another stream) is held for the next message */
+            if (coalesce_ms > 0)
+            {
+                flush_at = now_ms() + coalesce_ms;
+
+                while (msg_has_room(msg, 1) && (now = now_ms()) < flush_at)
+                {
+                    line_len = read_line(&input, line, (int)(flush_at - now), num_streams, skip, &line_stream);
+                    if (line_len <= 0)
+                    {
+                        input_done = line_len < 0;
+                        line_len = 0;
+
+                        break;
+                    }
+
+                    if (line_stream != msg->stream || !msg_add_record(msg, line, line_len))
+                    {
+                        break;
+                    }
+                    line_len = 0;
+                }
+            }
+
+            /* Compress the whole message (all of its records together) if it pays off */
+            msg_compress(msg, &compress);
+
+            /* Queue the message in the window and send it */
+            ARQ_POLICY(sender_send)(&senders[msg->stream]);
+
+            /* When batching, keep filling the windows with lines that are already waiting, so
+             * they go out together in one send */
+            if (link.use_gso && !input_done && line_len == 0 && any_room)
+            {
+                line_len = read_line(&input, line, 0, num_streams, skip, &line_stream);
+                if (line_len > 0)
+                {
+                    continue;
+                }
+
+                input_done = line_len < 0;
+                line_len = 0;
+            }
+        }
+
+        if (link.fec != NULL)
+        {
+            for (stream = 0; stream < num_streams; stream++)
+            {
+                close_fec_group(&link, &senders[stream], input_done && line_len == 0);
+            }
+        }
+
+        /* Messages batched for GSO go out before anything is re-sent, so a message still in the
+         * batch is never queued into it a second time */
+        flush_gso(&link);
+
+        /* Re-send on every stream whose timer ran out (under Selective Repeat, just the unacked
+         * messages whose own timer ran out), or whose oldest unacked message duplicate acks
+         * reported lost. An ack that moves the window on is no reason to go back, and a busy
+         * stream doesn't hold up the recovery of the others. The ack thread doesn't count duplicate
+         * acks, so with it only the timers re-send */
+        for (stream = 0; stream < num_streams; stream++)
+        {
+            if (ARQ_POLICY(sender_retransmit_due)(&senders[stream]))
+            {
+                ARQ_POLICY(sender_retransmit)(&senders[stream]);
+            }
+        }
+
+        /* Setup or reset timeout since select() modifes it: the time left until the first message's
+         * timer runs out, on whichever stream that is */
+        wait_usec = timeout_sec * 1000000L;
+        for (stream = 0; stream < num_streams; stream++)
+        {
+            if (!arq_sender_idle(&senders[stream]) &&
+                ARQ_POLICY(sender_wait_usec)(&senders[stream]) < wait_usec)
+            {
+                wait_usec = ARQ_POLICY(sender_wait_usec)(&senders[stream]);
+            }
+        }
+        timeout.tv_sec = wait_usec / 1000000L;
+        timeout.tv_usec = wait_usec % 1000000L;
+
+        /* Get the ack (reply) from the receiver, which updates the sliding window. With the ack
+         * thread reading them, a stream that just sent carries on sending, and otherwise this waits
+         * for the thread to note more acks */
+        if (link.use_uring)
+        {
+            get_reply_from_receiver_uring(senders, num_streams, &link, &timeout);
+        }
+        else if (link.mp != NULL)
+        {
+            get_reply_from_receiver_multipath(senders, num_streams, &link, &timeout);
+        }
+        else if (link.shm != NULL)
+        {
+            get_reply_from_receiver_shared(senders, num_streams, &link, &timeout);
+        }
+        else if (link.acks_on_thread && sent_stream >= 0)
+        {
+            flush_gso(&link);
+        }
+        else if (link.acks_on_thread)
+        {
+            wait_for_acks(&acks, &acks_seen, &timeout);
+        }
+        else if (link.spin_usec >= 0)
+        {
+            get_reply_from_receiver_spin(senders, num_streams, &link, &timeout);
+        }
+        else
+        {
+            get_reply_from_receiver(senders, num_streams, &link, &timeout);
+        }
+
+        /* Written out only when an ack moved a stream forward */
+        for (stream = 0; stream < num_streams; stream++)
+        {
+            journal_record(&journal, stream, arq_sender_ack_frontier(&senders[stream]), senders[stream].next_seq);
+        }
+    }
+
+    if (link.acks_on_thread)
+    {
+        stop_ack_thread(&acks);
+    }
+
+    if (link.mp != NULL)
+    {
+        multipath_close(link.mp);
+        mem_free(link.mp);
+    }
+
+    /* Lets the receiver go back to its socket */
+    if (link.shm != NULL)
+    {
+        shmem_close(link.shm);
+    }
+
+    journal_close(&journal);
+
+    /* Nothing else is sending or reading acks by now */
+    trace_close();
+
+    if (link.use_uring)
+    {
+        uring_destroy(&link.ring);
+    }
+
+    freeaddrinfo(serv_info);
+
+    close(link.sock);
+
+    mem_free(window);
+
+    if (link.fec != NULL)
+    {
+        mem_free(link.fec);
+    }
+
+    msg_pool_destroy(&pool);
+
+    return 0;
+}
@@ -0,0 +1,269 @@
+/**
+ * Session handshake: the sender and receiver agree on their settings
+ * before any data flows
+ *
+ * CMPT 434 - A2
+ * Steven Rau
+ * scr108
+ * 11115094
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#include "session.h"
+
+/*-----------------------------------------------------------------------------
+ * File-scope constants & globals
+ * --------------------------------------------------------------------------*/
+
+/* Reasons for refusing a session, indexed by enum session_reject */
+static const char *reject_names[SESSION_NUM_REJECTS] =
+{
+    "accepted",
+    "datagrams too small to carry a message",
+    "a different protocol version"
+};
+
+/*-----------------------------------------------------------------------------
+ * Helper functions
+ * --------------------------------------------------------------------------*/
+
+static void params_to_wire(struct session_params *wire, const struct session_params *p)
+{
+    int i;
+
+    memset(wire, 0, sizeof(*wire));
+
+    wire->version = p->version;
+    wire->num_streams = p->num_streams;
+    wire->features = htons(p->features);
+    wire->window = htonl(p->window);
+    wire->buffer = htonl(p->buffer);
+    wire->mss = htons(p->mss);
+    wire->shm_key = htonl(p->shm_key);
+
+    for (i = 0; i < MAX_STREAMS; i++)
+    {
+        wire->resume[i] = htonl(p->resume[i]);
+    }
+}
+
+static void params_from_wire(struct session_params *p, const struct session_params *wire)
+{
+    int i;
+
+    memset(p, 0, sizeof(*p));
+
+    p->version = wire->version;
+    p->num_streams = wire->num_streams;
+    p->features = ntohs(wire->features);
+    p->window = ntohl(wire->window);
+    p->buffer = ntohl(wire->buffer);
+    p->mss = ntohs(wire->mss);
+    p->shm_key = ntohl(wire->shm_key);
+
+    for (i = 0; i < MAX_STREAMS; i++)
+    {
+        p->resume[i] = ntohl(wire->resume[i]);
+    }
+}
+
+/**
+ * Prints one feature as on or off, noting if this end wanted it otherwise
+ */
+static void print_feature(const char *name, uint16_t bit, const struct session_params *mine,
+                          const struct session_params *agreed)
+{
+    printf(" %s %s%s", name, (agreed->features & bit) ? "on" : "off",
+           (mine->features & bit) && !(agreed->features & bit) ? " (not supported by the other end)" : "");
+}
+
+/*-----------------------------------------------------------------------------
+ * Session handshake
+ * --------------------------------------------------------------------------*/
+
+size_t session_hello(struct message *msg, const struct session_params *mine)
+{
+    struct session_params wire;
+    struct timespec now;
+
+    params_to_wire(&wire, mine);
+
+    msg_init(msg, 0);
+    msg->flags = MSG_FLAG_HELLO;
+    msg->count = htons(1);
+    msg->len = htons(sizeof(wire));
+    memcpy(msg->text, &wire, sizeof(wire));
+
+    /* The reply echoes the timestamp, like an ack */
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    msg_seal(msg, (uint32_t)now.tv_sec, (uint32_t)(now.tv_nsec / 1000));
+
+    return msg_wire_len(msg);
+}
+
+bool session_read_hello(struct message *msg, int len, struct session_params *theirs)
+{
+    if (!(msg->flags & MSG_FLAG_HELLO) || !msg_intact(msg, len) || msg_text_len(msg) < sizeof(*theirs))
+    {
+        return false;
+    }
+
+    params_from_wire(theirs, (const struct session_params *)msg->text);
+
+    return true;
+}
+
+enum session_reject session_check(const struct session_params *theirs)
+{
+    if (theirs->version != ACK_VERSION)
+    {
+        return SESSION_REJECT_VERSION;
+    }
+
+    if (theirs->mss < MSG_MIN_DATAGRAM)
+    {
+        return SESSION_REJECT_MSS;
+    }
+
+    return SESSION_ACCEPTED;
+}
+
+void session_negotiate(const struct session_params *sender, const struct session_params *receiver,
+                       struct session_params *agreed)
+{
+    int i;
+
+    memset(agreed, 0, sizeof(*agreed));
+
+    agreed->version = ACK_VERSION;
+    agreed->features = sender->features & receiver->features;
+    agreed->num_streams = sender->num_streams < receiver->num_streams ? sender->num_streams : receiver->num_streams;
+    agreed->buffer = receiver->buffer;
+    agreed->mss = sender->mss < receiver->mss ? sender->mss : receiver->mss;
+    agreed->shm_key = (agreed->features & SESSION_FEATURE_SHM) ? sender->shm_key : 0;
+
+    /* After a loss, up to a window less one messages arrive ahead of the gap, and a Selective
+     * Repeat receiver has to hold them all. Any more would be dropped and sent again */
+    agreed->window = sender->window;
+    if ((agreed->features & SESSION_FEATURE_SACK) && receiver->buffer > 0 && agreed->window > receiver->buffer + 1)
+    {
+        agreed->window = receiver->buffer + 1;
+    }
+
+    if (receiver->window > 0 && agreed->window > receiver->window)
+    {
+        agreed->window = receiver->window;
+    }
+
+    /* Going back is always possible (the sender replays its input, and the receiver takes the
+     * lines again), but going ahead would skip lines one end never had */
+    for (i = 0; i < agreed->num_streams && i < MAX_STREAMS; i++)
+    {
+        agreed->resume[i] = sender->resume[i] < receiver->resume[i] ? sender->resume[i] : receiver->resume[i];
+    }
+}
+
+int session_reply(void *buf, const struct message *hello, const struct session_params *agreed)
+{
+    struct ack reply;
+    struct session_params wire;
+
+    memset(&reply, 0, sizeof(reply));
+    reply.version = ACK_VERSION;
+    reply.flags = ACK_FLAG_HELLO;
+    reply.cum_ack = htonl(UINT32_MAX);
+    reply.ts_sec = hello->ts_sec;
+    reply.ts_usec = hello->ts_usec;
+
+    params_to_wire(&wire, agreed);
+
+    memcpy(buf, &reply, sizeof(reply));
+    memcpy((char *)buf + sizeof(reply), &wire, sizeof(wire));
+
+    return sizeof(reply) + sizeof(wire);
+}
+
+int session_reject(void *buf, const struct message *hello, enum session_reject reason)
+{
+    struct ack reply;
+
+    memset(&reply, 0, sizeof(reply));
+    reply.version = ACK_VERSION;
+    reply.flags = ACK_FLAG_HELLO | ACK_FLAG_REJECT;
+    reply.cum_ack = htonl(UINT32_MAX);
+    reply.sel_ack = htonl(reason);
+    reply.ts_sec = hello->ts_sec;
+    reply.ts_usec = hello->ts_usec;
+
+    memcpy(buf, &reply, sizeof(reply));
+
+    return sizeof(reply);
+}
+
+bool session_read_reply(const void *buf, int len, struct session_params *agreed)
+{
+    const struct ack *reply = buf;
+
+    if (len < (int)(sizeof(struct ack) + sizeof(*agreed)) || !(reply->flags & ACK_FLAG_HELLO) ||
+        (reply->flags & ACK_FLAG_REJECT))
+    {
+        return false;
+    }
+
+    params_from_wire(agreed, (const struct session_params *)((const char *)buf + sizeof(struct ack)));
+
+    return true;
+}
+
+enum session_reject session_read_rejection(const void *buf, int len)
+{
+    const struct ack *reply = buf;
+    uint32_t reason;
+
+    if (len < (int)sizeof(struct ack) ||
+        (reply->flags & (ACK_FLAG_HELLO | ACK_FLAG_REJECT)) != (ACK_FLAG_HELLO | ACK_FLAG_REJECT))
+    {
+        return SESSION_ACCEPTED;
+    }
+
+    /* A reason this end doesn't know of is still a refusal */
+    reason = ntohl(reply->sel_ack);
+
+    return reason > SESSION_ACCEPTED && reason < SESSION_NUM_REJECTS ? (enum session_reject)reason
+                                                                     : SESSION_NUM_REJECTS;
+}
+
+const char *session_reject_name(enum session_reject reason)
+{
+    return reason < SESSION_NUM_REJECTS ? reject_names[reason] : "unknown reason";
+}
+
+void session_print(const struct session_params *mine, const struct session_params *agreed)
+{
+    int i;
+
+    printf("\tSession: window %u%s, %u stream%s%s, datagrams up to %u bytes%s\n", agreed->window,
+           mine->window > agreed->window ? " (cut down to fit the receiver's buffer)" : "",
+           agreed->num_streams, agreed->num_streams == 1 ? "" : "s",
+           mine->num_streams > agreed->num_streams ? " (the other end has fewer)" : "", agreed->mss,
+           mine->mss > agreed->mss ? " (the other end takes less)" : "");
+
+    printf("\t        ");
+    print_feature("selective acks", SESSION_FEATURE_SACK, mine, agreed);
+    print_feature("| compression", SESSION_FEATURE_COMPRESS, mine, agreed);
+    print_feature("| FEC", SESSION_FEATURE_FEC, mine, agreed);
+    print_feature("| shared memory", SESSION_FEATURE_SHM, mine, agreed);
+    printf("\n");
+
+    for (i = 0; i < agreed->num_streams && i < MAX_STREAMS; i++)
+    {
+        if (mine->resume[i] > agreed->resume[i])
+        {
+            printf("\t         stream %d goes back to seq #%u (the other end is behind)\n", i, agreed->resume[i]);
+        }
+    }
+}
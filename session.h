@@ -0,0 +1,159 @@
+/**
+ * Session handshake: the sender and receiver agree on their settings
+ * before any data flows
+ *
+ * The sender's window and the receiver's buffer (along with the streams,
+ * the largest datagram and the optional features) are picked on two
+ * command lines, and a mismatch used to cost throughput silently: a window
+ * bigger than the buffer overflows it, and FEC parity sent to a receiver
+ * that doesn't decode it is wasted. Now the sender opens with a hello
+ * carrying its parameters, the receiver answers with the best settings
+ * both ends support, and both print what was agreed.
+ *
+ * The hello is a message (MSG_FLAG_HELLO, sealed like any other) with a
+ * struct session_params for text. The reply is an ack (ACK_FLAG_HELLO)
+ * followed by the agreed struct session_params. The sender re-sends its
+ * hello until a reply comes, and the receiver answers every hello it gets
+ * the same way, so either one being lost is harmless.
+ *
+ * Each end also says where every stream is to resume (from its journal, or
+ * for the receiver, how far it has got), and both start from the lower of
+ * the two. An end that lost its progress (or never had a journal) takes the
+ * other back to the start, instead of one end waiting on sequence numbers
+ * the other will never send.
+ *
+ * A hello the receiver can't work with gets a bare ack with ACK_FLAG_HELLO
+ * and ACK_FLAG_REJECT instead, with the reason in sel_ack, and the sender
+ * gives up.
+ *
+ * CMPT 434 - A2
+ * Steven Rau
+ * scr108
+ * 11115094
+ */
+
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "shared.h"
+#include "message.h"
+
+/* Features either end may support */
+#define SESSION_FEATURE_SACK      0x0001  /* Out of order messages are buffered and acked one by one (Selective Repeat) */
+#define SESSION_FEATURE_COMPRESS  0x0002  /* Messages may be LZ compressed */
+#define SESSION_FEATURE_FEC       0x0004  /* Groups of messages are followed by FEC parity */
+#define SESSION_FEATURE_SHM       0x0008  /* Messages and acks go through shared memory (same host only) */
+
+/* Smallest datagram that still carries a message holding the longest line */
+#define SESSION_MIN_MSS  (MSG_HEADER_SIZE + MSG_RECORD_OVERHEAD + MAX_TEXT_LENGTH)
+
+/* Times the sender sends its hello before going ahead with its own settings */
+#define SESSION_HELLO_TRIES  5
+
+/* Why the receiver refused a session. Keep in sync with the names in session.c */
+enum session_reject
+{
+    SESSION_ACCEPTED,
+    SESSION_REJECT_MSS,      /* The datagrams are too small to carry a message (see MSG_MIN_DATAGRAM) */
+    SESSION_REJECT_VERSION,  /* The ends lay out messages and acks differently (ACK_VERSION) */
+    SESSION_NUM_REJECTS
+};
+
+/*
+ * One end's parameters, or (in the reply) the ones agreed. Network byte
+ * order on the wire
+ */
+struct session_params
+{
+    uint8_t version;      /* Message and ack layout the end speaks (ACK_VERSION) */
+    uint8_t num_streams;
+    uint16_t features;    /* SESSION_FEATURE_* */
+    uint32_t window;      /* Most messages in flight per stream (0 from the receiver: no limit) */
+    uint32_t buffer;      /* Messages the receiver can hold out of order per stream (0 if it drops them) */
+    uint16_t mss;         /* Largest datagram the end sends or takes */
+    uint16_t reserved;
+    uint32_t shm_key;     /* Sender: names the shared memory it offers (see shmem.h) */
+    uint32_t resume[MAX_STREAMS];  /* First sequence number on each stream still to go through
+                                    * (see journal.h), 0 for a fresh start */
+};
+
+/**
+ * Sender: builds the hello carrying its parameters, sealed and ready to send
+ *
+ * Returns its length on the wire
+ */
+size_t session_hello(struct message *msg, const struct session_params *mine);
+
+/**
+ * Receiver: reads the sender's parameters out of a hello (msg has MSG_FLAG_HELLO set)
+ *
+ * Returns false if it is damaged or too short
+ */
+bool session_read_hello(struct message *msg, int len, struct session_params *theirs);
+
+/**
+ * Receiver: checks that the sender's parameters can be worked with
+ *
+ * Returns SESSION_ACCEPTED, or why the session has to be refused
+ */
+enum session_reject session_check(const struct session_params *theirs);
+
+/**
+ * Receiver: works out the best settings both ends support
+ *
+ * The features are the ones both have (the receiver still has to map the sender's shared
+ * memory before agreeing to it). The window is the sender's, cut down to what fits in the
+ * receiver's buffer when it buffers out of order messages, and the streams, segment size and
+ * resume points are the smaller of the two
+ */
+void session_negotiate(const struct session_params *sender, const struct session_params *receiver,
+                       struct session_params *agreed);
+
+/**
+ * Receiver: builds the reply to a hello, echoing its timestamp
+ *
+ * @param[out] buf     Room for sizeof(struct ack) + sizeof(struct session_params) bytes
+ * @param[in]  hello   The hello being answered
+ * @param[in]  agreed  The settings agreed
+ *
+ * Returns its length
+ */
+int session_reply(void *buf, const struct message *hello, const struct session_params *agreed);
+
+/**
+ * Receiver: builds the reply refusing a hello, echoing its timestamp
+ *
+ * @param[out] buf     Room for sizeof(struct ack) bytes
+ * @param[in]  hello   The hello being refused
+ * @param[in]  reason  Why
+ *
+ * Returns its length
+ */
+int session_reject(void *buf, const struct message *hello, enum session_reject reason);
+
+/**
+ * Sender: reads the agreed settings out of a datagram from the receiver
+ *
+ * Returns false if it isn't a reply to a hello (or is a refusal)
+ */
+bool session_read_reply(const void *buf, int len, struct session_params *agreed);
+
+/**
+ * Sender: checks if a datagram from the receiver refuses the session
+ *
+ * Returns why, or SESSION_ACCEPTED if it isn't a refusal
+ */
+enum session_reject session_read_rejection(const void *buf, int len);
+
+/* Says why a session was refused */
+const char *session_reject_name(enum session_reject reason);
+
+/**
+ * Prints the settings agreed, flagging the ones that differ from what this end asked for
+ */
+void session_print(const struct session_params *mine, const struct session_params *agreed);
+
+#endif /* SESSION_H */
@@ -7,8 +7,10 @@
  * 11115094
  */
 
-#include <stdint.h>
+#ifndef SHARED_H
+#define SHARED_H
 
+#include <stdint.h>
 
 /* Max and min allowed port numbers */
 #define MIN_PORT_NUM    30000
@@ -17,19 +19,100 @@
 /* Define the max line of text length */
 #define MAX_TEXT_LENGTH  256
 
+/* Largest datagram sent unless path MTU discovery finds room for more: a 1500 byte Ethernet MTU
+ * minus the IPv6 and UDP headers */
+#define DEFAULT_DATAGRAM_SIZE  1452
+
+/* Largest datagram ever sent or taken, which buffers are sized for: a 9000 byte jumbo frame minus
+ * the IPv6 and UDP headers */
+#define MAX_DATAGRAM_SIZE  8952
+
+/* Bytes of message header in front of the text (see struct message) */
+#define MSG_HEADER_SIZE  24
+
+/* Room left for text (one or more length-prefixed lines) in a single message */
+#define MAX_PAYLOAD_LENGTH  (MAX_DATAGRAM_SIZE - MSG_HEADER_SIZE)
+
+/* Most independent streams one sender can carry to a receiver */
+#define MAX_STREAMS  16
+
+/* Most UDP flows one transfer can be striped over (see multipath.h) */
+#define MAX_FLOWS  8
+
+/* Message flags */
+#define MSG_FLAG_COMPRESSED  0x01  /* Text is an LZ compressed block (see lz.h) of raw_len bytes */
+#define MSG_FLAG_PARITY      0x02  /* Not a message: FEC parity over a group of messages (see fec.h) */
+#define MSG_FLAG_HELLO       0x04  /* Not a message: the sender's session parameters (see session.h) */
+#define MSG_FLAG_PROBE       0x08  /* Not a message: padding sent to find the path MTU (see pmtu.h) */
+
 /*
- * Message struct containing the line of text as well as a
+ * Message struct containing one or more lines of text as well as a
  * sequence number.
  * 
  * The sender constructs this with a proper sequence number and
- * the lin of text from the command line entered from the user
+ * the line(s) of text from the command line entered from the user.
+ * Each line is a record of its own with its own sequence number, so a
+ * message holding count records covers sequence numbers seq to
+ * seq + count - 1. Records are stored back to back in text, each one a
+ * 2 byte length (network byte order) followed by the line itself.
+ * 
+ * Only the header and the len bytes of text in use are sent on the wire.
+ * 
+ * Every stream has its own sequence numbers, starting at 0, and is
+ * delivered in order independently of the others.
  * 
  * The receiver will expect the input buffer to contain data in this
  * form. so it can and should be cast to this struct
  */
 struct message
 {
-    uint32_t seq;
-    char text[MAX_TEXT_LENGTH];
+    uint32_t seq;      /* Sequence number of the first record. This and the lengths are in network
+                        * byte order (read them with msg_seq() etc. from message.h) */
+    uint32_t crc;      /* CRC32C of the header and text (computed with this field zeroed), network byte order */
+    uint32_t ts_sec;   /* Sender transmit timestamp, echoed back untouched in the ack */
+    uint32_t ts_usec;
+    uint16_t count;    /* Number of records in text */
+    uint16_t len;      /* Number of bytes of text in use */
+    uint8_t flags;     /* MSG_FLAG_* values */
+    uint8_t stream;    /* Stream the message belongs to (below MAX_STREAMS) */
+    uint16_t raw_len;  /* Length of the text before compression (if MSG_FLAG_COMPRESSED is set) */
+    char text[MAX_PAYLOAD_LENGTH];
+};
+
+/* Version of the ack header layout below */
+#define ACK_VERSION  5
+
+/* Ack flags describing what triggered the ack */
+#define ACK_FLAG_RETRANS      0x01  /* Ack for a retransmission of an already received message */
+#define ACK_FLAG_OUT_OF_ORDER 0x02  /* Ack re-sent after an out of order message arrived */
+#define ACK_FLAG_SELECTIVE    0x04  /* sel_ack names a message buffered out of order */
+#define ACK_FLAG_HELLO        0x08  /* Reply to a hello: the agreed session parameters follow (see session.h) */
+#define ACK_FLAG_REJECT       0x10  /* With ACK_FLAG_HELLO: the receiver refused the session, sel_ack says why (see session.h) */
+#define ACK_FLAG_PROBE        0x20  /* Reply to a path MTU probe: sel_ack is the probe's size (see pmtu.h) */
+
+/*
+ * Ack header sent from the receiver back to the sender.
+ * 
+ * All multi-byte fields are in network byte order. The timestamp is
+ * copied as-is from the message that triggered the ack, so the sender
+ * can take an RTT sample from every ack (including acks for
+ * retransmitted messages). hold_nsec lets the sender take the
+ * receiver's own processing time back out of that sample
+ */
+struct ack
+{
+    uint8_t version;
+    uint8_t flags;
+    uint8_t stream;     /* Stream of the message acked. The sequence numbers are that stream's */
+    uint8_t loss;       /* Loss the receiver's FEC decoder sees on the stream, in 255ths (0 without FEC) */
+    uint32_t cum_ack;   /* Sequence number of the most recent in-order message received,
+                         * UINT32_MAX if none has been yet */
+    uint32_t sel_ack;   /* Last sequence number of the message buffered (ACK_FLAG_SELECTIVE only) */
+    uint32_t ts_sec;    /* Echoed sender timestamp */
+    uint32_t ts_usec;
+    uint32_t hold_nsec; /* Time the message spent in the receiver, from the kernel receiving it to
+                         * the ack being sent (0 if unknown, UINT32_MAX if longer than that) */
 };
+
+#endif /* SHARED_H */
     
\ No newline at end of file
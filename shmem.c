@@ -0,0 +1,394 @@
+/**
+ * Shared-memory transport: a sender and receiver on the same host, without
+ * the UDP stack in between
+ *
+ * CMPT 434 - A2
+ * Steven Rau
+ * scr108
+ * 11115094
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <netinet/in.h>
+#include <linux/futex.h>
+
+#include "shmem.h"
+#include "stats.h"
+#include "log.h"
+
+/*-----------------------------------------------------------------------------
+ * File-scope constants & globals
+ * --------------------------------------------------------------------------*/
+
+/* Mapping names, from the sender's process ID */
+#define SHMEM_NAME_FORMAT  "/arq-%u"
+
+/*-----------------------------------------------------------------------------
+ * Helper functions
+ * --------------------------------------------------------------------------*/
+
+static long mono_usec(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec * 1000000L + now.tv_nsec / 1000;
+}
+
+/**
+ * Sleeps on a futex in the mapping while it holds val, for up to usec. The mapping is shared
+ * between processes, so the futex isn't FUTEX_PRIVATE
+ */
+static void futex_wait(uint32_t *word, uint32_t val, long usec)
+{
+    struct timespec ts;
+
+    ts.tv_sec = usec / 1000000L;
+    ts.tv_nsec = (usec % 1000000L) * 1000L;
+
+    if (syscall(SYS_futex, word, FUTEX_WAIT, val, &ts, NULL, 0) == -1 &&
+        errno != EAGAIN && errno != ETIMEDOUT && errno != EINTR)
+    {
+        perror("futex wait");
+    }
+}
+
+/**
+ * Wakes up the end sleeping on a ring, if it is
+ */
+static void wake_consumer(struct shmem_ring *r)
+{
+    if (__atomic_load_n(&r->waiting, __ATOMIC_SEQ_CST) == 0 ||
+        __atomic_exchange_n(&r->waiting, 0, __ATOMIC_SEQ_CST) == 0)
+    {
+        return;
+    }
+
+    STATS_INC(STAT_SHM_WAKEUPS);
+
+    if (syscall(SYS_futex, &r->waiting, FUTEX_WAKE, 1, NULL, NULL, 0) == -1)
+    {
+        perror("futex wake");
+    }
+}
+
+/**
+ * Puts a datagram in a ring whose entries are stride bytes apart, each a length followed by up
+ * to room bytes of data
+ */
+static bool ring_put(struct shmem_ring *r, char *entries, size_t stride, size_t room, const void *buf,
+                     size_t len)
+{
+    uint32_t tail = r->tail;
+    char *e;
+
+    if (tail - __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) >= SHMEM_RING_SIZE)
+    {
+        return false;
+    }
+
+    e = entries + (tail % SHMEM_RING_SIZE) * stride;
+    len = len < room ? len : room;
+    *(uint32_t *)e = len;
+    memcpy(e + offsetof(struct shmem_datagram, data), buf, len);
+
+    /* Publish the datagram before looking for a sleeping consumer, which sets its flag before
+     * looking at the ring, so one of the two always sees the other */
+    __atomic_store_n(&r->tail, tail + 1, __ATOMIC_SEQ_CST);
+
+    wake_consumer(r);
+
+    return true;
+}
+
+/**
+ * Takes the next datagram from a ring laid out as for ring_put()
+ *
+ * Returns its length, or -1 if the ring is empty
+ */
+static ssize_t ring_take(struct shmem_ring *r, const char *entries, size_t stride, void *buf, size_t len)
+{
+    uint32_t head = r->head;
+    const char *e;
+    size_t num_bytes;
+
+    if (head == __atomic_load_n(&r->tail, __ATOMIC_SEQ_CST))
+    {
+        return -1;
+    }
+
+    e = entries + (head % SHMEM_RING_SIZE) * stride;
+    num_bytes = *(const uint32_t *)e < len ? *(const uint32_t *)e : len;
+    memcpy(buf, e + offsetof(struct shmem_datagram, data), num_bytes);
+
+    __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+
+    return num_bytes;
+}
+
+static void name_mapping(struct shmem *s, uint32_t key)
+{
+    s->key = key;
+    snprintf(s->name, sizeof(s->name), SHMEM_NAME_FORMAT, key);
+}
+
+/*-----------------------------------------------------------------------------
+ * Shared-memory transport
+ * --------------------------------------------------------------------------*/
+
+bool shmem_is_local(const struct sockaddr *addr, socklen_t addr_len)
+{
+    struct sockaddr_storage any_port;
+    int fd;
+    bool local;
+
+    if (addr_len > sizeof(any_port) || (addr->sa_family != AF_INET && addr->sa_family != AF_INET6))
+    {
+        return false;
+    }
+
+    /* Only an address of this host's can be bound to */
+    memcpy(&any_port, addr, addr_len);
+    if (addr->sa_family == AF_INET6)
+    {
+        ((struct sockaddr_in6 *)&any_port)->sin6_port = 0;
+    }
+    else
+    {
+        ((struct sockaddr_in *)&any_port)->sin_port = 0;
+    }
+
+    if ((fd = socket(addr->sa_family, SOCK_DGRAM, 0)) == -1)
+    {
+        return false;
+    }
+
+    local = bind(fd, (struct sockaddr *)&any_port, addr_len) == 0;
+
+    close(fd);
+
+    return local;
+}
+
+bool shmem_create(struct shmem *s, uint16_t port)
+{
+    struct shmem_region *region;
+    int fd;
+
+    memset(s, 0, sizeof(*s));
+    s->sender = true;
+    name_mapping(s, (uint32_t)getpid());
+
+    /* A name left behind by an earlier sender that had the same process ID is taken over */
+    if ((fd = shm_open(s->name, O_CREAT | O_TRUNC | O_RDWR, 0600)) == -1)
+    {
+        perror("shm_open");
+
+        return false;
+    }
+
+    if (ftruncate(fd, sizeof(struct shmem_region)) == -1 ||
+        (region = mmap(NULL, sizeof(struct shmem_region), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED)
+    {
+        perror("shared memory");
+        close(fd);
+        shm_unlink(s->name);
+
+        return false;
+    }
+
+    close(fd);
+
+    /* The rings start out empty (the mapping is zero filled) */
+    region->version = ACK_VERSION;
+    region->port = port;
+    region->sender_pid = s->key;
+    __atomic_store_n(&region->magic, SHMEM_MAGIC, __ATOMIC_RELEASE);
+
+    s->region = region;
+    s->named = true;
+
+    return true;
+}
+
+void shmem_unlink(struct shmem *s)
+{
+    if (s->named)
+    {
+        shm_unlink(s->name);
+        s->named = false;
+    }
+}
+
+bool shmem_attach(struct shmem *s, uint32_t key, uint16_t port)
+{
+    struct shmem_region *region;
+    struct stat st;
+    int fd;
+
+    memset(s, 0, sizeof(*s));
+    name_mapping(s, key);
+
+    if ((fd = shm_open(s->name, O_RDWR, 0)) == -1)
+    {
+        LOG_DBG("\nNo shared memory %s to map (%s)\n", s->name, strerror(errno));
+
+        return false;
+    }
+
+    if (fstat(fd, &st) == -1 || st.st_size < (off_t)sizeof(struct shmem_region) ||
+        (region = mmap(NULL, sizeof(struct shmem_region), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED)
+    {
+        close(fd);
+
+        return false;
+    }
+
+    close(fd);
+
+    if (__atomic_load_n(&region->magic, __ATOMIC_ACQUIRE) != SHMEM_MAGIC || region->version != ACK_VERSION ||
+        region->sender_pid != key || region->port != port)
+    {
+        LOG_DBG("\nShared memory %s isn't for this receiver\n", s->name);
+        munmap(region, sizeof(struct shmem_region));
+
+        return false;
+    }
+
+    s->region = region;
+
+    return true;
+}
+
+bool shmem_send(struct shmem *s, const void *buf, size_t len)
+{
+    struct shmem_region *region = s->region;
+    bool put;
+
+    if (s->sender)
+    {
+        put = ring_put(&region->msg_ring, (char *)region->msgs, sizeof(struct shmem_datagram),
+                       MAX_DATAGRAM_SIZE, buf, len);
+    }
+    else
+    {
+        put = ring_put(&region->ack_ring, (char *)region->acks, sizeof(struct shmem_ack),
+                       sizeof(struct ack), buf, len);
+    }
+
+    if (!put)
+    {
+        LOG_WRN("Shared memory ring is full, datagram dropped\n");
+    }
+
+    return put;
+}
+
+ssize_t shmem_recv(struct shmem *s, void *buf, size_t len, long timeout_usec)
+{
+    struct shmem_region *region = s->region;
+    struct shmem_ring *r = s->sender ? &region->ack_ring : &region->msg_ring;
+    const char *entries = s->sender ? (const char *)region->acks : (const char *)region->msgs;
+    size_t stride = s->sender ? sizeof(struct shmem_ack) : sizeof(struct shmem_datagram);
+    long start = mono_usec();
+    long now;
+    ssize_t num_bytes;
+    bool slept = false;
+
+    while ((num_bytes = ring_take(r, entries, stride, buf, len)) < 0)
+    {
+        /* Whatever the sender put in before closing is still taken */
+        if (!s->sender && __atomic_load_n(&region->closed, __ATOMIC_ACQUIRE))
+        {
+            errno = EPIPE;
+
+            return -1;
+        }
+
+        now = mono_usec();
+        if (now - start >= timeout_usec)
+        {
+            errno = EAGAIN;
+
+            return -1;
+        }
+
+        /* Returns straight away on a core of its own. On a shared one it lets the other end run */
+        if (now - start < SHMEM_SPIN_USEC)
+        {
+            sched_yield();
+
+            continue;
+        }
+
+        /* Say we're going to sleep, then look once more, so a datagram put in between isn't missed */
+        __atomic_store_n(&r->waiting, 1, __ATOMIC_SEQ_CST);
+
+        if ((num_bytes = ring_take(r, entries, stride, buf, len)) >= 0 ||
+            (!s->sender && __atomic_load_n(&region->closed, __ATOMIC_SEQ_CST)))
+        {
+            __atomic_store_n(&r->waiting, 0, __ATOMIC_SEQ_CST);
+
+            if (num_bytes >= 0)
+            {
+                break;
+            }
+
+            continue;
+        }
+
+        if (!slept)
+        {
+            STATS_INC(STAT_SPIN_SLEEPS);
+            slept = true;
+        }
+
+        futex_wait(&r->waiting, 1, timeout_usec - (now - start));
+
+        __atomic_store_n(&r->waiting, 0, __ATOMIC_SEQ_CST);
+    }
+
+    if (!slept)
+    {
+        STATS_INC(STAT_SPIN_HITS);
+    }
+
+    return num_bytes;
+}
+
+bool shmem_peer_gone(struct shmem *s)
+{
+    return __atomic_load_n(&s->region->closed, __ATOMIC_ACQUIRE) ||
+           (kill((pid_t)s->region->sender_pid, 0) == -1 && errno == ESRCH);
+}
+
+void shmem_close(struct shmem *s)
+{
+    if (s->region == NULL)
+    {
+        return;
+    }
+
+    if (s->sender)
+    {
+        __atomic_store_n(&s->region->closed, 1, __ATOMIC_SEQ_CST);
+        wake_consumer(&s->region->msg_ring);
+    }
+
+    shmem_unlink(s);
+    munmap(s->region, sizeof(struct shmem_region));
+
+    s->region = NULL;
+}
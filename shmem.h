@@ -0,0 +1,167 @@
+/**
+ * Shared-memory transport: a sender and receiver on the same host, without
+ * the UDP stack in between
+ *
+ * When both ends run on one machine, every message still went through the
+ * UDP stack twice (once for the data, once for the ack): a system call on
+ * either side and a copy in and out of the kernel each way. Instead the two
+ * can share a mapping (shm_open()) holding a pair of single producer,
+ * single consumer rings, one carrying messages and one carrying acks. The
+ * datagrams and acks are byte for byte what would have gone over UDP, and
+ * keep UDP's semantics: one that finds its ring full is dropped, like one
+ * lost on the way, and the ARQ protocol re-sends it.
+ *
+ * Neither end makes a system call while the other is keeping up. An end
+ * that finds its ring empty spins for SHMEM_SPIN_USEC (yielding, so on a
+ * shared core the other end gets to run), then sleeps on a futex in the
+ * mapping. The other end only makes the futex wake call when it sees the
+ * sleeper's flag set.
+ *
+ * The sender creates the mapping, named after its process ID, and offers
+ * it in the session hello (SESSION_FEATURE_SHM) when the receiver's
+ * address is one of this host's. The receiver maps it before answering,
+ * and agrees only if the sender addressed the receiver's own port, so a
+ * transfer relayed through a proxy on the same host still goes over UDP.
+ * The name is removed once the handshake is over. When the sender is done
+ * it marks the mapping closed, and the receiver goes back to its socket.
+ *
+ * CMPT 434 - A2
+ * Steven Rau
+ * scr108
+ * 11115094
+ */
+
+#ifndef SHMEM_H
+#define SHMEM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include "shared.h"
+
+/* Datagrams (and acks) each ring can hold */
+#define SHMEM_RING_SIZE  256
+
+/* How long an end spins on an empty ring before sleeping on its futex (microseconds) */
+#define SHMEM_SPIN_USEC  50
+
+/* Set in the mapping once the sender has it ready */
+#define SHMEM_MAGIC  0x41525153
+
+/* Longest name a mapping gets ("/arq-<pid>") */
+#define SHMEM_NAME_LEN  32
+
+/* Rings are laid out so the ends don't share cache lines they both write */
+#define SHMEM_CACHE_LINE  64
+
+/* One ring's indices. The producer's and the consumer's are on cache lines of their own */
+struct shmem_ring
+{
+    uint32_t tail;        /* Shared: next free entry (advanced by the producer) */
+    char tail_pad[SHMEM_CACHE_LINE - sizeof(uint32_t)];
+    uint32_t head;        /* Shared: next entry to take (advanced by the consumer) */
+    uint32_t waiting;     /* Shared: futex word, 1 while the consumer sleeps on it */
+    char head_pad[SHMEM_CACHE_LINE - 2 * sizeof(uint32_t)];
+};
+
+/* A message in the ring, as it would have been sent on the socket */
+struct shmem_datagram
+{
+    uint32_t len;
+    char data[MAX_DATAGRAM_SIZE];
+};
+
+/* An ack in the ring */
+struct shmem_ack
+{
+    uint32_t len;
+    char data[sizeof(struct ack)];
+};
+
+/* Everything in the mapping */
+struct shmem_region
+{
+    uint32_t magic;       /* SHMEM_MAGIC once the sender has set the rest up */
+    uint32_t version;     /* Message and ack layout (ACK_VERSION) */
+    uint32_t port;        /* Port the sender addressed the receiver on */
+    uint32_t sender_pid;
+    uint32_t closed;      /* Shared: set once the sender is done */
+    char header_pad[SHMEM_CACHE_LINE - 5 * sizeof(uint32_t)];
+
+    struct shmem_ring msg_ring;
+    struct shmem_ring ack_ring;
+    struct shmem_datagram msgs[SHMEM_RING_SIZE];
+    struct shmem_ack acks[SHMEM_RING_SIZE];
+};
+
+/* One end's view of the mapping */
+struct shmem
+{
+    struct shmem_region *region;
+    bool sender;          /* The sender puts messages and takes acks, the receiver the other way round */
+    uint32_t key;         /* The sender's process ID, which names the mapping */
+    char name[SHMEM_NAME_LEN];
+    bool named;           /* Sender: whether the name still exists */
+};
+
+/**
+ * Whether an address belongs to this host (loopback, or one of its interfaces)
+ */
+bool shmem_is_local(const struct sockaddr *addr, socklen_t addr_len);
+
+/**
+ * Sender: creates the mapping, to offer in the session hello
+ *
+ * @param[in] s     The end to set up
+ * @param[in] port  Port the receiver is being sent to
+ *
+ * Returns false (with a message printed) if it couldn't be created
+ */
+bool shmem_create(struct shmem *s, uint16_t port);
+
+/**
+ * Sender: removes the mapping's name once the handshake is over. The receiver has it mapped by
+ * then if it agreed to use it, and nothing else can open it afterwards
+ */
+void shmem_unlink(struct shmem *s);
+
+/**
+ * Receiver: maps the mapping a sender offered
+ *
+ * @param[in] s     The end to set up
+ * @param[in] key   The sender's key, from its hello
+ * @param[in] port  Port this receiver is bound to
+ *
+ * Returns false if there is no such mapping (e.g. the sender is on another host), or it was set
+ * up for another port (the sender went through a relay)
+ */
+bool shmem_attach(struct shmem *s, uint32_t key, uint16_t port);
+
+/**
+ * Puts a datagram in this end's outgoing ring: messages from the sender, acks from the receiver
+ *
+ * Returns false if the ring is full, in which case the datagram is dropped
+ */
+bool shmem_send(struct shmem *s, const void *buf, size_t len);
+
+/**
+ * Takes the next datagram from this end's incoming ring, waiting up to timeout_usec for one
+ *
+ * Returns the number of bytes in it, or -1 with errno set: EAGAIN if the timeout ran out, or
+ * EPIPE (receiver) once the sender has closed the mapping and everything it sent was taken
+ */
+ssize_t shmem_recv(struct shmem *s, void *buf, size_t len, long timeout_usec);
+
+/**
+ * Receiver: whether the sender has closed the mapping, or died without doing so
+ */
+bool shmem_peer_gone(struct shmem *s);
+
+/**
+ * Unmaps the mapping. The sender marks it closed first, waking the receiver
+ */
+void shmem_close(struct shmem *s);
+
+#endif /* SHMEM_H */
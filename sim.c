@@ -0,0 +1,733 @@
+/**
+ * Discrete-event simulator for the sliding window protocols
+ *
+ * Runs the real ARQ library (the same sender window, ack handling,
+ * buffering and buffer clearing the programs use) between a simulated
+ * sender and receiver, over a modeled link, in virtual time. There are
+ * no sockets and no waiting, so a whole sweep of window sizes, timeouts,
+ * buffer sizes and loss rates runs in well under a second per thousand
+ * configurations.
+ *
+ * The simulated sender follows the same loop as sender.c with piped
+ * input: send a new message while the window has room, otherwise
+ * retransmit, then wait for an ack (or the timeout) before going again.
+ *
+ * One CSV row is printed per configuration, with the goodput and the
+ * per-message latency (first transmission to in-order delivery), ready
+ * to be plotted as throughput and latency curves.
+ *
+ * CMPT 434 - A2
+ * Steven Rau
+ * scr108
+ * 11115094
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "shared.h"
+#include "message.h"
+#include "pool.h"
+#include "log.h"
+#include "rng.h"
+#include "arq.h"
+
+
+/*-----------------------------------------------------------------------------
+ * File-scope constants & globals
+ * --------------------------------------------------------------------------*/
+
+/* Most values any one swept parameter can take */
+#define SIM_MAX_VALUES  64
+
+/* The policy specific half of the ARQ library, so both can be swept in one run */
+struct arq_policy
+{
+    const char *name;
+    bool (*sender_send)(struct arq_sender *s);
+    bool (*sender_on_ack)(struct arq_sender *s, const void *buf, int len);
+    void (*sender_retransmit)(struct arq_sender *s);
+    long (*sender_wait_usec)(struct arq_sender *s);
+    bool (*sender_retransmit_due)(struct arq_sender *s);
+    void (*receive)(struct arq_receiver *r, struct message *msg, int len);
+};
+
+static const struct arq_policy policies[] =
+{
+    { "gbn", arq_gbn_sender_send, arq_gbn_sender_on_ack, arq_gbn_sender_retransmit,
+      arq_gbn_sender_wait_usec, arq_gbn_sender_retransmit_due, arq_gbn_receive },
+    { "sr", arq_sr_sender_send, arq_sr_sender_on_ack, arq_sr_sender_retransmit,
+      arq_sr_sender_wait_usec, arq_sr_sender_retransmit_due, arq_sr_receive },
+};
+
+/* One configuration to simulate */
+struct sim_config
+{
+    const struct arq_policy *policy;
+    uint32_t window;
+    long timeout_usec;
+    uint32_t buffer;         /* Receiver buffer size (Selective Repeat only) */
+    double loss;             /* Chance of losing each datagram, in both directions */
+    long delay_usec;         /* One-way propagation delay */
+    long jitter_usec;        /* Delay varies uniformly by up to this much either way */
+    double rate_bps;         /* Link rate, 0 for unlimited */
+    uint32_t num_msgs;
+    uint32_t msg_bytes;      /* Text bytes per message */
+    uint64_t seed;
+    long limit_usec;         /* Give up on a transfer after this much virtual time */
+};
+
+/* One direction of the modeled link */
+struct sim_link
+{
+    struct rng rng;
+    long free_usec;          /* When the link finishes serializing its current datagram */
+};
+
+enum sim_event_type
+{
+    EV_MSG_ARRIVE,           /* A message reaches the receiver */
+    EV_ACK_ARRIVE,           /* An ack reaches the sender */
+    EV_TIMEOUT               /* The sender's wait for an ack runs out */
+};
+
+struct sim_event
+{
+    long due_usec;
+    uint64_t order;          /* Keeps events due at the same time first in, first out */
+    enum sim_event_type type;
+    uint64_t timer_gen;      /* EV_TIMEOUT: only the latest armed timer counts */
+    int len;
+    union
+    {
+        struct message msg;
+        struct ack ack;
+    } data;
+};
+
+/* State of one simulated transfer */
+struct sim
+{
+    const struct sim_config *cfg;
+    long now;
+
+    struct sim_event **heap; /* Pending events, min-heap by due time */
+    uint32_t num_events;
+    struct sim_event **free_events;
+    uint32_t num_free;
+    uint64_t next_order;
+
+    struct sim_link fwd;     /* Sender to receiver */
+    struct sim_link rev;     /* Receiver to sender */
+
+    struct arq_sender sender;
+    struct arq_receiver receiver;
+    uint64_t timer_gen;
+
+    uint32_t sent_new;       /* Messages handed to the sender so far */
+    uint32_t delivered;      /* Lines delivered in order by the receiver */
+    long *first_sent;        /* Time each sequence number was first sent */
+    long *latency;           /* First send to delivery, per delivered line */
+    uint32_t datagrams;      /* Messages put on the link, including retransmissions */
+    uint32_t timeouts;
+    uint32_t overflows;      /* Events dropped because the event pool ran out */
+    bool done;
+    long done_usec;
+};
+
+/* Results of one simulated transfer */
+struct sim_result
+{
+    bool completed;
+    double time_sec;
+    double goodput_kbps;
+    uint32_t datagrams;
+    uint32_t timeouts;
+    double lat_mean_ms;
+    double lat_p50_ms;
+    double lat_p99_ms;
+};
+
+static char payload[MAX_TEXT_LENGTH];
+
+/*-----------------------------------------------------------------------------
+ * Event queue
+ * --------------------------------------------------------------------------*/
+
+static bool event_before(const struct sim_event *a, const struct sim_event *b)
+{
+    return a->due_usec < b->due_usec || (a->due_usec == b->due_usec && a->order < b->order);
+}
+
+/**
+ * Takes an event from the pool, or returns NULL (and counts it) if none are left
+ */
+static struct sim_event *event_alloc(struct sim *sim, enum sim_event_type type, long due_usec)
+{
+    struct sim_event *ev;
+
+    if (sim->num_free == 0)
+    {
+        sim->overflows++;
+
+        return NULL;
+    }
+
+    ev = sim->free_events[--sim->num_free];
+    ev->type = type;
+    ev->due_usec = due_usec;
+
+    return ev;
+}
+
+static void event_push(struct sim *sim, struct sim_event *ev)
+{
+    uint32_t i = sim->num_events++;
+    struct sim_event *tmp;
+
+    ev->order = sim->next_order++;
+    sim->heap[i] = ev;
+
+    while (i > 0 && event_before(sim->heap[i], sim->heap[(i - 1) / 2]))
+    {
+        tmp = sim->heap[i];
+        sim->heap[i] = sim->heap[(i - 1) / 2];
+        sim->heap[(i - 1) / 2] = tmp;
+
+        i = (i - 1) / 2;
+    }
+}
+
+static struct sim_event *event_pop(struct sim *sim)
+{
+    struct sim_event *top = sim->heap[0];
+    struct sim_event *tmp;
+    uint32_t i = 0;
+    uint32_t child;
+
+    sim->heap[0] = sim->heap[--sim->num_events];
+
+    while ((child = 2 * i + 1) < sim->num_events)
+    {
+        if (child + 1 < sim->num_events && event_before(sim->heap[child + 1], sim->heap[child]))
+        {
+            child++;
+        }
+
+        if (!event_before(sim->heap[child], sim->heap[i]))
+        {
+            break;
+        }
+
+        tmp = sim->heap[i];
+        sim->heap[i] = sim->heap[child];
+        sim->heap[child] = tmp;
+
+        i = child;
+    }
+
+    return top;
+}
+
+/*-----------------------------------------------------------------------------
+ * Link model and ARQ callbacks
+ * --------------------------------------------------------------------------*/
+
+/**
+ * Puts a datagram on one direction of the link: it is serialized at the link rate, may be
+ * lost, and arrives after the propagation delay
+ */
+static void link_send(struct sim *sim, struct sim_link *link, enum sim_event_type type,
+                      const void *buf, size_t len)
+{
+    const struct sim_config *cfg = sim->cfg;
+    struct sim_event *ev;
+    long tx_done = link->free_usec > sim->now ? link->free_usec : sim->now;
+    long delay = cfg->delay_usec;
+
+    if (cfg->rate_bps > 0)
+    {
+        tx_done += (long)(len * 8 * 1e6 / cfg->rate_bps);
+    }
+    link->free_usec = tx_done;
+
+    if (cfg->jitter_usec > 0)
+    {
+        delay += (long)((2 * rng_uniform(&link->rng) - 1) * cfg->jitter_usec);
+        delay = delay < 0 ? 0 : delay;
+    }
+
+    if (rng_chance(&link->rng, cfg->loss))
+    {
+        return;
+    }
+
+    if ((ev = event_alloc(sim, type, tx_done + delay)) == NULL)
+    {
+        return;
+    }
+
+    ev->len = (int)len;
+    memcpy(&ev->data, buf, len);
+
+    event_push(sim, ev);
+}
+
+static long sim_clock(void *ctx)
+{
+    return ((struct sim *)ctx)->now;
+}
+
+static bool sim_send(void *ctx, const void *buf, size_t len)
+{
+    struct sim *sim = ctx;
+
+    sim->datagrams++;
+    link_send(sim, &sim->fwd, EV_MSG_ARRIVE, buf, len);
+
+    return true;
+}
+
+static bool sim_send_ack(void *ctx, const struct ack *ack)
+{
+    struct sim *sim = ctx;
+
+    link_send(sim, &sim->rev, EV_ACK_ARRIVE, ack, sizeof(*ack));
+
+    return true;
+}
+
+static void sim_deliver(void *ctx, uint32_t seq, const char *line, size_t len)
+{
+    struct sim *sim = ctx;
+
+    (void)line;
+    (void)len;
+
+    if (seq < sim->cfg->num_msgs)
+    {
+        sim->latency[sim->delivered++] = sim->now - sim->first_sent[seq];
+    }
+}
+
+/*-----------------------------------------------------------------------------
+ * Simulation
+ * --------------------------------------------------------------------------*/
+
+/**
+ * One pass of sender.c's main loop: send a new message or retransmit (if a timer ran out or
+ * duplicate acks came in), then wait for an ack
+ */
+static void sender_step(struct sim *sim)
+{
+    const struct sim_config *cfg = sim->cfg;
+    struct message *msg;
+    struct sim_event *ev;
+
+    if (!arq_sender_window_full(&sim->sender) && sim->sent_new < cfg->num_msgs)
+    {
+        msg = arq_sender_next_msg(&sim->sender);
+        msg_add_record(msg, payload, cfg->msg_bytes);
+
+        sim->first_sent[msg_seq(msg)] = sim->now;
+        sim->sent_new++;
+
+        cfg->policy->sender_send(&sim->sender);
+    }
+    else if (arq_sender_idle(&sim->sender))
+    {
+        sim->done = true;
+        sim->done_usec = sim->now;
+
+        return;
+    }
+    else if (cfg->policy->sender_retransmit_due(&sim->sender))
+    {
+        cfg->policy->sender_retransmit(&sim->sender);
+    }
+
+    /* Wait for an ack. Arming a new timer cancels the last one */
+    if ((ev = event_alloc(sim, EV_TIMEOUT, sim->now + cfg->policy->sender_wait_usec(&sim->sender))) != NULL)
+    {
+        ev->timer_gen = ++sim->timer_gen;
+
+        event_push(sim, ev);
+    }
+}
+
+static int compare_long(const void *a, const void *b)
+{
+    long x = *(const long *)a;
+    long y = *(const long *)b;
+
+    return (x > y) - (x < y);
+}
+
+/**
+ * Simulates one transfer of cfg->num_msgs messages
+ */
+static void simulate(const struct sim_config *cfg, struct sim_result *res)
+{
+    struct sim sim;
+    struct msg_pool send_pool;
+    struct msg_pool recv_pool;
+    struct arq_slot *window;
+    struct message **buffer = NULL;
+    struct sim_event *events;
+    struct sim_event *ev;
+    struct arq_sender_ops sender_ops;
+    struct arq_receiver_ops receiver_ops;
+    uint32_t capacity;
+    uint32_t i;
+    double total = 0;
+    bool selective = strcmp(cfg->policy->name, "sr") == 0;
+
+    memset(&sim, 0, sizeof(sim));
+    sim.cfg = cfg;
+    rng_seed(&sim.fwd.rng, cfg->seed * 2);
+    rng_seed(&sim.rev.rng, cfg->seed * 2 + 1);
+
+    /* Enough events for every message and ack the window can have in flight, several times over */
+    capacity = 8 * cfg->window + 64;
+    events = mem_alloc(capacity, sizeof(struct sim_event));
+    sim.heap = mem_alloc(capacity, sizeof(struct sim_event *));
+    sim.free_events = mem_alloc(capacity, sizeof(struct sim_event *));
+    for (i = 0; i < capacity; i++)
+    {
+        sim.free_events[i] = &events[i];
+    }
+    sim.num_free = capacity;
+
+    sim.first_sent = mem_alloc(cfg->num_msgs, sizeof(long));
+    sim.latency = mem_alloc(cfg->num_msgs, sizeof(long));
+
+    msg_pool_init(&send_pool, cfg->window);
+    window = mem_alloc(cfg->window, sizeof(struct arq_slot));
+
+    sender_ops.send = sim_send;
+    sender_ops.now_usec = sim_clock;
+    sender_ops.ctx = &sim;
+    arq_sender_init(&sim.sender, &send_pool, window, cfg->window, cfg->timeout_usec, &sender_ops);
+
+    receiver_ops.accept = NULL;
+    receiver_ops.deliver = sim_deliver;
+    receiver_ops.send_ack = sim_send_ack;
+    receiver_ops.ctx = &sim;
+    if (selective)
+    {
+        msg_pool_init(&recv_pool, cfg->buffer);
+        buffer = mem_alloc(cfg->buffer, sizeof(struct message *));
+        arq_receiver_init(&sim.receiver, &recv_pool, buffer, cfg->buffer, &receiver_ops);
+    }
+    else
+    {
+        arq_receiver_init(&sim.receiver, NULL, NULL, 0, &receiver_ops);
+    }
+
+    /* Run events in time order until everything is acked */
+    sender_step(&sim);
+
+    while (!sim.done && sim.num_events > 0)
+    {
+        ev = event_pop(&sim);
+        sim.now = ev->due_usec;
+
+        if (sim.now > cfg->limit_usec)
+        {
+            sim.free_events[sim.num_free++] = ev;
+
+            break;
+        }
+
+        switch (ev->type)
+        {
+            case EV_MSG_ARRIVE:
+                cfg->policy->receive(&sim.receiver, &ev->data.msg, ev->len);
+                break;
+            case EV_ACK_ARRIVE:
+                cfg->policy->sender_on_ack(&sim.sender, &ev->data.ack, ev->len);
+                sender_step(&sim);
+                break;
+            case EV_TIMEOUT:
+                if (ev->timer_gen == sim.timer_gen)
+                {
+                    sim.timeouts++;
+                    sender_step(&sim);
+                }
+                break;
+        }
+
+        sim.free_events[sim.num_free++] = ev;
+    }
+
+    /* Summarize */
+    res->completed = sim.done;
+    res->time_sec = (sim.done ? sim.done_usec : sim.now) / 1e6;
+    res->goodput_kbps = res->time_sec > 0 ?
+                        sim.delivered * (double)cfg->msg_bytes * 8 / res->time_sec / 1000 : 0;
+    res->datagrams = sim.datagrams;
+    res->timeouts = sim.timeouts;
+
+    res->lat_mean_ms = res->lat_p50_ms = res->lat_p99_ms = 0;
+    if (sim.delivered > 0)
+    {
+        for (i = 0; i < sim.delivered; i++)
+        {
+            total += sim.latency[i];
+        }
+
+        qsort(sim.latency, sim.delivered, sizeof(long), compare_long);
+
+        res->lat_mean_ms = total / sim.delivered / 1000;
+        res->lat_p50_ms = sim.latency[sim.delivered / 2] / 1000.0;
+        res->lat_p99_ms = sim.latency[(uint32_t)((sim.delivered - 1) * 0.99)] / 1000.0;
+    }
+
+    if (selective)
+    {
+        mem_free(buffer);
+        msg_pool_destroy(&recv_pool);
+    }
+    mem_free(window);
+    msg_pool_destroy(&send_pool);
+    mem_free(sim.latency);
+    mem_free(sim.first_sent);
+    mem_free(sim.free_events);
+    mem_free(sim.heap);
+    mem_free(events);
+}
+
+/*-----------------------------------------------------------------------------
+ * Helper functions
+ * --------------------------------------------------------------------------*/
+
+/**
+ * Parses a comma separated list of numbers
+ *
+ * Returns the number of values, or 0 if the list is malformed
+ */
+static int parse_list(const char *str, double *vals)
+{
+    char *end;
+    int n = 0;
+
+    while (n < SIM_MAX_VALUES)
+    {
+        vals[n++] = strtod(str, &end);
+
+        if (end == str)
+        {
+            return 0;
+        }
+        if (*end != ',')
+        {
+            return *end == '\0' ? n : 0;
+        }
+
+        str = end + 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Parses a comma separated list of policy names
+ */
+static int parse_policies(char *str, const struct arq_policy **out)
+{
+    char *name;
+    int n = 0;
+    size_t i;
+
+    for (name = strtok(str, ","); name != NULL && n < SIM_MAX_VALUES; name = strtok(NULL, ","))
+    {
+        for (i = 0; i < sizeof(policies) / sizeof(policies[0]); i++)
+        {
+            if (strcmp(name, policies[i].name) == 0)
+            {
+                out[n++] = &policies[i];
+                break;
+            }
+        }
+
+        if (i == sizeof(policies) / sizeof(policies[0]))
+        {
+            return 0;
+        }
+    }
+
+    return n;
+}
+
+static double elapsed_sec(const struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/*-----------------------------------------------------------------------------
+ *
+ * --------------------------------------------------------------------------*/
+
+int main(int argc, char *argv[])
+{
+    const struct arq_policy *pols[SIM_MAX_VALUES] = { &policies[0], &policies[1] };
+    double windows[SIM_MAX_VALUES] = { 1, 2, 4, 8, 16, 32 };
+    double timeouts[SIM_MAX_VALUES] = { 100 };
+    double buffers[SIM_MAX_VALUES] = { 32 };
+    double losses[SIM_MAX_VALUES] = { 0, 0.01, 0.05, 0.1 };
+    double delays[SIM_MAX_VALUES] = { 20 };
+    int num_pols = 2;
+    int num_windows = 6;
+    int num_timeouts = 1;
+    int num_buffers = 1;
+    int num_losses = 4;
+    int num_delays = 1;
+    int pi, wi, ti, bi, li, di;
+    int num_configs = 0;
+    struct sim_config cfg;
+    struct sim_result res;
+    struct timespec start;
+    double secs;
+    int opt;
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.num_msgs = 1000;
+    cfg.msg_bytes = 64;
+    cfg.seed = 1;
+    cfg.limit_usec = 3600 * 1000000L;
+
+    /* Every list option is a comma separated list of values to sweep over */
+    while ((opt = getopt(argc, argv, "p:w:t:b:l:d:j:R:n:m:S:T:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'p':
+                num_pols = parse_policies(optarg, pols);
+                break;
+            case 'w':
+                num_windows = parse_list(optarg, windows);
+                break;
+            case 't':
+                num_timeouts = parse_list(optarg, timeouts);
+                break;
+            case 'b':
+                num_buffers = parse_list(optarg, buffers);
+                break;
+            case 'l':
+                num_losses = parse_list(optarg, losses);
+                break;
+            case 'd':
+                num_delays = parse_list(optarg, delays);
+                break;
+            case 'j':
+                cfg.jitter_usec = (long)(atof(optarg) * 1000);
+                break;
+            case 'R':
+                cfg.rate_bps = atof(optarg) * 1000;
+                break;
+            case 'n':
+                cfg.num_msgs = atoi(optarg);
+                break;
+            case 'm':
+                cfg.msg_bytes = atoi(optarg);
+                break;
+            case 'S':
+                cfg.seed = strtoull(optarg, NULL, 10);
+                break;
+            case 'T':
+                cfg.limit_usec = (long)(atof(optarg) * 1000000);
+                break;
+            default:
+                num_pols = 0;
+                break;
+        }
+    }
+
+    if (num_pols == 0 || num_windows == 0 || num_timeouts == 0 || num_buffers == 0 ||
+        num_losses == 0 || num_delays == 0 || optind != argc)
+    {
+        fprintf(stderr, "Usage: %s [-p gbn,sr] [-w windows] [-t timeouts_ms] [-b buffer_sizes]\n"
+                        "\t[-l loss_probs] [-d delays_ms] [-j jitter_ms] [-R rate_kbps]\n"
+                        "\t[-n num_msgs] [-m msg_bytes] [-S seed] [-T time_limit_sec]\n"
+                        "Every option but -j, -R, -n, -m, -S and -T takes a comma separated list to sweep\n",
+                        argv[0]);
+
+        exit(1);
+    }
+
+    if (cfg.num_msgs < 1 || cfg.msg_bytes < 1 || cfg.msg_bytes > MAX_TEXT_LENGTH)
+    {
+        fprintf(stderr, "Usage: Need at least 1 message, of 1 to %d bytes\n", MAX_TEXT_LENGTH);
+
+        exit(1);
+    }
+
+    memset(payload, 'x', sizeof(payload));
+
+    /* The library's per-message warnings (full buffers and so on) are expected here */
+    log_level = LOG_ERROR;
+
+    printf("policy,window,timeout_ms,buffer,loss,delay_ms,completed,time_s,goodput_kbps,"
+           "datagrams,timeouts,lat_mean_ms,lat_p50_ms,lat_p99_ms\n");
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (pi = 0; pi < num_pols; pi++)
+    for (wi = 0; wi < num_windows; wi++)
+    for (ti = 0; ti < num_timeouts; ti++)
+    for (bi = 0; bi < num_buffers; bi++)
+    for (li = 0; li < num_losses; li++)
+    for (di = 0; di < num_delays; di++)
+    {
+        cfg.policy = pols[pi];
+        cfg.window = (uint32_t)windows[wi];
+        cfg.timeout_usec = (long)(timeouts[ti] * 1000);
+        cfg.loss = losses[li];
+        cfg.delay_usec = (long)(delays[di] * 1000);
+
+        /* Go-Back-N doesn't buffer, so only sweep buffer sizes for Selective Repeat */
+        if (strcmp(cfg.policy->name, "sr") == 0)
+        {
+            cfg.buffer = (uint32_t)buffers[bi];
+        }
+        else if (bi > 0)
+        {
+            continue;
+        }
+        else
+        {
+            cfg.buffer = 0;
+        }
+
+        if (cfg.window < 1 || cfg.timeout_usec < 1 || (cfg.buffer < 1 && cfg.policy == &policies[1]))
+        {
+            fprintf(stderr, "Skipping window %u, timeout %ld us, buffer %u: must all be at least 1\n",
+                    cfg.window, cfg.timeout_usec, cfg.buffer);
+
+            continue;
+        }
+
+        simulate(&cfg, &res);
+        num_configs++;
+
+        printf("%s,%u,%g,%u,%g,%g,%d,%.6f,%.3f,%u,%u,%.3f,%.3f,%.3f\n", cfg.policy->name,
+               cfg.window, timeouts[ti], cfg.buffer, cfg.loss, delays[di], res.completed,
+               res.time_sec, res.goodput_kbps, res.datagrams, res.timeouts, res.lat_mean_ms,
+               res.lat_p50_ms, res.lat_p99_ms);
+    }
+
+    secs = elapsed_sec(&start);
+    fprintf(stderr, "%d configurations in %.3f s (%.0f per second)\n", num_configs, secs,
+            secs > 0 ? num_configs / secs : 0);
+
+    return 0;
+}
@@ -0,0 +1,323 @@
+/**
+ * Socket buffer sizing, kernel drop accounting, kernel timestamps and UDP
+ * segmentation offload
+ *
+ * CMPT 434 - A2
+ * Steven Rau
+ * scr108
+ * 11115094
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+
+#ifdef __linux__
+#include <linux/net_tstamp.h>
+#include <linux/errqueue.h>
+#endif
+
+#include "sock.h"
+#include "stats.h"
+#include "log.h"
+
+/*-----------------------------------------------------------------------------
+ * Helper functions
+ * --------------------------------------------------------------------------*/
+
+/**
+ * Sets one buffer size, trying the privileged option first
+ */
+static void set_buffer(int fd, int opt, int force_opt, const char *name, int size)
+{
+    int got;
+    socklen_t got_len = sizeof(got);
+
+    if (size <= 0)
+    {
+        return;
+    }
+
+    /* Needs CAP_NET_ADMIN. Without it, fall back to the size capped by the system maximum */
+    if (force_opt < 0 || setsockopt(fd, SOL_SOCKET, force_opt, &size, sizeof(size)) == -1)
+    {
+        if (setsockopt(fd, SOL_SOCKET, opt, &size, sizeof(size)) == -1)
+        {
+            perror("setsockopt");
+
+            return;
+        }
+    }
+
+    /* The kernel doubles the size asked for to leave room for its own bookkeeping */
+    if (getsockopt(fd, SOL_SOCKET, opt, &got, &got_len) == 0 && got / 2 < size)
+    {
+        fprintf(stderr, "Warning: asked for a %d byte %s buffer but only got %d "
+                        "(raise the system maximum or run with CAP_NET_ADMIN)\n", size, name, got / 2);
+    }
+}
+
+/*-----------------------------------------------------------------------------
+ * Socket setup and receiving
+ * --------------------------------------------------------------------------*/
+
+void sock_set_buffers(int fd, int rcvbuf, int sndbuf)
+{
+#ifdef SO_RCVBUFFORCE
+    set_buffer(fd, SO_RCVBUF, SO_RCVBUFFORCE, "receive", rcvbuf);
+    set_buffer(fd, SO_SNDBUF, SO_SNDBUFFORCE, "send", sndbuf);
+#else
+    set_buffer(fd, SO_RCVBUF, -1, "receive", rcvbuf);
+    set_buffer(fd, SO_SNDBUF, -1, "send", sndbuf);
+#endif
+}
+
+void sock_track_drops(int fd)
+{
+#ifdef SO_RXQ_OVFL
+    int on = 1;
+
+    if (setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on)) == -1)
+    {
+        perror("setsockopt SO_RXQ_OVFL");
+    }
+#else
+    (void)fd;
+#endif
+}
+
+bool sock_enable_timestamps(int fd, bool tx)
+{
+    int on = 1;
+#ifdef SO_TIMESTAMPING
+    int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+
+    /* OPT_ID numbers each sent datagram, and OPT_TSONLY leaves the payload out of the
+     * error queue copy */
+    if (tx)
+    {
+        flags |= SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY;
+    }
+
+    if (setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) == 0)
+    {
+        return tx;
+    }
+#endif
+
+    /* Fall back to receive timestamps only */
+#ifdef SO_TIMESTAMPNS
+    if (setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) == -1)
+    {
+        perror("setsockopt SO_TIMESTAMPNS");
+    }
+#else
+    (void)on;
+    (void)fd;
+#endif
+
+    return false;
+}
+
+void sock_read_cmsgs(struct msghdr *mh, struct sock_rx_info *info, uint32_t *last_drops)
+{
+    struct cmsghdr *cmsg;
+    uint32_t drops;
+
+    if (info != NULL)
+    {
+        memset(info, 0, sizeof(*info));
+    }
+
+    for (cmsg = CMSG_FIRSTHDR(mh); cmsg != NULL; cmsg = CMSG_NXTHDR(mh, cmsg))
+    {
+#ifdef UDP_GRO
+        if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO && info != NULL)
+        {
+            memcpy(&info->segment_size, CMSG_DATA(cmsg), sizeof(info->segment_size));
+        }
+#endif
+
+        if (cmsg->cmsg_level != SOL_SOCKET)
+        {
+            continue;
+        }
+
+#ifdef SO_TIMESTAMPING
+        /* The software timestamp is the first of the three */
+        if (cmsg->cmsg_type == SCM_TIMESTAMPING && info != NULL)
+        {
+            memcpy(&info->ts, CMSG_DATA(cmsg), sizeof(info->ts));
+        }
+#endif
+#ifdef SO_TIMESTAMPNS
+        if (cmsg->cmsg_type == SCM_TIMESTAMPNS && info != NULL)
+        {
+            memcpy(&info->ts, CMSG_DATA(cmsg), sizeof(info->ts));
+        }
+#endif
+#ifdef SO_RXQ_OVFL
+        /* The count is the socket's running total, and is only attached once there has been a drop */
+        if (cmsg->cmsg_type == SO_RXQ_OVFL)
+        {
+            memcpy(&drops, CMSG_DATA(cmsg), sizeof(drops));
+
+            if (drops != *last_drops)
+            {
+                stats_add(STAT_KERNEL_DROPS, drops - *last_drops);
+                LOG_WRN("Kernel dropped %u datagrams (socket receive buffer full)\n",
+                        drops - *last_drops);
+
+                *last_drops = drops;
+            }
+        }
+#else
+        (void)drops;
+        (void)last_drops;
+#endif
+    }
+}
+
+ssize_t sock_recvfrom(int fd, void *buf, size_t len, int flags, struct sockaddr *addr,
+                      socklen_t *addr_len, struct sock_rx_info *info, uint32_t *last_drops)
+{
+    struct iovec iov;
+    struct msghdr mh;
+    char control[SOCK_CONTROL_LEN];
+    ssize_t num_bytes;
+
+    iov.iov_base = buf;
+    iov.iov_len = len;
+
+    memset(&mh, 0, sizeof(mh));
+    mh.msg_name = addr;
+    mh.msg_namelen = addr_len != NULL ? *addr_len : 0;
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    mh.msg_control = control;
+    mh.msg_controllen = sizeof(control);
+
+    if ((num_bytes = recvmsg(fd, &mh, flags)) == -1)
+    {
+        return -1;
+    }
+
+    if (addr_len != NULL)
+    {
+        *addr_len = mh.msg_namelen;
+    }
+
+    sock_read_cmsgs(&mh, info, last_drops);
+
+    return num_bytes;
+}
+
+bool sock_enable_gro(int fd)
+{
+#ifdef UDP_GRO
+    int on = 1;
+
+    return setsockopt(fd, SOL_UDP, UDP_GRO, &on, sizeof(on)) == 0;
+#else
+    (void)fd;
+
+    return false;
+#endif
+}
+
+bool sock_send_segments(int fd, const struct iovec *iov, unsigned count, uint16_t segment_size,
+                        const struct sockaddr *addr, socklen_t addr_len)
+{
+#ifdef UDP_SEGMENT
+    struct msghdr mh;
+    struct cmsghdr *cmsg;
+    char control[CMSG_SPACE(sizeof(uint16_t))];
+
+    memset(&mh, 0, sizeof(mh));
+    memset(control, 0, sizeof(control));
+    mh.msg_name = (void *)addr;
+    mh.msg_namelen = addr_len;
+    mh.msg_iov = (struct iovec *)iov;
+    mh.msg_iovlen = count;
+    mh.msg_control = control;
+    mh.msg_controllen = sizeof(control);
+
+    cmsg = CMSG_FIRSTHDR(&mh);
+    cmsg->cmsg_level = SOL_UDP;
+    cmsg->cmsg_type = UDP_SEGMENT;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+    memcpy(CMSG_DATA(cmsg), &segment_size, sizeof(segment_size));
+
+    return sendmsg(fd, &mh, 0) != -1;
+#else
+    (void)fd;
+    (void)iov;
+    (void)count;
+    (void)segment_size;
+    (void)addr;
+    (void)addr_len;
+    errno = ENOTSUP;
+
+    return false;
+#endif
+}
+
+bool sock_read_tx_timestamp(int fd, uint32_t *id, struct timespec *ts)
+{
+#ifdef SO_TIMESTAMPING
+    struct msghdr mh;
+    struct cmsghdr *cmsg;
+    struct sock_extended_err serr;
+    char control[CMSG_SPACE(3 * sizeof(struct timespec)) + CMSG_SPACE(sizeof(struct sock_extended_err)
+                 + sizeof(struct sockaddr_in6))];
+    bool have_ts = false;
+    bool have_id = false;
+
+    /* Each timestamp comes back as an "error": the time in one message, the datagram's id in
+     * another. Anything else on the error queue is skipped */
+    while (!(have_ts && have_id))
+    {
+        memset(&mh, 0, sizeof(mh));
+        mh.msg_control = control;
+        mh.msg_controllen = sizeof(control);
+
+        if (recvmsg(fd, &mh, MSG_ERRQUEUE | MSG_DONTWAIT) == -1)
+        {
+            return false;
+        }
+
+        have_ts = have_id = false;
+
+        for (cmsg = CMSG_FIRSTHDR(&mh); cmsg != NULL; cmsg = CMSG_NXTHDR(&mh, cmsg))
+        {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPING)
+            {
+                memcpy(ts, CMSG_DATA(cmsg), sizeof(*ts));
+                have_ts = true;
+            }
+            else if ((cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_RECVERR) ||
+                     (cmsg->cmsg_level == IPPROTO_IPV6 && cmsg->cmsg_type == IPV6_RECVERR))
+            {
+                memcpy(&serr, CMSG_DATA(cmsg), sizeof(serr));
+
+                if (serr.ee_errno == ENOMSG && serr.ee_origin == SO_EE_ORIGIN_TIMESTAMPING)
+                {
+                    *id = serr.ee_data;
+                    have_id = true;
+                }
+            }
+        }
+    }
+
+    return true;
+#else
+    (void)fd;
+    (void)id;
+    (void)ts;
+
+    return false;
+#endif
+}
@@ -0,0 +1,173 @@
+/**
+ * Socket buffer sizing, kernel drop accounting and kernel timestamps
+ *
+ * A burst bigger than a socket's receive buffer is dropped by the kernel
+ * before the program ever sees it, which looks exactly like loss on the
+ * network. These helpers size the buffers from the command line and read
+ * the kernel's drop counter (SO_RXQ_OVFL) off every received datagram, so
+ * those drops are counted on their own (kernel_drops) instead of showing up
+ * only as timeouts.
+ *
+ * They also turn on the kernel's software timestamps (SO_TIMESTAMPING, or
+ * SO_TIMESTAMPNS for receive only), so latencies can be measured from when
+ * a datagram actually left or arrived rather than from when the program got
+ * around to it. Kernel timestamps are CLOCK_REALTIME.
+ *
+ * For bulk transfers, UDP segmentation offload lets one send hand the
+ * kernel several datagrams at once (GSO), and lets one receive take in
+ * several that arrived back to back (GRO).
+ *
+ * CMPT 434 - A2
+ * Steven Rau
+ * scr108
+ * 11115094
+ */
+
+#ifndef SOCK_H
+#define SOCK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+/* Room for the ancillary data sock_recvfrom() asks for (drop count, timestamps and GRO size) */
+#define SOCK_CONTROL_LEN  (CMSG_SPACE(sizeof(uint32_t)) + CMSG_SPACE(3 * sizeof(struct timespec)) \
+                           + CMSG_SPACE(sizeof(int)))
+
+/* Most datagrams one GSO send can carry, and most bytes altogether */
+#define SOCK_GSO_MAX_SEGMENTS  64
+#define SOCK_GSO_MAX_BYTES     65000
+
+/* Largest receive GRO can coalesce datagrams into */
+#define SOCK_GRO_BUFFER_SIZE   65535
+
+/* What the kernel reported about a received datagram */
+struct sock_rx_info
+{
+    struct timespec ts;   /* When the kernel received it (zero if it wasn't timestamped) */
+    int segment_size;     /* Size of each datagram GRO coalesced into it (0 if it is just one) */
+};
+
+/**
+ * Sets a socket's receive and send buffer sizes
+ *
+ * The FORCE variants are tried first so the system maximum can be exceeded when the program has
+ * the privilege to; otherwise the size is capped by the system maximum, and a warning is printed
+ * if the kernel gave less than asked for
+ *
+ * @param[in] fd      The socket
+ * @param[in] rcvbuf  Receive buffer size in bytes (0 leaves the default)
+ * @param[in] sndbuf  Send buffer size in bytes (0 leaves the default)
+ */
+void sock_set_buffers(int fd, int rcvbuf, int sndbuf);
+
+/**
+ * Asks the kernel to report its drop count for the socket with every datagram received
+ */
+void sock_track_drops(int fd);
+
+/**
+ * Asks the kernel to timestamp every datagram the socket receives, and optionally every one
+ * it sends (read back with sock_read_tx_timestamp())
+ *
+ * @param[in] fd  The socket
+ * @param[in] tx  Whether to timestamp sent datagrams too
+ *
+ * Returns whether transmit timestamps were turned on
+ */
+bool sock_enable_timestamps(int fd, bool tx);
+
+/**
+ * recvfrom() that also picks up the kernel's drop count, receive timestamp and GRO segment size
+ *
+ * Drops since the last call are added to STAT_KERNEL_DROPS
+ *
+ * @param[in]     fd          The socket (set up with sock_track_drops())
+ * @param[out]    buf         Buffer for the datagram
+ * @param[in]     len         Size of buf
+ * @param[in]     flags       recvmsg() flags
+ * @param[out]    addr        Sender's address (may be NULL)
+ * @param[in,out] addr_len    Size of addr (may be NULL)
+ * @param[out]    info        Timestamp and GRO segment size of the datagram (may be NULL)
+ * @param[in,out] last_drops  The socket's drop count as of the last call (start at 0)
+ *
+ * Returns the number of bytes received, or -1 on error (with errno set)
+ */
+ssize_t sock_recvfrom(int fd, void *buf, size_t len, int flags, struct sockaddr *addr,
+                      socklen_t *addr_len, struct sock_rx_info *info, uint32_t *last_drops);
+
+/**
+ * Picks the drop count, receive timestamp and GRO segment size out of a received datagram's
+ * ancillary data (for datagrams read some other way than sock_recvfrom())
+ *
+ * @param[in]     mh          The msghdr the datagram was received with
+ * @param[out]    info        Timestamp and GRO segment size of the datagram (may be NULL)
+ * @param[in,out] last_drops  The socket's drop count as of the last datagram
+ */
+void sock_read_cmsgs(struct msghdr *mh, struct sock_rx_info *info, uint32_t *last_drops);
+
+/**
+ * Lets the kernel hand this socket several datagrams coalesced into one receive (UDP_GRO).
+ * Split them back up by the segment size sock_recvfrom() reports
+ *
+ * Returns false if the kernel doesn't support it
+ */
+bool sock_enable_gro(int fd);
+
+/**
+ * Sends several datagrams with one call, letting the kernel split them up (UDP_SEGMENT)
+ *
+ * Every datagram but the last has to be exactly segment_size bytes, the last at most that.
+ * Each iovec is one datagram
+ *
+ * @param[in] fd            The socket
+ * @param[in] iov           The datagrams
+ * @param[in] count         Number of datagrams (at most SOCK_GSO_MAX_SEGMENTS)
+ * @param[in] segment_size  Size of each datagram
+ * @param[in] addr          Where to send them
+ * @param[in] addr_len      Size of addr
+ *
+ * Returns false (with errno set) if the send failed, e.g. on a kernel without GSO
+ */
+bool sock_send_segments(int fd, const struct iovec *iov, unsigned count, uint16_t segment_size,
+                        const struct sockaddr *addr, socklen_t addr_len);
+
+/**
+ * Reads one transmit timestamp off the socket's error queue, without blocking
+ *
+ * @param[in]  fd  The socket (set up with sock_enable_timestamps(fd, true))
+ * @param[out] id  Which datagram it is for: 0 for the first one sent on the socket, and so on
+ * @param[out] ts  When the kernel sent it
+ *
+ * Returns false once there are none left
+ */
+bool sock_read_tx_timestamp(int fd, uint32_t *id, struct timespec *ts);
+
+/**
+ * Current time on the same clock as the kernel timestamps
+ */
+static inline void sock_now(struct timespec *ts)
+{
+    clock_gettime(CLOCK_REALTIME, ts);
+}
+
+/**
+ * A timestamp as nanoseconds since the epoch
+ */
+static inline int64_t sock_ts_ns(const struct timespec *ts)
+{
+    return (int64_t)ts->tv_sec * 1000000000LL + ts->tv_nsec;
+}
+
+/**
+ * Nanoseconds from earlier to later
+ */
+static inline int64_t sock_ts_diff_ns(const struct timespec *later, const struct timespec *earlier)
+{
+    return (int64_t)(later->tv_sec - earlier->tv_sec) * 1000000000LL + (later->tv_nsec - earlier->tv_nsec);
+}
+
+#endif /* SOCK_H */
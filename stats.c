@@ -0,0 +1,411 @@
+/**
+ * Runtime statistics shared by the sender and receiver
+ *
+ * CMPT 434 - A2
+ * Steven Rau
+ * scr108
+ * 11115094
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "stats.h"
+
+/*-----------------------------------------------------------------------------
+ * File-scope constants & globals
+ * --------------------------------------------------------------------------*/
+
+/* JSON names of the counters, indexed by enum stats_id */
+static const char *stat_names[STAT_NUM_COUNTERS] =
+{
+    "msgs_sent",
+    "retransmissions",
+    "timeouts",
+    "msgs_received",
+    "corrupt",
+    "acks_sent",
+    "acks_received",
+    "acks_lost",
+    "duplicates",
+    "out_of_order",
+    "compress_in_bytes",
+    "compress_out_bytes",
+    "heap_allocs",
+    "heap_frees",
+    "heap_bytes",
+    "proxy_forwarded",
+    "proxy_lost",
+    "proxy_queue_drops",
+    "proxy_reordered",
+    "proxy_duplicated",
+    "proxy_too_big",
+    "kernel_drops",
+    "fec_parity_sent",
+    "fec_recovered",
+    "spin_hits",
+    "spin_sleeps",
+    "pmtu_probes",
+    "shm_wakeups",
+    "buffer_occupancy",
+    "window_occupancy"
+};
+
+/* JSON names of the histograms, indexed by enum stats_hist_id */
+static const char *hist_names[STAT_NUM_HISTS] =
+{
+    "rtt_ns",
+    "rtt_network_ns",
+    "receiver_hold_ns",
+    "rx_wakeup_ns",
+    "tx_stack_ns"
+};
+
+/* Percentiles reported for each histogram */
+static const double hist_percentiles[] = { 50, 90, 99, 99.9 };
+static const char *hist_percentile_names[] = { "p50", "p90", "p99", "p999" };
+
+/* The calling thread's counters (NULL until the thread first bumps a counter) */
+_Thread_local struct stats_block *stats_local_block = NULL;
+
+/* List of every thread's counters. Blocks are never freed so the totals survive thread exit */
+static struct stats_block *all_blocks = NULL;
+static pthread_mutex_t blocks_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Export settings given to stats_start() */
+static const char *stats_role = "unknown";
+static const char *stats_file = NULL;
+static int stats_interval = 0;
+
+/* Signal the main thread is woken up with once SIGINT or SIGTERM asks it to stop, and how often
+ * (nanoseconds) it is woken up again until it has: the first one can land just before it blocks */
+#define STATS_WAKE_SIGNAL  SIGUSR2
+#define STATS_WAKE_NSEC    100000000L
+
+/* The thread that called stats_start(), and whether it has been asked to stop */
+static pthread_t main_thread;
+static bool stop_requested = false;
+
+/*-----------------------------------------------------------------------------
+ * Helper functions
+ * --------------------------------------------------------------------------*/
+
+/**
+ * Allocates and registers the calling thread's block of counters
+ */
+struct stats_block *stats_register_thread(void)
+{
+    struct stats_block *b = calloc(1, sizeof(struct stats_block));
+
+    if (b == NULL)
+    {
+        perror("calloc");
+
+        exit(1);
+    }
+
+    pthread_mutex_lock(&blocks_lock);
+    b->next = all_blocks;
+    all_blocks = b;
+    pthread_mutex_unlock(&blocks_lock);
+
+    stats_local_block = b;
+
+    return b;
+}
+
+void stats_aggregate(uint64_t totals[STAT_NUM_COUNTERS])
+{
+    struct stats_block *b;
+    uint64_t val;
+    int i;
+
+    memset(totals, 0, STAT_NUM_COUNTERS * sizeof(uint64_t));
+
+    pthread_mutex_lock(&blocks_lock);
+    for (b = all_blocks; b != NULL; b = b->next)
+    {
+        for (i = 0; i < STAT_FIRST_GAUGE; i++)
+        {
+            totals[i] += __atomic_load_n(&b->val[i], __ATOMIC_RELAXED);
+        }
+
+        for (i = STAT_FIRST_GAUGE; i < STAT_NUM_COUNTERS; i++)
+        {
+            val = __atomic_load_n(&b->val[i], __ATOMIC_RELAXED);
+            totals[i] = val > totals[i] ? val : totals[i];
+        }
+    }
+    pthread_mutex_unlock(&blocks_lock);
+}
+
+/**
+ * Smallest value that falls into a histogram bucket
+ */
+static uint64_t hist_bucket_low(int bucket)
+{
+    int shift;
+
+    if (bucket < STATS_HIST_SUB)
+    {
+        return bucket;
+    }
+
+    shift = bucket / STATS_HIST_SUB - 1;
+
+    return (uint64_t)(STATS_HIST_SUB + bucket % STATS_HIST_SUB) << shift;
+}
+
+/**
+ * Value reported for a bucket: the middle of its range
+ */
+static uint64_t hist_bucket_mid(int bucket)
+{
+    int shift = bucket < STATS_HIST_SUB ? 0 : bucket / STATS_HIST_SUB - 1;
+
+    return hist_bucket_low(bucket) + ((1ULL << shift) >> 1);
+}
+
+/**
+ * Writes one histogram (summed across threads) as a JSON object of its count, mean and percentiles
+ */
+static void hist_write_json(FILE *out, enum stats_hist_id id)
+{
+    uint64_t buckets[STATS_HIST_BUCKETS];
+    struct stats_block *b;
+    uint64_t count = 0;
+    uint64_t sum = 0;
+    uint64_t seen;
+    uint64_t rank;
+    int max_bucket = -1;
+    int i;
+    size_t p;
+
+    memset(buckets, 0, sizeof(buckets));
+
+    pthread_mutex_lock(&blocks_lock);
+    for (b = all_blocks; b != NULL; b = b->next)
+    {
+        for (i = 0; i < STATS_HIST_BUCKETS; i++)
+        {
+            buckets[i] += __atomic_load_n(&b->hist[id][i], __ATOMIC_RELAXED);
+        }
+        sum += __atomic_load_n(&b->hist_sum[id], __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&blocks_lock);
+
+    for (i = 0; i < STATS_HIST_BUCKETS; i++)
+    {
+        count += buckets[i];
+        max_bucket = buckets[i] > 0 ? i : max_bucket;
+    }
+
+    fprintf(out, "\"%s\":{\"count\":%llu,\"mean\":%llu", hist_names[id], (unsigned long long)count,
+            (unsigned long long)(count > 0 ? sum / count : 0));
+
+    for (p = 0; p < sizeof(hist_percentiles) / sizeof(hist_percentiles[0]); p++)
+    {
+        rank = (uint64_t)(count * hist_percentiles[p] / 100);
+        seen = 0;
+
+        for (i = 0; i < STATS_HIST_BUCKETS && count > 0; i++)
+        {
+            seen += buckets[i];
+            if (seen > rank || i == max_bucket)
+            {
+                break;
+            }
+        }
+
+        fprintf(out, ",\"%s\":%llu", hist_percentile_names[p],
+                (unsigned long long)(count > 0 ? hist_bucket_mid(i) : 0));
+    }
+
+    fprintf(out, ",\"max\":%llu}", (unsigned long long)(max_bucket >= 0 ? hist_bucket_mid(max_bucket) : 0));
+}
+
+/**
+ * Writes the aggregated counters as a single line of JSON
+ *
+ * @param[in] out     Stream to write to
+ * @param[in] reason  Why the dump happened ("signal", "periodic" or "exit")
+ */
+static void stats_write_json(FILE *out, const char *reason)
+{
+    uint64_t totals[STAT_NUM_COUNTERS];
+    struct timespec now;
+    int i;
+
+    stats_aggregate(totals);
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    fprintf(out, "{\"role\":\"%s\",\"pid\":%d,\"reason\":\"%s\",\"time\":%ld.%03ld,\"counters\":{",
+            stats_role, (int)getpid(), reason, (long)now.tv_sec, now.tv_nsec / 1000000);
+    for (i = 0; i < STAT_NUM_COUNTERS; i++)
+    {
+        fprintf(out, "%s\"%s\":%llu", i > 0 ? "," : "", stat_names[i], (unsigned long long)totals[i]);
+    }
+    fprintf(out, "},\"histograms\":{");
+    for (i = 0; i < STAT_NUM_HISTS; i++)
+    {
+        fprintf(out, "%s", i > 0 ? "," : "");
+        hist_write_json(out, i);
+    }
+    fprintf(out, "}}\n");
+    fflush(out);
+}
+
+/**
+ * Dumps the stats to the configured file (replaced atomically), or stderr if none was given
+ */
+static void stats_dump(const char *reason)
+{
+    char tmp_name[4096];
+    FILE *out;
+
+    if (stats_file == NULL)
+    {
+        stats_write_json(stderr, reason);
+
+        return;
+    }
+
+    snprintf(tmp_name, sizeof(tmp_name), "%s.tmp", stats_file);
+
+    if ((out = fopen(tmp_name, "w")) == NULL)
+    {
+        perror("stats: fopen");
+
+        return;
+    }
+
+    stats_write_json(out, reason);
+    fclose(out);
+
+    if (rename(tmp_name, stats_file) == -1)
+    {
+        perror("stats: rename");
+    }
+}
+
+static void stats_dump_at_exit(void)
+{
+    stats_dump("exit");
+}
+
+/**
+ * Does nothing: STATS_WAKE_SIGNAL is only sent to interrupt whatever the main thread is blocked in
+ */
+static void stats_wake(int sig)
+{
+    (void)sig;
+}
+
+/**
+ * Export thread. Waits for the blocked signals, dumping on SIGUSR1 and
+ * at every interval. SIGINT/SIGTERM ask the main thread to stop, so it
+ * leaves through its own shutdown path (closing the journal and trace,
+ * draining the log) and the final counters get written at exit
+ */
+static void *stats_thread(void *arg)
+{
+    sigset_t *set = arg;
+    struct timespec period;
+    struct timespec wake;
+    int sig;
+
+    period.tv_sec = stats_interval;
+    period.tv_nsec = 0;
+    wake.tv_sec = 0;
+    wake.tv_nsec = STATS_WAKE_NSEC;
+
+    while (1)
+    {
+        if (stats_stopping())
+        {
+            sig = sigtimedwait(set, NULL, &wake);
+        }
+        else if (stats_interval > 0)
+        {
+            sig = sigtimedwait(set, NULL, &period);
+        }
+        else
+        {
+            sig = sigwaitinfo(set, NULL);
+        }
+
+        if (sig == SIGUSR1)
+        {
+            stats_dump("signal");
+        }
+        else if (sig == SIGINT || sig == SIGTERM)
+        {
+            __atomic_store_n(&stop_requested, true, __ATOMIC_RELEASE);
+
+            pthread_kill(main_thread, STATS_WAKE_SIGNAL);
+        }
+        else if (sig == -1 && errno == EAGAIN && stats_stopping())
+        {
+            pthread_kill(main_thread, STATS_WAKE_SIGNAL);
+        }
+        else if (sig == -1 && errno == EAGAIN)
+        {
+            stats_dump("periodic");
+        }
+    }
+
+    return NULL;
+}
+
+/*-----------------------------------------------------------------------------
+ *
+ * --------------------------------------------------------------------------*/
+
+void stats_start(const char *role, const char *file, int interval_sec)
+{
+    static sigset_t set;
+    struct sigaction wake;
+    pthread_t tid;
+    int rv;
+
+    stats_role = role;
+    stats_file = file;
+    stats_interval = file != NULL ? interval_sec : 0;
+    main_thread = pthread_self();
+
+    /* No SA_RESTART, so a blocking call the wakeup lands in fails with EINTR */
+    memset(&wake, 0, sizeof(wake));
+    wake.sa_handler = stats_wake;
+    sigemptyset(&wake.sa_mask);
+    sigaction(STATS_WAKE_SIGNAL, &wake, NULL);
+
+    /* Block the signals here so every thread created later inherits the mask and
+     * only the export thread ever sees them */
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+    atexit(stats_dump_at_exit);
+
+    if ((rv = pthread_create(&tid, NULL, stats_thread, &set)) != 0)
+    {
+        fprintf(stderr, "stats: pthread_create: %s\n", strerror(rv));
+
+        return;
+    }
+
+    pthread_detach(tid);
+}
+
+bool stats_stopping(void)
+{
+    return __atomic_load_n(&stop_requested, __ATOMIC_ACQUIRE);
+}
@@ -0,0 +1,197 @@
+/**
+ * Runtime statistics shared by the sender and receiver
+ *
+ * Every thread gets its own block of counters that only it writes to, so
+ * bumping a counter is a plain (relaxed atomic) store with no locking. The
+ * blocks are summed on demand when the stats are dumped as JSON, which
+ * happens on SIGUSR1, periodically to a file, and at exit. Gauges (e.g.
+ * window occupancy) are set rather than added to, and the dump takes the
+ * highest value instead of the sum.
+ *
+ * Latencies go into log-linear histograms kept the same way (each power of
+ * two split into 32 buckets, so every value is within about 3% of its
+ * bucket), and are dumped as percentiles alongside the counters.
+ *
+ * CMPT 434 - A2
+ * Steven Rau
+ * scr108
+ * 11115094
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Counter (and gauge) identifiers. Keep in sync with the names in stats.c. Gauges go last, from
+ * STAT_FIRST_GAUGE on */
+enum stats_id
+{
+    STAT_MSGS_SENT,        /* Every datagram sent by the sender, including retransmissions */
+    STAT_RETRANSMISSIONS,  /* Messages re-sent from the window */
+    STAT_TIMEOUTS,         /* Waits for an ack that timed out */
+    STAT_MSGS_RECEIVED,    /* Datagrams read by the receiver */
+    STAT_CORRUPT,          /* Datagrams dropped because of a bad length or checksum */
+    STAT_ACKS_SENT,
+    STAT_ACKS_RECEIVED,
+    STAT_ACKS_LOST,        /* Acks dropped by the ack loss probability */
+    STAT_DUPLICATES,       /* Messages received more than once */
+    STAT_OUT_OF_ORDER,     /* Messages received ahead of the next in-order one */
+    STAT_COMPRESS_IN_BYTES,  /* Text bytes going into compression (compressed messages only) */
+    STAT_COMPRESS_OUT_BYTES, /* Bytes they were compressed down to */
+    STAT_HEAP_ALLOCS,      /* Allocations through mem_alloc() (flat once a transfer is running) */
+    STAT_HEAP_FREES,
+    STAT_HEAP_BYTES,       /* Bytes allocated through mem_alloc() */
+    STAT_PROXY_FORWARDED,  /* Datagrams the impairment proxy delivered (either direction) */
+    STAT_PROXY_LOST,       /* Datagrams it dropped as link loss */
+    STAT_PROXY_QUEUE_DROPS,  /* Datagrams it dropped because the link's queue was full */
+    STAT_PROXY_REORDERED,
+    STAT_PROXY_DUPLICATED,
+    STAT_PROXY_TOO_BIG,    /* Datagrams it dropped for being longer than the link's MTU allows */
+    STAT_KERNEL_DROPS,     /* Datagrams the kernel dropped because a socket's receive buffer was full */
+    STAT_FEC_PARITY_SENT,  /* FEC parity datagrams sent */
+    STAT_FEC_RECOVERED,    /* Lost messages the receiver rebuilt from parity */
+    STAT_SPIN_HITS,        /* Low-latency (or shared memory) receives that found a datagram while spinning */
+    STAT_SPIN_SLEEPS,      /* Low-latency (or shared memory) receives whose spin budget ran out, falling back to blocking */
+    STAT_PMTU_PROBES,      /* Path MTU probes sent */
+    STAT_SHM_WAKEUPS,      /* Futex wakeups one end of the shared-memory transport made for the other */
+    STAT_BUFFER_OCCUPANCY, /* Gauge: messages held in the receiver's reorder buffer */
+    STAT_WINDOW_OCCUPANCY, /* Gauge: messages queued in the sender's window */
+    STAT_NUM_COUNTERS
+};
+
+/* Gauges hold a level rather than a count, so summing them across threads means nothing. The
+ * dump reports the highest any thread holds */
+#define STAT_FIRST_GAUGE  STAT_BUFFER_OCCUPANCY
+
+/* Latency histogram identifiers, all in nanoseconds. Keep in sync with the names in stats.c */
+enum stats_hist_id
+{
+    HIST_RTT_NS,           /* Sender: message transmit to ack receive, kernel timestamps where available */
+    HIST_RTT_NETWORK_NS,   /* Sender: the RTT less the time the message spent in the receiver */
+    HIST_RECEIVER_HOLD_NS, /* Receiver: message receive (kernel timestamp) to its ack being sent */
+    HIST_RX_WAKEUP_NS,     /* Kernel receive timestamp to the datagram being read by the program */
+    HIST_TX_STACK_NS,      /* Sender: sendto() call to the kernel's transmit timestamp */
+    STAT_NUM_HISTS
+};
+
+/* Each power of two is split into 2^STATS_HIST_SUB_BITS buckets, up to 2^STATS_HIST_MAX_BITS ns */
+#define STATS_HIST_SUB_BITS  5
+#define STATS_HIST_SUB       (1 << STATS_HIST_SUB_BITS)
+#define STATS_HIST_MAX_BITS  40
+#define STATS_HIST_BUCKETS   ((STATS_HIST_MAX_BITS - STATS_HIST_SUB_BITS + 1) * STATS_HIST_SUB)
+
+/* One thread's counters */
+struct stats_block
+{
+    uint64_t val[STAT_NUM_COUNTERS];
+    uint64_t hist[STAT_NUM_HISTS][STATS_HIST_BUCKETS];
+    uint64_t hist_sum[STAT_NUM_HISTS];
+    struct stats_block *next;
+};
+
+extern _Thread_local struct stats_block *stats_local_block;
+
+struct stats_block *stats_register_thread(void);
+
+/**
+ * Adds to one of the calling thread's counters
+ *
+ * Only the owning thread writes to its block, so a relaxed store is enough
+ * for the dumping thread to read a consistent value
+ */
+static inline void stats_add(enum stats_id id, uint64_t n)
+{
+    struct stats_block *b = stats_local_block;
+
+    if (b == NULL)
+    {
+        b = stats_register_thread();
+    }
+
+    __atomic_store_n(&b->val[id], b->val[id] + n, __ATOMIC_RELAXED);
+}
+
+/**
+ * Sets one of the calling thread's gauges
+ */
+static inline void stats_set(enum stats_id id, uint64_t val)
+{
+    struct stats_block *b = stats_local_block;
+
+    if (b == NULL)
+    {
+        b = stats_register_thread();
+    }
+
+    __atomic_store_n(&b->val[id], val, __ATOMIC_RELAXED);
+}
+
+#define STATS_INC(id)  stats_add((id), 1)
+
+/**
+ * Histogram bucket a value falls into. Values below STATS_HIST_SUB get a bucket each
+ */
+static inline int stats_hist_bucket(uint64_t val)
+{
+    int msb;
+
+    if (val < STATS_HIST_SUB)
+    {
+        return (int)val;
+    }
+
+    msb = 63 - __builtin_clzll(val);
+    if (msb >= STATS_HIST_MAX_BITS)
+    {
+        return STATS_HIST_BUCKETS - 1;
+    }
+
+    return (msb - STATS_HIST_SUB_BITS + 1) * STATS_HIST_SUB
+           + (int)((val >> (msb - STATS_HIST_SUB_BITS)) & (STATS_HIST_SUB - 1));
+}
+
+/**
+ * Records a latency (in nanoseconds) in one of the calling thread's histograms
+ */
+static inline void stats_record(enum stats_hist_id id, uint64_t ns)
+{
+    struct stats_block *b = stats_local_block;
+    int bucket = stats_hist_bucket(ns);
+
+    if (b == NULL)
+    {
+        b = stats_register_thread();
+    }
+
+    __atomic_store_n(&b->hist[id][bucket], b->hist[id][bucket] + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&b->hist_sum[id], b->hist_sum[id] + ns, __ATOMIC_RELAXED);
+}
+
+/**
+ * Starts the stats export thread
+ *
+ * Must be called from main() before any other threads are created, since
+ * SIGUSR1, SIGINT and SIGTERM get blocked here and handled by the export thread.
+ * SIGINT and SIGTERM don't end the program: they set stats_stopping() and
+ * interrupt the calling thread (blocking calls fail with EINTR), which is
+ * expected to check it and shut down the usual way.
+ *
+ * @param[in] role          Name reported in the JSON ("sender" or "receiver")
+ * @param[in] file          File to dump to, or NULL to dump to stderr
+ * @param[in] interval_sec  Period of the file dumps, 0 to only dump on SIGUSR1 and exit
+ */
+void stats_start(const char *role, const char *file, int interval_sec);
+
+/**
+ * True once SIGINT or SIGTERM asked the program to stop. Safe from any thread
+ */
+bool stats_stopping(void);
+
+/**
+ * Sums every thread's counters into totals, taking the highest of each gauge
+ */
+void stats_aggregate(uint64_t totals[STAT_NUM_COUNTERS]);
+
+#endif /* STATS_H */
@@ -0,0 +1,47 @@
+/**
+ * Checks shared by the unit tests that make check runs
+ *
+ * Each test program exercises one module on its own, with no peer on the
+ * other end of a socket, and exits non-zero if any check failed. A failed
+ * check prints where it is and carries on, so one run shows every failure.
+ *
+ * CMPT 434 - A2
+ * Steven Rau
+ * scr108
+ * 11115094
+ */
+
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+
+/* Checks that failed in this program so far */
+static int test_failures = 0;
+
+/**
+ * Checks a condition, printing it along with where it is if it doesn't hold
+ */
+#define CHECK(cond)                                                                     \
+    do                                                                                  \
+    {                                                                                   \
+        if (!(cond))                                                                    \
+        {                                                                               \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);  \
+            test_failures++;                                                            \
+        }                                                                               \
+    } while (0)
+
+/**
+ * Prints how a test program went
+ *
+ * Returns its exit status
+ */
+static inline int test_done(const char *name)
+{
+    printf("%s: %s\n", name, test_failures == 0 ? "passed" : "FAILED");
+
+    return test_failures == 0 ? 0 : 1;
+}
+
+#endif /* TEST_H */
@@ -0,0 +1,93 @@
+/**
+ * Unit tests for the acks: their layout on the wire, with every field in
+ * network byte order where the receiver puts it
+ *
+ * CMPT 434 - A2
+ * Steven Rau
+ * scr108
+ * 11115094
+ */
+
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "test.h"
+#include "shared.h"
+
+/*-----------------------------------------------------------------------------
+ * Tests
+ * --------------------------------------------------------------------------*/
+
+/**
+ * The header is packed the same on every host: no padding, fields where the other end looks
+ */
+static void test_layout(void)
+{
+    CHECK(sizeof(struct ack) == 24);
+    CHECK(offsetof(struct ack, version) == 0);
+    CHECK(offsetof(struct ack, flags) == 1);
+    CHECK(offsetof(struct ack, stream) == 2);
+    CHECK(offsetof(struct ack, cum_ack) == 4);
+    CHECK(offsetof(struct ack, sel_ack) == 8);
+    CHECK(offsetof(struct ack, ts_sec) == 12);
+    CHECK(offsetof(struct ack, ts_usec) == 16);
+    CHECK(offsetof(struct ack, hold_nsec) == 20);
+
+    /* Flags are bits of their own */
+    CHECK((ACK_FLAG_RETRANS & ACK_FLAG_OUT_OF_ORDER) == 0);
+    CHECK(((ACK_FLAG_RETRANS | ACK_FLAG_OUT_OF_ORDER) & ACK_FLAG_SELECTIVE) == 0);
+}
+
+/**
+ * An ack built the way the receiver builds it reads back the same from its bytes, most
+ * significant byte first, and the echoed timestamp is the message's untouched
+ */
+static void test_byte_order(void)
+{
+    const uint8_t expect[24] = { ACK_VERSION, ACK_FLAG_SELECTIVE, 3, 0,
+                                 0x01, 0x02, 0x03, 0x04,
+                                 0x05, 0x06, 0x07, 0x08,
+                                 0x00, 0x00, 0x30, 0x39,
+                                 0x00, 0x0f, 0x42, 0x3f,
+                                 0x00, 0x01, 0x86, 0xa0 };
+    struct message msg;
+    struct ack reply;
+    struct ack read;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.ts_sec = htonl(12345);
+    msg.ts_usec = htonl(999999);
+
+    memset(&reply, 0, sizeof(reply));
+    reply.version = ACK_VERSION;
+    reply.flags = ACK_FLAG_SELECTIVE;
+    reply.stream = 3;
+    reply.cum_ack = htonl(0x01020304);
+    reply.sel_ack = htonl(0x05060708);
+    reply.ts_sec = msg.ts_sec;
+    reply.ts_usec = msg.ts_usec;
+    reply.hold_nsec = htonl(100000);
+
+    CHECK(memcmp(&reply, expect, sizeof(expect)) == 0);
+
+    /* And the sender gets the same values back out */
+    memcpy(&read, expect, sizeof(read));
+    CHECK(read.version == ACK_VERSION && read.stream == 3);
+    CHECK(ntohl(read.cum_ack) == 0x01020304 && ntohl(read.sel_ack) == 0x05060708);
+    CHECK(ntohl(read.ts_sec) == 12345 && ntohl(read.ts_usec) == 999999);
+    CHECK(ntohl(read.hold_nsec) == 100000);
+}
+
+/*-----------------------------------------------------------------------------
+ * Main
+ * --------------------------------------------------------------------------*/
+
+int main(void)
+{
+    test_layout();
+    test_byte_order();
+
+    return test_done("test_ack");
+}
@@ -0,0 +1,1084 @@
+/**
+ * Unit tests for the ARQ library: a sender and a receiver of each policy
+ * joined back to back, with the datagrams between them held so they can be
+ * handed over late, out of order, more than once or not at all
+ *
+ * CMPT 434 - A2
+ * Steven Rau
+ * scr108
+ * 11115094
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+
+#include "test.h"
+#include "shared.h"
+#include "message.h"
+#include "pool.h"
+#include "log.h"
+#include "arq.h"
+
+/*-----------------------------------------------------------------------------
+ * File-scope constants & globals
+ * --------------------------------------------------------------------------*/
+
+#define TEST_WINDOW  4
+
+/* Retransmission timeout. Long enough that no timer runs out by itself while a test runs */
+#define TEST_TIMEOUT_USEC  10000000L
+
+/* Most datagrams held in each direction at once */
+#define TEST_WIRE  32
+
+/* Length of each line in test_pieces(), long enough that two of them fill a datagram of at least
+ * MSG_MIN_DATAGRAM (all six still fit in the delivered lines) */
+#define TEST_PIECE_LINE  40
+
+/* Messages sent while a second thread notes their acks */
+#define TEST_THREAD_MSGS  20000
+
+/* The entry points of one policy, so every test runs against both */
+struct policy
+{
+    const char *name;
+    bool selective;
+    bool (*send)(struct arq_sender *s);
+    bool (*on_ack)(struct arq_sender *s, const void *buf, int len);
+    bool (*note_ack)(struct arq_sender *s, const void *buf, int len);
+    void (*reclaim)(struct arq_sender *s);
+    void (*retransmit)(struct arq_sender *s);
+    long (*wait_usec)(struct arq_sender *s);
+    bool (*retransmit_due)(struct arq_sender *s);
+    void (*receive)(struct arq_receiver *r, struct message *msg, int len);
+};
+
+static const struct policy policies[] =
+{
+    { "gbn", false, arq_gbn_sender_send, arq_gbn_sender_on_ack, arq_gbn_sender_note_ack,
+      arq_gbn_sender_reclaim, arq_gbn_sender_retransmit, arq_gbn_sender_wait_usec,
+      arq_gbn_sender_retransmit_due, arq_gbn_receive },
+    { "sr",  true,  arq_sr_sender_send,  arq_sr_sender_on_ack,  arq_sr_sender_note_ack,
+      arq_sr_sender_reclaim, arq_sr_sender_retransmit, arq_sr_sender_wait_usec,
+      arq_sr_sender_retransmit_due, arq_sr_receive }
+};
+
+/* Messages the sender has sent, and acks the receiver has sent, in the order they went out */
+static struct message msgs[TEST_WIRE];
+static size_t msg_lens[TEST_WIRE];
+static int num_msgs;
+static struct ack acks[TEST_WIRE];
+static int num_acks;
+
+/* Lines delivered so far, back to back */
+static char delivered[256];
+
+/* Storage for each end, set up fresh for every test */
+static struct msg_pool send_pool;
+static struct msg_pool recv_pool;
+static struct arq_slot window[TEST_WINDOW];
+static struct message *buffer[TEST_WINDOW];
+
+/* And for a second stream, in the tests that use one */
+static struct msg_pool send_pool_1;
+static struct msg_pool recv_pool_1;
+static struct arq_slot window_1[TEST_WINDOW];
+static struct message *buffer_1[TEST_WINDOW];
+
+/* What the two threads of test_ack_thread() share: the messages sent so far, and the first one
+ * not selectively acked yet (both only ever go up) */
+struct ack_thread_ctx
+{
+    const struct policy *p;
+    struct arq_sender *s;
+    uint32_t num_sent;
+    uint32_t sel_acked;
+    bool all_noted;
+};
+
+/*-----------------------------------------------------------------------------
+ * Callbacks
+ * --------------------------------------------------------------------------*/
+
+static bool capture_msg(void *ctx, const void *buf, size_t len)
+{
+    if (num_msgs == TEST_WIRE)
+    {
+        return false;
+    }
+
+    memcpy(&msgs[num_msgs], buf, len);
+    msg_lens[num_msgs] = len;
+    num_msgs++;
+
+    return true;
+}
+
+static bool capture_ack(void *ctx, const struct ack *ack)
+{
+    if (num_acks == TEST_WIRE)
+    {
+        return false;
+    }
+
+    acks[num_acks++] = *ack;
+
+    return true;
+}
+
+static void deliver_line(void *ctx, uint32_t seq, const char *line, size_t len)
+{
+    strncat(delivered, line, len);
+}
+
+/* For test_ack_thread(), whose messages are only counted */
+static bool drop_msg(void *ctx, const void *buf, size_t len)
+{
+    return true;
+}
+
+/*-----------------------------------------------------------------------------
+ * Helper functions
+ * --------------------------------------------------------------------------*/
+
+/**
+ * Sets up a sender and a receiver of a policy, with nothing on the wire or delivered yet
+ */
+static void setup(const struct policy *p, struct arq_sender *s, struct arq_receiver *r)
+{
+    struct arq_sender_ops send_ops = { capture_msg, NULL, NULL };
+    struct arq_receiver_ops recv_ops = { NULL, deliver_line, capture_ack, NULL };
+
+    memset(window, 0, sizeof(window));
+    msg_pool_init(&send_pool, TEST_WINDOW);
+    msg_pool_init(&recv_pool, TEST_WINDOW);
+    arq_sender_init(s, &send_pool, window, TEST_WINDOW, TEST_TIMEOUT_USEC, &send_ops);
+    arq_receiver_init(r, &recv_pool, p->selective ? buffer : NULL, p->selective ? TEST_WINDOW : 0,
+                      &recv_ops);
+
+    num_msgs = 0;
+    num_acks = 0;
+    delivered[0] = '\0';
+}
+
+/**
+ * Checks no message was left out of the pools (once the sender is done), and frees them
+ */
+static void teardown(struct arq_sender *s, struct arq_receiver *r)
+{
+    if (arq_sender_idle(s))
+    {
+        CHECK(send_pool.num_free == send_pool.capacity);
+    }
+    CHECK(r->num_buffed == 0);
+    CHECK(recv_pool.num_free == recv_pool.capacity);
+
+    msg_pool_destroy(&send_pool);
+    msg_pool_destroy(&recv_pool);
+}
+
+/**
+ * Sends a message holding one line
+ */
+static void send_line(const struct policy *p, struct arq_sender *s, const char *line)
+{
+    struct message *msg = arq_sender_next_msg(s);
+
+    CHECK(msg != NULL);
+    if (msg == NULL)
+    {
+        return;
+    }
+
+    msg_add_record(msg, line, strlen(line));
+    CHECK(p->send(s));
+}
+
+/**
+ * Makes the i'th oldest message in the window look like it was sent a whole timeout ago
+ */
+static void expire(struct arq_sender *s, uint32_t i)
+{
+    arq_sender_slot(s, i)->sent_usec -= TEST_TIMEOUT_USEC;
+}
+
+/**
+ * Runs out the timer of every message in the window and has the sender re-send what it will
+ */
+static void time_out(const struct policy *p, struct arq_sender *s)
+{
+    uint32_t i;
+
+    for (i = 0; i < s->num_queued; i++)
+    {
+        expire(s, i);
+    }
+
+    p->retransmit(s);
+}
+
+/**
+ * Hands the receiver the i'th datagram the sender sent (which stays on the wire, to be handed
+ * over again if need be)
+ */
+static void to_receiver(const struct policy *p, struct arq_receiver *r, int i)
+{
+    struct message msg;
+
+    memcpy(&msg, &msgs[i], sizeof(msg));
+    p->receive(r, &msg, msg_lens[i]);
+}
+
+/**
+ * Builds an ack the way a receiver on stream 0 would (with no timestamp to echo)
+ */
+static void make_ack(struct ack *ack, uint8_t flags, uint32_t cum_ack, uint32_t sel_ack)
+{
+    memset(ack, 0, sizeof(*ack));
+    ack->version = ACK_VERSION;
+    ack->flags = flags;
+    ack->cum_ack = htonl(cum_ack);
+    ack->sel_ack = htonl(sel_ack);
+}
+
+/**
+ * Hands the sender every ack sent since the last call, in order
+ */
+static void acks_to_sender(const struct policy *p, struct arq_sender *s)
+{
+    int i;
+
+    for (i = 0; i < num_acks; i++)
+    {
+        CHECK(p->on_ack(s, &acks[i], sizeof(acks[i])));
+    }
+    num_acks = 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Tests
+ * --------------------------------------------------------------------------*/
+
+/**
+ * With nothing lost, every message is acked as it arrives and the window empties
+ */
+static void test_in_order(const struct policy *p)
+{
+    struct arq_sender s;
+    struct arq_receiver r;
+
+    setup(p, &s, &r);
+
+    send_line(p, &s, "a");
+    send_line(p, &s, "b");
+    send_line(p, &s, "c");
+    CHECK(num_msgs == 3 && s.num_queued == 3);
+    CHECK(msg_seq(&msgs[0]) == 0 && msg_seq(&msgs[2]) == 2);
+
+    to_receiver(p, &r, 0);
+    to_receiver(p, &r, 1);
+    to_receiver(p, &r, 2);
+    CHECK(strcmp(delivered, "abc") == 0);
+    CHECK(num_acks == 3);
+    CHECK(ntohl(acks[0].cum_ack) == 0 && ntohl(acks[2].cum_ack) == 2);
+    CHECK(acks[2].flags == 0);
+
+    acks_to_sender(p, &s);
+    CHECK(arq_sender_idle(&s));
+    CHECK(s.last_ack == 2);
+
+    teardown(&s, &r);
+}
+
+/**
+ * A full window takes nothing more until an ack makes room
+ */
+static void test_window_full(const struct policy *p)
+{
+    struct arq_sender s;
+    struct arq_receiver r;
+    int i;
+
+    setup(p, &s, &r);
+
+    for (i = 0; i < TEST_WINDOW; i++)
+    {
+        send_line(p, &s, "x");
+    }
+    CHECK(arq_sender_window_full(&s));
+    CHECK(arq_sender_next_msg(&s) == NULL);
+
+    to_receiver(p, &r, 0);
+    acks_to_sender(p, &s);
+    CHECK(!arq_sender_window_full(&s));
+    CHECK(arq_sender_next_msg(&s) != NULL);
+
+    teardown(&s, &r);
+}
+
+/**
+ * Messages arriving ahead of a gap: Go-Back-N drops them and has them sent again, Selective
+ * Repeat buffers them and delivers them once the gap fills. Either way every line comes out
+ * once, in order
+ */
+static void test_reorder(const struct policy *p)
+{
+    struct arq_sender s;
+    struct arq_receiver r;
+
+    setup(p, &s, &r);
+
+    send_line(p, &s, "a");
+    send_line(p, &s, "b");
+    send_line(p, &s, "c");
+
+    /* b and c overtake a. Nothing has arrived in order, so nothing is acked cumulatively, but
+     * Selective Repeat acks each message it buffers */
+    to_receiver(p, &r, 1);
+    to_receiver(p, &r, 2);
+    CHECK(delivered[0] == '\0');
+    if (p->selective)
+    {
+        CHECK(num_acks == 2);
+        CHECK(acks[0].flags == (ACK_FLAG_OUT_OF_ORDER | ACK_FLAG_SELECTIVE));
+        CHECK(ntohl(acks[0].cum_ack) == UINT32_MAX && ntohl(acks[0].sel_ack) == 1);
+        CHECK(ntohl(acks[1].sel_ack) == 2);
+        acks_to_sender(p, &s);
+        CHECK(s.num_queued == 3);
+    }
+    else
+    {
+        CHECK(num_acks == 0);
+    }
+
+    to_receiver(p, &r, 0);
+    if (p->selective)
+    {
+        CHECK(strcmp(delivered, "abc") == 0);
+        CHECK(num_acks == 1 && ntohl(acks[0].cum_ack) == 2);
+    }
+    else
+    {
+        CHECK(strcmp(delivered, "a") == 0);
+        CHECK(num_acks == 1 && ntohl(acks[0].cum_ack) == 0);
+    }
+    acks_to_sender(p, &s);
+
+    /* Whatever is still unacked goes again, one timeout at a time */
+    while (!arq_sender_idle(&s) && num_msgs < TEST_WIRE)
+    {
+        time_out(p, &s);
+        to_receiver(p, &r, num_msgs - 1);
+        acks_to_sender(p, &s);
+    }
+
+    CHECK(arq_sender_idle(&s));
+    CHECK(strcmp(delivered, "abc") == 0);
+    CHECK(num_msgs == (p->selective ? 3 : 5));
+
+    teardown(&s, &r);
+}
+
+/**
+ * A lost message is sent again on a timeout, and the one after it gets through in the end
+ */
+static void test_loss(const struct policy *p)
+{
+    struct arq_sender s;
+    struct arq_receiver r;
+
+    setup(p, &s, &r);
+
+    send_line(p, &s, "a");
+    send_line(p, &s, "b");
+
+    /* a never arrives. Selective Repeat acks b on its own, so only a is sent again */
+    to_receiver(p, &r, 1);
+    CHECK(num_acks == (p->selective ? 1 : 0));
+    acks_to_sender(p, &s);
+
+    time_out(p, &s);
+    CHECK(num_msgs == 3 && msg_seq(&msgs[2]) == 0);
+    to_receiver(p, &r, 2);
+    acks_to_sender(p, &s);
+
+    if (!p->selective)
+    {
+        time_out(p, &s);
+        CHECK(msg_seq(&msgs[num_msgs - 1]) == 1);
+        to_receiver(p, &r, num_msgs - 1);
+        acks_to_sender(p, &s);
+    }
+
+    CHECK(arq_sender_idle(&s));
+    CHECK(strcmp(delivered, "ab") == 0);
+
+    teardown(&s, &r);
+}
+
+/**
+ * A message that arrives twice (its ack was lost) is acked again and not delivered again
+ */
+static void test_duplicate(const struct policy *p)
+{
+    struct arq_sender s;
+    struct arq_receiver r;
+
+    setup(p, &s, &r);
+
+    send_line(p, &s, "a");
+    to_receiver(p, &r, 0);
+    num_acks = 0;
+
+    time_out(p, &s);
+    to_receiver(p, &r, 1);
+    CHECK(num_acks == 1);
+    CHECK(acks[0].flags == ACK_FLAG_RETRANS);
+    CHECK(ntohl(acks[0].cum_ack) == 0);
+    CHECK(strcmp(delivered, "a") == 0);
+
+    acks_to_sender(p, &s);
+    CHECK(arq_sender_idle(&s));
+
+    teardown(&s, &r);
+}
+
+/**
+ * Damaged messages are dropped without an ack, and acks that aren't whole acks of this version
+ * are refused
+ */
+static void test_damaged(const struct policy *p)
+{
+    struct arq_sender s;
+    struct arq_receiver r;
+    struct ack stale;
+
+    setup(p, &s, &r);
+
+    send_line(p, &s, "a");
+    msgs[0].text[2] ^= 1;
+    to_receiver(p, &r, 0);
+    CHECK(num_acks == 0);
+    CHECK(delivered[0] == '\0');
+
+    time_out(p, &s);
+    to_receiver(p, &r, 1);
+    CHECK(num_acks == 1);
+
+    stale = acks[0];
+    stale.version = ACK_VERSION + 1;
+    CHECK(!p->on_ack(&s, &stale, sizeof(stale)));
+    CHECK(!p->on_ack(&s, &acks[0], sizeof(acks[0]) - 1));
+    CHECK(!arq_sender_idle(&s));
+
+    acks_to_sender(p, &s);
+    CHECK(arq_sender_idle(&s));
+
+    teardown(&s, &r);
+}
+
+/**
+ * ARQ_DUP_ACK_THRESHOLD acks in a row that don't move the window on re-send the oldest unacked
+ * message straight away, without waiting for its timer, and nothing else with it
+ */
+static void test_fast_retransmit(const struct policy *p)
+{
+    struct arq_sender s;
+    struct arq_receiver r;
+    int i;
+
+    setup(p, &s, &r);
+
+    send_line(p, &s, "a");
+    send_line(p, &s, "b");
+    send_line(p, &s, "c");
+    CHECK(!p->retransmit_due(&s));
+
+    /* a's ack moves the window on. The copies of it that follow don't */
+    to_receiver(p, &r, 0);
+    CHECK(p->on_ack(&s, &acks[0], sizeof(acks[0])));
+    for (i = 0; i < ARQ_DUP_ACK_THRESHOLD; i++)
+    {
+        CHECK(!p->retransmit_due(&s));
+        CHECK(p->on_ack(&s, &acks[0], sizeof(acks[0])));
+    }
+    CHECK(p->retransmit_due(&s));
+
+    p->retransmit(&s);
+    CHECK(num_msgs == 4 && msg_seq(&msgs[3]) == 1);
+    CHECK(!p->retransmit_due(&s));
+
+    /* Further duplicates count from zero again */
+    CHECK(p->on_ack(&s, &acks[0], sizeof(acks[0])));
+    CHECK(!p->retransmit_due(&s));
+
+    num_acks = 0;
+    to_receiver(p, &r, 3);
+    to_receiver(p, &r, 2);
+    CHECK(strcmp(delivered, "abc") == 0);
+    acks_to_sender(p, &s);
+    CHECK(arq_sender_idle(&s));
+    CHECK(!p->retransmit_due(&s));
+
+    teardown(&s, &r);
+}
+
+/**
+ * Under Selective Repeat, the acks for messages buffered behind a loss are the duplicate acks
+ * that report it, so the lost message goes again before its timer runs out
+ */
+static void test_sr_gap_fast_retransmit(const struct policy *p)
+{
+    struct arq_sender s;
+    struct arq_receiver r;
+    char line[2] = "a";
+    int i;
+
+    setup(p, &s, &r);
+
+    for (i = 0; i < TEST_WINDOW; i++)
+    {
+        line[0] = 'a' + i;
+        send_line(p, &s, line);
+    }
+
+    /* a is lost, and everything after it is buffered and acked on its own */
+    for (i = 1; i < TEST_WINDOW; i++)
+    {
+        to_receiver(p, &r, i);
+    }
+    CHECK(num_acks == TEST_WINDOW - 1);
+    acks_to_sender(p, &s);
+    CHECK(p->retransmit_due(&s));
+
+    p->retransmit(&s);
+    CHECK(num_msgs == TEST_WINDOW + 1 && msg_seq(&msgs[TEST_WINDOW]) == 0);
+
+    to_receiver(p, &r, TEST_WINDOW);
+    CHECK(strcmp(delivered, "abcd") == 0);
+    acks_to_sender(p, &s);
+    CHECK(arq_sender_idle(&s));
+
+    teardown(&s, &r);
+}
+
+/**
+ * A message sent whole, and sent again in pieces once the datagrams allowed shrink (twice, so
+ * the pieces of the two splits overlap), arriving in any order. Every line comes out once, in
+ * order, and nothing left in the receiver's buffer. Selective acks of pieces don't mark the
+ * whole message, and only what is held is acked selectively
+ */
+static void test_pieces(const struct policy *p)
+{
+    struct arq_sender s;
+    struct arq_receiver r;
+    struct message *msg;
+    char lines[6][TEST_PIECE_LINE];
+    char expect[sizeof(lines) + 1];
+    size_t rec = MSG_RECORD_OVERHEAD + TEST_PIECE_LINE;
+    int i;
+
+    CHECK(MSG_HEADER_SIZE + 2 * rec >= MSG_MIN_DATAGRAM);
+
+    setup(p, &s, &r);
+
+    expect[0] = '\0';
+    msg = arq_sender_next_msg(&s);
+    for (i = 0; i < 6; i++)
+    {
+        memset(lines[i], 'a' + i, TEST_PIECE_LINE);
+        strncat(expect, lines[i], TEST_PIECE_LINE);
+        CHECK(msg_add_record(msg, lines[i], TEST_PIECE_LINE));
+    }
+    CHECK(p->send(&s));
+    CHECK(!(arq_sender_slot(&s, 0)->tag & ARQ_TAG_PIECES));
+
+    /* Three lines to a datagram: sent again as 0-2 and 3-5 */
+    msg_set_max_datagram(MSG_HEADER_SIZE + 3 * rec);
+    time_out(p, &s);
+    CHECK(arq_sender_slot(&s, 0)->tag & ARQ_TAG_PIECES);
+
+    /* Then two: 0-1, 2-3 and 4-5 */
+    msg_set_max_datagram(MSG_HEADER_SIZE + 2 * rec);
+    time_out(p, &s);
+
+    CHECK(num_msgs == 6);
+    CHECK(msg_seq(&msgs[1]) == 0 && msg_last_seq(&msgs[1]) == 2);
+    CHECK(msg_seq(&msgs[2]) == 3 && msg_last_seq(&msgs[2]) == 5);
+    CHECK(msg_seq(&msgs[3]) == 0 && msg_last_seq(&msgs[3]) == 1);
+    CHECK(msg_seq(&msgs[4]) == 2 && msg_last_seq(&msgs[4]) == 3);
+    CHECK(msg_seq(&msgs[5]) == 4 && msg_last_seq(&msgs[5]) == 5);
+    for (i = 1; i < num_msgs; i++)
+    {
+        CHECK(msg_lens[i] <= MSG_HEADER_SIZE + (i < 3 ? 3 : 2) * rec);
+    }
+
+    /* 4-5, then 3-5 covering it, then 2-3 overlapping that, and 2-3 again */
+    to_receiver(p, &r, 5);
+    to_receiver(p, &r, 2);
+    to_receiver(p, &r, 4);
+    to_receiver(p, &r, 4);
+    CHECK(delivered[0] == '\0');
+    if (p->selective)
+    {
+        CHECK(r.num_buffed == 2);
+        CHECK(num_acks == 4);
+        CHECK(acks[1].flags == (ACK_FLAG_OUT_OF_ORDER | ACK_FLAG_SELECTIVE));
+        CHECK(ntohl(acks[1].sel_ack) == 5);
+
+        /* The window's message ends at 5 too, but is only acked by a cumulative ack now */
+        acks_to_sender(p, &s);
+        CHECK(!(arq_sender_slot(&s, 0)->tag & 1));
+        CHECK(!arq_sender_idle(&s));
+    }
+    else
+    {
+        CHECK(num_acks == 0);
+    }
+
+    /* 0-1 fills the gap. Selective Repeat delivers everything buffered, trimmed to what is new */
+    to_receiver(p, &r, 3);
+    CHECK(strncmp(delivered, expect, strlen(delivered)) == 0);
+    CHECK(strlen(delivered) == (p->selective ? 6 : 2) * TEST_PIECE_LINE);
+    CHECK(ntohl(acks[num_acks - 1].cum_ack) == (p->selective ? 5 : 1));
+    CHECK(r.num_buffed == 0);
+
+    /* The late 0-2 and the whole message only add the lines Go-Back-N dropped. Anything
+     * already delivered is acked again, never selectively */
+    to_receiver(p, &r, 1);
+    CHECK(strlen(delivered) == (p->selective ? 6 : 3) * TEST_PIECE_LINE);
+    to_receiver(p, &r, 0);
+    CHECK(strcmp(delivered, expect) == 0);
+    CHECK(ntohl(acks[num_acks - 1].cum_ack) == 5);
+    CHECK(!(acks[num_acks - 1].flags & ACK_FLAG_SELECTIVE));
+    CHECK(!(acks[num_acks - 2].flags & ACK_FLAG_SELECTIVE));
+    if (p->selective)
+    {
+        CHECK(acks[num_acks - 1].flags == ACK_FLAG_RETRANS && acks[num_acks - 2].flags == ACK_FLAG_RETRANS);
+    }
+
+    acks_to_sender(p, &s);
+    CHECK(arq_sender_idle(&s));
+
+    msg_set_max_datagram(DEFAULT_DATAGRAM_SIZE);
+
+    teardown(&s, &r);
+}
+
+/**
+ * Streams are independent: a loss on one doesn't hold up delivery on another, and neither end
+ * takes a datagram meant for another stream
+ */
+static void test_streams(const struct policy *p)
+{
+    struct arq_sender_ops send_ops = { capture_msg, NULL, NULL };
+    struct arq_receiver_ops recv_ops = { NULL, deliver_line, capture_ack, NULL };
+    struct arq_sender s;
+    struct arq_receiver r;
+    struct arq_sender s1;
+    struct arq_receiver r1;
+
+    setup(p, &s, &r);
+
+    msg_pool_init(&send_pool_1, TEST_WINDOW);
+    msg_pool_init(&recv_pool_1, TEST_WINDOW);
+    arq_sender_init(&s1, &send_pool_1, window_1, TEST_WINDOW, TEST_TIMEOUT_USEC, &send_ops);
+    arq_receiver_init(&r1, &recv_pool_1, p->selective ? buffer_1 : NULL, p->selective ? TEST_WINDOW : 0,
+                      &recv_ops);
+    s1.stream = 1;
+    r1.stream = 1;
+
+    /* Both streams number their messages from 0 */
+    send_line(p, &s, "a");
+    send_line(p, &s1, "x");
+    send_line(p, &s1, "y");
+    CHECK(msg_seq(&msgs[0]) == 0 && msg_seq(&msgs[1]) == 0 && msg_seq(&msgs[2]) == 1);
+    CHECK(arq_msg_stream(&msgs[0], msg_lens[0]) == 0);
+    CHECK(arq_msg_stream(&msgs[1], msg_lens[1]) == 1);
+
+    /* a is lost, but stream 1 delivers and empties its window all the same */
+    to_receiver(p, &r1, 1);
+    to_receiver(p, &r1, 2);
+    CHECK(strcmp(delivered, "xy") == 0);
+    CHECK(num_acks == 2 && arq_ack_stream(&acks[1], sizeof(acks[1])) == 1);
+
+    /* Stream 0 refuses stream 1's acks, and its window stays as it was */
+    CHECK(!p->on_ack(&s, &acks[1], sizeof(acks[1])));
+    CHECK(s.num_queued == 1 && s.last_ack == UINT32_MAX);
+
+    acks_to_sender(p, &s1);
+    CHECK(arq_sender_idle(&s1));
+    CHECK(!arq_sender_idle(&s));
+
+    /* A message for stream 1 is dropped by stream 0's receiver, without an ack */
+    to_receiver(p, &r, 1);
+    CHECK(num_acks == 0);
+    CHECK(strcmp(delivered, "xy") == 0);
+
+    time_out(p, &s);
+    to_receiver(p, &r, 3);
+    CHECK(strcmp(delivered, "xya") == 0);
+    CHECK(num_acks == 1 && arq_ack_stream(&acks[0], sizeof(acks[0])) == 0);
+    acks_to_sender(p, &s);
+    CHECK(arq_sender_idle(&s));
+
+    CHECK(send_pool_1.num_free == send_pool_1.capacity);
+    CHECK(r1.num_buffed == 0 && recv_pool_1.num_free == recv_pool_1.capacity);
+    msg_pool_destroy(&send_pool_1);
+    msg_pool_destroy(&recv_pool_1);
+
+    teardown(&s, &r);
+}
+
+/**
+ * Selective Repeat times each message on its own: only a message whose timer ran out is sent
+ * again, and never one that has been acked
+ */
+static void test_sr_timers(const struct policy *p)
+{
+    struct arq_sender s;
+    struct arq_receiver r;
+    long wait;
+
+    setup(p, &s, &r);
+
+    send_line(p, &s, "a");
+    send_line(p, &s, "b");
+    send_line(p, &s, "c");
+
+    wait = p->wait_usec(&s);
+    CHECK(wait > 0 && wait <= TEST_TIMEOUT_USEC);
+
+    /* Only b's timer runs out */
+    expire(&s, 1);
+    CHECK(p->wait_usec(&s) == 0);
+    p->retransmit(&s);
+    CHECK(num_msgs == 4 && msg_seq(&msgs[3]) == 1);
+    CHECK(p->wait_usec(&s) > 0);
+
+    /* b gets through and is acked on its own, so it isn't sent again when its timer runs out */
+    to_receiver(p, &r, 3);
+    acks_to_sender(p, &s);
+    CHECK(arq_sender_slot(&s, 1)->acked);
+    CHECK(!arq_sender_slot(&s, 0)->acked);
+    expire(&s, 1);
+    p->retransmit(&s);
+    CHECK(num_msgs == 4);
+    CHECK(s.num_queued == 3);
+
+    /* a and c get through: a fills the gap, and the window empties */
+    to_receiver(p, &r, 0);
+    to_receiver(p, &r, 2);
+    CHECK(strcmp(delivered, "abc") == 0);
+    acks_to_sender(p, &s);
+    CHECK(arq_sender_idle(&s));
+
+    teardown(&s, &r);
+}
+
+/**
+ * A message buffered out of order is acked selectively, echoing its timestamp, and a duplicate
+ * of it is acked again but not buffered twice
+ */
+static void test_sr_selective_ack(const struct policy *p)
+{
+    struct arq_sender s;
+    struct arq_receiver r;
+
+    setup(p, &s, &r);
+
+    send_line(p, &s, "a");
+    send_line(p, &s, "b");
+
+    to_receiver(p, &r, 1);
+    CHECK(num_acks == 1);
+    CHECK(acks[0].version == ACK_VERSION);
+    CHECK(acks[0].flags == (ACK_FLAG_OUT_OF_ORDER | ACK_FLAG_SELECTIVE));
+    CHECK(ntohl(acks[0].cum_ack) == UINT32_MAX);
+    CHECK(ntohl(acks[0].sel_ack) == msg_last_seq(&msgs[1]));
+    CHECK(acks[0].ts_sec == msgs[1].ts_sec && acks[0].ts_usec == msgs[1].ts_usec);
+    CHECK(r.num_buffed == 1 && recv_pool.num_free == recv_pool.capacity - 1);
+
+    to_receiver(p, &r, 1);
+    CHECK(num_acks == 2);
+    CHECK(acks[1].flags & ACK_FLAG_SELECTIVE);
+    CHECK(ntohl(acks[1].sel_ack) == 1);
+    CHECK(r.num_buffed == 1 && recv_pool.num_free == recv_pool.capacity - 1);
+    CHECK(delivered[0] == '\0');
+
+    to_receiver(p, &r, 0);
+    CHECK(strcmp(delivered, "ab") == 0);
+    CHECK(num_acks == 3 && ntohl(acks[2].cum_ack) == 1);
+
+    acks_to_sender(p, &s);
+    CHECK(arq_sender_idle(&s));
+
+    teardown(&s, &r);
+}
+
+/**
+ * Selective Repeat re-sends messages one by one, so gaps can fill in any order and the lines
+ * still come out in order, each once
+ */
+static void test_sr_fill_any_order(const struct policy *p)
+{
+    struct arq_sender s;
+    struct arq_receiver r;
+
+    setup(p, &s, &r);
+
+    send_line(p, &s, "a");
+    send_line(p, &s, "b");
+    send_line(p, &s, "c");
+    send_line(p, &s, "d");
+
+    to_receiver(p, &r, 3);
+    to_receiver(p, &r, 2);
+    CHECK(r.num_buffed == 2);
+    CHECK(msg_seq(r.buffer[0]) == 2 && msg_seq(r.buffer[1]) == 3);
+
+    to_receiver(p, &r, 0);
+    CHECK(strcmp(delivered, "a") == 0);
+
+    to_receiver(p, &r, 1);
+    CHECK(strcmp(delivered, "abcd") == 0);
+    CHECK(r.num_buffed == 0);
+    CHECK(ntohl(acks[num_acks - 1].cum_ack) == 3);
+
+    /* A late copy of anything already delivered is only acked again */
+    to_receiver(p, &r, 2);
+    CHECK(strcmp(delivered, "abcd") == 0);
+    CHECK(ntohl(acks[num_acks - 1].cum_ack) == 3);
+    CHECK(r.num_buffed == 0);
+
+    acks_to_sender(p, &s);
+    CHECK(arq_sender_idle(&s));
+
+    teardown(&s, &r);
+}
+
+/**
+ * note_ack() only records an ack. The window and the pool don't change until reclaim(), which
+ * takes out everything below the ack frontier and gives it back, freeing the window for more
+ */
+static void test_reclaim(const struct policy *p)
+{
+    struct arq_sender s;
+    struct arq_receiver r;
+    int i;
+
+    setup(p, &s, &r);
+
+    send_line(p, &s, "a");
+    send_line(p, &s, "b");
+    send_line(p, &s, "c");
+    send_line(p, &s, "d");
+    CHECK(arq_sender_window_full(&s) && send_pool.num_free == 0);
+
+    to_receiver(p, &r, 0);
+    to_receiver(p, &r, 1);
+    for (i = 0; i < num_acks; i++)
+    {
+        CHECK(p->note_ack(&s, &acks[i], sizeof(acks[i])));
+    }
+    num_acks = 0;
+
+    CHECK(arq_sender_ack_frontier(&s) == 2);
+    CHECK(s.num_queued == 4 && send_pool.num_free == 0);
+    CHECK(arq_sender_next_msg(&s) == NULL);
+
+    p->reclaim(&s);
+    CHECK(s.num_queued == 2 && send_pool.num_free == 2);
+    CHECK(msg_seq(arq_sender_msg(&s, 0)) == 2);
+
+    /* The slots given back are free to tag again */
+    CHECK(window[0].tag == 0 && window[1].tag == 0);
+    CHECK(window[2].tag == (uint64_t)3 << 1 && window[3].tag == (uint64_t)4 << 1);
+
+    /* Under Selective Repeat a buffered message is only marked: it stays queued (no longer timed)
+     * until the frontier passes it */
+    if (p->selective)
+    {
+        to_receiver(p, &r, 3);
+        CHECK(num_acks == 1 && p->note_ack(&s, &acks[0], sizeof(acks[0])));
+        num_acks = 0;
+
+        CHECK(window[3].tag == ((uint64_t)4 << 1 | 1));
+        CHECK(!arq_sender_slot(&s, 1)->acked);
+
+        p->reclaim(&s);
+        CHECK(s.num_queued == 2 && send_pool.num_free == 2);
+        CHECK(arq_sender_slot(&s, 1)->acked);
+    }
+
+    send_line(p, &s, "e");
+    send_line(p, &s, "f");
+    CHECK(arq_sender_window_full(&s));
+
+    /* Everything gets there, and the acks still take effect only once reclaimed */
+    to_receiver(p, &r, 2);
+    to_receiver(p, &r, 3);
+    to_receiver(p, &r, 4);
+    to_receiver(p, &r, 5);
+    CHECK(strcmp(delivered, "abcdef") == 0);
+    for (i = 0; i < num_acks; i++)
+    {
+        CHECK(p->note_ack(&s, &acks[i], sizeof(acks[i])));
+    }
+    num_acks = 0;
+    CHECK(arq_sender_ack_frontier(&s) == 6 && s.num_queued == 4);
+
+    p->reclaim(&s);
+    CHECK(arq_sender_idle(&s));
+    for (i = 0; i < TEST_WINDOW; i++)
+    {
+        CHECK(window[i].tag == 0 && window[i].msg == NULL);
+    }
+
+    teardown(&s, &r);
+}
+
+/**
+ * The ack thread of test_ack_thread(): acks every message once it is sent. Under Selective Repeat,
+ * even messages are first acked on their own, and the odd one before gets a late selective ack,
+ * after the cumulative ack that lets its slot be reclaimed and reused
+ */
+static void *ack_thread(void *arg)
+{
+    struct ack_thread_ctx *ctx = arg;
+    struct ack ack;
+    uint32_t seq;
+
+    for (seq = 0; seq < TEST_THREAD_MSGS; seq++)
+    {
+        while (__atomic_load_n(&ctx->num_sent, __ATOMIC_ACQUIRE) <= seq)
+        {
+            sched_yield();
+        }
+
+        if (ctx->p->selective && seq % 2 == 0)
+        {
+            make_ack(&ack, ACK_FLAG_SELECTIVE | ACK_FLAG_OUT_OF_ORDER, seq - 1, seq);
+            CHECK(ctx->p->note_ack(ctx->s, &ack, sizeof(ack)));
+            __atomic_store_n(&ctx->sel_acked, seq + 1, __ATOMIC_RELEASE);
+
+            if (seq > 0)
+            {
+                make_ack(&ack, ACK_FLAG_SELECTIVE | ACK_FLAG_RETRANS, seq - 1, seq - 1);
+                CHECK(ctx->p->note_ack(ctx->s, &ack, sizeof(ack)));
+            }
+        }
+
+        make_ack(&ack, 0, seq, 0);
+        CHECK(ctx->p->note_ack(ctx->s, &ack, sizeof(ack)));
+    }
+
+    __atomic_store_n(&ctx->all_noted, true, __ATOMIC_RELEASE);
+
+    return NULL;
+}
+
+/**
+ * With the acks noted on a thread of their own while this one sends and reclaims, no message
+ * leaves the window before its ack, a selective ack never marks a slot that went on to hold a newer
+ * message, and every message is accounted for at the end
+ */
+static void test_ack_thread(const struct policy *p)
+{
+    struct arq_sender s;
+    struct arq_receiver r;
+    struct arq_sender_ops send_ops = { drop_msg, NULL, NULL };
+    struct ack_thread_ctx ctx;
+    pthread_t thread;
+    struct message *msg;
+    struct arq_slot *slot;
+    uint32_t frontier;
+    uint32_t frontier_after;
+    uint32_t sel_acked;
+    uint32_t i;
+    int errors = 0;
+
+    setup(p, &s, &r);
+    arq_sender_init(&s, &send_pool, window, TEST_WINDOW, TEST_TIMEOUT_USEC, &send_ops);
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.p = p;
+    ctx.s = &s;
+    CHECK(pthread_create(&thread, NULL, ack_thread, &ctx) == 0);
+
+    while (ctx.num_sent < TEST_THREAD_MSGS || !arq_sender_idle(&s))
+    {
+        /* The frontier reclaim() went by lies between the two reads */
+        frontier = arq_sender_ack_frontier(&s);
+        p->reclaim(&s);
+        frontier_after = arq_sender_ack_frontier(&s);
+        sel_acked = __atomic_load_n(&ctx.sel_acked, __ATOMIC_ACQUIRE);
+
+        errors += s.num_queued + send_pool.num_free != send_pool.capacity;
+        errors += s.num_queued > ctx.num_sent - frontier || s.num_queued < ctx.num_sent - frontier_after;
+        for (i = 0; i < s.num_queued; i++)
+        {
+            slot = arq_sender_slot(&s, i);
+
+            errors += msg_last_seq(slot->msg) < frontier;
+            errors += slot->acked && msg_last_seq(slot->msg) >= sel_acked;
+        }
+
+        if (ctx.num_sent < TEST_THREAD_MSGS && (msg = arq_sender_next_msg(&s)) != NULL)
+        {
+            msg_add_record(msg, "x", 1);
+            errors += !p->send(&s);
+            __atomic_store_n(&ctx.num_sent, ctx.num_sent + 1, __ATOMIC_RELEASE);
+        }
+        else
+        {
+            sched_yield();
+        }
+    }
+
+    CHECK(pthread_join(thread, NULL) == 0);
+    CHECK(errors == 0);
+    CHECK(__atomic_load_n(&ctx.all_noted, __ATOMIC_ACQUIRE));
+    CHECK(s.next_seq == TEST_THREAD_MSGS && arq_sender_ack_frontier(&s) == TEST_THREAD_MSGS);
+
+    teardown(&s, &r);
+}
+
+/*-----------------------------------------------------------------------------
+ * Main
+ * --------------------------------------------------------------------------*/
+
+int main(void)
+{
+    size_t i;
+
+    log_level = LOG_ERROR;
+
+    for (i = 0; i < sizeof(policies) / sizeof(policies[0]); i++)
+    {
+        test_in_order(&policies[i]);
+        test_window_full(&policies[i]);
+        test_reorder(&policies[i]);
+        test_loss(&policies[i]);
+        test_duplicate(&policies[i]);
+        test_damaged(&policies[i]);
+        test_fast_retransmit(&policies[i]);
+        test_pieces(&policies[i]);
+        test_streams(&policies[i]);
+        test_reclaim(&policies[i]);
+        test_ack_thread(&policies[i]);
+
+        if (policies[i].selective)
+        {
+            test_sr_timers(&policies[i]);
+            test_sr_selective_ack(&policies[i]);
+            test_sr_fill_any_order(&policies[i]);
+            test_sr_gap_fast_retransmit(&policies[i]);
+        }
+    }
+
+    return test_done("test_arq");
+}
@@ -0,0 +1,144 @@
+/**
+ * Unit tests for CRC32C: known answers, and the SSE4.2 and slicing-by-8
+ * versions agreeing on every length and alignment
+ *
+ * crc32c.c is built into the test itself, so both versions can be called
+ * directly whichever one the CPU would pick.
+ *
+ * CMPT 434 - A2
+ * Steven Rau
+ * scr108
+ * 11115094
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "test.h"
+#include "crc32c.c"
+
+/*-----------------------------------------------------------------------------
+ * File-scope constants & globals
+ * --------------------------------------------------------------------------*/
+
+/* Longest buffer compared between the two versions, and the bytes in it */
+#define TEST_MAX_LEN  300
+
+static unsigned char data[TEST_MAX_LEN + 8];
+
+/*-----------------------------------------------------------------------------
+ * Tests
+ * --------------------------------------------------------------------------*/
+
+/**
+ * The check value and the iSCSI test vectors (RFC 3720, appendix B.4)
+ */
+static void test_known_answers(void)
+{
+    unsigned char buf[32];
+    int i;
+
+    CHECK(crc32c(0, "123456789", 9) == 0xE3069283);
+    CHECK(crc32c(0, "", 0) == 0);
+
+    memset(buf, 0, sizeof(buf));
+    CHECK(crc32c(0, buf, sizeof(buf)) == 0x8A9136AA);
+
+    memset(buf, 0xFF, sizeof(buf));
+    CHECK(crc32c(0, buf, sizeof(buf)) == 0x62A8AB43);
+
+    for (i = 0; i < 32; i++)
+    {
+        buf[i] = i;
+    }
+    CHECK(crc32c(0, buf, sizeof(buf)) == 0x46DD794E);
+
+    for (i = 0; i < 32; i++)
+    {
+        buf[i] = 31 - i;
+    }
+    CHECK(crc32c(0, buf, sizeof(buf)) == 0x113FDB5C);
+}
+
+/**
+ * A checksum continued over the rest of the data matches one taken over all of it at once
+ */
+static void test_continue(void)
+{
+    size_t split;
+    uint32_t whole = crc32c(0, data, TEST_MAX_LEN);
+
+    for (split = 0; split <= TEST_MAX_LEN; split += 7)
+    {
+        CHECK(crc32c(crc32c(0, data, split), data + split, TEST_MAX_LEN - split) == whole);
+    }
+}
+
+/**
+ * The slicing-by-8 version against a bit at a time reference, and the SSE4.2 version (if the CPU
+ * has it) against both, from every starting alignment
+ */
+static void test_versions_agree(void)
+{
+    size_t len;
+    size_t offset;
+    size_t i;
+    uint32_t ref;
+    int bit;
+    int mismatches = 0;
+
+    for (offset = 0; offset < 8; offset++)
+    {
+        for (len = 0; len <= TEST_MAX_LEN; len++)
+        {
+            ref = ~0u;
+            for (i = 0; i < len; i++)
+            {
+                ref ^= data[offset + i];
+                for (bit = 0; bit < 8; bit++)
+                {
+                    ref = (ref & 1) ? (ref >> 1) ^ CRC32C_POLY : ref >> 1;
+                }
+            }
+
+            mismatches += crc32c_sw(~0u, data + offset, len) != ref;
+#ifdef CRC32C_HAVE_SSE42_PATH
+            if (__builtin_cpu_supports("sse4.2"))
+            {
+                mismatches += crc32c_hw(~0u, data + offset, len) != ref;
+            }
+#endif
+        }
+    }
+
+    CHECK(mismatches == 0);
+
+#ifdef CRC32C_HAVE_SSE42_PATH
+    if (!__builtin_cpu_supports("sse4.2"))
+    {
+        printf("test_crc32c: no SSE4.2 on this CPU, only the slicing-by-8 version was checked\n");
+    }
+#endif
+}
+
+/*-----------------------------------------------------------------------------
+ * Main
+ * --------------------------------------------------------------------------*/
+
+int main(void)
+{
+    size_t i;
+
+    for (i = 0; i < sizeof(data); i++)
+    {
+        data[i] = (unsigned char)(i * 131 + 17);
+    }
+
+    test_known_answers();
+
+    /* The tables are built by the first crc32c() call, above */
+    test_continue();
+    test_versions_agree();
+
+    return test_done("test_crc32c");
+}
@@ -0,0 +1,387 @@
+/**
+ * Unit tests for forward error correction: GF(256) arithmetic, and groups
+ * coded with Reed-Solomon and XOR being rebuilt after losses
+ *
+ * fec.c is built into the test itself, so the plain and SSSE3 versions of
+ * the multiply can both be checked whichever one the CPU would pick.
+ *
+ * CMPT 434 - A2
+ * Steven Rau
+ * scr108
+ * 11115094
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "test.h"
+#include "fec.c"
+
+/*-----------------------------------------------------------------------------
+ * File-scope constants & globals
+ * --------------------------------------------------------------------------*/
+
+/* Messages in the test groups */
+#define TEST_K  8
+
+/*-----------------------------------------------------------------------------
+ * Helper functions
+ * --------------------------------------------------------------------------*/
+
+/**
+ * Multiplies over GF(256) a bit at a time, as a reference for the tables
+ */
+static uint8_t slow_mul(uint8_t a, uint8_t b)
+{
+    int x = a;
+    int product = 0;
+
+    while (b != 0)
+    {
+        if (b & 1)
+        {
+            product ^= x;
+        }
+
+        x <<= 1;
+        if (x & 0x100)
+        {
+            x ^= GF_POLY;
+        }
+        b >>= 1;
+    }
+
+    return (uint8_t)product;
+}
+
+/**
+ * Builds a group of sealed messages, message i holding i % 3 + 1 records of different lengths
+ */
+static void build_group(struct message msgs[TEST_K], uint32_t first_seq)
+{
+    char line[64];
+    uint32_t seq = first_seq;
+    int i;
+    int j;
+
+    for (i = 0; i < TEST_K; i++)
+    {
+        msg_init(&msgs[i], seq);
+
+        for (j = 0; j <= i % 3; j++)
+        {
+            snprintf(line, sizeof(line), "message %d record %d%.*s", i, j, i * 4, "................................");
+            msg_add_record(&msgs[i], line, strlen(line));
+            seq++;
+        }
+
+        msg_seal(&msgs[i], 1000, i);
+    }
+}
+
+/**
+ * Codes a group, hands the decoder the messages not in lost[] and then the parity, and checks
+ * which messages come back
+ *
+ * @param[in] mode          Code to use
+ * @param[in] max_r         Most parity datagrams per group
+ * @param[in] lost          Indexes of the messages lost, terminated by -1
+ * @param[in] num_parity    Parity datagrams the decoder is given
+ * @param[in] rebuildable   Whether that is enough to rebuild the lost messages
+ */
+static void lose_and_rebuild(enum fec_mode mode, int max_r, const int *lost, int num_parity, bool rebuildable)
+{
+    struct message msgs[TEST_K];
+    struct message got;
+    struct message check;
+    struct fec_encoder e;
+    struct fec_decoder d;
+    struct fec_header wire;
+    bool dropped[TEST_K] = { false };
+    int num_lost = 0;
+    int num_got = 0;
+    int i;
+
+    build_group(msgs, 100);
+
+    /* Heavy loss makes Reed-Solomon send all the parity it may. XOR would shrink its groups instead */
+    fec_encoder_init(&e, mode, TEST_K, max_r);
+    fec_encoder_set_loss(&e, mode == FEC_RS ? 255 : 0);
+    fec_decoder_init(&d);
+
+    for (i = 0; i < TEST_K; i++)
+    {
+        CHECK(fec_encoder_add(&e, &msgs[i]) == (i == TEST_K - 1));
+    }
+    CHECK(e.num_parity == max_r);
+
+    /* The header goes out in network byte order */
+    memcpy(&wire, e.parity[0].text, sizeof(wire));
+    CHECK(ntohl(wire.first_seq) == 100);
+    CHECK(wire.k == TEST_K && wire.r == max_r && wire.mode == mode);
+    CHECK(ntohs(wire.counts[1]) == 2);
+
+    for (i = 0; lost[i] != -1; i++)
+    {
+        dropped[lost[i]] = true;
+        num_lost++;
+    }
+
+    for (i = 0; i < TEST_K; i++)
+    {
+        if (!dropped[i])
+        {
+            fec_decoder_add_msg(&d, &msgs[i], msg_wire_len(&msgs[i]));
+        }
+    }
+
+    for (i = 0; i < num_parity; i++)
+    {
+        msg_seal(&e.parity[i], 2000, i);
+        fec_decoder_add_parity(&d, &e.parity[i], msg_wire_len(&e.parity[i]));
+    }
+
+    while (fec_decoder_next_recovered(&d, &got))
+    {
+        num_got++;
+
+        /* Rebuilt whole, down to its checksum */
+        check = got;
+        CHECK(msg_intact(&check, msg_wire_len(&got)));
+
+        for (i = 0; i < TEST_K; i++)
+        {
+            if (msg_seq(&msgs[i]) == msg_seq(&got))
+            {
+                CHECK(dropped[i]);
+                CHECK(msg_count(&got) == msg_count(&msgs[i]));
+                CHECK(msg_text_len(&got) == msg_text_len(&msgs[i]));
+                CHECK(memcmp(got.text, msgs[i].text, msg_text_len(&got)) == 0);
+            }
+        }
+    }
+
+    CHECK(num_got == (rebuildable ? num_lost : 0));
+
+    fec_decoder_destroy(&d);
+}
+
+/*-----------------------------------------------------------------------------
+ * Tests
+ * --------------------------------------------------------------------------*/
+
+/**
+ * The log and exp tables against a bit at a time multiply, for every pair
+ */
+static void test_gf_mul(void)
+{
+    int a;
+    int b;
+    int mismatches = 0;
+
+    CHECK(gf_mul(2, 0x80) == 0x1d);
+    CHECK(gf_mul(3, 7) == 9);
+    CHECK(gf_mul(0x53, 0xca) == 0x8f);
+    CHECK(gf_mul(0xff, 0xff) == 0xe2);
+    CHECK(gf_mul(2, 0x8e) == 1);
+
+    for (a = 0; a < 256; a++)
+    {
+        for (b = 0; b < 256; b++)
+        {
+            mismatches += gf_mul(a, b) != slow_mul(a, b);
+        }
+
+        if (a != 0)
+        {
+            mismatches += gf_mul(a, gf_inv(a)) != 1;
+        }
+    }
+
+    CHECK(mismatches == 0);
+}
+
+/**
+ * dst ^= c * src from both versions (the SSSE3 one if the CPU has it), over lengths that do and
+ * don't fill whole 16 byte registers
+ */
+static void test_gf_mul_add(void)
+{
+    uint8_t src[100];
+    uint8_t dst[100];
+    uint8_t ref[100];
+    size_t len;
+    size_t i;
+    int c;
+    int mismatches = 0;
+
+    for (i = 0; i < sizeof(src); i++)
+    {
+        src[i] = (uint8_t)(i * 73 + 5);
+    }
+
+    for (c = 0; c < 256; c += 7)
+    {
+        for (len = 0; len <= sizeof(src); len += 11)
+        {
+            for (i = 0; i < len; i++)
+            {
+                ref[i] = (uint8_t)i ^ slow_mul(c, src[i]);
+            }
+
+            for (i = 0; i < len; i++)
+            {
+                dst[i] = (uint8_t)i;
+            }
+            gf_mul_add_scalar(dst, src, c, len);
+            mismatches += memcmp(dst, ref, len) != 0;
+
+#ifdef FEC_HAVE_SSSE3
+            if (__builtin_cpu_supports("ssse3"))
+            {
+                for (i = 0; i < len; i++)
+                {
+                    dst[i] = (uint8_t)i;
+                }
+                gf_mul_add_ssse3(dst, src, c, len);
+                mismatches += memcmp(dst, ref, len) != 0;
+            }
+#endif
+
+            for (i = 0; i < len; i++)
+            {
+                dst[i] = (uint8_t)i;
+            }
+            gf_mul_add(dst, src, c, len);
+            mismatches += memcmp(dst, ref, len) != 0;
+        }
+    }
+
+    CHECK(mismatches == 0);
+}
+
+/**
+ * The Cauchy matrix the code uses has an inverse for every choice of rows and columns, so any r
+ * losses can be rebuilt
+ */
+static void test_gf_invert(void)
+{
+    uint8_t a[FEC_MAX_R][FEC_MAX_R];
+    uint8_t inv[FEC_MAX_R][FEC_MAX_R];
+    uint8_t copy[FEC_MAX_R][FEC_MAX_R];
+    uint8_t sum;
+    int m = FEC_MAX_R;
+    int i;
+    int j;
+    int n;
+
+    for (i = 0; i < m; i++)
+    {
+        for (j = 0; j < m; j++)
+        {
+            a[i][j] = fec_coef(FEC_RS, i, FEC_MAX_K - 1 - 3 * j);
+        }
+    }
+    memcpy(copy, a, sizeof(a));
+
+    CHECK(gf_invert(a, inv, m));
+
+    for (i = 0; i < m; i++)
+    {
+        for (j = 0; j < m; j++)
+        {
+            sum = 0;
+            for (n = 0; n < m; n++)
+            {
+                sum ^= gf_mul(copy[i][n], inv[n][j]);
+            }
+            CHECK(sum == (i == j));
+        }
+    }
+}
+
+/**
+ * Groups losing some of their messages
+ */
+static void test_rebuild(void)
+{
+    const int none[] = { -1 };
+    const int one[] = { 5, -1 };
+    const int first_and_last[] = { 0, TEST_K - 1, -1 };
+    const int four[] = { 1, 3, 4, 6, -1 };
+    const int five[] = { 0, 1, 2, 3, 4, -1 };
+
+    /* Reed-Solomon rebuilds as many losses as there is parity, wherever they fall */
+    lose_and_rebuild(FEC_RS, 4, none, 4, true);
+    lose_and_rebuild(FEC_RS, 1, one, 1, true);
+    lose_and_rebuild(FEC_RS, 4, first_and_last, 2, true);
+    lose_and_rebuild(FEC_RS, 4, four, 4, true);
+    lose_and_rebuild(FEC_RS, FEC_MAX_R, five, 5, true);
+    lose_and_rebuild(FEC_RS, 4, five, 4, false);
+    lose_and_rebuild(FEC_RS, 4, four, 3, false);
+
+    /* XOR rebuilds one */
+    lose_and_rebuild(FEC_XOR, 1, one, 1, true);
+    lose_and_rebuild(FEC_XOR, 1, first_and_last, 1, false);
+}
+
+/**
+ * Damaged or malformed parity is dropped without rebuilding anything
+ */
+static void test_bad_parity(void)
+{
+    struct message msgs[TEST_K];
+    struct message got;
+    struct fec_encoder e;
+    struct fec_decoder d;
+    struct fec_header wire;
+    int i;
+
+    build_group(msgs, 0);
+
+    fec_encoder_init(&e, FEC_XOR, TEST_K, 1);
+    fec_decoder_init(&d);
+
+    for (i = 0; i < TEST_K; i++)
+    {
+        fec_encoder_add(&e, &msgs[i]);
+    }
+    for (i = 1; i < TEST_K; i++)
+    {
+        fec_decoder_add_msg(&d, &msgs[i], msg_wire_len(&msgs[i]));
+    }
+
+    /* A flipped bit */
+    msg_seal(&e.parity[0], 0, 0);
+    e.parity[0].text[sizeof(wire)] ^= 1;
+    fec_decoder_add_parity(&d, &e.parity[0], msg_wire_len(&e.parity[0]));
+    CHECK(!fec_decoder_next_recovered(&d, &got));
+    e.parity[0].text[sizeof(wire)] ^= 1;
+
+    /* A header claiming a longer block than it carries */
+    memcpy(&wire, e.parity[0].text, sizeof(wire));
+    wire.block_len = htons(ntohs(wire.block_len) + 1);
+    memcpy(e.parity[0].text, &wire, sizeof(wire));
+    msg_seal(&e.parity[0], 0, 0);
+    fec_decoder_add_parity(&d, &e.parity[0], msg_wire_len(&e.parity[0]));
+    CHECK(!fec_decoder_next_recovered(&d, &got));
+
+    fec_decoder_destroy(&d);
+}
+
+/*-----------------------------------------------------------------------------
+ * Main
+ * --------------------------------------------------------------------------*/
+
+int main(void)
+{
+    log_level = LOG_ERROR;
+
+    test_gf_mul();
+    test_gf_mul_add();
+    test_gf_invert();
+    test_rebuild();
+    test_bad_parity();
+
+    return test_done("test_fec");
+}
@@ -0,0 +1,229 @@
+/**
+ * Unit tests for the journal: progress read back after a restart, the
+ * newest intact copy winning over a torn write, and journals for another
+ * end or stream count being refused
+ *
+ * CMPT 434 - A2
+ * Steven Rau
+ * scr108
+ * 11115094
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "test.h"
+#include "journal.h"
+
+/*-----------------------------------------------------------------------------
+ * File-scope constants & globals
+ * --------------------------------------------------------------------------*/
+
+static char path[] = "/tmp/test_journal.XXXXXX";
+
+/*-----------------------------------------------------------------------------
+ * Helper functions
+ * --------------------------------------------------------------------------*/
+
+/**
+ * Flips a byte of one copy of the record on disk, as a write torn by a crash would leave it
+ */
+static void damage_copy(int i)
+{
+    FILE *f = fopen(path, "r+b");
+    long offset = i * (long)sizeof(struct journal_record) + offsetof(struct journal_record, next);
+    int c;
+
+    CHECK(f != NULL);
+    if (f == NULL)
+    {
+        return;
+    }
+
+    fseek(f, offset, SEEK_SET);
+    c = fgetc(f);
+    fseek(f, offset, SEEK_SET);
+    fputc(c ^ 0x5a, f);
+    fclose(f);
+}
+
+/**
+ * Sends stderr to /dev/null while a journal is refused on purpose, so a passing run stays quiet
+ *
+ * @param[in] saved  The stderr to put back, or -1 to silence it
+ *
+ * Returns a copy of the stderr that was silenced (to pass back in), or -1 once it is put back
+ */
+static int quiet_stderr(int saved)
+{
+    int null_fd;
+
+    fflush(stderr);
+
+    if (saved != -1)
+    {
+        dup2(saved, STDERR_FILENO);
+        close(saved);
+
+        return -1;
+    }
+
+    saved = dup(STDERR_FILENO);
+    null_fd = open("/dev/null", O_WRONLY);
+    if (null_fd != -1)
+    {
+        dup2(null_fd, STDERR_FILENO);
+        close(null_fd);
+    }
+
+    return saved;
+}
+
+/*-----------------------------------------------------------------------------
+ * Tests
+ * --------------------------------------------------------------------------*/
+
+/**
+ * A new journal starts every stream at 0, and what is recorded is read back on the next open
+ */
+static void test_resume(void)
+{
+    struct journal j;
+    int i;
+
+    CHECK(journal_open(&j, path, JOURNAL_SENDER, 3));
+    CHECK(j.fd != -1);
+    for (i = 0; i < MAX_STREAMS; i++)
+    {
+        CHECK(j.rec.next[i] == 0 && j.rec.sent[i] == 0);
+    }
+
+    journal_record(&j, 0, 10, 14);
+    journal_record(&j, 2, 7, 9);
+    journal_record(&j, 0, 12, 20);
+    CHECK(j.rec.generation == 3);
+
+    /* Nothing moved, so nothing is written */
+    journal_record(&j, 0, 12, 20);
+    CHECK(j.rec.generation == 3);
+    journal_close(&j);
+    CHECK(j.fd == -1);
+
+    CHECK(journal_open(&j, path, JOURNAL_SENDER, 3));
+    CHECK(j.rec.generation == 3);
+    CHECK(j.rec.next[0] == 12 && j.rec.sent[0] == 20);
+    CHECK(j.rec.next[1] == 0 && j.rec.sent[1] == 0);
+    CHECK(j.rec.next[2] == 7 && j.rec.sent[2] == 9);
+
+    /* Carries on from the generation it read */
+    journal_record(&j, 1, 5, 5);
+    CHECK(j.rec.generation == 4);
+    journal_close(&j);
+
+    /* A journal that isn't being kept ignores progress */
+    journal_record(&j, 1, 6, 6);
+    CHECK(j.rec.generation == 4);
+}
+
+/**
+ * The copy written last is damaged: the one before it is read back. Both damaged: it starts over
+ */
+static void test_torn_write(void)
+{
+    struct journal j;
+
+    CHECK(journal_open(&j, path, JOURNAL_SENDER, 3));
+    journal_record(&j, 0, 30, 31);
+    CHECK(j.rec.generation == 5);
+    journal_record(&j, 0, 40, 41);
+    CHECK(j.rec.generation == 6);
+    journal_close(&j);
+
+    /* Generation 6 went to copy 0, generation 5 to copy 1 */
+    damage_copy(0);
+    CHECK(journal_open(&j, path, JOURNAL_SENDER, 3));
+    CHECK(j.rec.generation == 5);
+    CHECK(j.rec.next[0] == 30 && j.rec.sent[0] == 31);
+
+    /* The next write replaces the damaged copy, and wins */
+    journal_record(&j, 0, 50, 51);
+    CHECK(j.rec.generation == 6);
+    journal_close(&j);
+    CHECK(journal_open(&j, path, JOURNAL_SENDER, 3));
+    CHECK(j.rec.next[0] == 50);
+    journal_close(&j);
+
+    damage_copy(0);
+    damage_copy(1);
+    CHECK(journal_open(&j, path, JOURNAL_SENDER, 3));
+    CHECK(j.rec.generation == 0 && j.rec.next[0] == 0 && j.rec.next[2] == 0);
+    journal_close(&j);
+}
+
+/**
+ * A journal from the other end, or from a run with a different number of streams, is refused
+ * (journal_open() prints why, which is kept out of the test's output)
+ */
+static void test_refused(void)
+{
+    struct journal j;
+    bool other_end;
+    bool other_streams;
+    int saved;
+
+    CHECK(journal_open(&j, path, JOURNAL_RECEIVER, 2));
+    journal_record(&j, 1, 3, 0);
+    journal_close(&j);
+
+    /* Checked once stderr is back, so a failure still shows */
+    saved = quiet_stderr(-1);
+    other_end = !journal_open(&j, path, JOURNAL_SENDER, 2) && j.fd == -1;
+    other_streams = !journal_open(&j, path, JOURNAL_RECEIVER, 1) && j.fd == -1;
+    quiet_stderr(saved);
+
+    CHECK(other_end);
+    CHECK(other_streams);
+
+    CHECK(journal_open(&j, path, JOURNAL_RECEIVER, 2));
+    CHECK(j.rec.next[1] == 3);
+    journal_close(&j);
+}
+
+/*-----------------------------------------------------------------------------
+ * Main
+ * --------------------------------------------------------------------------*/
+
+int main(void)
+{
+    int fd = mkstemp(path);
+
+    if (fd == -1)
+    {
+        perror("mkstemp");
+
+        return 1;
+    }
+    close(fd);
+
+    test_resume();
+    test_torn_write();
+    unlink(path);
+
+    if ((fd = mkstemp(strcpy(path, "/tmp/test_journal.XXXXXX"))) == -1)
+    {
+        perror("mkstemp");
+
+        return 1;
+    }
+    close(fd);
+
+    test_refused();
+    unlink(path);
+
+    return test_done("test_journal");
+}
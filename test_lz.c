@@ -0,0 +1,216 @@
+/**
+ * Unit tests for the LZ codec and the compression stage built on it:
+ * known answers, round trips, and malformed blocks being refused
+ *
+ * CMPT 434 - A2
+ * Steven Rau
+ * scr108
+ * 11115094
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "test.h"
+#include "lz.h"
+#include "message.h"
+
+/*-----------------------------------------------------------------------------
+ * File-scope constants & globals
+ * --------------------------------------------------------------------------*/
+
+/* Room for the worst case: a block that doesn't compress at all, plus its length bytes */
+#define TEST_CAP  (LZ_MAX_BLOCK + LZ_MAX_BLOCK / 255 + 16)
+
+static uint8_t src[LZ_MAX_BLOCK];
+static uint8_t packed[TEST_CAP];
+static uint8_t unpacked[TEST_CAP];
+static uint16_t table[LZ_HASH_SIZE];
+
+/*-----------------------------------------------------------------------------
+ * Helper functions
+ * --------------------------------------------------------------------------*/
+
+/**
+ * Compresses a block and expands it again
+ *
+ * Returns the compressed size, or 0 (after a failed check) if it didn't come back the same
+ */
+static int round_trip(const uint8_t *data, int len)
+{
+    int packed_len = lz_compress(data, len, packed, sizeof(packed), table);
+
+    CHECK(packed_len > 0);
+    CHECK(lz_decompress(packed, packed_len, unpacked, sizeof(unpacked)) == len);
+    CHECK(memcmp(unpacked, data, len) == 0);
+
+    return packed_len;
+}
+
+/*-----------------------------------------------------------------------------
+ * Tests
+ * --------------------------------------------------------------------------*/
+
+/**
+ * Blocks worked out by hand from the format in lz.h
+ */
+static void test_known_answers(void)
+{
+    const uint8_t run[] = { 0x15, 'a', 0x01, 0x00, 0x00 };
+    uint8_t literals[2 + 20];
+    int i;
+
+    /* A run: one literal, then a match 9 long overlapping itself at offset 1 */
+    CHECK(lz_compress((const uint8_t *)"aaaaaaaaaa", 10, packed, sizeof(packed), table) == sizeof(run));
+    CHECK(memcmp(packed, run, sizeof(run)) == 0);
+    CHECK(lz_decompress(run, sizeof(run), unpacked, sizeof(unpacked)) == 10);
+    CHECK(memcmp(unpacked, "aaaaaaaaaa", 10) == 0);
+
+    /* Too short to hold a match: literals only */
+    CHECK(lz_compress((const uint8_t *)"abc", 3, packed, sizeof(packed), table) == 4);
+    CHECK(packed[0] == 0x30 && memcmp(&packed[1], "abc", 3) == 0);
+
+    /* 20 literals: 15 in the token, 5 more in a length byte */
+    literals[0] = 0xF0;
+    literals[1] = 5;
+    for (i = 0; i < 20; i++)
+    {
+        literals[2 + i] = 'A' + i;
+    }
+    CHECK(lz_decompress(literals, sizeof(literals), unpacked, sizeof(unpacked)) == 20);
+    CHECK(memcmp(unpacked, &literals[2], 20) == 0);
+
+    /* Nothing at all */
+    CHECK(lz_compress(src, 0, packed, sizeof(packed), table) == 1);
+    CHECK(lz_decompress(packed, 1, unpacked, sizeof(unpacked)) == 0);
+}
+
+/**
+ * Text, long runs (with lengths past the token nibble) and noise all come back the same, and only
+ * the noise doesn't shrink
+ */
+static void test_round_trips(void)
+{
+    const char *line = "The quick brown fox jumps over the lazy dog. ";
+    uint32_t x = 2463534242u;
+    int len;
+    int i;
+
+    for (i = 0; i < LZ_MAX_BLOCK; i++)
+    {
+        src[i] = line[i % strlen(line)];
+    }
+    for (len = 1; len < 600; len += 37)
+    {
+        round_trip(src, len);
+    }
+    CHECK(round_trip(src, LZ_MAX_BLOCK) < LZ_MAX_BLOCK / 20);
+
+    memset(src, 'z', LZ_MAX_BLOCK);
+    CHECK(round_trip(src, LZ_MAX_BLOCK) < 300);
+    CHECK(round_trip(src, 300) < 10);
+
+    /* xorshift noise doesn't compress, so every byte goes out as a literal */
+    for (i = 0; i < LZ_MAX_BLOCK; i++)
+    {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        src[i] = (uint8_t)x;
+    }
+    CHECK(round_trip(src, LZ_MAX_BLOCK) > LZ_MAX_BLOCK);
+    round_trip(src, 1000);
+
+    /* Noise followed by a copy of itself: only the first half goes out as literals */
+    memcpy(&src[1000], &src[0], 1000);
+    CHECK(round_trip(src, 2000) < 1100);
+
+    CHECK(lz_compress(src, LZ_MAX_BLOCK + 1, packed, sizeof(packed), table) == 0);
+}
+
+/**
+ * Blocks that would read or write out of bounds are refused
+ */
+static void test_malformed(void)
+{
+    const uint8_t zero_offset[] = { 0x10, 'a', 0x00, 0x00, 0x00 };
+    const uint8_t far_offset[] = { 0x10, 'a', 0x02, 0x00, 0x00 };
+    const uint8_t short_offset[] = { 0x10, 'a', 0x01 };
+    const uint8_t short_literals[] = { 0x50, 'a', 'b' };
+    const uint8_t short_length[] = { 0xF0, 255 };
+    const uint8_t run[] = { 0x1F, 'a', 0x01, 0x00, 200, 0x00 };
+
+    CHECK(lz_decompress(zero_offset, sizeof(zero_offset), unpacked, sizeof(unpacked)) == -1);
+    CHECK(lz_decompress(far_offset, sizeof(far_offset), unpacked, sizeof(unpacked)) == -1);
+    CHECK(lz_decompress(short_offset, sizeof(short_offset), unpacked, sizeof(unpacked)) == -1);
+    CHECK(lz_decompress(short_literals, sizeof(short_literals), unpacked, sizeof(unpacked)) == -1);
+    CHECK(lz_decompress(short_length, sizeof(short_length), unpacked, sizeof(unpacked)) == -1);
+
+    /* 1 + 4 + 15 + 200 bytes out, into a buffer a byte too small */
+    CHECK(lz_decompress(run, sizeof(run), unpacked, 220) == 220);
+    CHECK(lz_decompress(run, sizeof(run), unpacked, 219) == -1);
+
+    /* The compressor gives up rather than overflowing its output */
+    memset(src, 'q', 1000);
+    CHECK(lz_compress(src, 1000, packed, 3, table) == 0);
+}
+
+/**
+ * A message's text compressed by the stage comes back with the same records
+ */
+static void test_message(void)
+{
+    struct compress_stage stage;
+    struct message msg;
+    struct message copy;
+    const char *line = "a line of text that repeats, a line of text that repeats";
+    const char *got;
+    size_t got_len;
+    size_t offset = 0;
+    int count = 0;
+
+    /* A budget no machine runs out of, so timing never turns the stage off */
+    compress_init(&stage, 1e9);
+
+    msg_init(&msg, 7);
+    while (msg_add_record(&msg, line, strlen(line)))
+    {
+    }
+    copy = msg;
+
+    CHECK(msg_compress(&msg, &stage));
+    CHECK(msg.flags & MSG_FLAG_COMPRESSED);
+    CHECK(msg_text_len(&msg) < msg_text_len(&copy) / 4);
+    CHECK(ntohs(msg.raw_len) == msg_text_len(&copy));
+
+    CHECK(msg_decompress(&msg));
+    CHECK(!(msg.flags & MSG_FLAG_COMPRESSED));
+    CHECK(msg_text_len(&msg) == msg_text_len(&copy));
+    CHECK(memcmp(msg.text, copy.text, msg_text_len(&copy)) == 0);
+
+    while (msg_next_record(&msg, &offset, &got, &got_len))
+    {
+        CHECK(got_len == strlen(line) && memcmp(got, line, got_len) == 0);
+        count++;
+    }
+    CHECK(count == msg_count(&copy));
+
+    /* Text that doesn't expand to the length it was sent with is refused */
+    CHECK(msg_compress(&msg, &stage));
+    msg.raw_len = htons(ntohs(msg.raw_len) + 1);
+    CHECK(!msg_decompress(&msg));
+}
+
+/*-----------------------------------------------------------------------------
+ * Main
+ * --------------------------------------------------------------------------*/
+
+int main(void)
+{
+    test_known_answers();
+    test_round_trips();
+    test_malformed();
+    test_message();
+
+    return test_done("test_lz");
+}
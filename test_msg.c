@@ -0,0 +1,299 @@
+/**
+ * Unit tests for building and reading messages: how records are packed,
+ * the range of sequence numbers a message covers, and where a message
+ * (or a line of input) gets cut off
+ *
+ * CMPT 434 - A2
+ * Steven Rau
+ * scr108
+ * 11115094
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include "test.h"
+#include "message.h"
+#include "input.h"
+#include "log.h"
+
+/*-----------------------------------------------------------------------------
+ * File-scope constants & globals
+ * --------------------------------------------------------------------------*/
+
+static char line[MAX_TEXT_LENGTH];
+
+/*-----------------------------------------------------------------------------
+ * Helper functions
+ * --------------------------------------------------------------------------*/
+
+/**
+ * Fills the line buffer with len copies of a character
+ */
+static void make_line(char c, size_t len)
+{
+    memset(line, c, len);
+}
+
+/**
+ * Counts the records a message reads back as, checking they add up to its length
+ */
+static int count_records(const struct message *msg)
+{
+    const char *rec;
+    size_t rec_len;
+    size_t offset = 0;
+    int n = 0;
+
+    while (msg_next_record(msg, &offset, &rec, &rec_len))
+    {
+        n++;
+    }
+
+    CHECK(offset == msg_text_len(msg));
+
+    return n;
+}
+
+/*-----------------------------------------------------------------------------
+ * Tests
+ * --------------------------------------------------------------------------*/
+
+/**
+ * Records go back to back, each behind its length (network byte order), and read back the same
+ */
+static void test_packing(void)
+{
+    const uint8_t expect[] = { 0, 3, 'a', 'b', '\n', 0, 0, 0, 1, 'z' };
+    struct message msg;
+    const char *rec;
+    size_t rec_len;
+    size_t offset = 0;
+
+    msg_init(&msg, 0x01020304);
+    CHECK(msg_count(&msg) == 0 && msg_text_len(&msg) == 0);
+    CHECK(msg_wire_len(&msg) == MSG_HEADER_SIZE);
+
+    CHECK(msg_add_record(&msg, "ab\n", 3));
+    CHECK(msg_add_record(&msg, "", 0));
+    CHECK(msg_add_record(&msg, "z", 1));
+
+    CHECK(msg_count(&msg) == 3);
+    CHECK(msg_text_len(&msg) == sizeof(expect));
+    CHECK(msg_wire_len(&msg) == MSG_HEADER_SIZE + sizeof(expect));
+    CHECK(memcmp(msg.text, expect, sizeof(expect)) == 0);
+
+    /* The header is in network byte order too */
+    CHECK(memcmp(&msg.seq, "\x01\x02\x03\x04", 4) == 0);
+    CHECK(ntohs(msg.count) == 3 && ntohs(msg.len) == sizeof(expect));
+
+    CHECK(msg_next_record(&msg, &offset, &rec, &rec_len) && rec_len == 3);
+    CHECK(memcmp(rec, "ab\n", 3) == 0);
+    CHECK(msg_next_record(&msg, &offset, &rec, &rec_len) && rec_len == 0);
+    CHECK(msg_next_record(&msg, &offset, &rec, &rec_len) && rec_len == 1 && rec[0] == 'z');
+    CHECK(!msg_next_record(&msg, &offset, &rec, &rec_len));
+
+    /* A record claiming to run past the end is not read */
+    msg.text[8] = 9;
+    offset = 0;
+    CHECK(msg_next_record(&msg, &offset, &rec, &rec_len));
+    CHECK(msg_next_record(&msg, &offset, &rec, &rec_len));
+    CHECK(!msg_next_record(&msg, &offset, &rec, &rec_len));
+}
+
+/**
+ * A message covers one sequence number per record, starting at its own
+ */
+static void test_seq_range(void)
+{
+    struct message msg;
+
+    msg_init(&msg, 7);
+    CHECK(msg_add_record(&msg, "a", 1));
+    CHECK(msg_seq(&msg) == 7 && msg_last_seq(&msg) == 7);
+
+    CHECK(msg_add_record(&msg, "b", 1));
+    CHECK(msg_add_record(&msg, "c", 1));
+    CHECK(msg_seq(&msg) == 7 && msg_last_seq(&msg) == 9);
+
+    /* Sequence numbers are 32 bits, all the way up */
+    msg_init(&msg, 0xfffffffe);
+    CHECK(msg_add_record(&msg, "a", 1));
+    CHECK(msg_add_record(&msg, "b", 1));
+    CHECK(msg_last_seq(&msg) == 0xffffffff);
+}
+
+/**
+ * A message takes lines until the next one (with its length) would go past what a
+ * DEFAULT_DATAGRAM_SIZE datagram carries, and a line that doesn't fit leaves it untouched
+ */
+static void test_payload_limit(void)
+{
+    struct message msg;
+    struct message before;
+    size_t limit = DEFAULT_DATAGRAM_SIZE - MSG_HEADER_SIZE;
+    size_t per_line = MSG_RECORD_OVERHEAD + MAX_TEXT_LENGTH;
+    size_t full = limit / per_line;
+    size_t left = limit - full * per_line;
+    size_t i;
+
+    msg_init(&msg, 1);
+    make_line('x', MAX_TEXT_LENGTH);
+
+    for (i = 0; i < full; i++)
+    {
+        CHECK(msg_add_record(&msg, line, MAX_TEXT_LENGTH));
+    }
+    CHECK(!msg_has_room(&msg, MAX_TEXT_LENGTH));
+
+    /* The rest of the room takes exactly one more line of the right length */
+    CHECK(left > MSG_RECORD_OVERHEAD);
+    CHECK(msg_has_room(&msg, left - MSG_RECORD_OVERHEAD));
+    CHECK(!msg_has_room(&msg, left - MSG_RECORD_OVERHEAD + 1));
+
+    memcpy(&before, &msg, sizeof(msg));
+    CHECK(!msg_add_record(&msg, line, left - MSG_RECORD_OVERHEAD + 1));
+    CHECK(memcmp(&before, &msg, sizeof(msg)) == 0);
+
+    CHECK(msg_add_record(&msg, line, left - MSG_RECORD_OVERHEAD));
+    CHECK(msg_text_len(&msg) == limit);
+    CHECK(msg_wire_len(&msg) == DEFAULT_DATAGRAM_SIZE);
+    CHECK(!msg_has_room(&msg, 0));
+
+    CHECK(msg_count(&msg) == full + 1);
+    CHECK(count_records(&msg) == full + 1);
+}
+
+/**
+ * Once the datagram size changes (e.g. to the segment agreed in the session, or a path MTU found),
+ * the lines are split over messages that fit the new size, and sizes out of range are clamped
+ */
+static void test_max_datagram(void)
+{
+    struct message msg;
+    size_t per_line = MSG_RECORD_OVERHEAD + 50;
+    size_t lines = 0;
+
+    make_line('m', 50);
+
+    /* Filled up to the old size first */
+    msg_init(&msg, 1);
+    while (msg_add_record(&msg, line, 50))
+    {
+        lines++;
+    }
+    CHECK(lines == (DEFAULT_DATAGRAM_SIZE - MSG_HEADER_SIZE) / per_line);
+
+    /* A message already past the new size takes nothing more, and the same lines now take more,
+     * smaller messages, none bigger than the new size */
+    msg_set_max_datagram(300);
+    CHECK(msg_payload_limit == 300 - MSG_HEADER_SIZE);
+    CHECK(!msg_has_room(&msg, 0));
+
+    msg_init(&msg, 1);
+    lines = 0;
+    while (msg_add_record(&msg, line, 50))
+    {
+        lines++;
+    }
+    CHECK(lines == (300 - MSG_HEADER_SIZE) / per_line);
+    CHECK(msg_wire_len(&msg) <= 300);
+    CHECK(msg_last_seq(&msg) == lines);
+
+    /* A line too long for the new size doesn't go in a message at all */
+    msg_init(&msg, 1);
+    CHECK(!msg_has_room(&msg, 300 - MSG_HEADER_SIZE - MSG_RECORD_OVERHEAD + 1));
+    CHECK(msg_has_room(&msg, 300 - MSG_HEADER_SIZE - MSG_RECORD_OVERHEAD));
+
+    /* Too small a size still leaves room for a byte of text, and too big a one is capped */
+    msg_set_max_datagram(0);
+    CHECK(msg_payload_limit == MSG_MIN_DATAGRAM - MSG_HEADER_SIZE);
+    msg_set_max_datagram(MAX_DATAGRAM_SIZE + 1000);
+    CHECK(msg_payload_limit == MAX_PAYLOAD_LENGTH);
+
+    msg_set_max_datagram(DEFAULT_DATAGRAM_SIZE);
+    CHECK(msg_payload_limit == DEFAULT_DATAGRAM_SIZE - MSG_HEADER_SIZE);
+}
+
+/**
+ * A sealed message checks out, and stops checking out once a byte of it changes
+ */
+static void test_seal(void)
+{
+    struct message msg;
+    int len;
+
+    msg_init(&msg, 42);
+    CHECK(msg_add_record(&msg, "hello\n", 6));
+    msg_seal(&msg, 12345, 678);
+    len = msg_wire_len(&msg);
+
+    CHECK(ntohl(msg.ts_sec) == 12345 && ntohl(msg.ts_usec) == 678);
+    CHECK(msg_intact(&msg, len));
+
+    /* msg_intact() zeroes the checksum, so seal again before each try */
+    msg_seal(&msg, 12345, 678);
+    CHECK(!msg_intact(&msg, len - 1));
+
+    msg_seal(&msg, 12345, 678);
+    msg.text[3] ^= 0x20;
+    CHECK(!msg_intact(&msg, len));
+
+    /* An empty message is refused even with a good checksum */
+    msg_init(&msg, 1);
+    msg_seal(&msg, 0, 0);
+    CHECK(!msg_intact(&msg, MSG_HEADER_SIZE));
+}
+
+/**
+ * Input lines longer than MAX_TEXT_LENGTH are cut off there and the rest of the line skipped
+ */
+static void test_input_truncation(void)
+{
+    struct line_input input;
+    char buf[MAX_TEXT_LENGTH + 100];
+    int fds[2];
+
+    CHECK(pipe(fds) == 0);
+
+    memset(buf, 'y', sizeof(buf));
+    buf[sizeof(buf) - 1] = '\n';
+    CHECK(write(fds[1], buf, sizeof(buf)) == sizeof(buf));
+    CHECK(write(fds[1], "ok\nlast", 7) == 7);
+    close(fds[1]);
+
+    input_init(&input, fds[0]);
+
+    CHECK(input_read_line(&input, line, MAX_TEXT_LENGTH, -1) == MAX_TEXT_LENGTH);
+    CHECK(line[0] == 'y' && line[MAX_TEXT_LENGTH - 1] == 'y');
+
+    CHECK(input_read_line(&input, line, MAX_TEXT_LENGTH, -1) == 3);
+    CHECK(memcmp(line, "ok\n", 3) == 0);
+
+    /* The last line has no newline, and then the input is over */
+    CHECK(input_read_line(&input, line, MAX_TEXT_LENGTH, -1) == 4);
+    CHECK(memcmp(line, "last", 4) == 0);
+    CHECK(input_read_line(&input, line, MAX_TEXT_LENGTH, -1) == -1);
+
+    close(fds[0]);
+}
+
+/*-----------------------------------------------------------------------------
+ * Main
+ * --------------------------------------------------------------------------*/
+
+int main(void)
+{
+    log_level = LOG_ERROR;
+
+    test_packing();
+    test_seq_range();
+    test_payload_limit();
+    test_max_datagram();
+    test_seal();
+    test_input_truncation();
+
+    return test_done("test_msg");
+}
@@ -0,0 +1,266 @@
+/**
+ * Unit tests for path MTU discovery: the search run against simulated
+ * paths, probes that are refused locally or lost on the way, and a black
+ * hole sending it back to the base size
+ *
+ * Nothing is sent: the probes are handed straight to pmtu_reply() when
+ * the simulated path carries them. The socket is only there for
+ * pmtu_open() to set its options on.
+ *
+ * CMPT 434 - A2
+ * Steven Rau
+ * scr108
+ * 11115094
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#include "test.h"
+#include "pmtu.h"
+#include "message.h"
+#include "log.h"
+
+/*-----------------------------------------------------------------------------
+ * File-scope constants & globals
+ * --------------------------------------------------------------------------*/
+
+/* Timeout the searches are run with (microseconds), short so lost probes don't hold the test up */
+#define TEST_TIMEOUT_USEC  5000L
+
+/* Most times around the loop a search may take */
+#define TEST_MAX_STEPS  100000
+
+/* How a simulated path treats a datagram bigger than it carries */
+enum test_drop
+{
+    TEST_EMSGSIZE,  /* The local interface refuses it, so the probe fails at once */
+    TEST_SILENT     /* A router drops it, so the probe times out */
+};
+
+static int sock = -1;
+
+/*-----------------------------------------------------------------------------
+ * Helper functions
+ * --------------------------------------------------------------------------*/
+
+static void sleep_usec(long usec)
+{
+    struct timespec ts = { 0, usec * 1000L };
+
+    nanosleep(&ts, NULL);
+}
+
+/**
+ * Runs the search over a path until it settles
+ *
+ * @param[in] p        The discovery state, just opened
+ * @param[in] path     Largest datagram the path carries
+ * @param[in] drop     What happens to a bigger one
+ *
+ * Returns the number of probes sent
+ */
+static int run_search(struct pmtu *p, uint32_t path, enum test_drop drop)
+{
+    struct ack reply;
+    size_t len;
+    int num_probes = 0;
+    int steps;
+
+    for (steps = 0; steps < TEST_MAX_STEPS; steps++)
+    {
+        pmtu_update(p, -1, 0, false);
+
+        if (p->state == PMTU_SEARCH_COMPLETE || p->state == PMTU_ERROR)
+        {
+            break;
+        }
+
+        if ((len = pmtu_next_probe(p)) == 0)
+        {
+            sleep_usec(1000);
+
+            continue;
+        }
+
+        num_probes++;
+        CHECK(len == msg_wire_len(&p->probe));
+
+        if (len <= path)
+        {
+            CHECK(pmtu_reply(&reply, &p->probe, len));
+            pmtu_on_ack(p, &reply, sizeof(reply));
+        }
+        else if (drop == TEST_EMSGSIZE)
+        {
+            pmtu_probe_failed(p);
+        }
+    }
+
+    CHECK(steps < TEST_MAX_STEPS);
+
+    return num_probes;
+}
+
+/**
+ * Searches a path, checking that it finds the largest size within PMTU_SEARCH_STEP of what the
+ * path carries
+ */
+static void check_search(uint32_t max, uint32_t path, enum test_drop drop)
+{
+    struct pmtu p;
+    uint32_t expect = path < max ? path : max;
+
+    CHECK(pmtu_open(&p, sock, AF_INET, max, TEST_TIMEOUT_USEC));
+    CHECK(p.state == PMTU_BASE);
+    CHECK(p.size == (max < PMTU_BASE_DATAGRAM ? max : PMTU_BASE_DATAGRAM));
+
+    run_search(&p, path, drop);
+
+    CHECK(p.state == PMTU_SEARCH_COMPLETE);
+    CHECK(p.size <= expect);
+    CHECK(expect - p.size < PMTU_SEARCH_STEP);
+}
+
+/*-----------------------------------------------------------------------------
+ * Tests
+ * --------------------------------------------------------------------------*/
+
+/**
+ * The search on paths bigger, smaller and the same as what the receiver takes
+ */
+static void test_search(void)
+{
+    struct pmtu p;
+
+    /* A path carrying everything takes two probes: the base size, then the receiver's limit */
+    CHECK(pmtu_open(&p, sock, AF_INET, 1400, TEST_TIMEOUT_USEC));
+    CHECK(run_search(&p, MAX_DATAGRAM_SIZE, TEST_EMSGSIZE) == 2);
+    CHECK(p.state == PMTU_SEARCH_COMPLETE && p.size == 1400);
+
+    check_search(MAX_DATAGRAM_SIZE, 1500, TEST_EMSGSIZE);
+    check_search(MAX_DATAGRAM_SIZE, 1280, TEST_EMSGSIZE);
+    check_search(MAX_DATAGRAM_SIZE, 4000, TEST_SILENT);
+    check_search(2000, 1500, TEST_SILENT);
+    check_search(PMTU_BASE_DATAGRAM, MAX_DATAGRAM_SIZE, TEST_EMSGSIZE);
+
+    /* A receiver taking less than the base size starts (and ends) there */
+    check_search(1000, MAX_DATAGRAM_SIZE, TEST_SILENT);
+}
+
+/**
+ * A receiver that never answers leaves the sender at the base size
+ */
+static void test_no_answer(void)
+{
+    struct pmtu p;
+
+    CHECK(pmtu_open(&p, sock, AF_INET, 1500, TEST_TIMEOUT_USEC));
+    CHECK(run_search(&p, 0, TEST_SILENT) == PMTU_MAX_PROBES);
+    CHECK(p.state == PMTU_ERROR);
+    CHECK(p.size == PMTU_BASE_DATAGRAM);
+    CHECK(pmtu_next_probe(&p) == 0);
+}
+
+/**
+ * The path stops carrying the size found: once nothing is acked for PMTU_BLACK_HOLE_RTOS timeouts,
+ * it drops back to the base size and searches again
+ */
+static void test_black_hole(void)
+{
+    struct pmtu p;
+    int steps = 0;
+
+    CHECK(pmtu_open(&p, sock, AF_INET, 1500, TEST_TIMEOUT_USEC));
+    run_search(&p, 1500, TEST_EMSGSIZE);
+    CHECK(p.size == 1500);
+
+    /* Acks moving forward keep it where it is */
+    CHECK(!pmtu_update(&p, -1, 1, true));
+    sleep_usec(TEST_TIMEOUT_USEC);
+    CHECK(!pmtu_update(&p, -1, 2, true));
+    CHECK(p.size == 1500);
+
+    while (!pmtu_update(&p, -1, 2, true) && steps++ < 1000)
+    {
+        sleep_usec(1000);
+    }
+
+    CHECK(p.size == PMTU_BASE_DATAGRAM);
+    CHECK(p.state == PMTU_BASE);
+
+    /* The path now carries 1300 */
+    run_search(&p, 1300, TEST_SILENT);
+    CHECK(p.state == PMTU_SEARCH_COMPLETE);
+    CHECK(p.size <= 1300 && 1300 - p.size < PMTU_SEARCH_STEP);
+}
+
+/**
+ * The receiver's ack for a probe says how big it was, and damaged probes aren't acked
+ */
+static void test_reply(void)
+{
+    struct pmtu p;
+    struct ack reply;
+    struct message copy;
+    size_t len;
+
+    CHECK(pmtu_open(&p, sock, AF_INET, 1500, TEST_TIMEOUT_USEC));
+    len = pmtu_next_probe(&p);
+    CHECK(len == PMTU_BASE_DATAGRAM);
+    CHECK(p.probe.flags & MSG_FLAG_PROBE);
+
+    memcpy(&copy, &p.probe, len);
+    CHECK(pmtu_reply(&reply, &copy, len));
+    CHECK(reply.version == ACK_VERSION);
+    CHECK(reply.flags == ACK_FLAG_PROBE);
+    CHECK(ntohl(reply.sel_ack) == PMTU_BASE_DATAGRAM);
+    CHECK(reply.ts_sec == p.probe.ts_sec && reply.ts_usec == p.probe.ts_usec);
+
+    /* Cut short or damaged */
+    memcpy(&copy, &p.probe, len);
+    CHECK(!pmtu_reply(&reply, &copy, len - 1));
+    memcpy(&copy, &p.probe, len);
+    copy.text[100] ^= 1;
+    CHECK(!pmtu_reply(&reply, &copy, len));
+
+    /* Only an ack for a probe is taken */
+    memset(&reply, 0, sizeof(reply));
+    reply.sel_ack = htonl(PMTU_BASE_DATAGRAM);
+    pmtu_on_ack(&p, &reply, sizeof(reply));
+    CHECK(p.probe_acked == 0);
+    reply.flags = ACK_FLAG_PROBE;
+    pmtu_on_ack(&p, &reply, sizeof(reply) - 1);
+    CHECK(p.probe_acked == 0);
+    pmtu_on_ack(&p, &reply, sizeof(reply));
+    CHECK(p.probe_acked == PMTU_BASE_DATAGRAM);
+}
+
+/*-----------------------------------------------------------------------------
+ * Main
+ * --------------------------------------------------------------------------*/
+
+int main(void)
+{
+    log_level = LOG_ERROR;
+
+    if ((sock = socket(AF_INET, SOCK_DGRAM, 0)) == -1)
+    {
+        perror("socket");
+
+        return 1;
+    }
+
+    test_search();
+    test_no_answer();
+    test_black_hole();
+    test_reply();
+
+    close(sock);
+
+    return test_done("test_pmtu");
+}
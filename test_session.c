@@ -0,0 +1,237 @@
+/**
+ * Unit tests for the session handshake: hellos and replies round trip in
+ * network byte order, the settings agreed, and hellos that are refused
+ *
+ * CMPT 434 - A2
+ * Steven Rau
+ * scr108
+ * 11115094
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "test.h"
+#include "session.h"
+
+/*-----------------------------------------------------------------------------
+ * Helper functions
+ * --------------------------------------------------------------------------*/
+
+/**
+ * Parameters like a sender's or receiver's, with every field set
+ */
+static void fill_params(struct session_params *p, uint16_t features, uint32_t window, uint32_t buffer,
+                        uint16_t mss, int num_streams)
+{
+    int i;
+
+    memset(p, 0, sizeof(*p));
+
+    p->version = ACK_VERSION;
+    p->num_streams = num_streams;
+    p->features = features;
+    p->window = window;
+    p->buffer = buffer;
+    p->mss = mss;
+    p->shm_key = 0x12345678;
+
+    for (i = 0; i < MAX_STREAMS; i++)
+    {
+        p->resume[i] = 1000 + i;
+    }
+}
+
+/*-----------------------------------------------------------------------------
+ * Tests
+ * --------------------------------------------------------------------------*/
+
+/**
+ * The sender's parameters come out of its hello as they went in
+ */
+static void test_hello(void)
+{
+    struct session_params mine;
+    struct session_params theirs;
+    const struct session_params *wire;
+    struct message hello;
+    struct message copy;
+    size_t len;
+
+    fill_params(&mine, SESSION_FEATURE_SACK | SESSION_FEATURE_FEC, 64, 0, 1400, 2);
+
+    len = session_hello(&hello, &mine);
+    CHECK(len == MSG_HEADER_SIZE + sizeof(mine));
+    CHECK(hello.flags & MSG_FLAG_HELLO);
+
+    wire = (const struct session_params *)hello.text;
+    CHECK(ntohl(wire->window) == 64);
+    CHECK(ntohs(wire->mss) == 1400);
+    CHECK(ntohl(wire->resume[1]) == 1001);
+
+    copy = hello;
+    CHECK(session_read_hello(&copy, len, &theirs));
+    CHECK(memcmp(&theirs, &mine, sizeof(mine)) == 0);
+
+    /* Damaged, cut short, or not a hello at all */
+    copy = hello;
+    copy.text[3] ^= 1;
+    CHECK(!session_read_hello(&copy, len, &theirs));
+
+    copy = hello;
+    CHECK(!session_read_hello(&copy, len - 1, &theirs));
+
+    msg_init(&copy, 0);
+    msg_add_record(&copy, "data", 4);
+    msg_seal(&copy, 0, 0);
+    CHECK(!session_read_hello(&copy, msg_wire_len(&copy), &theirs));
+}
+
+/**
+ * Hellos the receiver can't work with
+ */
+static void test_check(void)
+{
+    struct session_params theirs;
+
+    fill_params(&theirs, 0, 16, 0, 1400, 1);
+    CHECK(session_check(&theirs) == SESSION_ACCEPTED);
+
+    theirs.mss = MSG_MIN_DATAGRAM;
+    CHECK(session_check(&theirs) == SESSION_ACCEPTED);
+
+    theirs.mss = MSG_MIN_DATAGRAM - 1;
+    CHECK(session_check(&theirs) == SESSION_REJECT_MSS);
+
+    theirs.mss = 1400;
+    theirs.version = ACK_VERSION + 1;
+    CHECK(session_check(&theirs) == SESSION_REJECT_VERSION);
+}
+
+/**
+ * The settings agreed from the two ends' parameters
+ */
+static void test_negotiate(void)
+{
+    struct session_params sender;
+    struct session_params receiver;
+    struct session_params agreed;
+
+    /* Features both have, the fewer streams, the smaller datagrams, and the sender's shared memory */
+    fill_params(&sender, SESSION_FEATURE_SACK | SESSION_FEATURE_COMPRESS | SESSION_FEATURE_SHM, 16, 0, 1400, 3);
+    fill_params(&receiver, SESSION_FEATURE_SACK | SESSION_FEATURE_SHM | SESSION_FEATURE_FEC, 0, 64, 9000, 2);
+    receiver.shm_key = 0;
+    session_negotiate(&sender, &receiver, &agreed);
+
+    CHECK(agreed.version == ACK_VERSION);
+    CHECK(agreed.features == (SESSION_FEATURE_SACK | SESSION_FEATURE_SHM));
+    CHECK(agreed.num_streams == 2);
+    CHECK(agreed.mss == 1400);
+    CHECK(agreed.window == 16);
+    CHECK(agreed.buffer == 64);
+    CHECK(agreed.shm_key == 0x12345678);
+
+    /* Selective Repeat: the window is cut to what the buffer holds ahead of a gap */
+    sender.window = 100;
+    session_negotiate(&sender, &receiver, &agreed);
+    CHECK(agreed.window == 65);
+
+    /* Go-Back-N buffers nothing, so the buffer doesn't limit the window */
+    receiver.features &= ~SESSION_FEATURE_SACK;
+    session_negotiate(&sender, &receiver, &agreed);
+    CHECK(agreed.window == 100);
+
+    /* A receiver with a window of its own caps it */
+    receiver.window = 40;
+    session_negotiate(&sender, &receiver, &agreed);
+    CHECK(agreed.window == 40);
+
+    /* No shared memory agreed, no key */
+    receiver.features &= ~SESSION_FEATURE_SHM;
+    session_negotiate(&sender, &receiver, &agreed);
+    CHECK(agreed.shm_key == 0);
+
+    /* Each stream resumes from the end that is behind, and streams not agreed stay at 0 */
+    receiver.resume[0] = 500;
+    sender.resume[1] = 20;
+    session_negotiate(&sender, &receiver, &agreed);
+    CHECK(agreed.resume[0] == 500);
+    CHECK(agreed.resume[1] == 20);
+    CHECK(agreed.resume[2] == 0);
+
+    /* An end starting over takes the other back to the start */
+    memset(receiver.resume, 0, sizeof(receiver.resume));
+    session_negotiate(&sender, &receiver, &agreed);
+    CHECK(agreed.resume[0] == 0 && agreed.resume[1] == 0);
+}
+
+/**
+ * The receiver's reply carries the agreed settings back, and a refusal its reason
+ */
+static void test_reply(void)
+{
+    struct session_params mine;
+    struct session_params agreed;
+    struct session_params got;
+    struct message hello;
+    const struct ack *ack;
+    char buf[sizeof(struct ack) + sizeof(struct session_params)];
+    int len;
+
+    fill_params(&mine, SESSION_FEATURE_COMPRESS, 32, 0, 1200, 1);
+    session_hello(&hello, &mine);
+    fill_params(&agreed, SESSION_FEATURE_COMPRESS, 16, 15, 1200, 1);
+
+    len = session_reply(buf, &hello, &agreed);
+    CHECK(len == (int)sizeof(buf));
+
+    ack = (const struct ack *)buf;
+    CHECK(ack->version == ACK_VERSION);
+    CHECK(ack->flags == ACK_FLAG_HELLO);
+    CHECK(ack->ts_sec == hello.ts_sec && ack->ts_usec == hello.ts_usec);
+    CHECK(ntohl(((const struct session_params *)(buf + sizeof(struct ack)))->window) == 16);
+
+    CHECK(session_read_reply(buf, len, &got));
+    CHECK(memcmp(&got, &agreed, sizeof(got)) == 0);
+    CHECK(session_read_rejection(buf, len) == SESSION_ACCEPTED);
+    CHECK(!session_read_reply(buf, len - 1, &got));
+
+    /* A refusal isn't taken for a reply */
+    len = session_reject(buf, &hello, SESSION_REJECT_MSS);
+    CHECK(len == (int)sizeof(struct ack));
+    CHECK(ack->flags == (ACK_FLAG_HELLO | ACK_FLAG_REJECT));
+    CHECK(ack->ts_sec == hello.ts_sec);
+    CHECK(!session_read_reply(buf, sizeof(buf), &got));
+    CHECK(session_read_rejection(buf, len) == SESSION_REJECT_MSS);
+
+    len = session_reject(buf, &hello, SESSION_REJECT_VERSION);
+    CHECK(session_read_rejection(buf, len) == SESSION_REJECT_VERSION);
+    CHECK(session_read_rejection(buf, len - 1) == SESSION_ACCEPTED);
+
+    /* A reason from a newer receiver is still a refusal */
+    ((struct ack *)buf)->sel_ack = htonl(SESSION_NUM_REJECTS + 3);
+    CHECK(session_read_rejection(buf, len) == SESSION_NUM_REJECTS);
+    CHECK(strcmp(session_reject_name(SESSION_NUM_REJECTS), "unknown reason") == 0);
+    CHECK(strcmp(session_reject_name(SESSION_REJECT_MSS), "unknown reason") != 0);
+
+    /* An ordinary ack is neither */
+    memset(buf, 0, sizeof(buf));
+    ((struct ack *)buf)->version = ACK_VERSION;
+    CHECK(!session_read_reply(buf, sizeof(buf), &got));
+    CHECK(session_read_rejection(buf, sizeof(struct ack)) == SESSION_ACCEPTED);
+}
+
+/*-----------------------------------------------------------------------------
+ * Main
+ * --------------------------------------------------------------------------*/
+
+int main(void)
+{
+    test_hello();
+    test_check();
+    test_negotiate();
+    test_reply();
+
+    return test_done("test_session");
+}
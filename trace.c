@@ -0,0 +1,240 @@
+/**
+ * Binary event trace of a transfer, for working out afterwards why it was
+ * slow
+ *
+ * CMPT 434 - A2
+ * Steven Rau
+ * scr108
+ * 11115094
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "trace.h"
+
+/*-----------------------------------------------------------------------------
+ * File-scope constants & globals
+ * --------------------------------------------------------------------------*/
+
+struct trace_header *trace_out = NULL;
+
+/* The file being recorded to */
+static int trace_fd = -1;
+
+/* Names of the events, indexed by enum trace_event */
+static const char *event_names[TRACE_NUM_EVENTS] =
+{
+    "none",
+    "send",
+    "retransmit",
+    "ack",
+    "timeout",
+    "reclaim",
+    "receive",
+    "buffer",
+    "drain",
+    "ack_sent",
+    "discard"
+};
+
+/* Names of the reasons for a discard, indexed by enum trace_discard */
+static const char *discard_names[TRACE_NUM_DROPS] =
+{
+    "damaged",
+    "out_of_order",
+    "duplicate",
+    "rejected",
+    "no_room",
+    "ack"
+};
+
+/*-----------------------------------------------------------------------------
+ * Helper functions
+ * --------------------------------------------------------------------------*/
+
+static uint64_t now_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+static size_t trace_size(uint64_t num_records)
+{
+    return sizeof(struct trace_header) + num_records * sizeof(struct trace_record);
+}
+
+/*-----------------------------------------------------------------------------
+ * Recording
+ * --------------------------------------------------------------------------*/
+
+void trace_write(uint8_t event, uint8_t stream, uint8_t flags, uint32_t seq, uint32_t last_seq,
+                 uint32_t occupancy, uint32_t len, uint32_t aux)
+{
+    struct trace_header *h = trace_out;
+    struct trace_record *slot;
+    uint64_t index = __atomic_fetch_add(&h->count, 1, __ATOMIC_RELAXED);
+
+    if (index >= h->capacity)
+    {
+        return;
+    }
+
+    slot = (struct trace_record *)(h + 1) + index;
+    slot->time_ns = now_ns();
+    slot->stream = stream;
+    slot->flags = flags;
+    slot->seq = seq;
+    slot->last_seq = last_seq;
+    slot->occupancy = occupancy;
+    slot->len = len;
+    slot->aux = aux;
+
+    /* A slot whose event is still TRACE_NONE was never finished, and is skipped when read */
+    __atomic_store_n(&slot->event, event, __ATOMIC_RELEASE);
+}
+
+bool trace_open(const char *path, uint8_t role)
+{
+    struct trace_header *h;
+    int fd;
+
+    if ((fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644)) == -1)
+    {
+        perror("trace open");
+
+        return false;
+    }
+
+    /* Blocks are only given to the file as records are written into them */
+    if (ftruncate(fd, trace_size(TRACE_MAX_RECORDS)) == -1 ||
+        (h = mmap(NULL, trace_size(TRACE_MAX_RECORDS), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED)
+    {
+        perror("trace file");
+        close(fd);
+
+        return false;
+    }
+
+    h->magic = TRACE_MAGIC;
+    h->version = TRACE_VERSION;
+    h->role = role;
+    h->record_size = sizeof(struct trace_record);
+    h->capacity = TRACE_MAX_RECORDS;
+    h->start_ns = now_ns();
+
+    trace_fd = fd;
+    trace_out = h;
+
+    return true;
+}
+
+void trace_close(void)
+{
+    struct trace_header *h = trace_out;
+    uint64_t count;
+
+    if (h == NULL)
+    {
+        return;
+    }
+
+    trace_out = NULL;
+
+    count = h->count < h->capacity ? h->count : h->capacity;
+
+    munmap(h, trace_size(TRACE_MAX_RECORDS));
+
+    if (ftruncate(trace_fd, trace_size(count)) == -1)
+    {
+        perror("trace truncate");
+    }
+
+    close(trace_fd);
+    trace_fd = -1;
+}
+
+/*-----------------------------------------------------------------------------
+ * Reading back
+ * --------------------------------------------------------------------------*/
+
+bool trace_load(struct trace_file *t, const char *path)
+{
+    const struct trace_header *h;
+    struct stat st;
+    uint64_t room;
+    int fd;
+
+    memset(t, 0, sizeof(*t));
+
+    if ((fd = open(path, O_RDONLY)) == -1)
+    {
+        perror(path);
+
+        return false;
+    }
+
+    if (fstat(fd, &st) == -1 || st.st_size < (off_t)sizeof(*h))
+    {
+        fprintf(stderr, "%s is too short to be a trace\n", path);
+        close(fd);
+
+        return false;
+    }
+
+    if ((h = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED)
+    {
+        perror("mmap");
+        close(fd);
+
+        return false;
+    }
+
+    close(fd);
+
+    if (h->magic != TRACE_MAGIC || h->version != TRACE_VERSION || h->record_size != sizeof(struct trace_record))
+    {
+        fprintf(stderr, "%s isn't a trace this program can read\n", path);
+        munmap((void *)h, st.st_size);
+
+        return false;
+    }
+
+    /* A trace that was never closed is still its full size, with the count telling what is in it */
+    room = (st.st_size - sizeof(*h)) / sizeof(struct trace_record);
+    t->num_records = h->count < h->capacity ? h->count : h->capacity;
+    t->num_records = t->num_records < room ? t->num_records : room;
+    t->dropped = h->count > h->capacity ? h->count - h->capacity : 0;
+    t->header = h;
+    t->records = (const struct trace_record *)(h + 1);
+    t->map_len = st.st_size;
+
+    return true;
+}
+
+void trace_unload(struct trace_file *t)
+{
+    if (t->header != NULL)
+    {
+        munmap((void *)t->header, t->map_len);
+        t->header = NULL;
+    }
+}
+
+const char *trace_event_name(uint8_t event)
+{
+    return event < TRACE_NUM_EVENTS ? event_names[event] : "unknown";
+}
+
+const char *trace_discard_name(uint8_t reason)
+{
+    return reason < TRACE_NUM_DROPS ? discard_names[reason] : "unknown";
+}
@@ -0,0 +1,176 @@
+/**
+ * Binary event trace of a transfer, for working out afterwards why it was
+ * slow
+ *
+ * The log scrolls by, and at LOG_DEBUG it slows the transfer down enough
+ * to change what happens. The trace instead records every send,
+ * retransmission, ack, timeout, buffer insert and drain as a fixed-size
+ * binary record with a nanosecond timestamp (CLOCK_MONOTONIC), straight
+ * into a file mapped into memory. Nothing is formatted and there is no
+ * system call per record: a record costs an atomic add to claim its slot
+ * and a 32 byte store. Records from every thread go into the one file, in
+ * the order their slots were claimed.
+ *
+ * The file is created at its full size (TRACE_MAX_RECORDS records, sparse
+ * until written) and cut down to the records written when the trace is
+ * closed. The number written is kept in the mapping itself, so a trace
+ * left by a program that was killed (or crashed) can still be read.
+ * Records that don't fit are dropped and counted.
+ *
+ * traceview reads a trace back: time-sequence and window occupancy series
+ * to plot, the causes of the retransmissions, and the longest stalls.
+ *
+ * CMPT 434 - A2
+ * Steven Rau
+ * scr108
+ * 11115094
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Identifies a trace file, and the layout of its records */
+#define TRACE_MAGIC    0x41525154
+#define TRACE_VERSION  1
+
+/* Most records one file holds (32 bytes each) */
+#define TRACE_MAX_RECORDS  (1u << 22)
+
+/* Which end wrote a trace */
+#define TRACE_SENDER    's'
+#define TRACE_RECEIVER  'r'
+
+/* Events. Keep in sync with the names in trace.c */
+enum trace_event
+{
+    TRACE_NONE,        /* A slot never written (the program died while writing it) */
+    TRACE_SEND,        /* Sender: a message went out for the first time */
+    TRACE_RETRANSMIT,  /* Sender: a message from the window went out again */
+    TRACE_ACK,         /* Sender: an ack arrived */
+    TRACE_TIMEOUT,     /* Sender: a wait for an ack ran out */
+    TRACE_RECLAIM,     /* Sender: acked messages left the window */
+    TRACE_RECEIVE,     /* Receiver: the next in-order message arrived and was delivered */
+    TRACE_BUFFER,      /* Receiver: an out of order message was buffered */
+    TRACE_DRAIN,       /* Receiver: buffered messages were delivered once the gap before them filled */
+    TRACE_ACK_SENT,    /* Receiver: an ack went out */
+    TRACE_DISCARD,     /* Receiver: a message (or ack) was thrown away, for the reason in flags */
+    TRACE_NUM_EVENTS
+};
+
+/* What a message or ack was discarded for (TRACE_DISCARD's flags) */
+enum trace_discard
+{
+    TRACE_DROP_DAMAGED,       /* Bad length or checksum */
+    TRACE_DROP_OUT_OF_ORDER,  /* Ahead of the next in-order message, under Go-Back-N */
+    TRACE_DROP_DUPLICATE,     /* Already delivered or buffered */
+    TRACE_DROP_REJECTED,      /* Refused by the accept callback (the user answered no) */
+    TRACE_DROP_NO_ROOM,       /* The buffer was full */
+    TRACE_DROP_ACK,           /* An ack that wasn't sent (e.g. chosen to be lost) */
+    TRACE_NUM_DROPS
+};
+
+/* Set in TRACE_RETRANSMIT's flags when the message's timer had run out. Without it the sender
+ * went back to the message early, on duplicate acks */
+#define TRACE_FLAG_TIMER  0x01
+
+/*
+ * One event, in host byte order. What the fields hold depends on the event:
+ *
+ *     SEND, RETRANSMIT  seq - last_seq of the message, occupancy = messages in the window,
+ *                       len = bytes sent, aux = the timestamp the message was stamped with
+ *     ACK, ACK_SENT     seq = cumulative ack, last_seq = selective ack, flags = the ack's flags,
+ *                       aux = the timestamp it echoes
+ *     RECLAIM           seq = first sequence number not yet acked, occupancy = messages left in
+ *                       the window, aux = messages taken out
+ *     RECEIVE, BUFFER   seq - last_seq of the message, occupancy = messages buffered, len = bytes
+ *     DRAIN             seq - last_seq delivered from the buffer, occupancy = messages left in it,
+ *                       aux = messages delivered
+ *     DISCARD           seq - last_seq of the message (seq = the cumulative ack for an ack)
+ *
+ * Timestamps in aux are the low 32 bits of the sender's clock in microseconds, as carried on the
+ * wire, so an ack can be matched to the transmission that triggered it
+ */
+struct trace_record
+{
+    uint64_t time_ns;     /* CLOCK_MONOTONIC */
+    uint8_t event;        /* enum trace_event, stored last */
+    uint8_t stream;
+    uint8_t flags;
+    uint8_t reserved;
+    uint32_t seq;
+    uint32_t last_seq;
+    uint32_t occupancy;
+    uint32_t len;
+    uint32_t aux;
+};
+
+/* The start of a trace file, followed by its records */
+struct trace_header
+{
+    uint32_t magic;
+    uint16_t version;
+    uint8_t role;         /* TRACE_SENDER or TRACE_RECEIVER */
+    uint8_t reserved;
+    uint32_t record_size;
+    uint32_t capacity;    /* Records the file has room for */
+    uint64_t count;       /* Shared: records claimed so far (any past capacity were dropped) */
+    uint64_t start_ns;    /* When the trace was opened */
+    char pad[32];
+};
+
+/* The open trace, or NULL while nothing is being traced */
+extern struct trace_header *trace_out;
+
+void trace_write(uint8_t event, uint8_t stream, uint8_t flags, uint32_t seq, uint32_t last_seq,
+                 uint32_t occupancy, uint32_t len, uint32_t aux);
+
+/**
+ * Records an event if a trace is open. The check is inlined so an untraced run pays a single
+ * compare, like LOG()
+ */
+#define TRACE(...) \
+    do { if (trace_out != NULL) trace_write(__VA_ARGS__); } while (0)
+
+/**
+ * Creates (or replaces) a trace file and starts recording to it
+ *
+ * @param[in] path  File to record to
+ * @param[in] role  TRACE_SENDER or TRACE_RECEIVER
+ *
+ * Returns false (with a message printed) if it couldn't be created
+ */
+bool trace_open(const char *path, uint8_t role);
+
+/**
+ * Stops recording and cuts the file down to the records written. Only called once nothing else
+ * can be recording (e.g. other threads have been joined)
+ */
+void trace_close(void);
+
+/* A trace file read back */
+struct trace_file
+{
+    const struct trace_header *header;
+    const struct trace_record *records;
+    uint64_t num_records;  /* Records in the file */
+    uint64_t dropped;      /* Records that didn't fit */
+    size_t map_len;
+};
+
+/**
+ * Maps a trace file for reading
+ *
+ * Returns false (with a message printed) if it can't be read or isn't a trace
+ */
+bool trace_load(struct trace_file *t, const char *path);
+
+void trace_unload(struct trace_file *t);
+
+/* Name of an event, or of the reason for a discard */
+const char *trace_event_name(uint8_t event);
+const char *trace_discard_name(uint8_t reason);
+
+#endif /* TRACE_H */
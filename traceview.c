@@ -0,0 +1,876 @@
+/**
+ * Offline analysis of an event trace (trace.h) written by the sender or
+ * a receiver with -t
+ *
+ * With no -g, prints a report:
+ *
+ *     - how many of each event there were, and on each stream how full
+ *       the window (or the receiver's buffer) was, at most and on average
+ *       over time
+ *     - sender: what caused the retransmissions. The trigger is whether
+ *       the message's timer ran out, or the sender went back to it early
+ *       on duplicate acks. The cause is worked out from the acks
+ *       around it:
+ *
+ *           gap reported  an out of order ack came in after the message
+ *                         went out: the receiver had what was sent after
+ *                         it, so the message was lost
+ *           acks stalled  acks came in, but none got as far as the message
+ *                         and none reported a gap (an earlier message was
+ *                         lost, or out of order messages were dropped)
+ *           no acks       nothing at all came back after it went out (the
+ *                         message and everything after it, or their acks,
+ *                         were lost)
+ *           spurious      an earlier copy got through: the first ack to
+ *                         cover the message echoes the timestamp of a
+ *                         transmission from before the retransmission
+ *
+ *     - the longest stalls. On the sender, times the first unacked
+ *       message stayed the same while messages were outstanding. On a
+ *       receiver, times messages arrived ahead of a gap and waited for it
+ *       to fill
+ *
+ * -g prints one of the series to plot instead, as CSV with times in
+ * milliseconds from the start of the trace:
+ *
+ *     seq           Every event with its sequence numbers (a time-sequence
+ *                   graph: sends, retransmissions and acks over time)
+ *     window        Window (or buffer) occupancy, each time it changes
+ *     retransmits   Every retransmission with its trigger and cause
+ *
+ * CMPT 434 - A2
+ * Steven Rau
+ * scr108
+ * 11115094
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "shared.h"
+#include "pool.h"
+#include "trace.h"
+
+
+/*-----------------------------------------------------------------------------
+ * File-scope constants & globals
+ * --------------------------------------------------------------------------*/
+
+/* Stalls listed in the report unless -n says otherwise */
+#define TV_DEFAULT_STALLS  5
+
+/* Most stalls that can be listed */
+#define TV_MAX_STALLS  100
+
+/* What the sender re-sent a message for */
+enum tv_cause
+{
+    TV_CAUSE_GAP,
+    TV_CAUSE_STALLED,
+    TV_CAUSE_SILENCE,
+    TV_CAUSE_SPURIOUS,
+    TV_NUM_CAUSES
+};
+
+static const char *cause_names[TV_NUM_CAUSES] =
+{
+    "gap_reported",
+    "acks_stalled",
+    "no_acks",
+    "spurious"
+};
+
+static const char *cause_help[TV_NUM_CAUSES] =
+{
+    "the receiver had what was sent after it: it was lost",
+    "acks came, but none got as far as it",
+    "nothing came back after it went out",
+    "an earlier copy got through: it needn't have been re-sent"
+};
+
+/* One retransmission */
+struct tv_retransmit
+{
+    uint64_t time_ns;
+    uint8_t stream;
+    bool timer;           /* Its timer had run out (rather than sent early) */
+    enum tv_cause cause;
+    uint32_t seq;
+    uint32_t last_seq;
+};
+
+/* A message the sender has out and not yet cumulatively acked */
+struct tv_msg
+{
+    uint32_t seq;
+    uint32_t last_seq;
+    uint32_t stamp;       /* Timestamp its latest transmission carried */
+    uint64_t acks_at;     /* The stream's ack counts when it last went out */
+    uint64_t gaps_at;
+    int64_t retransmit;   /* Its latest retransmission, until an ack settles it (-1 if none) */
+};
+
+/* A stretch without progress */
+struct tv_stall
+{
+    uint64_t start_ns;
+    uint64_t end_ns;
+    uint8_t stream;
+    uint32_t stuck_at;    /* Sender: first unacked sequence number. Receiver: the next one expected */
+    uint32_t events[3];   /* Sender: retransmits, timeouts, acks. Receiver: arrived ahead, duplicates,
+                           * acks not sent */
+    bool open;            /* Still going when the trace ended */
+};
+
+struct tv_stream
+{
+    bool seen;
+    uint64_t counts[TRACE_NUM_EVENTS];
+    uint64_t drops[TRACE_NUM_DROPS];
+    uint64_t acks;        /* Sender: acks received. Receiver: acks sent */
+    uint64_t gaps;        /* and of those, the out of order ones */
+    uint64_t dup_acks;    /* Receiver: acks for a duplicate (ACK_FLAG_RETRANS) */
+    uint32_t frontier;    /* Sender: first sequence number not acked. Receiver: the next one expected */
+    struct tv_msg *msgs;  /* Sender: sent and not cumulatively acked, in sequence order, from first */
+    uint64_t first;
+    uint64_t num_msgs;
+    uint32_t occupancy;   /* Messages in the window (or buffer), the most there were, and the sum */
+    uint32_t max_occupancy;  /* of the occupancy over time, for the average */
+    uint64_t occupancy_ns;
+    double occupancy_area;
+    uint64_t first_ns;
+    uint64_t last_ns;
+    bool waiting;         /* Sender: messages outstanding. Receiver: messages waiting on a gap */
+    struct tv_stall stall;   /* The stretch without progress so far */
+};
+
+struct tv_state
+{
+    const struct trace_file *trace;
+    bool sender;
+    struct tv_stream streams[MAX_STREAMS];
+    struct tv_retransmit *retransmits;
+    uint64_t num_retransmits;
+    struct tv_stall stalls[TV_MAX_STALLS];   /* The longest, longest first */
+    int num_stalls;
+    int max_stalls;
+};
+
+/*-----------------------------------------------------------------------------
+ * Helper functions
+ * --------------------------------------------------------------------------*/
+
+static double trace_ms(const struct tv_state *tv, uint64_t time_ns)
+{
+    return (double)(time_ns - tv->trace->header->start_ns) / 1000000.0;
+}
+
+/* Sequence numbers only move forward, so anything not yet seen counts as ahead */
+static bool seq_after(uint32_t seq, uint32_t than)
+{
+    return (int32_t)(seq - than) > 0;
+}
+
+/**
+ * Finds an outstanding message by its first (or last) sequence number
+ *
+ * Returns NULL if it isn't outstanding
+ */
+static struct tv_msg *find_msg(struct tv_stream *st, uint32_t seq, bool by_last)
+{
+    uint64_t lo = st->first;
+    uint64_t hi = st->num_msgs;
+    uint64_t mid;
+    uint32_t key;
+
+    while (lo < hi)
+    {
+        mid = lo + (hi - lo) / 2;
+        key = by_last ? st->msgs[mid].last_seq : st->msgs[mid].seq;
+
+        if (key == seq)
+        {
+            return &st->msgs[mid];
+        }
+
+        if (seq_after(seq, key))
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Keeps a finished stall if it is among the longest
+ */
+static void keep_stall(struct tv_state *tv, const struct tv_stall *stall)
+{
+    uint64_t len = stall->end_ns - stall->start_ns;
+    int pos = tv->num_stalls;
+
+    while (pos > 0 && tv->stalls[pos-1].end_ns - tv->stalls[pos-1].start_ns < len)
+    {
+        pos--;
+    }
+
+    if (pos >= tv->max_stalls)
+    {
+        return;
+    }
+
+    if (tv->num_stalls < tv->max_stalls)
+    {
+        tv->num_stalls++;
+    }
+
+    memmove(&tv->stalls[pos+1], &tv->stalls[pos], (tv->num_stalls - 1 - pos) * sizeof(struct tv_stall));
+    tv->stalls[pos] = *stall;
+}
+
+/**
+ * The stream made progress (or stopped waiting): the stall so far is over, and a new one starts
+ * if there is still something waiting
+ */
+static void progress(struct tv_state *tv, struct tv_stream *st, uint8_t stream, uint64_t time_ns, bool waiting)
+{
+    if (st->waiting && time_ns > st->stall.start_ns)
+    {
+        st->stall.end_ns = time_ns;
+        keep_stall(tv, &st->stall);
+    }
+
+    memset(&st->stall, 0, sizeof(st->stall));
+    st->stall.start_ns = time_ns;
+    st->stall.stream = stream;
+    st->stall.stuck_at = st->frontier;
+    st->waiting = waiting;
+}
+
+/**
+ * Something started waiting: a message went out on an idle sender, or arrived ahead of a gap
+ */
+static void start_waiting(struct tv_state *tv, struct tv_stream *st, uint8_t stream, uint64_t time_ns)
+{
+    if (!st->waiting)
+    {
+        progress(tv, st, stream, time_ns, true);
+    }
+}
+
+static void set_occupancy(struct tv_stream *st, uint64_t time_ns, uint32_t occupancy)
+{
+    st->occupancy_area += (double)st->occupancy * (double)(time_ns - st->occupancy_ns);
+    st->occupancy = occupancy;
+    st->occupancy_ns = time_ns;
+
+    if (occupancy > st->max_occupancy)
+    {
+        st->max_occupancy = occupancy;
+    }
+}
+
+/* Whether a record's occupancy field means anything (the sender's acks are read on whatever
+ * thread reads them, without the window) */
+static bool has_occupancy(const struct trace_record *rec)
+{
+    return rec->event != TRACE_ACK && rec->event != TRACE_NONE;
+}
+
+/**
+ * An ack now covers a message: if it echoes a transmission from before the message's latest
+ * retransmission, that retransmission wasn't needed
+ */
+static void settle(struct tv_state *tv, struct tv_msg *m, uint32_t echoed)
+{
+    if (m->retransmit >= 0 && (int32_t)(echoed - m->stamp) < 0)
+    {
+        tv->retransmits[m->retransmit].cause = TV_CAUSE_SPURIOUS;
+    }
+
+    m->retransmit = -1;
+}
+
+/*-----------------------------------------------------------------------------
+ * Going over the trace
+ * --------------------------------------------------------------------------*/
+
+static void sender_event(struct tv_state *tv, struct tv_stream *st, const struct trace_record *rec)
+{
+    struct tv_msg *m;
+    struct tv_retransmit *r;
+
+    switch (rec->event)
+    {
+        case TRACE_SEND:
+            if (st->first == st->num_msgs)
+            {
+                st->frontier = rec->seq;
+            }
+
+            m = &st->msgs[st->num_msgs++];
+            m->seq = rec->seq;
+            m->last_seq = rec->last_seq;
+            m->stamp = rec->aux;
+            m->acks_at = st->acks;
+            m->gaps_at = st->gaps;
+            m->retransmit = -1;
+
+            start_waiting(tv, st, rec->stream, rec->time_ns);
+            break;
+
+        case TRACE_RETRANSMIT:
+            r = &tv->retransmits[tv->num_retransmits];
+            r->time_ns = rec->time_ns;
+            r->stream = rec->stream;
+            r->timer = rec->flags & TRACE_FLAG_TIMER;
+            r->seq = rec->seq;
+            r->last_seq = rec->last_seq;
+            r->cause = TV_CAUSE_SILENCE;
+
+            if ((m = find_msg(st, rec->seq, false)) != NULL)
+            {
+                if (st->gaps > m->gaps_at)
+                {
+                    r->cause = TV_CAUSE_GAP;
+                }
+                else if (st->acks > m->acks_at)
+                {
+                    r->cause = TV_CAUSE_STALLED;
+                }
+
+                m->stamp = rec->aux;
+                m->acks_at = st->acks;
+                m->gaps_at = st->gaps;
+                m->retransmit = tv->num_retransmits;
+            }
+
+            tv->num_retransmits++;
+            st->stall.events[0]++;
+            break;
+
+        case TRACE_ACK:
+            st->acks++;
+            st->gaps += (rec->flags & ACK_FLAG_OUT_OF_ORDER) != 0;
+            st->stall.events[2]++;
+
+            /* A message the receiver buffered */
+            if ((rec->flags & ACK_FLAG_SELECTIVE) && (m = find_msg(st, rec->last_seq, true)) != NULL)
+            {
+                settle(tv, m, rec->aux);
+            }
+
+            /* Everything up to the cumulative ack is through */
+            if (rec->seq != UINT32_MAX && !seq_after(st->frontier, rec->seq))
+            {
+                while (st->first < st->num_msgs && !seq_after(st->msgs[st->first].last_seq, rec->seq))
+                {
+                    settle(tv, &st->msgs[st->first], rec->aux);
+                    st->first++;
+                }
+
+                st->frontier = rec->seq + 1;
+                progress(tv, st, rec->stream, rec->time_ns, st->first < st->num_msgs);
+            }
+            break;
+
+        case TRACE_TIMEOUT:
+            st->stall.events[1]++;
+            break;
+
+        case TRACE_RECLAIM:
+            if (rec->occupancy == 0)
+            {
+                progress(tv, st, rec->stream, rec->time_ns, false);
+            }
+            break;
+    }
+}
+
+static void receiver_event(struct tv_state *tv, struct tv_stream *st, const struct trace_record *rec)
+{
+    switch (rec->event)
+    {
+        case TRACE_RECEIVE:
+            st->frontier = rec->last_seq + 1;
+            progress(tv, st, rec->stream, rec->time_ns, rec->occupancy > 0);
+            break;
+
+        case TRACE_DRAIN:
+            st->frontier = rec->last_seq + 1;
+            progress(tv, st, rec->stream, rec->time_ns, rec->occupancy > 0);
+            break;
+
+        case TRACE_BUFFER:
+            start_waiting(tv, st, rec->stream, rec->time_ns);
+            st->stall.events[0]++;
+            break;
+
+        case TRACE_ACK_SENT:
+            st->acks++;
+            st->gaps += (rec->flags & ACK_FLAG_OUT_OF_ORDER) != 0;
+            st->dup_acks += (rec->flags & ACK_FLAG_RETRANS) != 0;
+            break;
+
+        case TRACE_DISCARD:
+            if (rec->flags < TRACE_NUM_DROPS)
+            {
+                st->drops[rec->flags]++;
+            }
+
+            if (rec->flags == TRACE_DROP_OUT_OF_ORDER)
+            {
+                start_waiting(tv, st, rec->stream, rec->time_ns);
+                st->stall.events[0]++;
+            }
+            else if (rec->flags == TRACE_DROP_DUPLICATE)
+            {
+                st->stall.events[1]++;
+            }
+            else if (rec->flags == TRACE_DROP_ACK)
+            {
+                st->stall.events[2]++;
+            }
+            break;
+    }
+}
+
+/**
+ * Goes over every record, sizing what it needs first
+ */
+static void analyze(struct tv_state *tv)
+{
+    const struct trace_file *t = tv->trace;
+    const struct trace_record *rec;
+    struct tv_stream *st;
+    uint64_t sends[MAX_STREAMS];
+    uint64_t last_ns = 0;
+    uint64_t i;
+    int stream;
+
+    memset(sends, 0, sizeof(sends));
+    for (i = 0; i < t->num_records; i++)
+    {
+        rec = &t->records[i];
+
+        if (rec->event == TRACE_SEND && rec->stream < MAX_STREAMS)
+        {
+            sends[rec->stream]++;
+        }
+
+        tv->num_retransmits += rec->event == TRACE_RETRANSMIT;
+    }
+
+    tv->retransmits = mem_alloc(tv->num_retransmits + 1, sizeof(struct tv_retransmit));
+    tv->num_retransmits = 0;
+
+    for (stream = 0; stream < MAX_STREAMS; stream++)
+    {
+        tv->streams[stream].msgs = mem_alloc(sends[stream] + 1, sizeof(struct tv_msg));
+    }
+
+    for (i = 0; i < t->num_records; i++)
+    {
+        rec = &t->records[i];
+
+        if (rec->event == TRACE_NONE || rec->event >= TRACE_NUM_EVENTS || rec->stream >= MAX_STREAMS)
+        {
+            continue;
+        }
+
+        st = &tv->streams[rec->stream];
+        if (!st->seen)
+        {
+            st->seen = true;
+            st->first_ns = rec->time_ns;
+            st->occupancy_ns = rec->time_ns;
+            st->stall.stream = rec->stream;
+        }
+
+        st->counts[rec->event]++;
+        st->last_ns = rec->time_ns;
+        last_ns = rec->time_ns > last_ns ? rec->time_ns : last_ns;
+
+        if (tv->sender)
+        {
+            sender_event(tv, st, rec);
+        }
+        else
+        {
+            receiver_event(tv, st, rec);
+        }
+
+        if (has_occupancy(rec))
+        {
+            set_occupancy(st, rec->time_ns, rec->occupancy);
+        }
+    }
+
+    /* Whatever was still waiting when the trace ended */
+    for (stream = 0; stream < MAX_STREAMS; stream++)
+    {
+        st = &tv->streams[stream];
+
+        if (st->seen && st->waiting && last_ns > st->stall.start_ns)
+        {
+            st->stall.end_ns = last_ns;
+            st->stall.open = true;
+            keep_stall(tv, &st->stall);
+        }
+    }
+}
+
+/*-----------------------------------------------------------------------------
+ * Output
+ * --------------------------------------------------------------------------*/
+
+static void print_seq(const struct tv_state *tv)
+{
+    const struct trace_file *t = tv->trace;
+    const struct trace_record *rec;
+    uint64_t i;
+
+    printf("time_ms,stream,event,seq,last_seq,detail\n");
+
+    for (i = 0; i < t->num_records; i++)
+    {
+        rec = &t->records[i];
+
+        if (rec->event == TRACE_NONE)
+        {
+            continue;
+        }
+
+        printf("%.3f,%u,%s,%u,%u,", trace_ms(tv, rec->time_ns), rec->stream, trace_event_name(rec->event),
+               rec->seq, rec->last_seq);
+
+        if (rec->event == TRACE_DISCARD)
+        {
+            printf("%s", trace_discard_name(rec->flags));
+        }
+        else if (rec->event == TRACE_RETRANSMIT)
+        {
+            printf("%s", (rec->flags & TRACE_FLAG_TIMER) ? "timer" : "early");
+        }
+        else if (rec->event == TRACE_ACK || rec->event == TRACE_ACK_SENT)
+        {
+            printf("%s%s%s", (rec->flags & ACK_FLAG_OUT_OF_ORDER) ? "out_of_order " : "",
+                   (rec->flags & ACK_FLAG_SELECTIVE) ? "selective " : "",
+                   (rec->flags & ACK_FLAG_RETRANS) ? "duplicate" : "");
+        }
+
+        printf("\n");
+    }
+}
+
+static void print_window(const struct tv_state *tv)
+{
+    const struct trace_file *t = tv->trace;
+    const struct trace_record *rec;
+    uint32_t last[MAX_STREAMS];
+    uint64_t i;
+
+    memset(last, 0xff, sizeof(last));
+
+    printf("time_ms,stream,occupancy\n");
+
+    for (i = 0; i < t->num_records; i++)
+    {
+        rec = &t->records[i];
+
+        if (!has_occupancy(rec) || rec->stream >= MAX_STREAMS || rec->occupancy == last[rec->stream])
+        {
+            continue;
+        }
+
+        last[rec->stream] = rec->occupancy;
+        printf("%.3f,%u,%u\n", trace_ms(tv, rec->time_ns), rec->stream, rec->occupancy);
+    }
+}
+
+static void print_retransmits(const struct tv_state *tv)
+{
+    const struct tv_retransmit *r;
+    uint64_t i;
+
+    printf("time_ms,stream,seq,last_seq,trigger,cause\n");
+
+    for (i = 0; i < tv->num_retransmits; i++)
+    {
+        r = &tv->retransmits[i];
+
+        printf("%.3f,%u,%u,%u,%s,%s\n", trace_ms(tv, r->time_ns), r->stream, r->seq, r->last_seq,
+               r->timer ? "timer" : "early", cause_names[r->cause]);
+    }
+}
+
+static void print_streams(const struct tv_state *tv)
+{
+    const struct tv_stream *st;
+    double span_ns;
+    int stream;
+    int i;
+
+    for (stream = 0; stream < MAX_STREAMS; stream++)
+    {
+        st = &tv->streams[stream];
+
+        if (!st->seen)
+        {
+            continue;
+        }
+
+        span_ns = st->last_ns > st->first_ns ? (double)(st->last_ns - st->first_ns) : 1.0;
+
+        if (tv->sender)
+        {
+            printf("Stream %d: %lu sent, %lu re-sent, %lu acks (%lu out of order), %lu timeouts\n", stream,
+                   (unsigned long)st->counts[TRACE_SEND], (unsigned long)st->counts[TRACE_RETRANSMIT],
+                   (unsigned long)st->acks, (unsigned long)st->gaps, (unsigned long)st->counts[TRACE_TIMEOUT]);
+            printf("\twindow: up to %u messages, %.1f on average\n", st->max_occupancy,
+                   st->occupancy_area / span_ns);
+        }
+        else
+        {
+            printf("Stream %d: %lu received in order, %lu buffered, %lu drained from the buffer\n", stream,
+                   (unsigned long)st->counts[TRACE_RECEIVE], (unsigned long)st->counts[TRACE_BUFFER],
+                   (unsigned long)st->counts[TRACE_DRAIN]);
+            printf("\tbuffer: up to %u messages, %.1f on average\n", st->max_occupancy,
+                   st->occupancy_area / span_ns);
+            printf("\tacks sent: %lu (%lu out of order, %lu for duplicates)\n", (unsigned long)st->acks,
+                   (unsigned long)st->gaps, (unsigned long)st->dup_acks);
+            printf("\tdiscarded:");
+            for (i = 0; i < TRACE_NUM_DROPS; i++)
+            {
+                printf(" %s %lu", trace_discard_name(i), (unsigned long)st->drops[i]);
+            }
+            printf("\n");
+        }
+    }
+}
+
+static void print_causes(const struct tv_state *tv)
+{
+    uint64_t causes[TV_NUM_CAUSES];
+    uint64_t timer = 0;
+    uint64_t i;
+    int c;
+
+    memset(causes, 0, sizeof(causes));
+    for (i = 0; i < tv->num_retransmits; i++)
+    {
+        causes[tv->retransmits[i].cause]++;
+        timer += tv->retransmits[i].timer;
+    }
+
+    printf("\nRetransmissions: %lu (%lu after the timer ran out, %lu early on duplicate acks)\n",
+           (unsigned long)tv->num_retransmits, (unsigned long)timer, (unsigned long)(tv->num_retransmits - timer));
+
+    for (c = 0; c < TV_NUM_CAUSES; c++)
+    {
+        printf("\t%-14s %8lu  %s\n", cause_names[c], (unsigned long)causes[c], cause_help[c]);
+    }
+}
+
+static void print_stalls(const struct tv_state *tv)
+{
+    const struct tv_stall *s;
+    int i;
+
+    if (tv->sender)
+    {
+        printf("\nLongest stalls (nothing more acked while messages were outstanding):\n"
+               "\t%12s %12s %6s %10s %11s %8s %6s\n", "at_ms", "lasted_ms", "stream", "stuck_at",
+               "retransmits", "timeouts", "acks");
+    }
+    else
+    {
+        printf("\nLongest stalls (messages waiting on a gap before them):\n"
+               "\t%12s %12s %6s %10s %13s %10s %10s\n", "at_ms", "lasted_ms", "stream", "waiting_for",
+               "arrived_ahead", "duplicates", "acks_lost");
+    }
+
+    for (i = 0; i < tv->num_stalls; i++)
+    {
+        s = &tv->stalls[i];
+
+        printf("\t%12.3f %12.3f %6u %10u", trace_ms(tv, s->start_ns), (s->end_ns - s->start_ns) / 1000000.0,
+               s->stream, s->stuck_at);
+
+        if (tv->sender)
+        {
+            printf(" %11u %8u %6u", s->events[0], s->events[1], s->events[2]);
+        }
+        else
+        {
+            printf(" %13u %10u %10u", s->events[0], s->events[1], s->events[2]);
+        }
+
+        printf("%s\n", s->open ? "  (still stalled at the end)" : "");
+    }
+
+    if (tv->num_stalls == 0)
+    {
+        printf("\tnone\n");
+    }
+}
+
+static void print_report(const struct tv_state *tv, const char *path)
+{
+    const struct trace_file *t = tv->trace;
+    uint64_t counts[TRACE_NUM_EVENTS];
+    uint64_t last_ns = t->header->start_ns;
+    uint64_t i;
+    int stream;
+    int e;
+
+    memset(counts, 0, sizeof(counts));
+    for (stream = 0; stream < MAX_STREAMS; stream++)
+    {
+        for (e = 0; e < TRACE_NUM_EVENTS; e++)
+        {
+            counts[e] += tv->streams[stream].counts[e];
+        }
+
+        if (tv->streams[stream].seen && tv->streams[stream].last_ns > last_ns)
+        {
+            last_ns = tv->streams[stream].last_ns;
+        }
+    }
+
+    for (i = 0; i < t->num_records; i++)
+    {
+        counts[TRACE_NONE] += t->records[i].event == TRACE_NONE;
+    }
+
+    printf("%s: %s trace, %lu records over %.3f ms", path, tv->sender ? "sender" : "receiver",
+           (unsigned long)t->num_records, trace_ms(tv, last_ns));
+    if (t->dropped > 0)
+    {
+        printf(" (%lu more didn't fit)", (unsigned long)t->dropped);
+    }
+    printf("\n\n");
+
+    for (e = 1; e < TRACE_NUM_EVENTS; e++)
+    {
+        if (counts[e] > 0)
+        {
+            printf("\t%-12s %10lu\n", trace_event_name(e), (unsigned long)counts[e]);
+        }
+    }
+    if (counts[TRACE_NONE] > 0)
+    {
+        printf("\t%-12s %10lu\n", "unfinished", (unsigned long)counts[TRACE_NONE]);
+    }
+    printf("\n");
+
+    print_streams(tv);
+
+    if (tv->sender)
+    {
+        print_causes(tv);
+    }
+
+    print_stalls(tv);
+}
+
+/*-----------------------------------------------------------------------------
+ *
+ * --------------------------------------------------------------------------*/
+
+int main(int argc, char **argv)
+{
+    struct trace_file trace;
+    struct tv_state *tv;
+    char *graph = NULL;
+    int num_stalls = TV_DEFAULT_STALLS;
+    int stream;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "g:n:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'g':
+                graph = optarg;
+                break;
+            case 'n':
+                num_stalls = atoi(optarg);
+                break;
+            default:
+                argc = 0;
+                break;
+        }
+    }
+
+    if (argc - optind < 1)
+    {
+        fprintf(stderr, "Usage: %s [-g seq|window|retransmits] [-n num_stalls] <trace_file>\n", argv[0]);
+
+        exit(1);
+    }
+
+    if (num_stalls < 0 || num_stalls > TV_MAX_STALLS)
+    {
+        fprintf(stderr, "Usage: Number of stalls must be between 0 and %d\n", TV_MAX_STALLS);
+
+        exit(1);
+    }
+
+    if (graph != NULL && strcmp(graph, "seq") != 0 && strcmp(graph, "window") != 0 &&
+        strcmp(graph, "retransmits") != 0)
+    {
+        fprintf(stderr, "Usage: Graphs are seq, window or retransmits\n");
+
+        exit(1);
+    }
+
+    if (!trace_load(&trace, argv[optind]))
+    {
+        exit(1);
+    }
+
+    tv = mem_alloc(1, sizeof(struct tv_state));
+    tv->trace = &trace;
+    tv->sender = trace.header->role == TRACE_SENDER;
+    tv->max_stalls = num_stalls;
+
+    analyze(tv);
+
+    if (graph == NULL)
+    {
+        print_report(tv, argv[optind]);
+    }
+    else if (strcmp(graph, "seq") == 0)
+    {
+        print_seq(tv);
+    }
+    else if (strcmp(graph, "window") == 0)
+    {
+        print_window(tv);
+    }
+    else
+    {
+        print_retransmits(tv);
+    }
+
+    for (stream = 0; stream < MAX_STREAMS; stream++)
+    {
+        mem_free(tv->streams[stream].msgs);
+    }
+    mem_free(tv->retransmits);
+    mem_free(tv);
+
+    trace_unload(&trace);
+
+    return 0;
+}
@@ -0,0 +1,441 @@
+/**
+ * Minimal io_uring wrapper for the optional io_uring I/O backend
+ *
+ * CMPT 434 - A2
+ * Steven Rau
+ * scr108
+ * 11115094
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "uring.h"
+#include "pool.h"
+#include "sock.h"
+
+/*-----------------------------------------------------------------------------
+ * File-scope constants & globals
+ * --------------------------------------------------------------------------*/
+
+/* Provided buffers for each receiving socket, and the group id they are registered under */
+#define URING_RX_BUFFERS  256
+#define URING_RX_GROUP    0
+
+/* Submission queue size */
+#define URING_ENTRIES     64
+
+/*-----------------------------------------------------------------------------
+ * Helper functions
+ * --------------------------------------------------------------------------*/
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags,
+                              void *arg, size_t arg_size)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, arg_size);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args)
+{
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/*-----------------------------------------------------------------------------
+ * Ring setup
+ * --------------------------------------------------------------------------*/
+
+bool uring_init(struct uring *u, unsigned entries)
+{
+    struct io_uring_params p;
+    char *ring;
+    size_t cq_size;
+
+    memset(u, 0, sizeof(*u));
+    memset(&p, 0, sizeof(p));
+
+    if ((u->fd = sys_io_uring_setup(entries, &p)) < 0)
+    {
+        return false;
+    }
+
+    /* Waiting with a timeout needs EXT_ARG (5.11), and the rings are assumed to share one mapping */
+    if (!(p.features & IORING_FEAT_EXT_ARG) || !(p.features & IORING_FEAT_SINGLE_MMAP))
+    {
+        close(u->fd);
+        errno = ENOSYS;
+
+        return false;
+    }
+
+    /* One mapping holds both the submission and completion rings */
+    u->ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (cq_size > u->ring_size)
+    {
+        u->ring_size = cq_size;
+    }
+
+    u->ring = mmap(NULL, u->ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   u->fd, IORING_OFF_SQ_RING);
+    if (u->ring == MAP_FAILED)
+    {
+        close(u->fd);
+
+        return false;
+    }
+
+    u->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    u->sqes = mmap(NULL, u->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   u->fd, IORING_OFF_SQES);
+    if (u->sqes == MAP_FAILED)
+    {
+        munmap(u->ring, u->ring_size);
+        close(u->fd);
+
+        return false;
+    }
+
+    ring = u->ring;
+    u->sq_head = (unsigned *)(ring + p.sq_off.head);
+    u->sq_tail = (unsigned *)(ring + p.sq_off.tail);
+    u->sq_mask = *(unsigned *)(ring + p.sq_off.ring_mask);
+    u->sq_array = (unsigned *)(ring + p.sq_off.array);
+    u->sq_local_tail = *u->sq_tail;
+
+    u->cq_head = (unsigned *)(ring + p.cq_off.head);
+    u->cq_tail = (unsigned *)(ring + p.cq_off.tail);
+    u->cq_mask = *(unsigned *)(ring + p.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe *)(ring + p.cq_off.cqes);
+
+    return true;
+}
+
+void uring_destroy(struct uring *u)
+{
+    munmap(u->sqes, u->sqes_size);
+    munmap(u->ring, u->ring_size);
+    close(u->fd);
+}
+
+/*-----------------------------------------------------------------------------
+ * Submission and completion
+ * --------------------------------------------------------------------------*/
+
+struct io_uring_sqe *uring_get_sqe(struct uring *u)
+{
+    unsigned head = __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+    struct io_uring_sqe *sqe;
+
+    if (u->sq_local_tail - head > u->sq_mask)
+    {
+        return NULL;
+    }
+
+    sqe = &u->sqes[u->sq_local_tail & u->sq_mask];
+    u->sq_array[u->sq_local_tail & u->sq_mask] = u->sq_local_tail & u->sq_mask;
+    u->sq_local_tail++;
+
+    memset(sqe, 0, sizeof(*sqe));
+
+    return sqe;
+}
+
+int uring_submit(struct uring *u, unsigned wait_nr, long timeout_usec)
+{
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    unsigned to_submit = u->sq_local_tail - *u->sq_tail;
+    unsigned flags = 0;
+    int rv;
+
+    __atomic_store_n(u->sq_tail, u->sq_local_tail, __ATOMIC_RELEASE);
+
+    if (to_submit == 0 && wait_nr == 0)
+    {
+        return 0;
+    }
+
+    memset(&arg, 0, sizeof(arg));
+    arg.sigmask_sz = _NSIG / 8;
+
+    if (wait_nr > 0)
+    {
+        flags |= IORING_ENTER_GETEVENTS;
+
+        if (timeout_usec >= 0)
+        {
+            ts.tv_sec = timeout_usec / 1000000L;
+            ts.tv_nsec = (timeout_usec % 1000000L) * 1000;
+            arg.ts = (uint64_t)(uintptr_t)&ts;
+        }
+    }
+
+    rv = sys_io_uring_enter(u->fd, to_submit, wait_nr, flags | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+
+    return rv < 0 ? -errno : rv;
+}
+
+struct io_uring_cqe *uring_peek_cqe(struct uring *u)
+{
+    unsigned head = *u->cq_head;
+
+    if (head == __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE))
+    {
+        return NULL;
+    }
+
+    return &u->cqes[head & u->cq_mask];
+}
+
+void uring_cqe_seen(struct uring *u)
+{
+    __atomic_store_n(u->cq_head, *u->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+/*-----------------------------------------------------------------------------
+ * Registration
+ * --------------------------------------------------------------------------*/
+
+bool uring_register_files(struct uring *u, const int *fds, unsigned count)
+{
+    return sys_io_uring_register(u->fd, IORING_REGISTER_FILES, (void *)fds, count) == 0;
+}
+
+bool uring_register_buffers(struct uring *u, const struct iovec *iovs, unsigned count)
+{
+    return sys_io_uring_register(u->fd, IORING_REGISTER_BUFFERS, (void *)iovs, count) == 0;
+}
+
+bool uring_buf_ring_init(struct uring *u, struct uring_buf_ring *br, uint16_t group,
+                         unsigned buf_size, unsigned count)
+{
+    struct io_uring_buf_reg reg;
+    unsigned i;
+
+    memset(br, 0, sizeof(*br));
+
+    /* The ring itself has to be page aligned */
+    br->ring_size = count * sizeof(struct io_uring_buf);
+    br->ring = mmap(NULL, br->ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (br->ring == MAP_FAILED)
+    {
+        return false;
+    }
+
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)br->ring;
+    reg.ring_entries = count;
+    reg.bgid = group;
+
+    if (sys_io_uring_register(u->fd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0)
+    {
+        munmap(br->ring, br->ring_size);
+
+        return false;
+    }
+
+    br->bufs = mem_alloc(count, buf_size);
+    br->buf_size = buf_size;
+    br->count = count;
+    br->group = group;
+
+    /* Hand every buffer to the kernel */
+    for (i = 0; i < count; i++)
+    {
+        br->ring->bufs[i].addr = (uint64_t)(uintptr_t)uring_buf(br, i);
+        br->ring->bufs[i].len = buf_size;
+        br->ring->bufs[i].bid = i;
+    }
+    __atomic_store_n(&br->ring->tail, count, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+void uring_buf_ring_destroy(struct uring *u, struct uring_buf_ring *br)
+{
+    struct io_uring_buf_reg reg;
+
+    memset(&reg, 0, sizeof(reg));
+    reg.bgid = br->group;
+    sys_io_uring_register(u->fd, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+
+    munmap(br->ring, br->ring_size);
+    mem_free(br->bufs);
+}
+
+void uring_buf_ring_recycle(struct uring_buf_ring *br, unsigned bid)
+{
+    uint16_t tail = br->ring->tail;
+    struct io_uring_buf *buf = &br->ring->bufs[tail & (br->count - 1)];
+
+    buf->addr = (uint64_t)(uintptr_t)uring_buf(br, bid);
+    buf->len = br->buf_size;
+    buf->bid = bid;
+
+    __atomic_store_n(&br->ring->tail, (uint16_t)(tail + 1), __ATOMIC_RELEASE);
+}
+
+/*-----------------------------------------------------------------------------
+ * Receiving
+ * --------------------------------------------------------------------------*/
+
+bool uring_receiver_init(struct uring_receiver *ur, int fd, size_t max_payload)
+{
+    memset(ur, 0, sizeof(*ur));
+
+    if (!uring_init(&ur->ring, URING_ENTRIES))
+    {
+        return false;
+    }
+
+    /* Each buffer gets the recvmsg header, the sender's address, the ancillary data and
+     * the datagram, back to back */
+    ur->hdr.msg_namelen = sizeof(struct sockaddr_storage);
+    ur->hdr.msg_controllen = SOCK_CONTROL_LEN;
+
+    if (!uring_register_files(&ur->ring, &fd, 1) ||
+        !uring_buf_ring_init(&ur->ring, &ur->bufs, URING_RX_GROUP,
+                             sizeof(struct io_uring_recvmsg_out) + ur->hdr.msg_namelen
+                             + ur->hdr.msg_controllen + max_payload, URING_RX_BUFFERS))
+    {
+        uring_destroy(&ur->ring);
+
+        return false;
+    }
+
+    return true;
+}
+
+void uring_receiver_destroy(struct uring_receiver *ur)
+{
+    uring_buf_ring_destroy(&ur->ring, &ur->bufs);
+    uring_destroy(&ur->ring);
+}
+
+/**
+ * Starts the multishot recvmsg (again, after it stops for lack of buffers or an error)
+ */
+static bool uring_receiver_arm(struct uring_receiver *ur)
+{
+    struct io_uring_sqe *sqe = uring_get_sqe(&ur->ring);
+
+    if (sqe == NULL)
+    {
+        return false;
+    }
+
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = 0;
+    sqe->flags = IOSQE_FIXED_FILE | IOSQE_BUFFER_SELECT;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->addr = (uint64_t)(uintptr_t)&ur->hdr;
+    sqe->len = 1;
+    sqe->buf_group = URING_RX_GROUP;
+
+    ur->armed = true;
+
+    return true;
+}
+
+ssize_t uring_receiver_recv(struct uring_receiver *ur, void *buf, size_t len, struct sockaddr *addr,
+                            socklen_t *addr_len, struct sock_rx_info *info, uint32_t *last_drops)
+{
+    struct io_uring_cqe *cqe;
+    struct io_uring_recvmsg_out *out;
+    struct msghdr control;
+    char *data;
+    unsigned bid;
+    int res;
+    unsigned flags;
+    size_t payload_len;
+    int rv;
+
+    while (1)
+    {
+        /* Only enter the kernel once every datagram already received has been handed out */
+        while ((cqe = uring_peek_cqe(&ur->ring)) == NULL)
+        {
+            if (!ur->armed && !uring_receiver_arm(ur))
+            {
+                errno = EBUSY;
+
+                return -1;
+            }
+
+            /* Including EINTR, so a signal gets the caller back to check why it was sent */
+            if ((rv = uring_submit(&ur->ring, 1, -1)) < 0)
+            {
+                errno = -rv;
+
+                return -1;
+            }
+        }
+
+        res = cqe->res;
+        flags = cqe->flags;
+        uring_cqe_seen(&ur->ring);
+
+        /* The multishot request ends on errors (e.g. running out of buffers) and has to be re-armed */
+        if (!(flags & IORING_CQE_F_MORE))
+        {
+            ur->armed = false;
+        }
+
+        if (res < 0)
+        {
+            if (res == -ENOBUFS)
+            {
+                continue;
+            }
+
+            errno = -res;
+
+            return -1;
+        }
+
+        if (!(flags & IORING_CQE_F_BUFFER))
+        {
+            continue;
+        }
+
+        bid = flags >> IORING_CQE_BUFFER_SHIFT;
+        data = uring_buf(&ur->bufs, bid);
+        out = (struct io_uring_recvmsg_out *)data;
+        data += sizeof(*out);
+
+        if (addr != NULL && addr_len != NULL)
+        {
+            *addr_len = out->namelen < *addr_len ? out->namelen : *addr_len;
+            memcpy(addr, data, *addr_len);
+        }
+        data += ur->hdr.msg_namelen;
+
+        /* Read the drop count and timestamp the same way as the classic path */
+        memset(&control, 0, sizeof(control));
+        control.msg_control = data;
+        control.msg_controllen = out->controllen;
+        sock_read_cmsgs(&control, info, last_drops);
+        data += ur->hdr.msg_controllen;
+
+        /* A datagram too big for the buffer comes in truncated */
+        payload_len = uring_buf(&ur->bufs, bid) + ur->bufs.buf_size - data;
+        payload_len = out->payloadlen < payload_len ? out->payloadlen : payload_len;
+        payload_len = payload_len < len ? payload_len : len;
+        memcpy(buf, data, payload_len);
+
+        uring_buf_ring_recycle(&ur->bufs, bid);
+
+        return (ssize_t)payload_len;
+    }
+}
@@ -0,0 +1,170 @@
+/**
+ * Minimal io_uring wrapper for the optional io_uring I/O backend
+ *
+ * Just enough of the ring handling (setup, getting SQEs, submitting and
+ * waiting with a timeout, reaping CQEs) and registration (fixed files,
+ * fixed buffers and provided buffer rings) for the sender and receivers,
+ * done with the raw system calls so no extra library is needed.
+ *
+ * Everything here reports failure instead of exiting, so the programs can
+ * fall back to the classic select()/recvfrom()/sendto() path on kernels
+ * without io_uring (or the features used).
+ *
+ * CMPT 434 - A2
+ * Steven Rau
+ * scr108
+ * 11115094
+ */
+
+#ifndef URING_H
+#define URING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <linux/io_uring.h>
+
+#include "sock.h"
+
+struct uring
+{
+    int fd;
+
+    /* Submission queue */
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned sq_mask;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned sq_local_tail;    /* SQEs handed out, published to the kernel by uring_submit() */
+
+    /* Completion queue */
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+
+    void *ring;                /* Mapping of both queues */
+    size_t ring_size;
+    size_t sqes_size;
+};
+
+/* A ring of provided buffers the kernel picks from for buffer-select receives */
+struct uring_buf_ring
+{
+    struct io_uring_buf_ring *ring;
+    size_t ring_size;
+    char *bufs;
+    unsigned buf_size;
+    unsigned count;            /* Power of two */
+    uint16_t group;
+};
+
+/**
+ * Sets up a ring
+ *
+ * @param[out] u        The ring
+ * @param[in]  entries  Submission queue size
+ *
+ * Returns false (with errno set) if io_uring, or a feature this wrapper needs, isn't available
+ */
+bool uring_init(struct uring *u, unsigned entries);
+
+void uring_destroy(struct uring *u);
+
+/**
+ * Gets the next free SQE (zeroed), or NULL if the submission queue is full
+ */
+struct io_uring_sqe *uring_get_sqe(struct uring *u);
+
+/**
+ * Submits every SQE gotten since the last call, and optionally waits for completions
+ *
+ * @param[in] u             The ring
+ * @param[in] wait_nr       Number of CQEs to wait for (0 to only submit)
+ * @param[in] timeout_usec  Longest time to wait, or negative to wait as long as it takes
+ *
+ * Returns the number of SQEs submitted, or -errno (-ETIME if the wait timed out)
+ */
+int uring_submit(struct uring *u, unsigned wait_nr, long timeout_usec);
+
+/**
+ * Next completion, or NULL if there are none waiting. Mark it seen with uring_cqe_seen()
+ */
+struct io_uring_cqe *uring_peek_cqe(struct uring *u);
+
+void uring_cqe_seen(struct uring *u);
+
+/**
+ * Registers file descriptors, to be used by index with IOSQE_FIXED_FILE
+ */
+bool uring_register_files(struct uring *u, const int *fds, unsigned count);
+
+/**
+ * Registers buffers, to be used by index with the *_FIXED operations
+ */
+bool uring_register_buffers(struct uring *u, const struct iovec *iovs, unsigned count);
+
+/**
+ * Allocates count buffers of buf_size bytes and registers them as a provided buffer ring
+ *
+ * @param[in]  u         The ring
+ * @param[out] br        The buffer ring
+ * @param[in]  group     Buffer group id to select from (sqe->buf_group)
+ * @param[in]  buf_size  Size of each buffer
+ * @param[in]  count     Number of buffers (a power of two)
+ */
+bool uring_buf_ring_init(struct uring *u, struct uring_buf_ring *br, uint16_t group,
+                         unsigned buf_size, unsigned count);
+
+void uring_buf_ring_destroy(struct uring *u, struct uring_buf_ring *br);
+
+/**
+ * Start of a provided buffer
+ */
+static inline char *uring_buf(const struct uring_buf_ring *br, unsigned bid)
+{
+    return br->bufs + (size_t)bid * br->buf_size;
+}
+
+/**
+ * Hands a provided buffer back to the kernel once its contents have been used
+ */
+void uring_buf_ring_recycle(struct uring_buf_ring *br, unsigned bid);
+
+/*
+ * A socket read with one multishot recvmsg into a provided buffer ring:
+ * a single submission keeps delivering datagrams, and every one already
+ * completed is read without a system call
+ */
+struct uring_receiver
+{
+    struct uring ring;
+    struct uring_buf_ring bufs;
+    struct msghdr hdr;         /* Name and control lengths for every datagram */
+    bool armed;                /* Whether the multishot recvmsg is still running */
+};
+
+/**
+ * Sets up a ring reading one socket (registered as a fixed file)
+ *
+ * @param[out] ur           The receiver
+ * @param[in]  fd           The socket
+ * @param[in]  max_payload  Largest datagram to receive
+ *
+ * Returns false if io_uring, or multishot receive with provided buffer rings, isn't available
+ */
+bool uring_receiver_init(struct uring_receiver *ur, int fd, size_t max_payload);
+
+void uring_receiver_destroy(struct uring_receiver *ur);
+
+/**
+ * Reads the next datagram, waiting for one if none have arrived. Works like sock_recvfrom()
+ */
+ssize_t uring_receiver_recv(struct uring_receiver *ur, void *buf, size_t len, struct sockaddr *addr,
+                            socklen_t *addr_len, struct sock_rx_info *info, uint32_t *last_drops);
+
+#endif /* URING_H */